@@ -3,6 +3,11 @@
 
 import PackageDescription
 
+// Counters of remote reads and phase timers compile to nothing with `MEMTOOL_DISABLE_METRICS=1 swift build`.
+let metricsEnabled = Context.environment["MEMTOOL_DISABLE_METRICS"] == nil
+let metricsCSettings: [CSetting] = metricsEnabled ? [.define("MEMTOOL_METRICS")] : []
+let metricsSwiftSettings: [SwiftSetting] = metricsEnabled ? [.define("MEMTOOL_METRICS")] : []
+
 let package = Package(
     name: "memtool",
     products: [
@@ -10,11 +15,10 @@ let package = Package(
         .executable(name: "memtool", targets: ["memtool"])
     ],
     targets: [
-        .target(name: "Cutils"),
-        .target(name: "MemtoolCore", dependencies: ["Cutils"]),
+        .target(name: "Cutils", cSettings: metricsCSettings),
+        .target(name: "MemtoolCore", dependencies: ["Cutils"], swiftSettings: metricsSwiftSettings),
         .executableTarget(name: "memtool", dependencies: ["MemtoolCore"]),
-
-
+        .executableTarget(name: "memtool-bench", dependencies: ["MemtoolCore"]),
         .testTarget(name: "MemtoolCoreTests", dependencies: ["MemtoolCore"])
     ]
 )
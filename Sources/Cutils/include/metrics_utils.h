@@ -0,0 +1,34 @@
+#ifdef __linux__
+#ifndef METRICS_UTILS_H
+#define METRICS_UTILS_H
+
+#include <stdint.h>
+
+// Counters of the remote memory reads, shared by all threads of the tracing process. Each thread
+// also counts its own reads, so the reads of a single analysis can be told apart from concurrent
+// ones. They are updated only if the package is built with `MEMTOOL_METRICS` defined.
+typedef enum {
+    swift_inspect_bridge__metric_read_calls = 0,
+    swift_inspect_bridge__metric_read_bytes,
+    swift_inspect_bridge__metric_read_failures,
+    swift_inspect_bridge__metric_process_vm_readv_syscalls,
+    swift_inspect_bridge__metric_proc_mem_syscalls,
+    swift_inspect_bridge__metric_peekdata_syscalls,
+    swift_inspect_bridge__metric_cache_hits,
+    swift_inspect_bridge__metric_cache_misses,
+    swift_inspect_bridge__metric_count
+} swift_inspect_bridge__metric_t;
+
+uint64_t swift_inspect_bridge__metrics_get(swift_inspect_bridge__metric_t metric);
+void swift_inspect_bridge__metrics_add(swift_inspect_bridge__metric_t metric, uint64_t value);
+uint64_t swift_inspect_bridge__metrics_get_thread(swift_inspect_bridge__metric_t metric);
+void swift_inspect_bridge__metrics_reset(void);
+
+#ifdef MEMTOOL_METRICS
+#define MEMTOOL_METRIC_ADD(metric, value) swift_inspect_bridge__metrics_add(swift_inspect_bridge__metric_##metric, (value))
+#else
+#define MEMTOOL_METRIC_ADD(metric, value) ((void)0)
+#endif
+
+#endif /* METRICS_UTILS_H */
+#endif /* __linux__ */
@@ -0,0 +1,13 @@
+#ifdef __linux__
+#ifndef PROC_UTILS_H
+#define PROC_UTILS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fills the `buffer` with `struct linux_dirent64` records of the open directory. Returns the
+// number of bytes written, 0 at the end of the directory or -1 with `errno` set.
+long int swift_inspect_bridge__getdents64(int fd, void * _Nonnull buffer, size_t length);
+
+#endif /* PROC_UTILS_H */
+#endif /* __linux__ */
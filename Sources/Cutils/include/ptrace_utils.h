@@ -4,14 +4,35 @@
 
 #include <sys/types.h>
 #include <sys/reg.h>
+#include <sys/user.h>
 #include <stdint.h>
 #include <asm/ldt.h>
 #include <error.h>
 
 long int swift_inspect_bridge__ptrace_attach(pid_t pid);
 long int swift_inspect_bridge__ptrace_syscall(pid_t pid);
+// Attaches the thread and waits until it stops. Returns 0, or -1 with `errno` set if the thread
+// could not be attached or exited. `pending_signal` receives the signal, that the thread was
+// stopped in the delivery of (0 if none), pass it to `swift_inspect_bridge__ptrace_detach`.
+long int swift_inspect_bridge__ptrace_attach_and_wait(pid_t tid, int * _Nonnull pending_signal);
+// Detaches the stopped thread, which continues with the delivery of the `signal` (0 for none).
+long int swift_inspect_bridge__ptrace_detach(pid_t tid, int signal);
+long int swift_inspect_bridge__ptrace_getregs(pid_t tid, struct user_regs_struct * _Nonnull registers);
 void * _Nullable swift_inspect_bridge__ptrace_peekdata(pid_t pid, uint64_t base_address, uint64_t length);
-void swift_inspect_bridge__ptrace_peekdata_buffer(pid_t pid, uint64_t base_address, uint64_t length, void * _Nonnull buffer);
+
+// Following functions copy `length` bytes of the remote memory into the `buffer`. They return
+// the number of bytes copied (which is lower than `length` if the read stopped on unreadable
+// page) or -1 with `errno` set, if nothing could be read.
+long int swift_inspect_bridge__ptrace_peekdata_buffer(pid_t pid, uint64_t base_address, uint64_t length, void * _Nonnull buffer);
+long int swift_inspect_bridge__process_vm_readv(pid_t pid, uint64_t base_address, uint64_t length, void * _Nonnull buffer);
+long int swift_inspect_bridge__proc_mem_pread(pid_t pid, uint64_t base_address, uint64_t length, void * _Nonnull buffer);
+// Bulk read: tries `process_vm_readv`, then `pread` on `/proc/[pid]/mem` and `PTRACE_PEEKDATA` at last.
+long int swift_inspect_bridge__read_memory(pid_t pid, uint64_t base_address, uint64_t length, void * _Nonnull buffer);
+// Vectored read: copies `count` remote segments into consecutive parts of the `buffer` with one
+// `process_vm_readv` per `IOV_MAX` segments. Segments, that were not read completely, are read
+// by `swift_inspect_bridge__read_memory`. `copied` receives the number of bytes copied of each
+// segment. Returns the total number of bytes copied.
+long int swift_inspect_bridge__read_memory_vector(pid_t pid, const uint64_t * _Nonnull bases, const uint64_t * _Nonnull lengths, uint64_t count, void * _Nonnull buffer, uint64_t * _Nonnull copied);
 
 size_t swift_inspect_bridge__ptrace_peekuser(pid_t pid, int offset_in_words);
 long int swift_inspect_bridge__ptrace_get_thread_area(pid_t pid, size_t gdt_index, struct user_desc * _Nonnull buffer);
@@ -0,0 +1,25 @@
+#include "include/metrics_utils.h"
+
+static uint64_t counters[swift_inspect_bridge__metric_count];
+// Counters of the calling thread, never reset
+static __thread uint64_t thread_counters[swift_inspect_bridge__metric_count];
+
+uint64_t swift_inspect_bridge__metrics_get(swift_inspect_bridge__metric_t metric) {
+    return __atomic_load_n(&counters[metric], __ATOMIC_RELAXED);
+}
+
+void swift_inspect_bridge__metrics_add(swift_inspect_bridge__metric_t metric, uint64_t value) {
+    // Workers read concurrently, the order of the updates does not matter
+    __atomic_fetch_add(&counters[metric], value, __ATOMIC_RELAXED);
+    thread_counters[metric] += value;
+}
+
+uint64_t swift_inspect_bridge__metrics_get_thread(swift_inspect_bridge__metric_t metric) {
+    return thread_counters[metric];
+}
+
+void swift_inspect_bridge__metrics_reset(void) {
+    for (int i = 0; i < swift_inspect_bridge__metric_count; i++) {
+        __atomic_store_n(&counters[i], 0, __ATOMIC_RELAXED);
+    }
+}
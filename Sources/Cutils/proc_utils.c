@@ -0,0 +1,11 @@
+#define _GNU_SOURCE
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "include/proc_utils.h"
+
+long int swift_inspect_bridge__getdents64(int fd, void * _Nonnull buffer, size_t length) {
+    // Glibc provides `getdents64` wrapper only since 2.30
+    return syscall(SYS_getdents64, fd, buffer, length);
+}
@@ -1,13 +1,22 @@
+#define _GNU_SOURCE
+
 #include <stdlib.h>
 #include <string.h>
 #include <malloc.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 
 #include <unistd.h>
+#include <sys/uio.h>
 #include <sys/user.h>
 #include <sys/syscall.h>
 #include <sys/ptrace.h>
+#include <sys/wait.h>
 
 #include "include/ptrace_utils.h"
+#include "include/metrics_utils.h"
 
 #define WORD 8
 
@@ -16,6 +25,9 @@ typedef union {
     char bytes[WORD];
 } word_bytes_t;
 
+// Set once the kernel reports, that `process_vm_readv` is not implemented.
+static int process_vm_readv_unavailable = 0;
+
 long int swift_inspect_bridge__ptrace_attach(pid_t pid) {
     return ptrace(PTRACE_ATTACH, pid);
 }
@@ -24,6 +36,47 @@ long int swift_inspect_bridge__ptrace_syscall(pid_t pid) {
     return ptrace(PTRACE_SYSCALL, pid);
 }
 
+long int swift_inspect_bridge__ptrace_attach_and_wait(pid_t tid, int * _Nonnull pending_signal) {
+    *pending_signal = 0;
+
+    // Unlike PTRACE_ATTACH, the interrupt does not queue a SIGSTOP, that would stop the
+    // process again after the detach
+    if (ptrace(PTRACE_SEIZE, tid, NULL, NULL) < 0) {
+        return -1;
+    }
+    if (ptrace(PTRACE_INTERRUPT, tid, NULL, NULL) < 0) {
+        return -1;
+    }
+
+    for (;;) {
+        int status;
+        if (waitpid(tid, &status, __WALL) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (!WIFSTOPPED(status)) {
+            errno = ESRCH;
+            return -1;
+        }
+
+        // A signal may stop the thread before the interrupt, the detach delivers it
+        if (status >> 16 != PTRACE_EVENT_STOP) {
+            *pending_signal = WSTOPSIG(status);
+        }
+        return 0;
+    }
+}
+
+long int swift_inspect_bridge__ptrace_detach(pid_t tid, int signal) {
+    return ptrace(PTRACE_DETACH, tid, NULL, (void *)(uintptr_t)signal);
+}
+
+long int swift_inspect_bridge__ptrace_getregs(pid_t tid, struct user_regs_struct * _Nonnull registers) {
+    return ptrace(PTRACE_GETREGS, tid, NULL, registers);
+}
+
 void * _Nullable swift_inspect_bridge__ptrace_peekdata(pid_t pid, uint64_t base_address, uint64_t length) {
     void * buffer = malloc(length);
 
@@ -32,25 +85,210 @@ void * _Nullable swift_inspect_bridge__ptrace_peekdata(pid_t pid, uint64_t base_
         return NULL;
     }
 
-    swift_inspect_bridge__ptrace_peekdata_buffer(pid, base_address, length, buffer);
+    if (swift_inspect_bridge__read_memory(pid, base_address, length, buffer) != (long int)length) {
+        free(buffer);
+        return NULL;
+    }
+
     return buffer;
 }
 
-void swift_inspect_bridge__ptrace_peekdata_buffer(pid_t pid, uint64_t base_address, uint64_t length, void * _Nonnull buffer) {
+long int swift_inspect_bridge__ptrace_peekdata_buffer(pid_t pid, uint64_t base_address, uint64_t length, void * _Nonnull buffer) {
     uint64_t full_pointers = length / WORD;
     uint64_t remainder = length % WORD;
 
     for (uint64_t i = 0; i < full_pointers; i++) {
         word_bytes_t data;
+        // PEEKDATA returns the word itself, therefore -1 is only an error if errno is set
+        errno = 0;
         data.word = ptrace(PTRACE_PEEKDATA, pid, base_address + i * WORD);
-        memcpy(buffer + i * WORD, data.bytes, WORD); 
+        MEMTOOL_METRIC_ADD(peekdata_syscalls, 1);
+        if (errno != 0) {
+            return i > 0 ? (long int)(i * WORD) : -1;
+        }
+        memcpy((char *)buffer + i * WORD, data.bytes, WORD);
     }
 
     if (remainder > 0) {
         word_bytes_t data;
+        errno = 0;
         data.word = ptrace(PTRACE_PEEKDATA, pid, base_address + full_pointers * WORD);
-        memcpy(buffer + full_pointers * WORD, data.bytes, remainder); 
+        MEMTOOL_METRIC_ADD(peekdata_syscalls, 1);
+        if (errno != 0) {
+            return full_pointers > 0 ? (long int)(full_pointers * WORD) : -1;
+        }
+        memcpy((char *)buffer + full_pointers * WORD, data.bytes, remainder);
+    }
+
+    return (long int)length;
+}
+
+long int swift_inspect_bridge__process_vm_readv(pid_t pid, uint64_t base_address, uint64_t length, void * _Nonnull buffer) {
+    uint64_t total = 0;
+
+    // The kernel stops at the first page it fails to read and reports the number of bytes
+    // copied so far. Repeat the request for the rest until it fails or everything is read.
+    while (total < length) {
+        struct iovec local = { .iov_base = (char *)buffer + total, .iov_len = length - total };
+        struct iovec remote = { .iov_base = (void *)(uintptr_t)(base_address + total), .iov_len = length - total };
+
+        ssize_t result = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+        MEMTOOL_METRIC_ADD(process_vm_readv_syscalls, 1);
+        if (result < 0) {
+            return total > 0 ? (long int)total : -1;
+        }
+        if (result == 0) {
+            break;
+        }
+        total += result;
+    }
+
+    return (long int)total;
+}
+
+long int swift_inspect_bridge__proc_mem_pread(pid_t pid, uint64_t base_address, uint64_t length, void * _Nonnull buffer) {
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/%d/mem", pid);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    MEMTOOL_METRIC_ADD(proc_mem_syscalls, 1);
+    if (fd < 0) {
+        return -1;
     }
+
+    uint64_t total = 0;
+    int failure = 0;
+
+    while (total < length) {
+        ssize_t result = pread(fd, (char *)buffer + total, length - total, (off_t)(base_address + total));
+        MEMTOOL_METRIC_ADD(proc_mem_syscalls, 1);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0) {
+            failure = errno;
+            break;
+        }
+        if (result == 0) {
+            break;
+        }
+        total += result;
+    }
+
+    close(fd);
+    MEMTOOL_METRIC_ADD(proc_mem_syscalls, 1);
+
+    if (total == 0 && failure != 0) {
+        errno = failure;
+        return -1;
+    }
+
+    return (long int)total;
+}
+
+long int swift_inspect_bridge__read_memory(pid_t pid, uint64_t base_address, uint64_t length, void * _Nonnull buffer) {
+    uint64_t total = 0;
+    long int result;
+
+    if (length == 0) {
+        return 0;
+    }
+    MEMTOOL_METRIC_ADD(read_calls, 1);
+
+    // 1. A single syscall for the whole range, works for any thread of the tracer
+    if (!process_vm_readv_unavailable) {
+        result = swift_inspect_bridge__process_vm_readv(pid, base_address, length, buffer);
+        if (result < 0 && errno == ENOSYS) {
+            process_vm_readv_unavailable = 1;
+        }
+        if (result > 0) {
+            total = result;
+        }
+        if (total == length) {
+            MEMTOOL_METRIC_ADD(read_bytes, total);
+            return (long int)total;
+        }
+    }
+
+    // 2. `/proc/[pid]/mem` can also read pages, that are not readable by the tracee itself
+    result = swift_inspect_bridge__proc_mem_pread(pid, base_address + total, length - total, (char *)buffer + total);
+    if (result > 0) {
+        total += result;
+    }
+    if (total == length) {
+        MEMTOOL_METRIC_ADD(read_bytes, total);
+        return (long int)total;
+    }
+
+    // 3. Word by word, only works from the tracing thread
+    result = swift_inspect_bridge__ptrace_peekdata_buffer(pid, base_address + total, length - total, (char *)buffer + total);
+    if (result > 0) {
+        total += result;
+    }
+
+    MEMTOOL_METRIC_ADD(read_bytes, total);
+    if (total < length) {
+        MEMTOOL_METRIC_ADD(read_failures, 1);
+    }
+    return total > 0 ? (long int)total : -1;
+}
+
+long int swift_inspect_bridge__read_memory_vector(pid_t pid, const uint64_t * _Nonnull bases, const uint64_t * _Nonnull lengths, uint64_t count, void * _Nonnull buffer, uint64_t * _Nonnull copied) {
+    struct iovec remote[IOV_MAX];
+    uint64_t index = 0;
+    uint64_t offset = 0;
+    uint64_t total = 0;
+
+    while (index < count) {
+        if (!process_vm_readv_unavailable) {
+            // Segments are consecutive in the local buffer, so a single local iovec covers them
+            uint64_t batch = 0;
+            uint64_t batch_length = 0;
+            while (index + batch < count && batch < IOV_MAX) {
+                remote[batch].iov_base = (void *)(uintptr_t)bases[index + batch];
+                remote[batch].iov_len = lengths[index + batch];
+                batch_length += lengths[index + batch];
+                batch++;
+            }
+            struct iovec local = { .iov_base = (char *)buffer + offset, .iov_len = batch_length };
+
+            ssize_t result = process_vm_readv(pid, &local, 1, remote, batch, 0);
+            MEMTOOL_METRIC_ADD(process_vm_readv_syscalls, 1);
+            MEMTOOL_METRIC_ADD(read_calls, 1);
+            if (result < 0 && errno == ENOSYS) {
+                process_vm_readv_unavailable = 1;
+            }
+
+            // The kernel stops at the first segment it fails to read completely
+            uint64_t remaining = result > 0 ? (uint64_t)result : 0;
+            MEMTOOL_METRIC_ADD(read_bytes, remaining);
+            total += remaining;
+            while (index < count && remaining >= lengths[index]) {
+                copied[index] = lengths[index];
+                remaining -= lengths[index];
+                offset += lengths[index];
+                index++;
+            }
+            if (index == count) {
+                break;
+            }
+            copied[index] = remaining;
+        } else {
+            copied[index] = 0;
+        }
+
+        // The rest of the failed segment is read by the fallbacks
+        uint64_t done = copied[index];
+        long int result = swift_inspect_bridge__read_memory(pid, bases[index] + done, lengths[index] - done, (char *)buffer + offset + done);
+        if (result > 0) {
+            copied[index] += result;
+            total += result;
+        }
+        offset += lengths[index];
+        index++;
+    }
+
+    return (long int)total;
 }
 
 size_t swift_inspect_bridge__ptrace_peekuser(pid_t pid, int offset_in_words) {
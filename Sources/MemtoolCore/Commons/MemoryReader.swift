@@ -0,0 +1,63 @@
+/// MemoryReader provides the memory of the analyzed process to the checked loads of `Session`.
+/// The memory is either read from the live process (`RemoteMemoryCache`) or from its copy.
+public protocol MemoryReader: AnyObject {
+    /// Loads raw bytes of the memory.
+    /// - Parameter segment: Range of the memory that should be copied
+    /// - Throws: `RemoteMemoryError` if the memory was not read completely.
+    func load(_ segment: MemoryRange) throws -> RawRemoteMemory
+
+    /// Loads the memory and binds it to the type T.
+    /// - Parameters:
+    ///   - type: Type bound to the data.
+    ///   - base: Base address of the memory (length is deduced from the size of the type T)
+    /// - Throws: `RemoteMemoryError` if the memory was not read completely.
+    func load<T>(of type: T.Type, base: UInt) throws -> BoundRemoteMemory<T>
+
+    /// Announces, that the range will be read soon.
+    /// - Returns: Number of bytes made available by the call.
+    @discardableResult
+    func prefetch(_ range: MemoryRange) -> UInt
+
+    /// Discards copies of the memory, that may not be valid anymore.
+    func invalidate()
+
+    /// Creates a reader, that can be used concurrently with this one from another thread.
+    func makeWorkerReader() -> MemoryReader
+
+    /// Provides the bytes of the range to the closure without storing them for later loads.
+    /// Used by scans reading large parts of the memory only once.
+    /// - Parameters:
+    ///   - segment: Range of the memory.
+    ///   - body: Closure receiving the bytes, which must not escape it.
+    /// - Throws: `RemoteMemoryError` if the memory was not read completely.
+    func withUnsafeBytes<R>(of segment: MemoryRange, _ body: (UnsafeRawBufferPointer) throws -> R) throws -> R
+
+    /// Copies the segments into consecutive parts of the buffer with as few requests as possible,
+    /// without storing them for later loads. Used by bulk exports of many small ranges.
+    /// - Parameters:
+    ///   - segments: Ranges of the memory, their total length must not exceed the buffer.
+    ///   - buffer: Buffer receiving the bytes of the segments one after another.
+    /// - Returns: Number of bytes copied of each segment, lower than its length if the segment
+    ///   could not be read completely.
+    func read(segments: [MemoryRange], into buffer: UnsafeMutableRawBufferPointer) -> [Int]
+}
+
+public extension MemoryReader {
+    func withUnsafeBytes<R>(of segment: MemoryRange, _ body: (UnsafeRawBufferPointer) throws -> R) throws -> R {
+        try load(segment).buffer.withUnsafeBytes(body)
+    }
+
+    func read(segments: [MemoryRange], into buffer: UnsafeMutableRawBufferPointer) -> [Int] {
+        var offset = 0
+        return segments.map { segment in
+            defer { offset += segment.count }
+            let target = UnsafeMutableRawBufferPointer(rebasing: buffer[offset..<(offset + segment.count)])
+            do {
+                try withUnsafeBytes(of: segment) { target.copyMemory(from: $0) }
+                return segment.count
+            } catch {
+                return 0
+            }
+        }
+    }
+}
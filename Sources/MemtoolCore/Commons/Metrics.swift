@@ -0,0 +1,180 @@
+import Cutils
+import Foundation
+
+/// Metrics is a snapshot of the counters of remote memory reads and of the wall time spent in the
+/// phases of the analysis (`loadMap()`, `loadSymbols()`, the steps of `GlibcMallocAnalyzer.analyze()`
+/// and the TLS heuristics).
+///
+/// The counters of `current` are process-wide: they are shared by all sessions, analyzers and
+/// workers of the tracing process, so concurrent analyses (like `FleetAnalysis`) add up in them.
+/// Each thread also keeps its own counters in `currentThread`, the difference of two values taken
+/// on the same thread measures the work done between them regardless of other threads. The
+/// `GlibcMallocAnalyzer.metrics` are measured this way, including its workers. The counters are
+/// collected only if the package is built with `MEMTOOL_METRICS` defined (the default), otherwise
+/// they compile to nothing and stay zero.
+///
+/// ```swift
+/// Metrics.reset()
+/// try analyzer.analyze()
+/// print(Metrics.current.remoteReads)
+///
+/// let before = Metrics.currentThread
+/// session.loadSymbols()
+/// print((Metrics.currentThread - before).phases)
+/// ```
+public struct Metrics {
+    /// Requests for a range of the remote memory.
+    public var remoteReads: UInt64 = 0
+    /// Bytes copied from the remote memory.
+    public var remoteBytes: UInt64 = 0
+    /// Requests, that could not read the whole range.
+    public var failedReads: UInt64 = 0
+    public var processVmReadvSyscalls: UInt64 = 0
+    /// `open`, `pread` and `close` of `/proc/[pid]/mem`.
+    public var procMemSyscalls: UInt64 = 0
+    public var peekdataSyscalls: UInt64 = 0
+    /// Pages of `RemoteMemoryCache` served from the copies.
+    public var cacheHits: UInt64 = 0
+    /// Pages of `RemoteMemoryCache` read from the remote process.
+    public var cacheMisses: UInt64 = 0
+    /// Wall time spent in each phase by its name.
+    public var phases: [String: Duration] = [:]
+
+    public var syscalls: UInt64 {
+        processVmReadvSyscalls + procMemSyscalls + peekdataSyscalls
+    }
+
+    public static var isEnabled: Bool {
+        #if MEMTOOL_METRICS
+        return true
+        #else
+        return false
+        #endif
+    }
+
+    /// Current values of the process-wide counters.
+    public static var current: Metrics {
+        var metrics = Metrics()
+        #if MEMTOOL_METRICS
+        metrics.remoteReads = swift_inspect_bridge__metrics_get(swift_inspect_bridge__metric_read_calls)
+        metrics.remoteBytes = swift_inspect_bridge__metrics_get(swift_inspect_bridge__metric_read_bytes)
+        metrics.failedReads = swift_inspect_bridge__metrics_get(swift_inspect_bridge__metric_read_failures)
+        metrics.processVmReadvSyscalls = swift_inspect_bridge__metrics_get(swift_inspect_bridge__metric_process_vm_readv_syscalls)
+        metrics.procMemSyscalls = swift_inspect_bridge__metrics_get(swift_inspect_bridge__metric_proc_mem_syscalls)
+        metrics.peekdataSyscalls = swift_inspect_bridge__metrics_get(swift_inspect_bridge__metric_peekdata_syscalls)
+        metrics.cacheHits = swift_inspect_bridge__metrics_get(swift_inspect_bridge__metric_cache_hits)
+        metrics.cacheMisses = swift_inspect_bridge__metrics_get(swift_inspect_bridge__metric_cache_misses)
+        phaseLock.lock()
+        metrics.phases = phaseDurations
+        phaseLock.unlock()
+        #endif
+        return metrics
+    }
+
+    /// Current values of the counters of the calling thread. They count since the thread started
+    /// and are not affected by `reset()`.
+    public static var currentThread: Metrics {
+        var metrics = Metrics()
+        #if MEMTOOL_METRICS
+        metrics.remoteReads = swift_inspect_bridge__metrics_get_thread(swift_inspect_bridge__metric_read_calls)
+        metrics.remoteBytes = swift_inspect_bridge__metrics_get_thread(swift_inspect_bridge__metric_read_bytes)
+        metrics.failedReads = swift_inspect_bridge__metrics_get_thread(swift_inspect_bridge__metric_read_failures)
+        metrics.processVmReadvSyscalls = swift_inspect_bridge__metrics_get_thread(swift_inspect_bridge__metric_process_vm_readv_syscalls)
+        metrics.procMemSyscalls = swift_inspect_bridge__metrics_get_thread(swift_inspect_bridge__metric_proc_mem_syscalls)
+        metrics.peekdataSyscalls = swift_inspect_bridge__metrics_get_thread(swift_inspect_bridge__metric_peekdata_syscalls)
+        metrics.cacheHits = swift_inspect_bridge__metrics_get_thread(swift_inspect_bridge__metric_cache_hits)
+        metrics.cacheMisses = swift_inspect_bridge__metrics_get_thread(swift_inspect_bridge__metric_cache_misses)
+        metrics.phases = ThreadPhases.current.durations
+        #endif
+        return metrics
+    }
+
+    /// Work done between two values of the same counters.
+    public static func - (lhs: Metrics, rhs: Metrics) -> Metrics {
+        var result = Metrics()
+        result.remoteReads = lhs.remoteReads &- rhs.remoteReads
+        result.remoteBytes = lhs.remoteBytes &- rhs.remoteBytes
+        result.failedReads = lhs.failedReads &- rhs.failedReads
+        result.processVmReadvSyscalls = lhs.processVmReadvSyscalls &- rhs.processVmReadvSyscalls
+        result.procMemSyscalls = lhs.procMemSyscalls &- rhs.procMemSyscalls
+        result.peekdataSyscalls = lhs.peekdataSyscalls &- rhs.peekdataSyscalls
+        result.cacheHits = lhs.cacheHits &- rhs.cacheHits
+        result.cacheMisses = lhs.cacheMisses &- rhs.cacheMisses
+        for (phase, duration) in lhs.phases where duration != rhs.phases[phase] {
+            result.phases[phase] = duration - (rhs.phases[phase] ?? .zero)
+        }
+        return result
+    }
+
+    /// Sum of the work counted by both metrics, for example by several threads.
+    public static func + (lhs: Metrics, rhs: Metrics) -> Metrics {
+        var result = lhs
+        result.remoteReads += rhs.remoteReads
+        result.remoteBytes += rhs.remoteBytes
+        result.failedReads += rhs.failedReads
+        result.processVmReadvSyscalls += rhs.processVmReadvSyscalls
+        result.procMemSyscalls += rhs.procMemSyscalls
+        result.peekdataSyscalls += rhs.peekdataSyscalls
+        result.cacheHits += rhs.cacheHits
+        result.cacheMisses += rhs.cacheMisses
+        result.phases.merge(rhs.phases, uniquingKeysWith: +)
+        return result
+    }
+
+    /// Sets all counters to zero.
+    public static func reset() {
+        #if MEMTOOL_METRICS
+        swift_inspect_bridge__metrics_reset()
+        phaseLock.lock()
+        phaseDurations = [:]
+        phaseLock.unlock()
+        #endif
+    }
+
+    /// Adds the wall time of the body to the duration of the phase.
+    @inline(__always)
+    static func measure<T>(_ phase: String, _ body: () throws -> T) rethrows -> T {
+        #if MEMTOOL_METRICS
+        let clock = ContinuousClock()
+        let start = clock.now
+        defer {
+            let duration = clock.now - start
+            phaseLock.lock()
+            phaseDurations[phase, default: .zero] += duration
+            phaseLock.unlock()
+            ThreadPhases.current.durations[phase, default: .zero] += duration
+        }
+        #endif
+        return try body()
+    }
+
+    /// Counts the pages of `RemoteMemoryCache`.
+    @inline(__always)
+    static func countCache(hit: Bool) {
+        #if MEMTOOL_METRICS
+        swift_inspect_bridge__metrics_add(hit ? swift_inspect_bridge__metric_cache_hits : swift_inspect_bridge__metric_cache_misses, 1)
+        #endif
+    }
+
+    #if MEMTOOL_METRICS
+    private static let phaseLock = NSLock()
+    private static var phaseDurations: [String: Duration] = [:]
+    #endif
+}
+
+#if MEMTOOL_METRICS
+/// Wall time of the phases measured by the thread, kept in its thread dictionary.
+private final class ThreadPhases {
+    var durations: [String: Duration] = [:]
+
+    static var current: ThreadPhases {
+        let key = "MemtoolCore.Metrics.phases"
+        if let phases = Thread.current.threadDictionary[key] as? ThreadPhases {
+            return phases
+        }
+        let phases = ThreadPhases()
+        Thread.current.threadDictionary[key] = phases
+        return phases
+    }
+}
+#endif
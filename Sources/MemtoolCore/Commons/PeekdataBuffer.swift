@@ -1,4 +1,5 @@
 import Cutils
+import Glibc
 
 /// Peeks remote process memory and fills the content into existing buffer in this process.
 /// - Parameters:
@@ -6,17 +7,14 @@ import Cutils
 ///   - baseAddress: The base address of the remote peeked memory
 ///   - buffer: Buffer in local process that will be filles with the data from remote process.
 /// Length of loaded memory is determined by the `MemoryLayout.size` of the provided buffer.
-/// 
-/// - Warning: The buffer has to be C layouted struct! If you use Swift native type, youre in 
+/// - Returns: Number of bytes copied or -1 if nothing could be read.
+///
+/// - Warning: The buffer has to be C layouted struct! If you use Swift native type, youre in
 /// risk of memory corruption!
-public func swift_inspect_bridge__ptrace_peekdata_initialize<T>(_ pid: pid_t, _ baseAddress : UInt, _ buffer: inout T) {
+@discardableResult
+public func swift_inspect_bridge__ptrace_peekdata_initialize<T>(_ pid: pid_t, _ baseAddress : UInt, _ buffer: inout T) -> Int {
     withUnsafeMutableBytes(of: &buffer) { ptr in
-        swift_inspect_bridge__ptrace_peekdata_buffer(
-            pid, 
-            UInt64(baseAddress), 
-            UInt64(MemoryLayout<T>.size), 
-            ptr.baseAddress!
-        )
+        swift_inspect_bridge__ptrace_peekdata_initialize(pid, baseAddress, ptr)
     }
 }
 
@@ -26,14 +24,11 @@ public func swift_inspect_bridge__ptrace_peekdata_initialize<T>(_ pid: pid_t, _
 ///   - baseAddress: The base address of the remote peeked memory
 ///   - buffer: Buffer in local process that will be filles with the data from remote process.
 /// Length of loaded memory is determined by the `count` of the provided array.
-public func swift_inspect_bridge__ptrace_peekdata_initialize(_ pid: pid_t, _ baseAddress : UInt, _ buffer: inout ContiguousArray<UInt8>) {
-    buffer.withUnsafeMutableBufferPointer { ptr in
-        swift_inspect_bridge__ptrace_peekdata_buffer(
-            pid, 
-            UInt64(baseAddress), 
-            UInt64(ptr.count), 
-            ptr.baseAddress!
-        )
+/// - Returns: Number of bytes copied or -1 if nothing could be read.
+@discardableResult
+public func swift_inspect_bridge__ptrace_peekdata_initialize(_ pid: pid_t, _ baseAddress : UInt, _ buffer: inout ContiguousArray<UInt8>) -> Int {
+    buffer.withUnsafeMutableBytes { ptr in
+        swift_inspect_bridge__ptrace_peekdata_initialize(pid, baseAddress, ptr)
     }
 }
 
@@ -43,11 +38,39 @@ public func swift_inspect_bridge__ptrace_peekdata_initialize(_ pid: pid_t, _ bas
 ///   - baseAddress: The base address of the remote peeked memory
 ///   - buffer: Buffer in local process that will be filles with the data from remote process.
 /// Length of loaded memory is determined by the `count` of the provided buffer pointer.
-public func swift_inspect_bridge__ptrace_peekdata_initialize(_ pid: pid_t, _ baseAddress : UInt, _ buffer: UnsafeMutableRawBufferPointer) {
-    swift_inspect_bridge__ptrace_peekdata_buffer(
-        pid, 
-        UInt64(baseAddress), 
-        UInt64(buffer.count), 
-        buffer.baseAddress!
+/// - Returns: Number of bytes copied or -1 if nothing could be read.
+@discardableResult
+public func swift_inspect_bridge__ptrace_peekdata_initialize(_ pid: pid_t, _ baseAddress : UInt, _ buffer: UnsafeMutableRawBufferPointer) -> Int {
+    guard let bufferBase = buffer.baseAddress, buffer.count > 0 else {
+        return 0
+    }
+
+    return swift_inspect_bridge__read_memory(
+        pid,
+        UInt64(baseAddress),
+        UInt64(buffer.count),
+        bufferBase
     )
 }
+
+/// Copies remote process memory into existing buffer in this process using the bulk read
+/// backend (`process_vm_readv`, `/proc/[pid]/mem` and `PTRACE_PEEKDATA` as the last resort).
+/// - Parameters:
+///   - pid: The PID of the remote process
+///   - baseAddress: The base address of the remote memory
+///   - buffer: Buffer in local process, its `count` determines the length of the load.
+/// - Throws: `RemoteMemoryError` if the memory was not read completely.
+public func readRemoteMemory(pid: pid_t, baseAddress: UInt, into buffer: UnsafeMutableRawBufferPointer) throws {
+    let result = swift_inspect_bridge__ptrace_peekdata_initialize(pid, baseAddress, buffer)
+
+    guard result >= 0 else {
+        throw RemoteMemoryError.readFailed(base: baseAddress, errno: errno)
+    }
+
+    guard result == buffer.count else {
+        throw RemoteMemoryError.partialRead(
+            segment: baseAddress..<(baseAddress + UInt(buffer.count)),
+            bytesRead: result
+        )
+    }
+}
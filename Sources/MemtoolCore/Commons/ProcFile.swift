@@ -0,0 +1,150 @@
+import Cutils
+import Glibc
+
+/// Helpers for reading the `/proc` filesystem directly, without spawning other programs.
+public enum ProcFile {
+    /// Reads the whole file. Files in `/proc` report size 0, therefore the file is read
+    /// until the end in blocks.
+    /// - Parameter path: Path to the file.
+    /// - Returns: Content of the file or nil, if it could not be read.
+    public static func read(_ path: String) -> ContiguousArray<UInt8>? {
+        let fd = open(path, O_RDONLY | O_CLOEXEC)
+        guard fd >= 0 else {
+            error("Error: Failed to open \(path), errno \(errno)")
+            return nil
+        }
+        defer { close(fd) }
+
+        let blockSize = 1 << 16
+        var content = ContiguousArray<UInt8>()
+        while true {
+            let previousCount = content.count
+            content.append(contentsOf: repeatElement(0, count: blockSize))
+            let result = content.withUnsafeMutableBytes { buffer in
+                Glibc.read(fd, buffer.baseAddress! + previousCount, blockSize)
+            }
+
+            if result < 0, errno == EINTR {
+                content.removeLast(blockSize)
+                continue
+            }
+            guard result >= 0 else {
+                error("Error: Failed to read \(path), errno \(errno)")
+                return nil
+            }
+
+            content.removeLast(blockSize - result)
+            if result == 0 {
+                return content
+            }
+        }
+    }
+
+    /// Reads a part of the file, used for files indexed by the offset like `/proc/[pid]/pagemap`.
+    /// - Parameters:
+    ///   - path: Path to the file.
+    ///   - offset: Offset of the first byte.
+    ///   - count: Number of bytes.
+    /// - Returns: Content of the file, shorter than `count` at the end of the file, or nil if it could not be read.
+    public static func read(_ path: String, offset: UInt, count: Int) -> ContiguousArray<UInt8>? {
+        let fd = open(path, O_RDONLY | O_CLOEXEC)
+        guard fd >= 0 else {
+            error("Error: Failed to open \(path), errno \(errno)")
+            return nil
+        }
+        defer { close(fd) }
+
+        var content = ContiguousArray<UInt8>(repeating: 0, count: count)
+        var total = 0
+        while total < count {
+            let result = content.withUnsafeMutableBytes { buffer in
+                pread(fd, buffer.baseAddress! + total, count - total, off_t(offset) + off_t(total))
+            }
+
+            if result < 0, errno == EINTR {
+                continue
+            }
+            guard result >= 0 else {
+                error("Error: Failed to read \(path) at offset \(offset), errno \(errno)")
+                return nil
+            }
+            if result == 0 {
+                break
+            }
+            total += result
+        }
+
+        content.removeLast(count - total)
+        return content
+    }
+
+    /// Writes the content into the file, used for control files like `/proc/[pid]/clear_refs`.
+    /// - Parameters:
+    ///   - path: Path to the file.
+    ///   - content: Content written by a single `write`.
+    /// - Returns: True, if the whole content was written.
+    @discardableResult
+    public static func write(_ path: String, _ content: String) -> Bool {
+        let fd = open(path, O_WRONLY | O_CLOEXEC)
+        guard fd >= 0 else {
+            error("Error: Failed to open \(path), errno \(errno)")
+            return false
+        }
+        defer { close(fd) }
+
+        var content = content
+        let written = content.withUTF8 { bytes in
+            Glibc.write(fd, bytes.baseAddress, bytes.count)
+        }
+        guard written == content.utf8.count else {
+            error("Error: Failed to write \(path), errno \(errno)")
+            return false
+        }
+        return true
+    }
+
+    /// Lists names of the entries of the directory using `getdents64`. Entries `.` and `..` are omitted.
+    /// - Parameter path: Path to the directory.
+    /// - Returns: Names of the entries or nil, if the directory could not be read.
+    public static func directoryEntries(_ path: String) -> [String]? {
+        let fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+        guard fd >= 0 else {
+            error("Error: Failed to open \(path), errno \(errno)")
+            return nil
+        }
+        defer { close(fd) }
+
+        // struct linux_dirent64 { u64 d_ino; s64 d_off; u16 d_reclen; u8 d_type; char d_name[]; }
+        let recordLengthOffset = 16
+        let nameOffset = 19
+
+        var names: [String] = []
+        let buffer = UnsafeMutableRawBufferPointer.allocate(byteCount: 1 << 16, alignment: 8)
+        defer { buffer.deallocate() }
+
+        while true {
+            let result = swift_inspect_bridge__getdents64(fd, buffer.baseAddress!, buffer.count)
+            if result < 0, errno == EINTR {
+                continue
+            }
+            guard result >= 0 else {
+                error("Error: Failed to list \(path), errno \(errno)")
+                return nil
+            }
+            if result == 0 {
+                return names
+            }
+
+            var offset = 0
+            while offset < result {
+                let recordLength = Int(buffer.loadUnaligned(fromByteOffset: offset + recordLengthOffset, as: UInt16.self))
+                let record = UnsafeRawBufferPointer(rebasing: buffer[(offset + nameOffset)..<(offset + recordLength)])
+                let name = record[..<(record.firstIndex(of: 0) ?? record.endIndex)]
+                if !name.elementsEqual(".".utf8), !name.elementsEqual("..".utf8) {
+                    names.append(String(decoding: name, as: UTF8.self))
+                }
+                offset += recordLength
+            }
+        }
+    }
+}
@@ -1,5 +1,13 @@
 import Foundation
 
+/// Errors reported by the loads of the remote memory.
+public enum RemoteMemoryError: Error {
+    /// No byte of the memory could be read. Contains `errno` of the last attempt.
+    case readFailed(base: UInt, errno: Int32)
+    /// Only first `bytesRead` bytes of the segment were read.
+    case partialRead(segment: MemoryRange, bytesRead: Int)
+}
+
 /// RawRemoteMemory is a container for raw bytes stored in the memory of the
 /// remote process, copied to the memory of tracing process.
 public struct RawRemoteMemory {
@@ -8,14 +16,41 @@ public struct RawRemoteMemory {
     /// Buffer containing bytes copied from the remote process
     public let buffer: ContiguousArray<UInt8>
 
-    /// This initializer performs **unchecked and unsafe** load from the memory of the remote process
+    /// Wraps bytes, that were already copied from the remote process.
+    /// - Parameters:
+    ///   - segment: The region of the remote process memory
+    ///   - buffer: Bytes copied from the segment
+    public init(segment: MemoryRange, buffer: ContiguousArray<UInt8>) {
+        self.segment = segment
+        self.buffer = buffer
+    }
+
+    /// This initializer performs **unchecked and unsafe** load from the memory of the remote process.
+    /// Bytes that could not be read are left zeroed and the failure is logged.
     /// - Parameters:
     ///   - pid: The PID of the process attached by the tracing process 
     ///   - segment: Range of the memory that should be copied
     public init(pid: Int32, load segment: MemoryRange) {
         self.segment = segment
         var buffer = ContiguousArray<UInt8>.init(repeating: 0, count: segment.count)
-        swift_inspect_bridge__ptrace_peekdata_initialize(pid, segment.startIndex, &buffer)
+        let result = swift_inspect_bridge__ptrace_peekdata_initialize(pid, segment.startIndex, &buffer)
+        if result != segment.count {
+            error("Warning: Read \(result) of \(segment.count) bytes at " + String(format: "0x%016lx", segment.lowerBound))
+        }
+        self.buffer = buffer
+    }
+
+    /// This initializer performs **unchecked** load from the memory of the remote process,
+    /// but fails if the memory could not be read completely.
+    /// - Parameters:
+    ///   - pid: The PID of the process attached by the tracing process
+    ///   - segment: Range of the memory that should be copied
+    public init(pid: Int32, reading segment: MemoryRange) throws {
+        self.segment = segment
+        var buffer = ContiguousArray<UInt8>.init(repeating: 0, count: segment.count)
+        try buffer.withUnsafeMutableBytes { ptr in
+            try readRemoteMemory(pid: pid, baseAddress: segment.lowerBound, into: ptr)
+        }
         self.buffer = buffer
     }
 }
@@ -41,6 +76,16 @@ public struct BoundRemoteMemory<T> {
     /// Buffer containing bytes copied from the remote process bound to a type
     public let buffer: T
 
+    /// Wraps value, that was already copied from the remote process.
+    /// - Parameters:
+    ///   - segment: The region of the remote process memory
+    ///   - buffer: Value copied from the segment
+    public init(segment: MemoryRange, buffer: T) {
+        Self.checkRuntimeSafety()
+        self.segment = segment
+        self.buffer = buffer
+    }
+
     /// This initializer performs **unchecked and unsafe** load from the memory of the remote process.
     /// - Parameters:
     ///   - pid: The PID of the process attached by the tracing process
@@ -50,7 +95,10 @@ public struct BoundRemoteMemory<T> {
         Self.checkRuntimeSafety()
         self.segment = baseAddress..<(baseAddress + UInt(MemoryLayout<T>.size))
         var buffer = initialValue
-        swift_inspect_bridge__ptrace_peekdata_initialize(pid, baseAddress, &buffer)
+        let result = swift_inspect_bridge__ptrace_peekdata_initialize(pid, baseAddress, &buffer)
+        if result != MemoryLayout<T>.size {
+            error("Warning: Read \(result) of \(MemoryLayout<T>.size) bytes of \(T.self) at " + String(format: "0x%016lx", baseAddress))
+        }
         self.buffer = buffer
     }
 
@@ -67,6 +115,18 @@ public struct BoundRemoteMemory<T> {
         self.init(bind: rawRemote)!
     }
 
+    /// This initializer performs **unchecked** load from the memory of the remote process, but
+    /// fails if the memory could not be read completely.
+    /// - Parameters:
+    ///   - pid: The PID of the process attached by the tracing process
+    ///   - baseAddress: Base address of the memory (length is deduced from the size of the type T)
+    public init(pid: Int32, reading baseAddress: UInt) throws {
+        Self.checkRuntimeSafety()
+        let segment = baseAddress..<(baseAddress + UInt(MemoryLayout<T>.size))
+        let rawRemote = try RawRemoteMemory(pid: pid, reading: segment)
+        self.init(bind: rawRemote)!
+    }
+
     /// Unsafely binds the raw data to the type T. This initializer may fail if some expectations 
     /// are not fulfiled, **but is unsafe.**
     /// - Parameter rawMemory: 
@@ -0,0 +1,186 @@
+import Cutils
+import Glibc
+
+/// RemoteMemoryCache holds page-sized copies of the remote process memory in the memory
+/// of the tracing process. Loads are served from the copies, pages that were not loaded yet
+/// are read from the remote process with a read-ahead, so sequential walks (like traversal
+/// of heap chunks) result in few large reads.
+///
+/// The content is only valid while the remote process is stopped. Call `invalidate()`
+/// whenever the remote process (or any of its threads) is resumed.
+public final class RemoteMemoryCache: MemoryReader {
+    /// Size of the page used as the unit of the cache.
+    public static let pageSize = UInt(getpagesize())
+
+    /// Largest single read issued by `prefetch(_:)`.
+    public static let prefetchWindow: UInt = 1 << 20
+
+    /// The PID of the process attached by the tracing process.
+    public let pid: Int32
+
+    /// Number of pages read on a cache miss, including the missing page.
+    public var readAheadPages: Int
+
+    /// Number of pages currently stored.
+    public var pageCount: Int { pages.count }
+
+    private var pages: [UInt: ContiguousArray<UInt8>] = [:]
+    private var lastErrno: Int32 = 0
+
+    public init(pid: Int32, readAheadPages: Int = 16) {
+        self.pid = pid
+        self.readAheadPages = readAheadPages
+    }
+
+    /// Discards all cached pages.
+    public func invalidate() {
+        pages.removeAll()
+    }
+
+    /// Copies the remote memory into the buffer. Missing pages are loaded from the remote process.
+    /// - Parameters:
+    ///   - base: The base address of the remote memory
+    ///   - buffer: Buffer in local process, its `count` determines the length of the load.
+    /// - Throws: `RemoteMemoryError` if the memory was not read completely.
+    public func read(_ base: UInt, into buffer: UnsafeMutableRawBufferPointer) throws {
+        var copied = 0
+        while copied < buffer.count {
+            let address = base + UInt(copied)
+            let pageBase = address & ~(Self.pageSize - 1)
+
+            let cached = pages[pageBase]
+            Metrics.countCache(hit: cached != nil)
+            guard let page = cached ?? fetch(pageBase: pageBase) else {
+                guard copied > 0 else {
+                    throw RemoteMemoryError.readFailed(base: address, errno: lastErrno)
+                }
+                throw RemoteMemoryError.partialRead(segment: base..<(base + UInt(buffer.count)), bytesRead: copied)
+            }
+
+            let offset = Int(address - pageBase)
+            let length = min(page.count - offset, buffer.count - copied)
+            page.withUnsafeBytes { source in
+                UnsafeMutableRawBufferPointer(rebasing: buffer[copied..<(copied + length)])
+                    .copyMemory(from: UnsafeRawBufferPointer(rebasing: source[offset..<(offset + length)]))
+            }
+            copied += length
+        }
+    }
+
+    /// Loads raw bytes of the remote memory.
+    /// - Parameter segment: Range of the memory that should be copied
+    /// - Throws: `RemoteMemoryError` if the memory was not read completely.
+    public func load(_ segment: MemoryRange) throws -> RawRemoteMemory {
+        var buffer = ContiguousArray<UInt8>(repeating: 0, count: segment.count)
+        try buffer.withUnsafeMutableBytes { ptr in
+            try read(segment.lowerBound, into: ptr)
+        }
+        return RawRemoteMemory(segment: segment, buffer: buffer)
+    }
+
+    /// Loads the remote memory and binds it to the type T.
+    /// - Parameters:
+    ///   - type: Type bound to the data.
+    ///   - base: Base address of the memory (length is deduced from the size of the type T)
+    /// - Throws: `RemoteMemoryError` if the memory was not read completely.
+    public func load<T>(of type: T.Type, base: UInt) throws -> BoundRemoteMemory<T> {
+        try withUnsafeTemporaryAllocation(byteCount: MemoryLayout<T>.size, alignment: MemoryLayout<T>.alignment) { ptr in
+            try read(base, into: ptr)
+            return BoundRemoteMemory(segment: base..<(base + UInt(ptr.count)), buffer: ptr.load(as: T.self))
+        }
+    }
+
+    /// Creates an empty cache of the same process. Reads from other threads than the tracing
+    /// one are served by `process_vm_readv` or `/proc/[pid]/mem`.
+    public func makeWorkerReader() -> MemoryReader {
+        RemoteMemoryCache(pid: pid, readAheadPages: readAheadPages)
+    }
+
+    /// Reads the range with a single request, bypassing the cache. Neither uses nor stores the pages.
+    /// - Throws: `RemoteMemoryError` if the memory was not read completely.
+    public func withUnsafeBytes<R>(of segment: MemoryRange, _ body: (UnsafeRawBufferPointer) throws -> R) throws -> R {
+        let buffer = UnsafeMutableRawBufferPointer.allocate(byteCount: segment.count, alignment: MemoryLayout<UInt>.alignment)
+        defer {
+            buffer.deallocate()
+        }
+        try readRemoteMemory(pid: pid, baseAddress: segment.lowerBound, into: buffer)
+        return try body(UnsafeRawBufferPointer(buffer))
+    }
+
+    /// Reads the segments with one `process_vm_readv` per `IOV_MAX` segments, bypassing the cache.
+    public func read(segments: [MemoryRange], into buffer: UnsafeMutableRawBufferPointer) -> [Int] {
+        guard let bufferBase = buffer.baseAddress, !segments.isEmpty else {
+            return segments.map { _ in 0 }
+        }
+
+        let bases = segments.map { UInt64($0.lowerBound) }
+        let lengths = segments.map { UInt64($0.count) }
+        var copied = [UInt64](repeating: 0, count: segments.count)
+        swift_inspect_bridge__read_memory_vector(pid, bases, lengths, UInt64(segments.count), bufferBase, &copied)
+        return copied.map { Int($0) }
+    }
+
+    /// Loads all pages of the range using large reads. Pages that could not be read are skipped,
+    /// pages already present are read again.
+    /// - Parameter range: Range of the remote memory.
+    /// - Returns: Number of bytes stored in the cache.
+    @discardableResult
+    public func prefetch(_ range: MemoryRange) -> UInt {
+        let pageSize = Self.pageSize
+        var current = range.lowerBound & ~(pageSize - 1)
+        var loaded: UInt = 0
+
+        while current < range.upperBound {
+            let remaining = (range.upperBound - current + pageSize - 1) & ~(pageSize - 1)
+            let stored = load(pages: Int(min(Self.prefetchWindow, remaining) / pageSize), at: current)
+
+            guard stored > 0 else {
+                // The page is not readable, continue after it
+                current += pageSize
+                continue
+            }
+
+            loaded += UInt(stored) * pageSize
+            current += UInt(stored) * pageSize
+        }
+
+        return loaded
+    }
+
+    /// Loads the missing page and up to `readAheadPages - 1` following pages, which are not present.
+    private func fetch(pageBase: UInt) -> ContiguousArray<UInt8>? {
+        var count = 1
+        while count < readAheadPages, pages[pageBase + UInt(count) * Self.pageSize] == nil {
+            count += 1
+        }
+
+        guard load(pages: count, at: pageBase) > 0 else {
+            return nil
+        }
+        return pages[pageBase]
+    }
+
+    /// Reads `count` pages with a single request and stores all the completely read pages.
+    /// - Returns: Number of stored pages.
+    private func load(pages count: Int, at pageBase: UInt) -> Int {
+        let pageSize = Int(Self.pageSize)
+        var window = ContiguousArray<UInt8>(repeating: 0, count: count * pageSize)
+        let result = swift_inspect_bridge__ptrace_peekdata_initialize(pid, pageBase, &window)
+
+        guard result >= pageSize else {
+            lastErrno = errno
+            return 0
+        }
+
+        let stored = result / pageSize
+        if stored == 1, count == 1 {
+            pages[pageBase] = window
+            return 1
+        }
+
+        for index in 0..<stored {
+            pages[pageBase + UInt(index * pageSize)] = ContiguousArray(window[(index * pageSize)..<((index + 1) * pageSize)])
+        }
+        return stored
+    }
+}
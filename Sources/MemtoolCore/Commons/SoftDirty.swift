@@ -0,0 +1,92 @@
+import Glibc
+
+/// Soft-dirty bits are kept by the kernel for every page of the process. Clearing them and
+/// reading them later tells, which pages were written by the process in between [1].
+///
+/// Notice, that the kernel reports all pages of a mapping as written, when the mapping is
+/// created, grown or merged after the bits were cleared.
+///
+/// [1] https://www.kernel.org/doc/Documentation/admin-guide/mm/soft-dirty.rst
+public enum SoftDirty {
+    public enum Error: Swift.Error {
+        case clearFailed(pid: Int32)
+        case pagemapReadFailed(pid: Int32)
+        case unsupported
+    }
+
+    /// Bit of the `/proc/[pid]/pagemap` entry set for soft-dirty pages.
+    static let softDirtyBit: UInt64 = 1 << 55
+
+    /// Number of pagemap entries read at once.
+    static let entriesPerRead = 4096
+
+    /// The kernel tracks soft-dirty bits. Without `CONFIG_MEM_SOFT_DIRTY`, clearing the bits
+    /// succeeds, but no page is ever reported as written. Pages of a new mapping are always
+    /// reported as written, so a page mapped by the tracing process tells.
+    public static let isSupported: Bool = {
+        let pageSize = Int(RemoteMemoryCache.pageSize)
+        guard
+            let page = mmap(nil, pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0),
+            page != UnsafeMutableRawPointer(bitPattern: -1)
+        else {
+            return false
+        }
+        defer { munmap(page, pageSize) }
+
+        page.storeBytes(of: 1, as: UInt8.self)
+        let entrySize = MemoryLayout<UInt64>.size
+        guard
+            let entry = ProcFile.read("/proc/self/pagemap", offset: UInt(bitPattern: page) / UInt(pageSize) * UInt(entrySize), count: entrySize),
+            entry.count == entrySize
+        else {
+            return false
+        }
+        return entry.withUnsafeBytes { $0.loadUnaligned(as: UInt64.self) } & softDirtyBit != 0
+    }()
+
+    /// Clears soft-dirty bits of all pages of the process.
+    public static func clear(pid: Int32) throws {
+        guard isSupported else {
+            throw Error.unsupported
+        }
+        guard ProcFile.write("/proc/\(pid)/clear_refs", "4") else {
+            throw Error.clearFailed(pid: pid)
+        }
+    }
+
+    /// Locates the first page of the range written since the bits were cleared.
+    /// - Parameters:
+    ///   - pid: The PID of the process.
+    ///   - range: Range of the memory of the process.
+    /// - Returns: Base address of the page or the lower bound of the range, if it is located in the page. Nil, if no page was written.
+    public static func firstDirtyPage(pid: Int32, in range: MemoryRange) throws -> UInt? {
+        let pageSize = RemoteMemoryCache.pageSize
+        let entrySize = UInt(MemoryLayout<UInt64>.size)
+        let path = "/proc/\(pid)/pagemap"
+
+        var page = range.lowerBound / pageSize
+        let endPage = (range.upperBound + pageSize - 1) / pageSize
+
+        while page < endPage {
+            let count = Int(min(UInt(entriesPerRead), endPage - page))
+            guard
+                let entries = ProcFile.read(path, offset: page * entrySize, count: count * Int(entrySize)),
+                entries.count == count * Int(entrySize)
+            else {
+                throw Error.pagemapReadFailed(pid: pid)
+            }
+
+            let dirty = entries.withUnsafeBytes { buffer in
+                (0..<count).first { index in
+                    buffer.loadUnaligned(fromByteOffset: index * Int(entrySize), as: UInt64.self) & softDirtyBit != 0
+                }
+            }
+            if let dirty = dirty {
+                return max(range.lowerBound, (page + UInt(dirty)) * pageSize)
+            }
+            page += UInt(count)
+        }
+
+        return nil
+    }
+}
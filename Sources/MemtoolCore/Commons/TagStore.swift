@@ -0,0 +1,107 @@
+import Foundation
+
+/// TagStore records the types bound to the addresses of the remote memory by the checked loads
+/// (see `Session.checkedLoad(of:base:skipMismatchTypeCheck:)`). A load of a type different from
+/// the recorded one is reported as a mismatch.
+///
+/// The store is a reference shared by a process session and its thread sessions, so each load
+/// updates a single record in place. Types are stored as compact ids. The store is not thread-safe,
+/// workers use their own stores, which are merged afterwards.
+public final class TagStore {
+    /// Determines which loads are recorded.
+    public enum Policy: Equatable {
+        /// Every checked load is recorded and checked.
+        case full
+        /// Only loads of roughly one of `rate` addresses are recorded and checked. The selection
+        /// depends only on the address, so the same address is always either checked or skipped.
+        case sampled(rate: Int)
+        /// Nothing is recorded, checked loads do not check types.
+        case off
+    }
+
+    /// Changing the policy discards the records.
+    public var policy: Policy {
+        didSet {
+            if policy != oldValue {
+                removeAll()
+            }
+        }
+    }
+
+    /// Recorded type ids by the address.
+    private var ids: [UInt: UInt16] = [:]
+    /// Types indexed by their id.
+    private var types: [Any.Type] = []
+    private var idsByType: [ObjectIdentifier: UInt16] = [:]
+
+    /// Number of recorded addresses.
+    public var count: Int { ids.count }
+
+    public init(policy: Policy = .full) {
+        self.policy = policy
+    }
+
+    /// Whether loads at the address are recorded under the current policy.
+    public func isTracked(_ base: UInt) -> Bool {
+        switch policy {
+        case .full:
+            return true
+        case let .sampled(rate):
+            // Fibonacci hashing spreads the aligned addresses uniformly
+            return (((base >> 3) &* 0x9e37_79b9_7f4a_7c15) >> 32) % UInt(max(rate, 1)) == 0
+        case .off:
+            return false
+        }
+    }
+
+    /// Tag of the address, nil if no type was recorded.
+    public subscript(base: UInt) -> MemoryTag? {
+        ids[base].map { MemoryTag(type: types[Int($0)]) }
+    }
+
+    /// Records the type at the address, unless the address is not tracked.
+    /// - Returns: The previously recorded type, if it differs from the type. The record is not changed.
+    @discardableResult
+    public func record(_ type: Any.Type, at base: UInt) -> Any.Type? {
+        guard isTracked(base) else {
+            return nil
+        }
+
+        let id = id(of: type)
+        if let existing = ids[base] {
+            return existing == id ? nil : types[Int(existing)]
+        }
+        ids[base] = id
+        return nil
+    }
+
+    /// Records all types of the other store.
+    /// - Throws: `SessionError.loadingPreviouslyLoadedTypeMismatch` if the stores recorded different types at the same address.
+    public func merge(_ other: TagStore) throws {
+        for (base, otherId) in other.ids {
+            let type = other.types[Int(otherId)]
+            if let existing = record(type, at: base) {
+                error("Error: Worker loaded type \(type) at " + String(format: "%016lx", base) + ". Previously loaded a mismatching type \(existing).")
+                throw SessionError.loadingPreviouslyLoadedTypeMismatch
+            }
+        }
+    }
+
+    /// Discards all records.
+    public func removeAll() {
+        ids.removeAll()
+    }
+
+    private func id(of type: Any.Type) -> UInt16 {
+        let identifier = ObjectIdentifier(type)
+        if let id = idsByType[identifier] {
+            return id
+        }
+        guard let id = UInt16(exactly: types.count) else {
+            preconditionFailure("TagStore supports at most \(UInt16.max) types")
+        }
+        types.append(type)
+        idsByType[identifier] = id
+        return id
+    }
+}
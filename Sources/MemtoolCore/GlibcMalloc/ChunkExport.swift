@@ -0,0 +1,198 @@
+import Foundation
+
+/// ChunkExport streams the contents of many chunks, for example every active allocation of the
+/// heap, with few remote reads.
+///
+/// Chunks are taken in the order of their addresses and grouped into batches of at most
+/// `Options.maxSegments` segments and `Options.memoryBudget` bytes. Adjacent chunks are read
+/// as a single segment and each batch is read by a single vectored request
+/// (`MemoryReader.read(segments:into:)`, one `process_vm_readv` of the live process). The batch
+/// is reused, so the memory stays bounded by the budget regardless of the size of the heap.
+/// Chunks larger than the budget are delivered in several consecutive parts.
+///
+/// ```swift
+/// let summary = try ChunkExport.export(chunks: analyzer.chunks, from: session) { record in
+///     consume(record.range, record.bytes)
+/// }
+/// ```
+public enum ChunkExport {
+    /// Largest number of segments of a single `process_vm_readv` (`IOV_MAX` on Linux).
+    public static let maxSegments = 1024
+
+    public struct Options {
+        /// Exports also chunks, that are not active.
+        public var includeFree = false
+        /// Largest number of bytes read by a single batch, also the size of the reused buffer.
+        public var memoryBudget = 64 << 20
+        /// Largest number of segments of a single batch.
+        public var maxSegments = ChunkExport.maxSegments
+
+        public init(includeFree: Bool = false, memoryBudget: Int = 64 << 20, maxSegments: Int = ChunkExport.maxSegments) {
+            self.includeFree = includeFree
+            self.memoryBudget = memoryBudget
+            self.maxSegments = maxSegments
+        }
+    }
+
+    /// Content of a chunk, or of its part if the chunk exceeds the memory budget.
+    public struct Record {
+        public let chunk: ChunkTable.Entry
+        /// Range of the exported bytes, the whole chunk including its header unless the chunk
+        /// is delivered in parts.
+        public let range: MemoryRange
+        /// Bytes of the range, valid only during the call of the sink. Bytes after `bytesRead`
+        /// could not be read and are zeroed.
+        public let bytes: UnsafeRawBufferPointer
+        public let bytesRead: Int
+
+        public var isComplete: Bool { bytesRead == range.count }
+        /// Offset of the range within the chunk.
+        public var offset: UInt { range.lowerBound - chunk.base }
+    }
+
+    public struct Summary: Equatable {
+        /// Number of exported chunks.
+        public var chunks = 0
+        /// Number of records delivered to the sink.
+        public var records = 0
+        public var bytesRead = 0
+        /// Bytes of the records, that could not be read.
+        public var bytesMissing = 0
+        /// Number of vectored reads.
+        public var batches = 0
+    }
+
+    /// Reads the contents of the chunks and passes them to the sink in the order of addresses.
+    /// - Parameters:
+    ///   - chunks: Chunks found by the analysis, see `GlibcMallocAnalyzer.chunks`.
+    ///   - session: Session of the process, whose memory contains the chunks.
+    ///   - options: Selection of the chunks and the limits of the batches.
+    ///   - sink: Receives the records, the export stops on the first error it throws.
+    public static func export(chunks: ChunkTable, from session: Session, options: Options = Options(), _ sink: (Record) throws -> Void) throws -> Summary {
+        try export(chunks: chunks, from: session.memory, options: options, sink)
+    }
+
+    /// Reads the contents of the chunks from the memory and passes them to the sink.
+    public static func export(chunks: ChunkTable, from memory: MemoryReader, options: Options = Options(), _ sink: (Record) throws -> Void) throws -> Summary {
+        var chunks = chunks
+        chunks.sort()
+
+        let budget = max(options.memoryBudget, 1)
+        let maxSegments = max(options.maxSegments, 1)
+        let buffer = UnsafeMutableRawBufferPointer.allocate(byteCount: budget, alignment: MemoryLayout<UInt>.alignment)
+        defer {
+            buffer.deallocate()
+        }
+
+        var summary = Summary()
+        var segments: [MemoryRange] = []
+        var pieces: [(chunk: Int, range: MemoryRange)] = []
+        var batchBytes = 0
+
+        func flush() throws {
+            guard !segments.isEmpty else {
+                return
+            }
+
+            let copied = memory.read(segments: segments, into: UnsafeMutableRawBufferPointer(rebasing: buffer[0..<batchBytes]))
+            summary.batches += 1
+
+            // Pieces follow each other in the buffer as well as in the segments
+            var segment = 0
+            var segmentOffset = 0
+            var offset = 0
+            for piece in pieces {
+                if segmentOffset == segments[segment].count {
+                    segment += 1
+                    segmentOffset = 0
+                }
+
+                let length = piece.range.count
+                let bytesRead = min(max(copied[segment] - segmentOffset, 0), length)
+                let bytes = UnsafeMutableRawBufferPointer(rebasing: buffer[offset..<(offset + length)])
+                if bytesRead < length {
+                    UnsafeMutableRawBufferPointer(rebasing: bytes[bytesRead...]).initializeMemory(as: UInt8.self, repeating: 0)
+                }
+
+                let chunk = chunks[piece.chunk]
+                try sink(Record(chunk: chunk, range: piece.range, bytes: UnsafeRawBufferPointer(bytes), bytesRead: bytesRead))
+                summary.records += 1
+                summary.bytesRead += bytesRead
+                summary.bytesMissing += length - bytesRead
+                if piece.range.upperBound == chunk.range.upperBound {
+                    summary.chunks += 1
+                }
+
+                segmentOffset += length
+                offset += length
+            }
+
+            segments.removeAll(keepingCapacity: true)
+            pieces.removeAll(keepingCapacity: true)
+            batchBytes = 0
+        }
+
+        for index in chunks.indices {
+            guard options.includeFree || GlibcMallocChunkState(rawValue: chunks.states[index])?.isActive == true else {
+                continue
+            }
+
+            var start = chunks.bases[index]
+            let end = start + chunks.sizes[index]
+            while start < end {
+                let length = Int(min(end - start, UInt(budget)))
+                let range = start..<(start + UInt(length))
+                let coalesces = segments.last?.upperBound == range.lowerBound
+                if batchBytes + length > budget || (!coalesces && segments.count == maxSegments) {
+                    try flush()
+                }
+
+                if let last = segments.last, last.upperBound == range.lowerBound {
+                    segments[segments.count - 1] = last.lowerBound..<range.upperBound
+                } else {
+                    segments.append(range)
+                }
+                pieces.append((index, range))
+                batchBytes += length
+                start = range.upperBound
+            }
+        }
+        try flush()
+
+        return summary
+    }
+
+    /// Size of the header preceding the bytes of each record written by `write(chunks:from:options:to:)`.
+    public static let recordHeaderSize = 48
+
+    /// Writes the records to the file. Each record is a header of little-endian `UInt64` fields
+    /// (base and size of the chunk, offset of the range within the chunk, length of the range,
+    /// bytes read), the state of the chunk (`GlibcMallocChunkState.rawValue`) padded to 8 bytes
+    /// and the bytes of the range. The output is written in blocks of about 1 MiB.
+    public static func write(chunks: ChunkTable, from session: Session, options: Options = Options(), to handle: FileHandle) throws -> Summary {
+        let blockSize = 1 << 20
+        var block = Data()
+        block.reserveCapacity(blockSize + recordHeaderSize)
+
+        let summary = try export(chunks: chunks, from: session, options: options) { record in
+            for field in [record.chunk.base, record.chunk.size, record.offset, UInt(record.range.count), UInt(record.bytesRead)] {
+                withUnsafeBytes(of: UInt64(field).littleEndian) { block.append(contentsOf: $0) }
+            }
+            block.append(record.chunk.state.rawValue)
+            block.append(contentsOf: repeatElement(0, count: 7))
+
+            if block.count + record.bytes.count > blockSize {
+                try handle.write(contentsOf: block)
+                block.removeAll(keepingCapacity: true)
+            }
+            if record.bytes.count >= blockSize {
+                try handle.write(contentsOf: Data(bytesNoCopy: UnsafeMutableRawPointer(mutating: record.bytes.baseAddress!), count: record.bytes.count, deallocator: .none))
+            } else {
+                block.append(contentsOf: record.bytes)
+            }
+        }
+        try handle.write(contentsOf: block)
+
+        return summary
+    }
+}
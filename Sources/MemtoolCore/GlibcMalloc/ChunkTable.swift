@@ -0,0 +1,224 @@
+/// ChunkTable stores chunks located by the Glibc malloc analysis in columns: base addresses,
+/// sizes, a byte of the state and a 32-bit index into the table of owners. Owners (the heap, the
+/// tcache and whether the arena is freed) are shared by all chunks of the same origin, so
+/// a chunk does not allocate any memory on its own.
+///
+/// Chunks are iterated as `Entry` values, which are created on access. Use `region` of the
+/// entry only when the `GlibcMallocRegion` is needed.
+public struct ChunkTable {
+    /// Origin of the chunk shared by many chunks of the table.
+    public struct Owner: Hashable {
+        /// Base address of the thread arena, nil for the main arena.
+        public var threadHeapBase: UInt?
+        /// The PID/TID of the thread whose tcache holds the chunk.
+        public var tcacheThread: Int32?
+        /// The chunk was found in a freed thread arena.
+        public var freedArena: Bool
+
+        public init(threadHeapBase: UInt?, tcacheThread: Int32? = nil, freedArena: Bool = false) {
+            self.threadHeapBase = threadHeapBase
+            self.tcacheThread = tcacheThread
+            self.freedArena = freedArena
+        }
+
+        /// The origin in the form used by `GlibcMallocInfo`.
+        public var origin: [GlibcMallocStateOrigin] {
+            var origin: [GlibcMallocStateOrigin] = [threadHeapBase.map { .threadHeap(base: $0) } ?? .mainHeap]
+            if let tcacheThread = tcacheThread {
+                origin.append(.tlsTCacge(pthreadId: tcacheThread))
+            }
+            if freedArena {
+                origin.append(.freedArena)
+            }
+            return origin
+        }
+
+        /// Whether the `origin` contains the item, without creating the `origin`.
+        public func contains(_ item: GlibcMallocStateOrigin) -> Bool {
+            switch item {
+            case .mainHeap:
+                return threadHeapBase == nil
+            case let .threadHeap(base):
+                return threadHeapBase == base
+            case let .tlsTCacge(pthreadId):
+                return tcacheThread == pthreadId
+            case .freedArena:
+                return freedArena
+            }
+        }
+    }
+
+    /// A single row of the table.
+    public struct Entry: Equatable {
+        public let base: UInt
+        public let size: UInt
+        public let state: GlibcMallocChunkState
+        public let owner: Owner
+
+        public var range: MemoryRange { base..<(base + size) }
+
+        /// The chunk as a region with the `GlibcMallocInfo`.
+        public var region: GlibcMallocRegion {
+            GlibcMallocRegion(range: range, properties: GlibcMallocInfo(rebound: .mallocChunk(state), explored: true, origin: owner.origin))
+        }
+    }
+
+    private(set) var bases: [UInt] = []
+    private(set) var sizes: [UInt] = []
+    private(set) var states: [UInt8] = []
+    private(set) var ownerIds: [UInt32] = []
+    private(set) var owners: [Owner] = []
+    private var ownerIdsByOwner: [Owner: UInt32] = [:]
+
+    /// Whether chunks are sorted by their base address. Tables filled in the order of
+    /// addresses stay sorted without any additional work.
+    public private(set) var isSorted = true
+
+    public init() {}
+
+    /// Creates the table from the columns, used by readers of stored tables.
+    /// - Returns: nil if the columns differ in length or refer to missing owners.
+    init?(bases: [UInt], sizes: [UInt], states: [UInt8], ownerIds: [UInt32], owners: [Owner]) {
+        guard
+            sizes.count == bases.count, states.count == bases.count, ownerIds.count == bases.count,
+            states.allSatisfy({ GlibcMallocChunkState(rawValue: $0) != nil }),
+            ownerIds.allSatisfy({ Int($0) < owners.count })
+        else {
+            return nil
+        }
+
+        self.bases = bases
+        self.sizes = sizes
+        self.states = states
+        self.ownerIds = ownerIds
+        self.owners = owners
+        for (id, owner) in owners.enumerated() {
+            ownerIdsByOwner[owner] = UInt32(id)
+        }
+        self.isSorted = zip(bases, bases.dropFirst()).allSatisfy { $0 <= $1 }
+    }
+
+    /// Appends a chunk to the end of the table.
+    public mutating func append(base: UInt, size: UInt, state: GlibcMallocChunkState, owner: Owner) {
+        if let last = bases.last, last > base {
+            isSorted = false
+        }
+        bases.append(base)
+        sizes.append(size)
+        states.append(state.rawValue)
+        ownerIds.append(id(of: owner))
+    }
+
+    /// Appends the chunk to the end of the table.
+    public mutating func append(_ entry: Entry) {
+        append(base: entry.base, size: entry.size, state: entry.state, owner: entry.owner)
+    }
+
+    /// Appends all chunks of the other table.
+    public mutating func append(contentsOf other: ChunkTable) {
+        guard !other.isEmpty else {
+            return
+        }
+        if !other.isSorted || (bases.last.map { $0 > other.bases[0] } ?? false) {
+            isSorted = false
+        }
+
+        var ids: [UInt32] = []
+        for owner in other.owners {
+            ids.append(id(of: owner))
+        }
+        bases.append(contentsOf: other.bases)
+        sizes.append(contentsOf: other.sizes)
+        states.append(contentsOf: other.states)
+        ownerIds.append(contentsOf: other.ownerIds.lazy.map { ids[Int($0)] })
+    }
+
+    /// Changes the state of the chunk at the index.
+    public mutating func setState(_ state: GlibcMallocChunkState, at index: Int) {
+        states[index] = state.rawValue
+    }
+
+    /// Reorders the chunks by their base address. Does nothing, if the table is sorted.
+    public mutating func sort() {
+        guard !isSorted else {
+            return
+        }
+        let order = bases.indices.sorted { bases[$0] < bases[$1] }
+        bases = order.map { bases[$0] }
+        sizes = order.map { sizes[$0] }
+        states = order.map { states[$0] }
+        ownerIds = order.map { ownerIds[$0] }
+        isSorted = true
+    }
+
+    /// Index of the chunk containing the address.
+    public func index(containing address: UInt) -> Int? {
+        guard isSorted else {
+            return indices.first { self[$0].range.contains(address) }
+        }
+
+        // Last chunk with base address lower or equal to the address
+        let position = upperBound(of: address) - 1
+        guard position >= 0, address - bases[position] < sizes[position] else {
+            return nil
+        }
+        return position
+    }
+
+    /// Indices of the chunks overlapping the range. The table has to be sorted.
+    public func indices(overlapping range: MemoryRange) -> Range<Int> {
+        precondition(isSorted, "ChunkTable has to be sorted")
+        var lower = upperBound(of: range.lowerBound)
+        if lower > 0, bases[lower - 1] + sizes[lower - 1] > range.lowerBound {
+            lower -= 1
+        }
+        let upper = range.isEmpty ? lower : max(lower, upperBound(of: range.upperBound - 1))
+        return lower..<upper
+    }
+
+    /// First position with base address greater than the address.
+    private func upperBound(of address: UInt) -> Int {
+        var low = 0
+        var high = bases.count
+        while low < high {
+            let middle = (low + high) / 2
+            if bases[middle] <= address {
+                low = middle + 1
+            } else {
+                high = middle
+            }
+        }
+        return low
+    }
+
+    /// Indices of the chunks whose owner satisfies the predicate, evaluated once per owner.
+    public func indices(where predicate: (Owner) throws -> Bool) rethrows -> [Int] {
+        let matches = try owners.map(predicate)
+        return ownerIds.indices.filter { matches[Int(ownerIds[$0])] }
+    }
+
+    private mutating func id(of owner: Owner) -> UInt32 {
+        if let id = ownerIdsByOwner[owner] {
+            return id
+        }
+        // Owners combine the heap with the tcache thread, so there can be many of them
+        let id = UInt32(owners.count)
+        owners.append(owner)
+        ownerIdsByOwner[owner] = id
+        return id
+    }
+}
+
+extension ChunkTable: RandomAccessCollection {
+    public var startIndex: Int { 0 }
+    public var endIndex: Int { bases.count }
+
+    public subscript(position: Int) -> Entry {
+        Entry(
+            base: bases[position],
+            size: sizes[position],
+            state: GlibcMallocChunkState(rawValue: states[position])!,
+            owner: owners[Int(ownerIds[position])]
+        )
+    }
+}
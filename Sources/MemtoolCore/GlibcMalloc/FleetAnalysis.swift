@@ -0,0 +1,216 @@
+import Foundation
+
+/// FleetAnalysis analyzes the glibc malloc heaps of many processes, typically workers of a prefork
+/// server running the same binary, and sums their usage by size class and arena.
+///
+/// Processes are analyzed concurrently, each of them by a single thread from the attach to the
+/// detach, as `ptrace` requests are accepted only from the thread, that attached the process. The
+/// thread detaches the process explicitly by `ProcessSession.detach()` as soon as its heap is
+/// analyzed, a released session must not be relied on to detach. Symbols of files mapped by
+/// several processes are decoded once and shared through `symbolStore`.
+///
+/// ```swift
+/// let fleet = FleetAnalysis()
+/// let report = fleet.analyze(pids: pids, workerCount: 8)
+/// print(report.aggregate.usage.activeBytes)
+/// ```
+public final class FleetAnalysis {
+    public enum Error: Swift.Error {
+        case couldNotAttach
+    }
+
+    /// Chunks and bytes of a group of chunks.
+    public struct Usage: Equatable {
+        public var activeChunks = 0
+        public var activeBytes: UInt = 0
+        public var freeChunks = 0
+        public var freeBytes: UInt = 0
+
+        public init() {}
+
+        public mutating func add(size: UInt, isActive: Bool) {
+            if isActive {
+                activeChunks += 1
+                activeBytes += size
+            } else {
+                freeChunks += 1
+                freeBytes += size
+            }
+        }
+
+        public static func += (lhs: inout Usage, rhs: Usage) {
+            lhs.activeChunks += rhs.activeChunks
+            lhs.activeBytes += rhs.activeBytes
+            lhs.freeChunks += rhs.freeChunks
+            lhs.freeBytes += rhs.freeBytes
+        }
+    }
+
+    /// Arena owning the chunks. Thread arenas are numbered by the base of their heap within each
+    /// process. The numbers of unrelated processes do not match, so the aggregate sums all thread
+    /// arenas in `threads`.
+    public enum Arena: Hashable, Comparable {
+        case main
+        case thread(index: Int)
+        /// Thread arenas of all processes, used only by the aggregate.
+        case threads
+        /// Chunks mmapped outside of any arena.
+        case mmapped
+    }
+
+    /// Result of a single process.
+    public struct ProcessResult {
+        public let pid: Int32
+        public var usage = Usage()
+        /// Usage keyed by the size class, see `FleetAnalysis.sizeClass(of:)`.
+        public var sizeClasses: [UInt: Usage] = [:]
+        public var arenas: [Arena: Usage] = [:]
+        /// Base of the heap of each thread arena.
+        public var arenaBases: [Arena: UInt] = [:]
+        /// The process could not be analyzed, its usage is empty.
+        public var error: Swift.Error?
+
+        public init(pid: Int32) {
+            self.pid = pid
+        }
+    }
+
+    /// Sum of the results of all analyzed processes.
+    public struct Aggregate {
+        public var processCount = 0
+        public var failedCount = 0
+        public var usage = Usage()
+        public var sizeClasses: [UInt: Usage] = [:]
+        public var arenas: [Arena: Usage] = [:]
+
+        public init() {}
+    }
+
+    public struct Report {
+        /// Results in the order of the PIDs.
+        public let processes: [ProcessResult]
+        public let aggregate: Aggregate
+    }
+
+    /// Symbols shared by the sessions of the analyzed processes, it may be kept for later analyses.
+    public let symbolStore: SharedSymbolStore
+
+    public init(symbolStore: SharedSymbolStore = SharedSymbolStore()) {
+        self.symbolStore = symbolStore
+    }
+
+    /// Attaches to the processes, analyzes their heaps and detaches each of them from the thread,
+    /// that attached it, before its chunks are summed. Failures of single processes are reported
+    /// in their results and do not stop the analysis of others.
+    /// - Parameters:
+    ///   - pids: Processes to analyze.
+    ///   - workerCount: Number of processes analyzed concurrently.
+    public func analyze(pids: [Int32], workerCount: Int = 1) -> Report {
+        var results = [ProcessResult?](repeating: nil, count: pids.count)
+        let lock = NSLock()
+        var nextPid = 0
+
+        results.withUnsafeMutableBufferPointer { storage in
+            // Each process writes only its own element
+            let results = storage
+            DispatchQueue.concurrentPerform(iterations: max(1, min(workerCount, pids.count))) { _ in
+                while true {
+                    lock.lock()
+                    let index = nextPid
+                    nextPid += 1
+                    lock.unlock()
+
+                    guard index < pids.count else {
+                        return
+                    }
+                    results[index] = analyze(pid: pids[index])
+                }
+            }
+        }
+
+        let processes = results.map { $0! }
+        return Report(processes: processes, aggregate: Self.aggregate(processes))
+    }
+
+    /// Analyzes a single process on the calling thread, which also detaches it.
+    private func analyze(pid: Int32) -> ProcessResult {
+        let session = ProcessSession(pid: pid)
+        // Detaches after failures, the detach is a no-op once the process is detached
+        defer { session.detach() }
+
+        do {
+            guard session.isAttached else {
+                throw Error.couldNotAttach
+            }
+            session.loadMap()
+            session.loadSymbols(store: symbolStore)
+            session.loadThreads()
+            let analyzer = try GlibcMallocAnalyzer(session: session)
+            try analyzer.analyze()
+            session.detach()
+            return Self.summarize(pid: pid, chunks: analyzer.chunks)
+        } catch {
+            var result = ProcessResult(pid: pid)
+            result.error = error
+            return result
+        }
+    }
+
+    /// Sums the chunks of a process by size class and arena.
+    static func summarize(pid: Int32, chunks: ChunkTable) -> ProcessResult {
+        var result = ProcessResult(pid: pid)
+
+        let heapBases = Set(chunks.lazy.compactMap(\.owner.threadHeapBase)).sorted()
+        var arenaOfHeap: [UInt: Arena] = [:]
+        for (index, base) in heapBases.enumerated() {
+            arenaOfHeap[base] = .thread(index: index)
+            result.arenaBases[.thread(index: index)] = base
+        }
+
+        for chunk in chunks {
+            let isActive = chunk.state.isActive
+            let arena: Arena
+            if chunk.state == .mmapped {
+                arena = .mmapped
+            } else if let base = chunk.owner.threadHeapBase, let thread = arenaOfHeap[base] {
+                arena = thread
+            } else {
+                arena = .main
+            }
+
+            result.usage.add(size: chunk.size, isActive: isActive)
+            result.sizeClasses[sizeClass(of: chunk.size), default: Usage()].add(size: chunk.size, isActive: isActive)
+            result.arenas[arena, default: Usage()].add(size: chunk.size, isActive: isActive)
+        }
+        return result
+    }
+
+    static func aggregate(_ results: [ProcessResult]) -> Aggregate {
+        var aggregate = Aggregate()
+        for result in results {
+            aggregate.processCount += 1
+            guard result.error == nil else {
+                aggregate.failedCount += 1
+                continue
+            }
+
+            aggregate.usage += result.usage
+            for (sizeClass, usage) in result.sizeClasses {
+                aggregate.sizeClasses[sizeClass, default: Usage()] += usage
+            }
+            for (arena, usage) in result.arenas {
+                if case .thread = arena {
+                    aggregate.arenas[.threads, default: Usage()] += usage
+                } else {
+                    aggregate.arenas[arena, default: Usage()] += usage
+                }
+            }
+        }
+        return aggregate
+    }
+
+    /// Size class of a chunk, see `GlibcMallocStatistics.powerOfTwoClass(of:)`.
+    public static func sizeClass(of size: UInt) -> UInt {
+        GlibcMallocStatistics.powerOfTwoClass(of: size)
+    }
+}
@@ -63,40 +63,43 @@ public enum GlibcAssurances {
 
     }
 
-    /// Checks, whether it can be reasonable assumed, that the file is a `glib` binary.
-    /// (Either Glibc or ld).
-    /// - Parameters:
-    ///   - file: The investigated file.
-    ///   - unloadedSymbols: Symbol loaded for each file in the remote process.
-    /// - Returns: true if symbols contain the file and it has GLIBC version tags.
-    public static func isFileFromGlibc(_ file: String, unloadedSymbols: [String: [UnloadedSymbolInfo]]) -> Bool {
-        unloadedSymbols[file].flatMap(loadGlibcVersions(in:))?.isEmpty == false
+    /// Files, that can be reasonably assumed to be `glib` binaries (they contain GLIBC version tags).
+    /// - Parameter symbolIndex: Index of the symbols of the remote process.
+    public static func glibcFiles(in symbolIndex: SymbolIndex) -> Set<String> {
+        Set(glibcVersionSymbols(in: symbolIndex).map(\.file))
     }
 
     /// Checks, whether it can be reasonable assumed, that the file is a `glib` binary.
     /// (Either Glibc or ld).
-    /// - Parameter pair: File and symbols associated with the file
-    /// - Returns: true if symbols contain the file and it has GLIBC version tags.
-    public static func glibcFilePredicate(pair: (key: String, value: [UnloadedSymbolInfo])) -> Bool {
-        loadGlibcVersions(in: pair.value).isEmpty == false
+    /// - Parameters:
+    ///   - file: The investigated file.
+    ///   - symbolIndex: Index of the symbols of the remote process.
+    /// - Returns: true if the file has GLIBC version tags.
+    public static func isFileFromGlibc(_ file: String, symbolIndex: SymbolIndex) -> Bool {
+        glibcFiles(in: symbolIndex).contains(file)
     }
 
     /// Locates unloaded symbol info for requested known symbol.
     /// - Parameters:
     ///   - knownSymbol: The searched symbol.
-    ///   - unloadedSymbols: The list of unloaded symbol that is searched.
+    ///   - symbolIndex: Index of the symbols of the remote process.
     /// - Returns: Candidates for the correct result.
-    public static func glibcOccurances(of knownSymbol: KnownSymbols, in unloadedSymbols: [String: [UnloadedSymbolInfo]]) -> [UnloadedSymbolInfo] {
-        unloadedSymbols.filter(glibcFilePredicate(pair:)).values.flatMap { $0 }.filter {
-            $0.name == knownSymbol.name && $0.segment == knownSymbol.segment
+    public static func glibcOccurances(of knownSymbol: KnownSymbols, in symbolIndex: SymbolIndex) -> [UnloadedSymbolInfo] {
+        let candidates = symbolIndex.unloadedSymbols(named: knownSymbol.name).filter { $0.segment == knownSymbol.segment }
+        guard !candidates.isEmpty else {
+            return []
         }
+        let files = glibcFiles(in: symbolIndex)
+        return candidates.filter { files.contains($0.file) }
     }
 
     /// Searches, whether there are files, that contain `glibc` binary and that the 
     /// binary maximal version is among validated versions.
-    /// - Parameter unloadedSymbols: The list of unloaded symbol that is searched.
-    public static func isValidatedGlibcVersion(unloadedSymbols: [String: [UnloadedSymbolInfo]]) -> Bool {
-        let versions = unloadedSymbols.values.map(loadGlibcVersions(in:)).filter { !$0.isEmpty }
+    /// - Parameter symbolIndex: Index of the symbols of the remote process.
+    public static func isValidatedGlibcVersion(symbolIndex: SymbolIndex) -> Bool {
+        let versions = Dictionary(grouping: glibcVersionSymbols(in: symbolIndex), by: \.file).values.map {
+            $0.compactMap { Version(rawValue: $0.name) }
+        }
 
         return !versions.isEmpty
             && versions.allSatisfy { versions in
@@ -108,8 +111,19 @@ public enum GlibcAssurances {
             }
     }
 
-    private static func loadGlibcVersions(in symbols: [UnloadedSymbolInfo]) -> [Version] {
-        symbols.filter { $0.segment == .known(.abs) }.map(\.name).compactMap(Version.init(rawValue:))
+    /// Checks by the name of the file only, whether it is likely a `glibc` binary (either Glibc or ld).
+    /// Used before the symbols are loaded, where `isFileFromGlibc` can not be used.
+    /// - Parameter file: Path to the file mapped in the remote process.
+    public static func isGlibcFileName(_ file: String) -> Bool {
+        let name = file.split(separator: "/").last.map(String.init) ?? file
+        return name.hasPrefix("libc.so") || name.hasPrefix("libc-") || name.hasPrefix("ld-linux") || name.hasPrefix("ld-")
+    }
+
+    /// Version tags of the `glibc` binaries.
+    private static func glibcVersionSymbols(in symbolIndex: SymbolIndex) -> [UnloadedSymbolInfo] {
+        symbolIndex.unloadedSymbols(withPrefix: "GLIBC_").filter {
+            $0.segment == .known(.abs) && Version(rawValue: $0.name) != nil
+        }
     }
 }
 
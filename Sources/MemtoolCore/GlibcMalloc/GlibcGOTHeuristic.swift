@@ -60,15 +60,14 @@ public final class TbssSymbolGlibcLdHeuristic {
 
         // Assert, that everything is initialized
         guard 
-            let map = session.map, 
-            let unloadedSymbols = session.unloadedSymbols,
-            let symbols = session.symbols 
+            let map = session.mapIndex, 
+            let symbols = session.symbolIndex
         else {
             throw Error.initializeSessionWithMapAndSymbols
         }
 
         // Find that desired symbol exists in .tbss
-        guard let symbolReference = unloadedSymbols[fileName]?.first(where: { $0.segment == .known(.tbss) && $0.name == tbssSymbolName }) else {
+        guard let symbolReference = symbols.unloadedSymbols(named: tbssSymbolName).first(where: { $0.segment == .known(.tbss) && $0.file == fileName }) else {
             throw Error.noSuchTbssSymbolOrFile
         }
         self.symbol = symbolReference
@@ -90,9 +89,9 @@ public final class TbssSymbolGlibcLdHeuristic {
         let index = privateLinkItem.buffer.l_tls_modid
 
         // Get FS register
-        let fsBase = UInt(bitPattern: swift_inspect_bridge__ptrace_peekuser(session.ptraceId, FS_BASE))
+        let fsBase = session.fsBase
         self.fsBase = fsBase
-        guard map.contains(where: { $0.range.contains(fsBase) && $0.properties.flags.contains([.read, .write])}) == true else {
+        guard map.contains(fsBase, flags: [.read, .write]) else {
             throw Error.fsBaseNotInReadableSpace
         }
 
@@ -113,14 +112,20 @@ public final class TbssSymbolGlibcLdHeuristic {
         let loadedSymbolBase = UInt(bitPattern: indexDtv.buffer.pointer.val) + symbolReference.location
         self.loadedSymbolBase = loadedSymbolBase
 
-        guard map.contains(where: { $0.range.contains(loadedSymbolBase) && $0.properties.flags.contains([.read, .write])}) == true else {
+        guard map.contains(loadedSymbolBase, flags: [.read, .write]) else {
             throw Error.symbolNotInReadableSpace
         }
     }
 
-    private static func iterateRDebug(session: Session, symbol: SymbolRegion, file: String) throws -> BoundRemoteMemory<link_map>? {
+    /// Walks the link maps of `_r_debug` and returns the one of the file.
+    static func iterateRDebug(session: Session, symbol: SymbolRegion, file: String) throws -> BoundRemoteMemory<link_map>? {
+        try Metrics.measure("tls.iterateRDebug") {
+            try linkMap(of: file, rDebug: symbol, session: session)
+        }
+    }
+
+    private static func linkMap(of file: String, rDebug symbol: SymbolRegion, session: Session) throws -> BoundRemoteMemory<link_map>? {
         let rDebugContent = try session.checkedLoad(of: r_debug.self, base: symbol.range.lowerBound)
-        let loadLimit = UInt(file.utf8.count)
 
         var nextLink = rDebugContent.buffer.r_map
         repeat {
@@ -131,9 +136,7 @@ public final class TbssSymbolGlibcLdHeuristic {
             let linkBase = UInt(bitPattern: linkPtr)
             let link = try session.checkedLoad(of: link_map.self, base: linkBase)
             let nameBase = UInt(bitPattern: link.buffer.l_name)
-            let name = RawRemoteMemory(pid: session.pid, load: nameBase..<(nameBase + loadLimit))
-            let nameString = String(cString: Array(name.buffer) + [0]) // This is not ideal solution, ideally we would like to load whole c string
-            //let nameString = String(decoding: name.buffer, as: UTF8.self)
+            let nameString = try session.checkedLoadCString(base: nameBase)
             // While debugging, it was discovered, that ld string contains only part of the path, "/lib/x86_64-linux-gnu/libc.so.6" instead of "/usr/lib/x86_64-linux-gnu/libc.so.6"
             if !nameString.isEmpty, file.hasSuffix(nameString) {
                 return link
@@ -345,7 +348,7 @@ public final class GlibcErrnoAsmHeuristic {
         let fsOffsetToErrno = try session.checkedLoad(of: UInt.self, base: gotOffsetLocation)
         
         // Get FS register
-        let fsBase = UInt(bitPattern: swift_inspect_bridge__ptrace_peekuser(session.ptraceId, FS_BASE))
+        let fsBase = session.fsBase
 
         // This MUST overflow. errno should be located on lower address than FS
         let gotAddition = fsBase.addingReportingOverflow(fsOffsetToErrno.buffer)
@@ -371,7 +374,27 @@ Disassembly of section .text:
    239e2:       00 00
    239e4:       c3                      ret
 */
+    private static let disassemblyLock = NSLock()
+    /// Disassemblies of successful runs keyed by `SharedSymbolStore.key(for:)`, so sessions of
+    /// processes using the same glibc run `objdump` once.
+    private static var disassemblies: [String: String] = [:]
+
     private static func getErrnoLocationDisassembly(for glibcPath: String) -> String {
+        let key = SharedSymbolStore.key(for: glibcPath)
+        disassemblyLock.lock()
+        defer { disassemblyLock.unlock() }
+        if let disassembly = disassemblies[key] {
+            return disassembly
+        }
+
+        let disassembly = runObjdump(for: glibcPath)
+        if !disassembly.isEmpty {
+            disassemblies[key] = disassembly
+        }
+        return disassembly
+    }
+
+    private static func runObjdump(for glibcPath: String) -> String {
         let process = Process()
         let aStdout = Pipe()
         let aStderr = Pipe()
@@ -1,3 +1,4 @@
+import Foundation
 import Cutils
 
 /// Glibc analyzer is the most important classes of this project: it encapsulates the 
@@ -14,16 +15,18 @@ public final class GlibcMallocAnalyzer {
         case couldNotLocateThreadArenaInDebugSymbols
         case unknownSessionType
         case arenaForSessionNotFound
+        case analysisNotPerformed
+        case snapshotOfDifferentProcess
     }
 
     /// The process associated with this analysis
-    private let session: ProcessSession
+    private let session: ProcessWideSession
 
-    // Main arena is excluded from `exploredHeap`, because it is located in the Glibc .data section.
+    // Main arena is excluded from `structures`, because it is located in the Glibc .data section.
     public let mainArena: BoundRemoteMemory<malloc_state>
 
-    /// Thread arenas and their corresponding TBSS heuristic that determined their location
-    public private(set) var threadArenas: [Int32: (base: UInt, tlsResult: TbssSymbolGlibcLdHeuristic)]
+    /// Thread arenas and the location of `thread_arena` in the TLS of the corresponding thread
+    public private(set) var threadArenas: [Int32: (base: UInt, tlsResult: TLSResolver.Location)]
     /// Keys are base addresses of the chunks located in any of the tcaches. Values are the PID/TID of the
     /// corresponding thread. 
     public private(set) var tcacheFreedChunks: [UInt: Int32]
@@ -31,30 +34,78 @@ public final class GlibcMallocAnalyzer {
     public private(set) var fastbinFreedChunks: Set<UInt>
     /// Base addresses of chunks found in any of the arena bins.
     public private(set) var binFreedChunks: Set<UInt>
+    /// Number of chunks in each fastbin and bin of the arenas, keyed by the base of the arena.
+    private(set) var binOccupancy: [UInt: (fastBins: [Int], bins: [Int])] = [:]
+    /// Number of chunks in each non-empty tcache bin, keyed by the PID/TID of the thread.
+    private(set) var tcacheOccupancy: [Int32: [Int: Int]] = [:]
+
+    /// Regions of `malloc_state` and `heap_info` of thread arenas, the working data of the analysis.
+    public private(set) var structures: [GlibcMallocRegion]
+
+    /// Chunks located by the analysis sorted by their address.
+    public private(set) var chunks: ChunkTable
+
+    /// Number of `chunks` taken from the snapshot by `analyze(since:)` instead of walking the heaps.
+    public private(set) var reusedChunkCount = 0
+
+    /// Remote reads and wall time of the phases of the last `analyze()` or `analyze(since:)`,
+    /// counted on the calling thread and on the workers. Unlike `Metrics.current`, sessions analyzed
+    /// concurrently by other threads are not included.
+    public private(set) var metrics = Metrics()
+    /// Work of the workers of the running analysis, added to `metrics` when it ends.
+    private var workerMetrics = Metrics()
+
+    /// The `structures` followed by all the `chunks` as regions. Every chunk is materialized,
+    /// iterate `chunks` in order to avoid it.
+    public var exploredHeap: [GlibcMallocRegion] {
+        structures + chunks.map(\.region)
+    }
+
+    /// Steps of the analysis measured in `Metrics.phases`, under the name `analyze.<rawValue>`.
+    public enum Phase: String, CaseIterable {
+        case localizeThreadArenas
+        case localizeFreedThreadArenas
+        case analyzeThreadArenas
+        case analyzeBins
+        case analyzeTcache
+        case traverseHeaps
+        case statistics
+    }
 
-    /// The collection holding the working data and the result of the analysis.
-    public private(set) var exploredHeap: [GlibcMallocRegion]
+    /// Number of workers walking the bins of arenas, the tcaches and the heaps concurrently.
+    /// With more than one worker, the memory is read by `WorkerSession`s without `ptrace`.
+    /// The result of the analysis does not depend on the number of workers.
+    public var workerCount: Int
+
+    /// Arenas, heaps and lists of freed chunks were located.
+    private var isPrepared = false
+    /// Chunks of all heaps are stored in `chunks`.
+    private var isAnalyzed = false
+    /// Areas of the heaps walked by `analyze()`.
+    private var heapAreas: [MemoryRange] = []
+    /// TLS modules of `thread_arena` and `tcache` resolved for all threads.
+    private var tlsResolver: TLSResolver
 
     /// Initializes the object with some of the data required for successful analysis.
     /// - Parameters:
     ///   - session: Process that shall be analyzed with maps and symbols loaded.
-    public init(session: ProcessSession) throws {
+    ///   - workerCount: Number of workers used by the analysis, 1 analyzes serially.
+    public init(session: ProcessWideSession, workerCount: Int = 1) throws {
         guard 
-            let map = session.map, 
-            let unloadedSymbols = session.unloadedSymbols,
-            let symbols = session.symbols 
+            session.mapIndex != nil, 
+            let symbolIndex = session.symbolIndex
         else {
             throw Error.initializeSessionWithMapAndSymbols
         }
 
-        guard let mainArena = symbols.locate(knownSymbol: .mainArena).first else {
+        guard let mainArena = symbolIndex.locate(knownSymbol: .mainArena).first else {
             throw Error.mainArenaDebugSymbolNotFound
         }
 
         guard 
-            let mainArenaInMap = map.first(where: { $0.range.contains(mainArena.range.lowerBound) }),
+            let mainArenaInMap = session.mapIndex?.region(containing: mainArena.range.lowerBound),
             case let .file(mainArenaFile) = mainArenaInMap.properties.pathname,
-            GlibcAssurances.isFileFromGlibc(mainArenaFile, unloadedSymbols: unloadedSymbols)
+            GlibcAssurances.isFileFromGlibc(mainArenaFile, symbolIndex: symbolIndex)
         else {
             throw Error.onlySupportsGlibcMalloc
         }
@@ -63,42 +114,234 @@ public final class GlibcMallocAnalyzer {
         self.mainArena = try session.checkedLoad(of: malloc_state.self, base: mainArena.range.lowerBound)
         self.threadArenas = [:]
         self.tcacheFreedChunks = [:]
-        self.exploredHeap = []
+        self.structures = []
+        self.chunks = ChunkTable()
         self.fastbinFreedChunks = []
         self.binFreedChunks = []
         self.threadArenas = [:]
+        self.workerCount = workerCount
+        self.tlsResolver = TLSResolver(session: session)
     }
 
     /// Perform the analysis of the Glibc-malloc-allocated heap of the remote process.
     public func analyze() throws {
-        if !exploredHeap.isEmpty {
-            error("Warning: Discarding previous explored Glibc heap.")
-            exploredHeap = []
+        try countMetrics {
+            discardPreviousAnalysis()
+            try prepare()
+            try measure(.traverseHeaps) { try traverseHeaps() }
+            isAnalyzed = true
+        }
+    }
+
+    /// Keeps the result of `analyze()` for the incremental analysis and clears the soft-dirty bits
+    /// of the process, so pages written from now on are known to the next analysis.
+    public func snapshot() throws -> GlibcMallocSnapshot {
+        guard isAnalyzed else {
+            throw Error.analysisNotPerformed
+        }
+
+        try SoftDirty.clear(pid: session.pid)
+        return GlibcMallocSnapshot(pid: session.pid, chunks: chunks, heapAreas: heapAreas)
+    }
+
+    /// Performs the analysis reusing chunks of the snapshot, that are located before the first page
+    /// written since the snapshot was taken. Arenas and lists of freed chunks are located again and
+    /// the heaps are walked from the first written page, so the cost depends on the changes rather
+    /// than the size of the heap.
+    /// - Parameter snapshot: Snapshot of an earlier analysis of the process.
+    /// - Returns: Changes of the active chunks since the snapshot.
+    public func analyze(since snapshot: GlibcMallocSnapshot) throws -> GlibcMallocDiff {
+        guard snapshot.pid == session.pid else {
+            throw Error.snapshotOfDifferentProcess
+        }
+
+        try countMetrics {
+            discardPreviousAnalysis()
+            try prepare()
+            try measure(.traverseHeaps) { try traverseHeaps(reusing: snapshot) }
+            isAnalyzed = true
+        }
+        return GlibcMallocDiff(from: snapshot.chunks, to: chunks)
+    }
+
+    private func discardPreviousAnalysis() {
+        guard isAnalyzed else {
+            return
+        }
+
+        error("Warning: Discarding previous explored Glibc heap.")
+        structures = []
+        chunks = ChunkTable()
+        reusedChunkCount = 0
+        heapAreas = []
+        binOccupancy = [:]
+        tcacheOccupancy = [:]
+        tlsResolver = TLSResolver(session: session)
+        isPrepared = false
+        isAnalyzed = false
+    }
+
+    /// Visits chunks as they are located in the heaps, without storing them in `chunks`. Arenas and
+    /// lists of freed chunks are located first, if it was not done yet. Once `analyze()` was performed,
+    /// the stored `chunks` are visited instead.
+    /// - Parameters:
+    ///   - origin: Visits only chunks with the origin. Heaps of other arenas are not read for `.mainHeap`,
+    ///   `.threadHeap(base:)` and `.freedArena`.
+    ///   - states: Visits only chunks in one of the states, nil for all states.
+    ///   - visitor: Called for each matching chunk in the order of addresses. Return false to stop the enumeration.
+    public func enumerateChunks(
+        origin: GlibcMallocStateOrigin? = nil,
+        states: Set<GlibcMallocChunkState>? = nil,
+        _ visitor: (ChunkTable.Entry) throws -> Bool
+    ) throws {
+        func matches(_ chunk: ChunkTable.Entry) -> Bool {
+            (origin.map { chunk.owner.contains($0) } ?? true) && (states?.contains(chunk.state) ?? true)
+        }
+
+        if isAnalyzed {
+            for chunk in chunks where matches(chunk) {
+                guard try visitor(chunk) else {
+                    return
+                }
+            }
+            return
+        }
+
+        try prepare()
+        let heaps = try [mainArenaHeap()].compactMap { $0 } + threadArenaHeaps()
+        for heap in heaps.sorted(by: { $0.chunkArea.lowerBound < $1.chunkArea.lowerBound }) {
+            let heapOwner = ChunkTable.Owner(threadHeapBase: heap.threadHeapBase, freedArena: heap.freedArena)
+            if let origin = origin, !origin.isTCache, !heapOwner.contains(origin) {
+                continue
+            }
+
+            let completed = try walkChunks(in: heap.chunkArea, owner: heapOwner, in: session) { chunk in
+                try !matches(chunk) || visitor(chunk)
+            }
+            guard completed else {
+                return
+            }
+        }
+    }
+
+    /// Computes statistics of the heap. Chunks are counted while the heaps are walked and are not
+    /// stored, arenas and lists of freed chunks are located first, if it was not done yet. Once
+    /// `analyze()` was performed, the stored `chunks` are counted instead.
+    public func statistics() throws -> GlibcMallocStatistics {
+        try prepare()
+
+        var tops: [UInt: (base: UInt, size: UInt)] = [:]
+        for arenaBase in arenaBases {
+            let arena = try arenaBase == mainArena.segment.lowerBound ? mainArena : session.checkedLoad(of: malloc_state.self, base: arenaBase)
+            guard let top = arena.buffer.top.flatMap(UInt.init(bitPattern:)) else {
+                continue
+            }
+            do {
+                tops[arenaBase] = (top, try session.checkedLoad(of: malloc_chunk.self, base: top).buffer.size)
+            } catch let loadError {
+                error("Warning: Failed to load top chunk " + String(format: "0x%016lx", top) + ": \(loadError)")
+            }
         }
 
-        try localizeThreadArenas()
-        try localizeFreedThreadArenas()
-        try analyzeThreadArenas()
+        let topChunks = Set(tops.values.map(\.base))
+        var statistics = GlibcMallocStatistics(topChunks: topChunks)
+        try measure(.statistics) {
+            if isAnalyzed {
+                for chunk in chunks {
+                    statistics.add(chunk)
+                }
+                return
+            }
+
+            let heaps = try [mainArenaHeap()].compactMap { $0 } + threadArenaHeaps()
+            let walks = try perform(heaps) { heap, session -> GlibcMallocStatistics in
+                var walk = GlibcMallocStatistics(topChunks: topChunks)
+                let owner = ChunkTable.Owner(threadHeapBase: heap.threadHeapBase, freedArena: heap.freedArena)
+                try self.walkChunks(in: heap.chunkArea, owner: owner, in: session) { chunk in
+                    walk.add(chunk)
+                    return true
+                }
+                return walk
+            }
+            for walk in walks {
+                statistics.merge(walk)
+            }
+        }
+
+        let mainArenaBase = mainArena.segment.lowerBound
+        for arenaBase in arenaBases {
+            let index = statistics.arenaIndex(threadHeapBase: arenaBase == mainArenaBase ? nil : arenaBase)
+            if let top = tops[arenaBase] {
+                statistics.arenas[index].topChunkBase = top.base
+                statistics.arenas[index].topChunkSize = top.size
+            }
+            if let occupancy = binOccupancy[arenaBase] {
+                for (bin, count) in occupancy.fastBins.enumerated() where count > 0 {
+                    statistics.arenas[index].fastbinOccupancy[bin] = count
+                }
+                // The first bin of `malloc_state.bins` has the index 1
+                for (bin, count) in occupancy.bins.enumerated() where count > 0 {
+                    statistics.arenas[index].binOccupancy[bin + 1] = count
+                }
+            }
+        }
+
+        for thread in [session as Session] + session.threads {
+            var threadStatistics = GlibcMallocStatistics.Thread(ptraceId: thread.ptraceId, threadHeapBase: threadArenas[thread.ptraceId]?.base)
+            threadStatistics.tcache = statistics.tcacheChunks[thread.ptraceId] ?? GlibcMallocStatistics.Counter()
+            threadStatistics.tcacheOccupancy = tcacheOccupancy[thread.ptraceId] ?? [:]
+            statistics.threads.append(threadStatistics)
+        }
+
+        statistics.sort()
+        return statistics
+    }
+
+    /// Locates arenas, their heaps and all the lists of freed chunks.
+    private func prepare() throws {
+        guard !isPrepared else {
+            return
+        }
+
+        try measure(.localizeThreadArenas) { try localizeThreadArenas() }
+        try measure(.localizeFreedThreadArenas) { try localizeFreedThreadArenas() }
+        try measure(.analyzeThreadArenas) { try analyzeThreadArenas() }
         try analyzeFreed()
-        try traverseMainArenaChunks()
-        try traverseThreadArenaChunks()
+        isPrepared = true
     }
 
-    /// Filters the results in the `exloredHeap` for a certain thread.
+    /// Adds the wall time of the body to the duration of the phase in `Metrics`.
+    private func measure(_ phase: Phase, _ body: () throws -> Void) rethrows {
+        try Metrics.measure("analyze." + phase.rawValue, body)
+    }
+
+    /// Stores the work of the calling thread and of the workers during the body in `metrics`.
+    private func countMetrics(_ body: () throws -> Void) rethrows {
+        let before = Metrics.currentThread
+        workerMetrics = Metrics()
+        defer { metrics = Metrics.currentThread - before + workerMetrics }
+        try body()
+    }
+
+    /// Filters the results of the analysis for a certain thread. Chunks are filtered by their owner.
     /// - Parameter session: Process or Thread session
-    public func view(for session: Session) throws -> [GlibcMallocRegion] {
+    public func view(for session: Session) throws -> GlibcMallocView {
         let requestedOrigin: GlibcMallocStateOrigin
-        if let session = session as? ThreadSession {
-            guard let threadArena = threadArenas[session.tid] else {
+        if session is ProcessWideSession {
+            requestedOrigin = .mainHeap
+        } else if self.session.threads.contains(where: { $0 === session }) {
+            guard let threadArena = threadArenas[session.ptraceId] else {
                 throw Error.arenaForSessionNotFound
             }
             requestedOrigin = .threadHeap(base: threadArena.base)
-        } else if session is ProcessSession {
-            requestedOrigin = .mainHeap
         } else {
             throw Error.unknownSessionType
         }
-        return exploredHeap.filter { $0.properties.origin.contains(requestedOrigin) }
+        return GlibcMallocView(
+            structures: structures.filter { $0.properties.origin.contains(requestedOrigin) },
+            chunks: chunks,
+            indices: chunks.indices { $0.contains(requestedOrigin) }
+        )
     }
 
     /// Uses the `main_arena` to localize thread arenas and schedule them for exploration.
@@ -106,7 +349,7 @@ public final class GlibcMallocAnalyzer {
         var currentBase = UInt(bitPattern: mainArena.buffer.next)
         while currentBase != mainArena.segment.lowerBound {
             let threadArena = try session.checkedLoad(of: malloc_state.self, base: currentBase)
-            exploredHeap.append(GlibcMallocRegion(
+            structures.append(GlibcMallocRegion(
                 range: threadArena.segment, 
                 properties: GlibcMallocInfo(rebound: .mallocState, explored: false, origin: [.threadHeap(base: currentBase)])
             ))
@@ -114,17 +357,17 @@ public final class GlibcMallocAnalyzer {
         }
 
         guard 
-            let unloadedSymbols = session.unloadedSymbols,
-            let threadArenaSymbol = GlibcAssurances.glibcOccurances(of: .threadArena, in: unloadedSymbols).first
+            let symbolIndex = session.symbolIndex,
+            let threadArenaSymbol = GlibcAssurances.glibcOccurances(of: .threadArena, in: symbolIndex).first
         else {
             throw Error.couldNotLocateThreadArenaInDebugSymbols
         }
 
-        for thread in session.threadSessions {
-            let tlsValue = try TbssSymbolGlibcLdHeuristic(session: thread, fileName: threadArenaSymbol.file, tbssSymbolName: threadArenaSymbol.name)
-            let arena = try session.checkedLoad(of: Optional<mstate>.self, base: tlsValue.loadedSymbolBase)
+        let locations = try tlsResolver.locate(fileName: threadArenaSymbol.file, symbolName: threadArenaSymbol.name, in: session.threads)
+        for location in locations {
+            let arena = try session.checkedLoad(of: Optional<mstate>.self, base: location.symbolBase)
             if let base = arena.buffer.flatMap(UInt.init(bitPattern:)) {
-                threadArenas[thread.tid] = (base, tlsValue)
+                threadArenas[location.ptraceId] = (base, location)
             }
         }
     }
@@ -134,7 +377,7 @@ public final class GlibcMallocAnalyzer {
         var nextBase = mainArena.buffer.next_free.flatMap(UInt.init(bitPattern:))
         while let currentBase = nextBase {
             let threadArena = try session.checkedLoad(of: malloc_state.self, base: currentBase)
-            exploredHeap.append(GlibcMallocRegion(
+            structures.append(GlibcMallocRegion(
                 range: threadArena.segment, 
                 properties: GlibcMallocInfo(rebound: .mallocState, explored: false, origin: [
                     .threadHeap(base: currentBase),
@@ -148,8 +391,8 @@ public final class GlibcMallocAnalyzer {
     /// Locates all the heap blocks for thread arenas. Those blocks are exclusive to the
     /// thread arenas and are necessary when trying to locate chunks belonging to thread arenas.
     func analyzeThreadArenas() throws {
-        let exploredCopy = exploredHeap
-        for (index, region) in exploredCopy.enumerated() {
+        let structuresCopy = structures
+        for (index, region) in structuresCopy.enumerated() {
             guard 
                 !region.properties.explored,
                 case .mallocState = region.properties.rebound
@@ -167,13 +410,13 @@ public final class GlibcMallocAnalyzer {
             }
 
             for heapInfo in heapInfoBlocks {
-                exploredHeap.append(GlibcMallocRegion(
+                structures.append(GlibcMallocRegion(
                     range: heapInfo.segment, 
                     properties: GlibcMallocInfo(rebound: .heapInfo, explored: false, origin: origin)
                 ))
             }
 
-            exploredHeap[index].properties.explored = true
+            structures[index].properties.explored = true
         }
     }
 
@@ -198,63 +441,93 @@ public final class GlibcMallocAnalyzer {
         return result
     }
 
-    private func analyzeFreed() throws {
-        try analyzeFastBins(arenaBase: mainArena.segment.lowerBound)
-        try analyzeBins(arenaBase: mainArena.segment.lowerBound)
-        try analyzeTcache()
-
-        for region in exploredHeap {
-            guard 
-                case .mallocState = region.properties.rebound
-            else {
-                continue
+    /// Base addresses of the main arena and the located thread arenas.
+    private var arenaBases: [UInt] {
+        [mainArena.segment.lowerBound] + structures.compactMap { region -> UInt? in
+            guard case .mallocState = region.properties.rebound else {
+                return nil
             }
+            return region.range.lowerBound
+        }
+    }
 
-            try analyzeFastBins(arenaBase: region.range.lowerBound)
-            try analyzeBins(arenaBase: region.range.lowerBound)
+    private func analyzeFreed() throws {
+        let arenaBases = arenaBases
+
+        try measure(.analyzeBins) {
+            let freed = try perform(arenaBases) { arenaBase, session in
+                (
+                    fastBins: try self.analyzeFastBins(arenaBase: arenaBase, in: session),
+                    bins: try self.analyzeBins(arenaBase: arenaBase, in: session)
+                )
+            }
+            for (arenaBase, arena) in zip(arenaBases, freed) {
+                for list in arena.fastBins {
+                    fastbinFreedChunks.formUnion(list)
+                }
+                for list in arena.bins {
+                    binFreedChunks.formUnion(list)
+                }
+                binOccupancy[arenaBase] = (arena.fastBins.map(\.count), arena.bins.map(\.count))
+            }
         }
+
+        try measure(.analyzeTcache) { try analyzeTcache() }
     }
 
     /// Loads all fastbin chunk base addresses for given arena
-    /// - Parameter arenaBase: Base address of an arena that should be looked into
-    private func analyzeFastBins(arenaBase: UInt) throws {
+    /// - Parameters:
+    ///   - arenaBase: Base address of an arena that should be looked into
+    ///   - session: Session used to read the memory
+    /// - Returns: Base addresses of the chunks of each fastbin.
+    private func analyzeFastBins(arenaBase: UInt, in session: Session) throws -> [[UInt]] {
         let firstOffset = MemoryLayout<malloc_state>.offset(of: \.fastbinsY.0)!
         let fastbinPtrSize = MemoryLayout<mfastbinptr>.size
         let fdOffset = MemoryLayout<malloc_chunk>.offset(of: \.fd)!
         let fastBinsCount = macro_NFASTBINS()
 
-        let fastBinFirstChunkBases = try (0..<fastBinsCount).compactMap { index in
+        let fastBinFirstChunkBases = try (0..<fastBinsCount).map { index in
             let base = arenaBase + UInt(firstOffset - fdOffset + index * fastbinPtrSize)
             // Address of index 0 is the same as the index of the arena
             let chunk = try session.checkedLoad(of: malloc_chunk.self, base: base, skipMismatchTypeCheck: index == 0)
             return chunk.buffer.fd.flatMap { UInt(bitPattern: $0) }
         }
 
-        try fastBinFirstChunkBases.forEach { currentFastbin in
-            var nextChunk: UInt? = currentFastbin
+        // A cycle ends only its own bin, the following bins of the arena are still walked
+        var result: [[UInt]] = []
+        for firstChunk in fastBinFirstChunkBases {
+            var list: [UInt] = []
+            var visited: Set<UInt> = []
+            defer { result.append(list) }
+            var nextChunk: UInt? = firstChunk
 
             while let current = nextChunk {
-                self.fastbinFreedChunks.insert(current)
+                list.append(current)
+                visited.insert(current)
                 let chunk = try session.checkedLoad(of: malloc_chunk.self, base: current)
                 nextChunk = chunk.deobfuscate(pointer: \.fd).flatMap(UInt.init(bitPattern:))
 
-                guard current != nextChunk else {
-                    error("Error: Endless cycle in chunk \(String(format: "%016lx", current)) while iterating bin  \(String(format: "%016lx", currentFastbin))")
-                    return
+                if let next = nextChunk, visited.contains(next) {
+                    error("Error: Endless cycle in chunk \(String(format: "%016lx", current)) while iterating bin  \(String(format: "%016lx", firstChunk ?? 0))")
+                    break
                 }
             }
         }
+        return result
     }
 
     /// Loads all bin chunk base addresses for given arena
-    /// - Parameter arenaBase: Base address of an arena that should be looked into
-    private func analyzeBins(arenaBase: UInt) throws {
+    /// - Parameters:
+    ///   - arenaBase: Base address of an arena that should be looked into
+    ///   - session: Session used to read the memory
+    /// - Returns: Base addresses of the chunks of each bin, the first is the unsorted bin.
+    private func analyzeBins(arenaBase: UInt, in session: Session) throws -> [[UInt]] {
         let firstOffset = MemoryLayout<malloc_state>.offset(of: \.bins.0)!
         let binPtrSize = MemoryLayout<mchunkptr>.size * 2
         let fdOffset = MemoryLayout<malloc_chunk>.offset(of: \.fd)!
         let binsTotal = macro_NBINS_TOTAL() / 2
 
-        let binFirstChunkBases: [(breaker: UInt, base: UInt)] = try (0..<binsTotal).compactMap { index -> (UInt, UInt)? in
+        let binFirstChunkBases: [(breaker: UInt, base: UInt)?] = try (0..<binsTotal).map { index -> (UInt, UInt)? in
             let base = UInt(firstOffset - fdOffset + index * binPtrSize) + arenaBase
             let chunk = try session.checkedLoad(of: malloc_chunk.self, base: base)
             guard 
@@ -266,43 +539,64 @@ public final class GlibcMallocAnalyzer {
             return (breaker: base, base: fd)
         }
 
-        try binFirstChunkBases.forEach { item in
-            var nextChunk: UInt? = item.base
-            while let current = nextChunk, current != item.breaker {
-                self.binFreedChunks.insert(current)
+        var result: [[UInt]] = []
+        for item in binFirstChunkBases {
+            var list: [UInt] = []
+            var nextChunk: UInt? = item?.base
+            while let current = nextChunk, current != item?.breaker {
+                list.append(current)
                 let chunk = try session.checkedLoad(of: malloc_chunk.self, base: current)
                 nextChunk = chunk.buffer.fd.flatMap(UInt.init(bitPattern:))
             }
+            result.append(list)
         }
+        return result
+    }
+
+    /// Non-empty tcache bin of a thread scheduled for iteration.
+    private struct TcacheList {
+        /// The PID/TID of the thread owning the tcache.
+        let ptraceId: Int32
+        /// Index of the tcache bin.
+        let index: Int
+        /// The first entry of the linked list.
+        let firstChunkBase: UInt
+        /// The number of entries reported by the tcache.
+        let count: UInt16
     }
 
     /// Locates tcache symbols and performs tcache analysis for all threads.
     private func analyzeTcache() throws {
         guard 
-            let unloadedSymbols = session.unloadedSymbols,
-            let tCacheSymbol = GlibcAssurances.glibcOccurances(of: .tCache, in: unloadedSymbols).first
+            let symbolIndex = session.symbolIndex,
+            let tCacheSymbol = GlibcAssurances.glibcOccurances(of: .tCache, in: symbolIndex).first
         else {
             throw Error.couldNotLocateTcacheInDebugSymbols
         }
 
-        try analyzeTcacheFromTLS(of: self.session, tCacheSymbol: tCacheSymbol)
+        // Locating the TLS requires registers of the threads, therefore it is done by the tracer
+        let locations = try tlsResolver.locate(fileName: tCacheSymbol.file, symbolName: tCacheSymbol.name, in: [session] + session.threads)
+        let lists = try locations.flatMap { try tcacheLists(at: $0) }
 
-        for threadSession in self.session.threadSessions {
-            try analyzeTcacheFromTLS(of: threadSession, tCacheSymbol: tCacheSymbol)
+        let chunkUserSpaceOffset = UInt(MemoryLayout<malloc_chunk>.offset(of: \.fd)!)
+        let entries = try perform(lists) { list, session in
+            try self.iterateTcacheChunks(from: list.firstChunkBase, count: list.count, in: session)
+        }
+        for (list, entries) in zip(lists, entries) {
+            for base in entries {
+                tcacheFreedChunks[base - chunkUserSpaceOffset] = list.ptraceId
+            }
+            tcacheOccupancy[list.ptraceId, default: [:]][list.index] = entries.count
         }
     }
 
-    /// Traverses array of potention tcache entries and if in any array item there is a chunk
-    /// stored, calls a function to travers the linked list of the stored chunks.
-    /// - Parameters:
-    ///   - taskSession: The thread on which the tcache should be explored
-    ///   - tCacheSymbol: The symbol representing the tcache used to compute its offset in TLS
-    private func analyzeTcacheFromTLS(of taskSession: Session, tCacheSymbol: UnloadedSymbolInfo) throws {
-        let tCacheLocation = try TbssSymbolGlibcLdHeuristic(session: taskSession, fileName: tCacheSymbol.file, tbssSymbolName: tCacheSymbol.name)
-        let tCacheTLSPtr = try session.checkedLoad(of: swift_inspect_bridge__tcache_perthread_t.self, base: tCacheLocation.loadedSymbolBase)
+    /// Traverses array of potention tcache entries and collects the non-empty ones.
+    /// - Parameter tCacheLocation: Location of the `tcache` in the TLS of the thread.
+    private func tcacheLists(at tCacheLocation: TLSResolver.Location) throws -> [TcacheList] {
+        let tCacheTLSPtr = try session.checkedLoad(of: swift_inspect_bridge__tcache_perthread_t.self, base: tCacheLocation.symbolBase)
 
         guard let tCachePtr = tCacheTLSPtr.buffer.tcache_ptr else {
-            return
+            return []
         }
         let tCachePtrBase = UInt(bitPattern: tCachePtr)
         
@@ -312,6 +606,7 @@ public final class GlibcMallocAnalyzer {
         let entryOffset = UInt(MemoryLayout<tcache_perthread_struct>.offset(of: \.entries.0)!)
         let entrySize: UInt = 8 // Size of pointer
 
+        var lists: [TcacheList] = []
         for i in 0..<Cutils.TCACHE_MAX_BINS {
             let i = UInt(i)
             let count = try session.checkedLoad(of: UInt16.self, base: tCachePtrBase + countsOffset + i * countsSize)
@@ -324,54 +619,145 @@ public final class GlibcMallocAnalyzer {
                 error("Error: tcache " + String(format: "%016lx", tCachePtrBase) + " in index \(i) is null but count is greater than 0")
                 continue
             }
-            try iterateTcacheChunks(from: firstChunkBase, count: count.buffer, taskSession: taskSession)
+            lists.append(TcacheList(ptraceId: tCacheLocation.ptraceId, index: Int(i), firstChunkBase: firstChunkBase, count: count.buffer))
         }
+        return lists
     }
 
     /// Iterates all chunks in the tcache linked list
     /// - Parameters:
     ///   - baseChunk: The first chunk in the tcache linked list
     ///   - count: The expected number of items
-    ///   - taskSession: The session
-    private func iterateTcacheChunks(from baseChunk: UInt, count: UInt16, taskSession: Session) throws {
-        let chunkUserSpactOffset = UInt(MemoryLayout<malloc_chunk>.offset(of: \.fd)!)
-
+    ///   - session: Session used to read the memory
+    /// - Returns: Addresses of the tcache entries in the order of the list.
+    private func iterateTcacheChunks(from baseChunk: UInt, count: UInt16, in session: Session) throws -> [UInt] {
+        var result: [UInt] = []
         var currentBase: UInt? = baseChunk
         for i in 0..<(count + 1) {
             guard let base = currentBase else {
                 if i != count {
                     error("Error: tcache entry " + String(format: "%016lx", baseChunk) + " ended iterating after \(i) steps, expected \(count) steps")
                 }
-                return
+                return result
             }
             guard i < count else {
                 error("Error: tcache entry " + String(format: "%016lx", baseChunk) + " exceeded the expected number of iterations!")
-                return
+                return result
             }
             let chunk = try session.checkedLoad(of: tcache_entry.self, base: base)
             let nextPointer = chunk.deobfuscate(pointer: \.next)
 
             currentBase = nextPointer.flatMap(UInt.init(bitPattern:))
-            tcacheFreedChunks[base - chunkUserSpactOffset] = taskSession.ptraceId
+            result.append(base)
+        }
+        return result
+    }
+
+    /// Chunk area of a single heap scheduled for traversal.
+    private struct HeapTraversal {
+        /// The area which should contain chunks.
+        let chunkArea: MemoryRange
+        /// Base address of the thread arena, nil for the main arena.
+        let threadHeapBase: UInt?
+        /// The heap belongs to an arena on the free list.
+        let freedArena: Bool
+        /// Index of the `heapInfo` region in `structures`, nil for the main arena.
+        let regionIndex: Int?
+    }
+
+    /// Locates all chunks in the main arena and in all unexplored heaps of thread arenas.
+    /// - Parameter snapshot: Snapshot, whose chunks located on pages not written since are reused.
+    func traverseHeaps(reusing snapshot: GlibcMallocSnapshot? = nil) throws {
+        let heaps = try [mainArenaHeap()].compactMap { $0 } + threadArenaHeaps()
+
+        var reused = heaps.map { _ in ChunkTable() }
+        var walks = heaps
+        if let snapshot = snapshot {
+            for (index, heap) in heaps.enumerated() where snapshot.heapAreas.contains(where: { $0.lowerBound == heap.chunkArea.lowerBound }) {
+                reused[index] = try reusableChunks(of: heap, from: snapshot)
+                let restart = reused[index].last?.range.upperBound ?? heap.chunkArea.lowerBound
+                walks[index] = HeapTraversal(
+                    chunkArea: restart..<max(restart, heap.chunkArea.upperBound),
+                    threadHeapBase: heap.threadHeapBase,
+                    freedArena: heap.freedArena,
+                    regionIndex: heap.regionIndex
+                )
+            }
+        }
+
+        let tables = try perform(walks) { heap, session in
+            session.memory.prefetch(heap.chunkArea)
+            return try self.traverseChunks(in: heap.chunkArea, threadHeapBase: heap.threadHeapBase, freedArena: heap.freedArena, in: session)
+        }
+
+        // Heaps do not overlap, appending them by their address keeps the table sorted
+        let order = heaps.indices.sorted { heaps[$0].chunkArea.lowerBound < heaps[$1].chunkArea.lowerBound }
+        for index in order {
+            reusedChunkCount += reused[index].count
+            chunks.append(contentsOf: reused[index])
+            chunks.append(contentsOf: tables[index])
+            heapAreas.append(heaps[index].chunkArea)
+
+            if let regionIndex = heaps[index].regionIndex {
+                structures[regionIndex].properties.explored = true
+            }
         }
+        chunks.sort()
     }
 
-    /// Executed function that locates all chunks in main arena.
-    func traverseMainArenaChunks() throws {
+    /// Chunks of the snapshot in the heap, that together with the header of the following chunk
+    /// are located before the first page written since the snapshot. Their boundaries can not
+    /// change without a write to those pages, their states are determined by the current lists
+    /// of freed chunks.
+    private func reusableChunks(of heap: HeapTraversal, from snapshot: GlibcMallocSnapshot) throws -> ChunkTable {
+        let firstDirtyPage = try SoftDirty.firstDirtyPage(pid: session.pid, in: heap.chunkArea)
+        let limit = firstDirtyPage.map { $0 > Chunk.chunkContentOffset ? $0 - Chunk.chunkContentOffset : 0 } ?? heap.chunkArea.upperBound
+        let heapOwner = ChunkTable.Owner(threadHeapBase: heap.threadHeapBase, freedArena: heap.freedArena)
+
+        var table = ChunkTable()
+        for index in snapshot.chunks.indices(overlapping: heap.chunkArea) {
+            let chunk = snapshot.chunks[index]
+            guard chunk.base >= heap.chunkArea.lowerBound, chunk.range.upperBound <= limit else {
+                break
+            }
+
+            var owner = heapOwner
+            let state: GlibcMallocChunkState
+            if let pthreadId = tcacheFreedChunks[chunk.base] {
+                state = .heapTCache
+                owner.tcacheThread = pthreadId
+            } else if binFreedChunks.contains(chunk.base) {
+                state = .heapBin
+            } else if fastbinFreedChunks.contains(chunk.base) {
+                state = .heapFastBin
+            } else if chunk.state == .heapBin || chunk.state == .heapNoBinFree {
+                // `PREV_INUSE` of the following chunk is still cleared
+                state = .heapNoBinFree
+            } else {
+                state = .heapActive
+            }
+
+            table.append(ChunkTable.Entry(base: chunk.base, size: chunk.size, state: state, owner: owner))
+        }
+        return table
+    }
+
+    /// Determines the chunk area of the main arena.
+    private func mainArenaHeap() -> HeapTraversal? {
         let topChunk = UInt(bitPattern: mainArena.buffer.top)
         guard let mainHeapMap = getMapIndex(for: topChunk) else {
             error("Error: Top chunk of main arena is outside mapped memory!")
-            return
+            return nil
         }
 
-        let chunks = try traverseChunks(in: session.map![mainHeapMap].range.lowerBound..<topChunk)
-        exploredHeap.append(contentsOf: chunks)
+        let mainHeapRange = session.map![mainHeapMap].range.lowerBound..<topChunk
+        return HeapTraversal(chunkArea: mainHeapRange, threadHeapBase: nil, freedArena: false, regionIndex: nil)
     }
 
-    /// Executed function that locates all chunks in thread arenas.
-    func traverseThreadArenaChunks() throws {
-        let exploredCopy = exploredHeap
-        for (index, region) in exploredCopy.enumerated() {
+    /// Determines the chunk areas of all unexplored heaps of thread arenas.
+    private func threadArenaHeaps() throws -> [HeapTraversal] {
+        var heaps: [HeapTraversal] = []
+        for (index, region) in structures.enumerated() {
             guard 
                 !region.properties.explored,
                 case .heapInfo = region.properties.rebound
@@ -397,17 +783,14 @@ public final class GlibcMallocAnalyzer {
                 assumedRange = (assumedRange.lowerBound + alignment)..<assumedRange.upperBound
             }
 
-            var chunks = try traverseChunks(in: assumedRange, threadHeapBase: threadArena.segment.lowerBound)
-            if region.properties.origin.contains(.freedArena) {
-                for i in 0..<chunks.count {
-                    chunks[i].properties.origin.append(.freedArena)
-                }
-            }
-
-            exploredHeap.append(contentsOf: chunks)
-
-            exploredHeap[index].properties.explored = true
+            heaps.append(HeapTraversal(
+                chunkArea: assumedRange,
+                threadHeapBase: threadArena.segment.lowerBound,
+                freedArena: region.properties.origin.contains(.freedArena),
+                regionIndex: index
+            ))
         }
+        return heaps
     }
 
     /// Locates all the chunks in a specific region of memory. It is invariant, that there is a valid chunk
@@ -415,22 +798,51 @@ public final class GlibcMallocAnalyzer {
     /// - Parameters:
     ///   - chunkArea: The area which should contain chunks.
     ///   - threadHeapBase: If the arena which these chunks belong to is not main_arena, enter its base address.
-    /// - Returns: List of chunks.
-    func traverseChunks(in chunkArea: Range<UInt>, threadHeapBase: UInt? = nil) throws -> [GlibcMallocRegion] {
-        var chunks: [GlibcMallocRegion] = []
+    ///   - freedArena: The arena which these chunks belong to is freed.
+    ///   - session: Session used to read the memory, the analyzed process by default.
+    /// - Returns: Table of chunks in the order of their addresses.
+    func traverseChunks(in chunkArea: Range<UInt>, threadHeapBase: UInt? = nil, freedArena: Bool = false, in session: Session? = nil) throws -> ChunkTable {
+        var chunks = ChunkTable()
+        let owner = ChunkTable.Owner(threadHeapBase: threadHeapBase, freedArena: freedArena)
+        try walkChunks(in: chunkArea, owner: owner, in: session ?? self.session) { chunk in
+            chunks.append(chunk)
+            return true
+        }
+        return chunks
+    }
+
+    /// Walks the chunks of the area in the order of their addresses. The state of a chunk is known
+    /// only after the header of the following chunk is loaded, therefore each chunk is visited
+    /// after its successor is loaded.
+    /// - Parameters:
+    ///   - chunkArea: The area which should contain chunks.
+    ///   - heapOwner: Owner of the chunks in the area.
+    ///   - session: Session used to read the memory.
+    ///   - visit: Called for each chunk. Return false to stop the walk.
+    /// - Returns: False, if the walk was stopped.
+    @discardableResult
+    private func walkChunks(
+        in chunkArea: Range<UInt>,
+        owner heapOwner: ChunkTable.Owner,
+        in session: Session,
+        _ visit: (ChunkTable.Entry) throws -> Bool
+    ) throws -> Bool {
+        var pending: ChunkTable.Entry?
         var currentTop: UInt = chunkArea.lowerBound
 
         while chunkArea.contains(currentTop) {
             let chunk = try session.checkedLoad(of: malloc_chunk.self, base: currentTop)
-            if chunk.buffer.isPreviousInUse == false, chunks.count > 0 {
-                if 
-                    case let .mallocChunk(state) = chunks[chunks.count - 1].properties.rebound, 
-                    ![GlibcMallocChunkState.heapFastBin, .heapBin, .heapTCache].contains(state)
-                {
-                    error("Error: Chunk \(chunks[chunks.count - 1].range) is before chunk marked as `previous is not active` and has state \(state)")
-                    chunks[chunks.count - 1].properties.rebound = .mallocChunk(.heapNoBinFree)
+            if var previous = pending {
+                if chunk.buffer.isPreviousInUse == false, ![GlibcMallocChunkState.heapFastBin, .heapBin, .heapTCache].contains(previous.state) {
+                    error("Error: Chunk \(previous.range) is before chunk marked as `previous is not active` and has state \(previous.state)")
+                    previous = ChunkTable.Entry(base: previous.base, size: previous.size, state: .heapNoBinFree, owner: previous.owner)
+                }
+                pending = nil
+                guard try visit(previous) else {
+                    return false
                 }
             }
+
             let chunkRange = currentTop..<(currentTop + chunk.buffer.size)
             guard chunkRange.count > 0 else {
                 error("Error: Chunk \(chunkRange) with range 0 in area \(chunkArea)")
@@ -438,11 +850,11 @@ public final class GlibcMallocAnalyzer {
             }
 
             var chunkState: GlibcMallocChunkState
-            var origin: [GlibcMallocStateOrigin] = [threadHeapBase == nil ? .mainHeap : .threadHeap(base: threadHeapBase!)]
+            var owner = heapOwner
 
             if let pthreadId = tcacheFreedChunks[chunkRange.lowerBound] {
                 chunkState = .heapTCache
-                origin.append(.tlsTCacge(pthreadId: pthreadId))
+                owner.tcacheThread = pthreadId
             }else if binFreedChunks.contains(chunkRange.lowerBound) {
                 chunkState = .heapBin
             } else if fastbinFreedChunks.contains(chunkRange.lowerBound) {
@@ -451,18 +863,40 @@ public final class GlibcMallocAnalyzer {
                 chunkState = .heapActive
             }
 
-            chunks.append(GlibcMallocRegion(
-                range: chunkRange, 
-                properties: .init(rebound: .mallocChunk(chunkState), explored: true, origin: origin)
-            ))
+            pending = ChunkTable.Entry(base: chunkRange.lowerBound, size: UInt(chunkRange.count), state: chunkState, owner: owner)
             currentTop = chunkRange.upperBound
         }
-        return chunks
+
+        if let last = pending {
+            return try visit(last)
+        }
+        return true
+    }
+
+    /// Performs the tasks with `workerCount` workers, see `Session.perform(_:workerCount:_:)`.
+    private func perform<Task, Output>(_ tasks: [Task], _ body: (Task, Session) throws -> Output) throws -> [Output] {
+        let callingThread = pthread_self()
+        let lock = NSLock()
+        return try session.perform(tasks, workerCount: workerCount) { task, session in
+            // Work of the calling thread, which may run some of the tasks, is counted by `countMetrics`
+            guard pthread_equal(pthread_self(), callingThread) == 0 else {
+                return try body(task, session)
+            }
+
+            let before = Metrics.currentThread
+            defer {
+                let work = Metrics.currentThread - before
+                lock.lock()
+                workerMetrics = workerMetrics + work
+                lock.unlock()
+            }
+            return try body(task, session)
+        }
     }
 
     /// Gets index of item in the map (stored in the Session) that contains the address.
     func getMapIndex(for base: UInt) -> Int? {
-        guard let index = session.map!.firstIndex(where: { $0.range.contains(base)} ) else {
+        guard let index = session.mapIndex!.index(containing: base) else {
             error("Warning: Didn't find map page for top chunk " + String(format: "0x%016lx", base))
             return nil 
         }
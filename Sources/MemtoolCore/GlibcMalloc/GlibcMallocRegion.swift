@@ -1,4 +1,4 @@
-public enum GlibcMallocChunkState: Equatable {
+public enum GlibcMallocChunkState: UInt8, Equatable {
     /// Chunk is mmapped and not book-kept by any arena
     case mmapped
     /// Chunk is active
@@ -45,6 +45,14 @@ public enum GlibcMallocStateOrigin: Equatable {
     case threadHeap(base: UInt)
     /// The chunk was found in a freed thread arena.
     case freedArena
+
+    /// The origin describes a tcache rather than a heap.
+    var isTCache: Bool {
+        if case .tlsTCacge = self {
+            return true
+        }
+        return false
+    }
 }
 
 /// Information associated with results of glibc malloc analysis.
@@ -58,3 +66,24 @@ public struct GlibcMallocInfo: Equatable {
 }
 
 public typealias GlibcMallocRegion = MemoryRegion<GlibcMallocInfo>
+
+/// Results of the Glibc malloc analysis for a single arena: the `structures` followed by the
+/// `chunks` as regions. Chunks are materialized only when they are accessed as regions.
+public struct GlibcMallocView: RandomAccessCollection {
+    /// Regions of `malloc_state` and `heap_info` of the arena.
+    public let structures: [GlibcMallocRegion]
+    /// Chunks of the arena in the order of their addresses.
+    public let chunks: LazyMapCollection<[Int], ChunkTable.Entry>
+
+    init(structures: [GlibcMallocRegion], chunks table: ChunkTable, indices: [Int]) {
+        self.structures = structures
+        self.chunks = indices.lazy.map { table[$0] }
+    }
+
+    public var startIndex: Int { 0 }
+    public var endIndex: Int { structures.count + chunks.count }
+
+    public subscript(position: Int) -> GlibcMallocRegion {
+        position < structures.count ? structures[position] : chunks[position - structures.count].region
+    }
+}
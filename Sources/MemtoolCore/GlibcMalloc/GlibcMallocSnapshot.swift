@@ -0,0 +1,61 @@
+/// Result of an analysis kept for the incremental analysis of a later sample of the same process.
+/// Created by `GlibcMallocAnalyzer.snapshot()`, which also starts tracking of written pages.
+public struct GlibcMallocSnapshot {
+    /// The PID of the analyzed process.
+    public let pid: Int32
+    /// Chunks located by the analysis sorted by their address.
+    public let chunks: ChunkTable
+    /// Areas of the heaps walked by the analysis.
+    public let heapAreas: [MemoryRange]
+}
+
+/// Differences of active chunks between two analyses of the same process.
+public struct GlibcMallocDiff {
+    /// Chunks that are active and were free or did not exist.
+    public private(set) var allocated: [ChunkTable.Entry] = []
+    /// Chunks that were active and are free or do not exist anymore.
+    public private(set) var freed: [ChunkTable.Entry] = []
+    /// Active chunks with the same base address and a different size.
+    public private(set) var resized: [(old: ChunkTable.Entry, new: ChunkTable.Entry)] = []
+
+    public var isEmpty: Bool { allocated.isEmpty && freed.isEmpty && resized.isEmpty }
+
+    /// Compares chunks of two analyses.
+    /// - Parameters:
+    ///   - old: Sorted chunks of the earlier analysis.
+    ///   - new: Sorted chunks of the later analysis.
+    public init(from old: ChunkTable, to new: ChunkTable) {
+        var oldIndex = old.startIndex
+        var newIndex = new.startIndex
+
+        while oldIndex < old.endIndex || newIndex < new.endIndex {
+            let oldChunk = oldIndex < old.endIndex ? old[oldIndex] : nil
+            let newChunk = newIndex < new.endIndex ? new[newIndex] : nil
+
+            if let oldChunk = oldChunk, let newChunk = newChunk, oldChunk.base == newChunk.base {
+                switch (oldChunk.state.isActive, newChunk.state.isActive) {
+                case (true, true) where oldChunk.size != newChunk.size:
+                    resized.append((old: oldChunk, new: newChunk))
+                case (true, false):
+                    freed.append(oldChunk)
+                case (false, true):
+                    allocated.append(newChunk)
+                default:
+                    break
+                }
+                oldIndex += 1
+                newIndex += 1
+            } else if let oldChunk = oldChunk, newChunk.map({ oldChunk.base < $0.base }) ?? true {
+                if oldChunk.state.isActive {
+                    freed.append(oldChunk)
+                }
+                oldIndex += 1
+            } else if let newChunk = newChunk {
+                if newChunk.state.isActive {
+                    allocated.append(newChunk)
+                }
+                newIndex += 1
+            }
+        }
+    }
+}
@@ -0,0 +1,231 @@
+/// Aggregated numbers of the glibc malloc heap, computed by `GlibcMallocAnalyzer.statistics()`
+/// while the heaps are walked, without storing the chunks. The size of the result depends only
+/// on the number of arenas, threads and size classes, so it is cheap to compute and keep for
+/// large processes over time.
+public struct GlibcMallocStatistics {
+    /// Number and total size of chunks.
+    public struct Counter: Equatable {
+        public var count = 0
+        public var bytes: UInt = 0
+
+        public init() {}
+
+        public mutating func add(size: UInt) {
+            count += 1
+            bytes += size
+        }
+
+        public static func += (lhs: inout Counter, rhs: Counter) {
+            lhs.count += rhs.count
+            lhs.bytes += rhs.bytes
+        }
+    }
+
+    /// Active and free chunks of a size class.
+    public struct SizeClass: Equatable {
+        public var active = Counter()
+        public var free = Counter()
+
+        public init() {}
+
+        public static func += (lhs: inout SizeClass, rhs: SizeClass) {
+            lhs.active += rhs.active
+            lhs.free += rhs.free
+        }
+    }
+
+    public struct Arena {
+        /// Base address of the thread arena, nil for the main arena.
+        public let threadHeapBase: UInt?
+        /// The arena is on the list of free arenas.
+        public var freedArena = false
+
+        /// Chunks in use, including the mmapped ones.
+        public var active = Counter()
+        /// Chunks in any of the lists of freed chunks or marked as free, without the top chunk.
+        public var free = Counter()
+        public var states: [GlibcMallocChunkState: Counter] = [:]
+        /// Chunks keyed by the power of two size class, see `powerOfTwoClass(of:)`.
+        public var powerOfTwoClasses: [UInt: SizeClass] = [:]
+        /// Chunks keyed by the index of the glibc bin matching their size, see `binIndex(of:)`.
+        public var binClasses: [Int: SizeClass] = [:]
+
+        /// Number of chunks of the non-empty fastbins, keyed by the index of the fastbin.
+        public var fastbinOccupancy: [Int: Int] = [:]
+        /// Number of chunks of the non-empty bins, keyed by the glibc bin index (1 is the unsorted bin).
+        public var binOccupancy: [Int: Int] = [:]
+
+        /// Base of the top chunk, nil if it could not be read.
+        public var topChunkBase: UInt?
+        /// Size of the top chunk, the memory of the arena available without searching the bins.
+        public var topChunkSize: UInt = 0
+
+        /// The largest run of adjacent free chunks.
+        public var largestFreeExtent: UInt = 0
+        /// Share of the free bytes, that are not part of the largest free extent. 0 if all the free
+        /// memory is contiguous, close to 1 if it is scattered in small pieces.
+        public var fragmentation: Double {
+            free.bytes == 0 ? 0 : 1 - Double(largestFreeExtent) / Double(free.bytes)
+        }
+
+        /// End of the last free chunk of the walk and the size of its run.
+        private var freeRunEnd: UInt = 0
+        private var freeRunBytes: UInt = 0
+
+        public init(threadHeapBase: UInt?) {
+            self.threadHeapBase = threadHeapBase
+        }
+
+        /// Counts the chunk, chunks of a heap have to be added in the order of their addresses.
+        mutating func add(_ chunk: ChunkTable.Entry) {
+            let isActive = chunk.state.isActive
+            if isActive {
+                active.add(size: chunk.size)
+                powerOfTwoClasses[GlibcMallocStatistics.powerOfTwoClass(of: chunk.size), default: SizeClass()].active.add(size: chunk.size)
+                binClasses[GlibcMallocStatistics.binIndex(of: chunk.size), default: SizeClass()].active.add(size: chunk.size)
+                freeRunEnd = 0
+            } else {
+                free.add(size: chunk.size)
+                powerOfTwoClasses[GlibcMallocStatistics.powerOfTwoClass(of: chunk.size), default: SizeClass()].free.add(size: chunk.size)
+                binClasses[GlibcMallocStatistics.binIndex(of: chunk.size), default: SizeClass()].free.add(size: chunk.size)
+
+                freeRunBytes = freeRunEnd == chunk.base ? freeRunBytes + chunk.size : chunk.size
+                freeRunEnd = chunk.range.upperBound
+                largestFreeExtent = max(largestFreeExtent, freeRunBytes)
+            }
+            states[chunk.state, default: Counter()].add(size: chunk.size)
+            freedArena = freedArena || chunk.owner.freedArena
+        }
+
+        /// Adds the chunks of another walk of the arena, for example of its other heap.
+        mutating func merge(_ other: Arena) {
+            freedArena = freedArena || other.freedArena
+            active += other.active
+            free += other.free
+            for (state, counter) in other.states {
+                states[state, default: Counter()] += counter
+            }
+            for (sizeClass, counter) in other.powerOfTwoClasses {
+                powerOfTwoClasses[sizeClass, default: SizeClass()] += counter
+            }
+            for (index, counter) in other.binClasses {
+                binClasses[index, default: SizeClass()] += counter
+            }
+            largestFreeExtent = max(largestFreeExtent, other.largestFreeExtent)
+        }
+    }
+
+    public struct Thread {
+        /// The PID/TID of the thread.
+        public let ptraceId: Int32
+        /// Base of the thread arena used by the thread, nil for the main arena. Chunks are not
+        /// attributed to the threads allocating them, their usage is reported by the arena.
+        public var threadHeapBase: UInt?
+        /// Chunks in the tcache of the thread.
+        public var tcache = Counter()
+        /// Number of chunks of the non-empty tcache bins, keyed by the index of the tcache bin.
+        public var tcacheOccupancy: [Int: Int] = [:]
+
+        public init(ptraceId: Int32, threadHeapBase: UInt?) {
+            self.ptraceId = ptraceId
+            self.threadHeapBase = threadHeapBase
+        }
+    }
+
+    /// Arenas, the main arena first and thread arenas in the order of their addresses.
+    public internal(set) var arenas: [Arena] = []
+    /// Threads in the order of the PID/TID.
+    public internal(set) var threads: [Thread] = []
+
+    /// Top chunks are reported by the size of the arena, not as free chunks.
+    let topChunks: Set<UInt>
+    /// Chunks of the tcaches keyed by the PID/TID of their thread.
+    private(set) var tcacheChunks: [Int32: Counter] = [:]
+
+    init(topChunks: Set<UInt> = []) {
+        self.topChunks = topChunks
+    }
+
+    public var active: Counter {
+        arenas.reduce(into: Counter()) { $0 += $1.active }
+    }
+
+    public var free: Counter {
+        arenas.reduce(into: Counter()) { $0 += $1.free }
+    }
+
+    /// Counts the chunk, chunks of a heap have to be added in the order of their addresses.
+    mutating func add(_ chunk: ChunkTable.Entry) {
+        guard !topChunks.contains(chunk.base) else {
+            return
+        }
+
+        let index = arenaIndex(threadHeapBase: chunk.owner.threadHeapBase)
+        arenas[index].add(chunk)
+        if let thread = chunk.owner.tcacheThread {
+            tcacheChunks[thread, default: Counter()].add(size: chunk.size)
+        }
+    }
+
+    /// Adds the chunks of another walk.
+    mutating func merge(_ other: GlibcMallocStatistics) {
+        for arena in other.arenas {
+            arenas[arenaIndex(threadHeapBase: arena.threadHeapBase)].merge(arena)
+        }
+        for (thread, counter) in other.tcacheChunks {
+            tcacheChunks[thread, default: Counter()] += counter
+        }
+    }
+
+    /// Index of the arena in `arenas`, the arena is created if it was not present yet.
+    mutating func arenaIndex(threadHeapBase: UInt?) -> Int {
+        // Chunks of a heap belong to the same arena
+        if let last = arenas.indices.last, arenas[last].threadHeapBase == threadHeapBase {
+            return last
+        }
+        if let index = arenas.firstIndex(where: { $0.threadHeapBase == threadHeapBase }) {
+            return index
+        }
+        arenas.append(Arena(threadHeapBase: threadHeapBase))
+        return arenas.count - 1
+    }
+
+    /// Orders the arenas and threads.
+    mutating func sort() {
+        arenas.sort { ($0.threadHeapBase ?? 0) < ($1.threadHeapBase ?? 0) }
+        threads.sort { $0.ptraceId < $1.ptraceId }
+    }
+
+    /// Size class of a chunk, the smallest power of two not less than its size (at least 32, the
+    /// minimal size of a chunk).
+    public static func powerOfTwoClass(of size: UInt) -> UInt {
+        guard size > 32 else {
+            return 32
+        }
+        return 1 << (UInt.bitWidth - (size - 1).leadingZeroBitCount)
+    }
+
+    /// Index of the glibc bin, that holds free chunks of the size (`bin_index` of malloc.c on
+    /// 64-bit platforms): 64 small bins by 16 bytes below 1 KiB, then large bins of growing width.
+    public static func binIndex(of size: UInt) -> Int {
+        if size < 1024 {
+            return Int(size >> 4)
+        }
+        if size >> 6 <= 48 {
+            return 48 + Int(size >> 6)
+        }
+        if size >> 9 <= 20 {
+            return 91 + Int(size >> 9)
+        }
+        if size >> 12 <= 10 {
+            return 110 + Int(size >> 12)
+        }
+        if size >> 15 <= 4 {
+            return 119 + Int(size >> 15)
+        }
+        if size >> 18 <= 2 {
+            return 124 + Int(size >> 18)
+        }
+        return 126
+    }
+}
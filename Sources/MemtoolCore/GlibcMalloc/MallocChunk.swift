@@ -64,4 +64,17 @@ public extension Chunk {
             load: (baseAddress + Chunk.chunkContentOffset)..<(baseAddress + header.size + Chunk.chunkContentEndOffset)
         )
     }
+
+    /// Performs *unchecked* load through the reader, which fails if the memory is not available.
+    /// - Parameters:
+    ///   - memory: Memory of the remote process, live or copied.
+    ///   - baseAddress: The base address of the malloc chunk (not the user space!)
+    init(memory: MemoryReader, baseAddress: UInt) throws {
+        self.header = try memory.load(of: malloc_chunk.self, base: baseAddress).buffer
+        let endAddress = (baseAddress + Chunk.chunkContentEndOffset).addingReportingOverflow(header.size)
+        guard !endAddress.overflow else {
+            throw SessionError.sizeAdditionOverflow
+        }
+        self.content = try memory.load((baseAddress + Chunk.chunkContentOffset)..<endAddress.partialValue)
+    }
 }
@@ -0,0 +1,126 @@
+import Cutils
+
+/// TLSResolver locates `__thread` variables of many threads, using the same heuristic as
+/// `TbssSymbolGlibcLdHeuristic`. The parts shared by all threads (the symbol in `.tbss`, the walk
+/// of the `_r_debug` link maps and the `link_map_private` of the file) are resolved once per file
+/// and symbol, each thread then requires only the reads of its `tcbhead_t`, the size of its dtv
+/// and the slot of the module.
+///
+/// The resolver caches the modules, create a new one whenever the process could load a library.
+public final class TLSResolver {
+    public typealias Error = TbssSymbolGlibcLdHeuristic.Error
+
+    /// TLS module of a file together with the symbol located in its `.tbss`.
+    public struct Module {
+        public let symbol: UnloadedSymbolInfo
+        /// Base address of the `link_map` of the file.
+        public let linkMapBase: UInt
+        /// Index of the module in the dtv of each thread (`l_tls_modid`).
+        public let moduleId: Int
+    }
+
+    /// Location of the variable in the TLS of a thread.
+    public struct Location {
+        public let ptraceId: Int32
+        /// Value of the `FS_BASE` register of the thread, which points to its `tcbhead_t`.
+        public let fsBase: UInt
+        public let dtvBase: UInt
+        public let symbolBase: UInt
+    }
+
+    public let session: Session
+
+    private struct Key: Hashable {
+        let fileName: String
+        let symbolName: String
+    }
+    private var modules: [Key: Module] = [:]
+
+    public init(session: Session) {
+        self.session = session
+    }
+
+    /// Resolves the module of the file and the symbol in its `.tbss`. The result is cached.
+    public func module(fileName: String, symbolName: String) throws -> Module {
+        let key = Key(fileName: fileName, symbolName: symbolName)
+        if let module = modules[key] {
+            return module
+        }
+
+        guard let symbols = session.symbolIndex, session.mapIndex != nil else {
+            throw Error.initializeSessionWithMapAndSymbols
+        }
+
+        guard let symbol = symbols.unloadedSymbols(named: symbolName).first(where: { $0.segment == .known(.tbss) && $0.file == fileName }) else {
+            throw Error.noSuchTbssSymbolOrFile
+        }
+
+        guard let rDebug = symbols.locate(knownSymbol: .rDebug).first else {
+            throw Error.couldNotfindGlibcRdebug
+        }
+
+        guard let linkItem = try TbssSymbolGlibcLdHeuristic.iterateRDebug(session: session, symbol: rDebug, file: fileName) else {
+            throw Error.couldNotLocateLinkItem
+        }
+
+        // Rebound to link_item_private. Following code braks Glibc guarentees and needs to be validated!
+        let privateLinkItem = try session.checkedLoad(of: link_map_private.self, base: linkItem.segment.lowerBound, skipMismatchTypeCheck: true)
+
+        let module = Module(
+            symbol: symbol,
+            linkMapBase: linkItem.segment.lowerBound,
+            moduleId: privateLinkItem.buffer.l_tls_modid
+        )
+        modules[key] = module
+        return module
+    }
+
+    /// Locates the variable in the TLS of the thread.
+    public func locate(fileName: String, symbolName: String, in thread: Session) throws -> Location {
+        try locate(fileName: fileName, symbolName: symbolName, in: [thread])[0]
+    }
+
+    /// Locates the variable in the TLS of each of the threads.
+    /// - Returns: Locations in the order of the threads.
+    public func locate(fileName: String, symbolName: String, in threads: [Session]) throws -> [Location] {
+        let module = try module(fileName: fileName, symbolName: symbolName)
+        return try Metrics.measure("tls.locate") {
+            try locate(module, in: threads)
+        }
+    }
+
+    private func locate(_ module: Module, in threads: [Session]) throws -> [Location] {
+        guard let map = session.mapIndex else {
+            throw Error.initializeSessionWithMapAndSymbols
+        }
+
+        // The thread control blocks are read first, the dtvs of all threads afterwards
+        let dtvBases = try threads.map { thread -> UInt in
+            guard map.contains(thread.fsBase, flags: [.read, .write]) else {
+                throw Error.fsBaseNotInReadableSpace
+            }
+
+            let head = try session.checkedLoad(of: tcbhead_t.self, base: thread.fsBase)
+            guard head.buffer.dtv != nil else {
+                throw Error.dtvNotInitialized
+            }
+            return UInt(bitPattern: head.buffer.dtv)
+        }
+
+        return try zip(threads, dtvBases).map { pair -> Location in
+            let (thread, dtvBase) = pair
+            let dtvCount = try session.checkedLoad(of: dtv_t.self, base: dtvBase - UInt(MemoryLayout<dtv_t>.size))
+            guard dtvCount.buffer.counter >= module.moduleId else {
+                throw Error.dtvTooSmall
+            }
+
+            let slot = try session.checkedLoad(of: dtv_t.self, base: dtvBase + UInt(module.moduleId * MemoryLayout<dtv_t>.size))
+            let symbolBase = UInt(bitPattern: slot.buffer.pointer.val) + module.symbol.location
+            guard map.contains(symbolBase, flags: [.read, .write]) else {
+                throw Error.symbolNotInReadableSpace
+            }
+
+            return Location(ptraceId: thread.ptraceId, fsBase: thread.fsBase, dtvBase: dtvBase, symbolBase: symbolBase)
+        }
+    }
+}
@@ -0,0 +1,71 @@
+/// MapIndex provides lookups of the regions of the memory map in logarithmic time. Regions
+/// of the map do not overlap, therefore it is sufficient to keep them sorted by their base
+/// address and use binary search.
+public struct MapIndex {
+    /// Regions of the map in the original order.
+    public let regions: [MapRegion]
+
+    /// Indices into `regions` sorted by the base address of the region.
+    private let order: [Int]
+    /// Base addresses of regions sorted in ascending order.
+    private let lowerBounds: [UInt]
+
+    /// Creates the index.
+    /// - Parameter regions: Map of the remote process memory.
+    public init(regions: [MapRegion]) {
+        self.regions = regions
+        self.order = regions.indices.sorted { regions[$0].range.lowerBound < regions[$1].range.lowerBound }
+        self.lowerBounds = order.map { regions[$0].range.lowerBound }
+    }
+
+    /// Index into `regions` of the region containing the address.
+    public func index(containing address: UInt) -> Int? {
+        guard let candidate = candidate(for: address), regions[candidate].range.contains(address) else {
+            return nil
+        }
+        return candidate
+    }
+
+    /// Index into `regions` of the region containing the whole range.
+    public func index(containing range: MemoryRange) -> Int? {
+        guard let candidate = candidate(for: range.lowerBound), regions[candidate].range.contains(range) else {
+            return nil
+        }
+        return candidate
+    }
+
+    /// Region containing the address.
+    public func region(containing address: UInt) -> MapRegion? {
+        index(containing: address).map { regions[$0] }
+    }
+
+    /// Region containing the whole range.
+    public func region(containing range: MemoryRange) -> MapRegion? {
+        index(containing: range).map { regions[$0] }
+    }
+
+    /// Returns true, if a single region contains the address and has all the flags.
+    public func contains(_ address: UInt, flags: MapFlags = []) -> Bool {
+        region(containing: address)?.properties.flags.contains(flags) == true
+    }
+
+    /// Returns true, if a single region contains the whole range and has all the flags.
+    public func contains(_ range: MemoryRange, flags: MapFlags = []) -> Bool {
+        region(containing: range)?.properties.flags.contains(flags) == true
+    }
+
+    /// Finds the last region, which base address is lower or equal to the address.
+    private func candidate(for address: UInt) -> Int? {
+        var low = 0
+        var high = lowerBounds.count
+        while low < high {
+            let middle = (low + high) / 2
+            if lowerBounds[middle] <= address {
+                low = middle + 1
+            } else {
+                high = middle
+            }
+        }
+        return low > 0 ? order[low - 1] : nil
+    }
+}
@@ -1,119 +1,198 @@
 import Foundation
-import RegexBuilder
-import _StringProcessing
 
 extension Map {
 
-    private static let startRef = Reference(Substring.self)
-    private static let endRef = Reference(Substring.self)
-    private static let flagsRef = Reference(Substring.self)
-    private static let offsetRef = Reference(Substring.self)
-    private static let deviceMajorRef = Reference(Substring.self)
-    private static let deviceMinorRef = Reference(Substring.self)
-    private static let inodeRef = Reference(Substring.self)
-    private static let pathnameRef = Reference(Substring.self)
-
-    private static let regex: Regex = {
-        let hexadec = Regex {
-            Optionally {
-                "0x"
-            }
-            OneOrMore(.hexDigit)
+    /// Loads and parses `/proc/[pid]/maps` of the process.
+    /// - Parameter pid: The PID of the process.
+    public static func getMap(for pid: Int32) -> [MapRegion] {
+        guard let content = ProcFile.read("/proc/\(pid)/maps") else {
+            error("Error: Map failed to load for pid \(pid)")
+            return []
         }
-        
-        return Regex {
-            Capture(as: startRef) {
-                hexadec
-            }
-            "-"
-            Capture(as: endRef) {
-                hexadec
-            }
-            One(.horizontalWhitespace)
-            Capture(as: flagsRef) {
-                ChoiceOf {
-                    "r"
-                    "-"
-                }
-                ChoiceOf {
-                    "w"
-                    "-"
-                }
-                ChoiceOf {
-                    "x"
-                    "-"
-                }
-                ChoiceOf {
-                    "p"
-                    "-"
-                }
-            }
-            OneOrMore(.horizontalWhitespace)
-            Capture(as: offsetRef) {
-                hexadec
-            }
-            OneOrMore(.horizontalWhitespace)
-            Capture(as: deviceMajorRef) {
-                OneOrMore(.digit)
+
+        return content.withUnsafeBytes(parse(maps:))
+    }
+
+    /// Computes the lowest address, to which each executable file was loaded. Files, that do not
+    /// have any executable mapping, are omitted.
+    /// - Parameter map: Map of the process.
+    public static func executableFileBasePoints(in map: [MapRegion]) -> [String: UInt] {
+        var basePoints: [String: UInt] = [:]
+        var executableFiles: Set<String> = []
+        for region in map {
+            guard case let .file(filename) = region.properties.pathname else {
+                continue
             }
-            ":"
-            Capture(as: deviceMinorRef) {
-                OneOrMore(.digit)
+
+            basePoints[filename] = min(basePoints[filename] ?? region.range.lowerBound, region.range.lowerBound)
+            if region.properties.flags.contains(.execute) {
+                executableFiles.insert(filename)
             }
-            One(.horizontalWhitespace)
-            Capture(as: inodeRef) {
-                OneOrMore(.digit)
+        }
+
+        return basePoints.filter { executableFiles.contains($0.key) }
+    }
+
+    /// Parses the content of the maps file in a single pass. Lines that do not match the format
+    /// described in `MapInfo` are reported and skipped. Equal pathnames share the same storage.
+    /// - Parameter maps: Content of the maps file.
+    public static func parse(maps: UnsafeRawBufferPointer) -> [MapRegion] {
+        var regions: [MapRegion] = []
+        // Keys point into the parsed buffer, which outlives the dictionary
+        var paths: [PathKey: MapPath] = [:]
+        var lineStart = 0
+
+        while lineStart < maps.count {
+            let lineEnd = maps[lineStart...].firstIndex(of: UInt8(ascii: "\n")) ?? maps.count
+            let line = UnsafeRawBufferPointer(rebasing: maps[lineStart..<lineEnd])
+            lineStart = lineEnd + 1
+
+            guard !line.isEmpty else {
+                continue
             }
-            One(.horizontalWhitespace)
-            Capture(as: pathnameRef) {
-                Optionally { OneOrMore(.anyNonNewline) }
+
+            var parser = LineParser(line: line)
+            guard
+                let start = parser.hexadecimal(),
+                parser.skip(UInt8(ascii: "-")),
+                let end = parser.hexadecimal(),
+                parser.skipSpaces(),
+                let flags = parser.flags(),
+                parser.skipSpaces(),
+                let offset = parser.hexadecimal(),
+                parser.skipSpaces(),
+                // Device numbers are printed in hexadecimal
+                let major = parser.hexadecimal(),
+                parser.skip(UInt8(ascii: ":")),
+                let minor = parser.hexadecimal(),
+                parser.skipSpaces(),
+                let inode = parser.decimal()
+            else {
+                error("Warning: Map failed to parse line: \(String(decoding: line, as: UTF8.self))")
+                continue
             }
-        }
-    }()
 
-    private static func getMaps(for pid: Int32) -> String {
-        let process = Process()
-        let aStdout = Pipe()
-        let aStderr = Pipe()
+            let pathBytes = parser.remainder()
+            let key = PathKey(bytes: pathBytes)
+            let pathname = paths[key] ?? {
+                let pathname = MapPath(rawValue: String(decoding: pathBytes, as: UTF8.self))
+                paths[key] = pathname
+                return pathname
+            }()
 
-        process.executableURL = URL(fileURLWithPath: "/bin/env")
-        process.standardOutput = aStdout
-        process.standardError = aStderr
-        // more info in `man proc`
-        process.arguments = ["bash", "-c", "cat /proc/\(pid)/maps"]
+            regions.append(MapRegion(
+                range: start..<end,
+                properties: MapInfo(
+                    flags: flags,
+                    offset: offset,
+                    device: (major: major, minor: minor),
+                    inode: inode,
+                    pathname: pathname
+                )
+            ))
+        }
 
-        try! process.run()
+        return regions
+    }
 
-        process.waitUntilExit()
+    /// Pathname bytes used as a dictionary key without copying.
+    private struct PathKey: Hashable {
+        let bytes: UnsafeRawBufferPointer
 
-        guard process.terminationStatus == 0 else {
-            error("Error: Map failed to load. Path: \(process.executableURL?.path ?? ""), arguments: \(process.arguments ?? []), termination status: \(process.terminationStatus), stderr: \(String(data: aStderr.fileHandleForReading.readDataToEndOfFile(), encoding: .utf8) ?? "")") 
-            return "" 
+        static func == (lhs: PathKey, rhs: PathKey) -> Bool {
+            lhs.bytes.elementsEqual(rhs.bytes)
         }
-        let result = String(data: aStdout.fileHandleForReading.readDataToEndOfFile(), encoding: .utf8)
 
-        return result!
+        func hash(into hasher: inout Hasher) {
+            hasher.combine(bytes: bytes)
+        }
     }
 
-    public static func getMap(for pid: Int32) -> [MapRegion] {
-        return getMaps(for: pid).components(separatedBy: "\n").compactMap { line -> MapRegion? in
-            guard !line.isEmpty else {
-                return nil
+    private struct LineParser {
+        let line: UnsafeRawBufferPointer
+        var position = 0
+
+        init(line: UnsafeRawBufferPointer) {
+            self.line = line
+        }
+
+        mutating func hexadecimal() -> UInt? {
+            var value: UInt = 0
+            let start = position
+            while position < line.count {
+                let byte = line[position]
+                let digit: UInt
+                switch byte {
+                case UInt8(ascii: "0")...UInt8(ascii: "9"):
+                    digit = UInt(byte - UInt8(ascii: "0"))
+                case UInt8(ascii: "a")...UInt8(ascii: "f"):
+                    digit = UInt(byte - UInt8(ascii: "a") + 10)
+                case UInt8(ascii: "A")...UInt8(ascii: "F"):
+                    digit = UInt(byte - UInt8(ascii: "A") + 10)
+                default:
+                    return position > start ? value : nil
+                }
+                value = value << 4 | digit
+                position += 1
+            }
+            return position > start ? value : nil
+        }
+
+        mutating func decimal() -> UInt? {
+            var value: UInt = 0
+            let start = position
+            while position < line.count, (UInt8(ascii: "0")...UInt8(ascii: "9")).contains(line[position]) {
+                value = value * 10 + UInt(line[position] - UInt8(ascii: "0"))
+                position += 1
             }
-            guard let result = try? regex.firstMatch(in: line) else {
-                error("Warning: Map failed to match regex: \(line)")
+            return position > start ? value : nil
+        }
+
+        mutating func flags() -> MapFlags? {
+            guard position + 4 <= line.count else {
                 return nil
             }
-            return MapRegion(
-                range: UInt(String(result[startRef]), radix: 16)!..<UInt(String(result[endRef]), radix: 16)!, 
-                properties: MapInfo(
-                    flags: MapFlags(rawValue: String(result[flagsRef])),
-                    offset: UInt(String(result[offsetRef]), radix: 16)!,
-                    device: (major: UInt(String(result[deviceMajorRef]), radix: 10)!, minor: UInt(String(result[deviceMinorRef]), radix: 10)!),
-                    inode: UInt(String(result[inodeRef]), radix: 10)!,
-                    pathname: MapPath(rawValue: String(result[pathnameRef]).trimmingCharacters(in: .whitespacesAndNewlines))
-                )
-            )
+            let expected: [(character: Unicode.Scalar, flag: MapFlags)] = [("r", .read), ("w", .write), ("x", .execute), ("p", .protected)]
+            var flags = MapFlags()
+            for (offset, (character, flag)) in expected.enumerated() {
+                switch line[position + offset] {
+                case UInt8(ascii: character):
+                    flags.insert(flag)
+                case UInt8(ascii: "-"), UInt8(ascii: "s"):
+                    break
+                default:
+                    return nil
+                }
+            }
+            position += 4
+            return flags
+        }
+
+        mutating func skip(_ character: UInt8) -> Bool {
+            guard position < line.count, line[position] == character else {
+                return false
+            }
+            position += 1
+            return true
+        }
+
+        mutating func skipSpaces() -> Bool {
+            let start = position
+            while position < line.count, line[position] == UInt8(ascii: " ") || line[position] == UInt8(ascii: "\t") {
+                position += 1
+            }
+            return position > start
+        }
+
+        /// The rest of the line without leading and trailing whitespace.
+        mutating func remainder() -> UnsafeRawBufferPointer {
+            _ = skipSpaces()
+            var end = line.count
+            while end > position, line[end - 1] == UInt8(ascii: " ") || line[end - 1] == UInt8(ascii: "\t") {
+                end -= 1
+            }
+            defer { position = line.count }
+            return UnsafeRawBufferPointer(rebasing: line[position..<end])
         }
     }
 }
@@ -0,0 +1,486 @@
+import Foundation
+
+/// MemoryGraph contains references between the active chunks found by a conservative pointer scan.
+/// Every aligned word in the content of an active chunk, that points into another active chunk, is
+/// a reference. The roots of the graph are the writable mappings of the files (`.data` and `.bss`),
+/// the main stack and the mappings containing the TLS of the threads (stacks of the threads).
+///
+/// ```swift
+/// let analyzer = try GlibcMallocAnalyzer(session: session)
+/// try analyzer.analyze()
+/// let graph = try MemoryGraph(session: session, chunks: analyzer.chunks)
+/// let leaked = graph.unreachableNodes()
+/// ```
+///
+/// Nodes are identified by their index in the order of the base addresses, references are stored in
+/// the compressed sparse row format: references of the node `n` are `targets[offsets[n]..<offsets[n + 1]]`.
+public struct MemoryGraph {
+    public enum Error: Swift.Error {
+        /// The session has no map, call `loadMap()` first.
+        case mapNotLoaded
+        /// Node indices are stored as `UInt32`.
+        case tooManyNodes(Int)
+    }
+
+    /// Set of nodes of the graph.
+    public struct NodeSet {
+        private var words: [UInt64]
+
+        init(capacity: Int) {
+            words = [UInt64](repeating: 0, count: (capacity + 63) / 64)
+        }
+
+        public func contains(_ node: Int) -> Bool {
+            words[node / 64] & (1 << UInt64(node % 64)) != 0
+        }
+
+        /// Inserts the node.
+        /// - Returns: False, if the node was already in the set.
+        @discardableResult
+        mutating func insert(_ node: Int) -> Bool {
+            let bit: UInt64 = 1 << UInt64(node % 64)
+            guard words[node / 64] & bit == 0 else {
+                return false
+            }
+            words[node / 64] |= bit
+            return true
+        }
+
+        /// Number of nodes in the set.
+        public var count: Int {
+            words.reduce(0) { $0 + $1.nonzeroBitCount }
+        }
+    }
+
+    /// Base addresses of the nodes in increasing order.
+    public var bases: [UInt] { index.bases }
+    /// Sizes of the nodes (the size of the chunk including the header).
+    public var sizes: [UInt] { index.sizes }
+    /// Mappings scanned as roots.
+    public let rootRegions: [MemoryRange]
+    /// Nodes referenced by the roots, sorted and without duplicates.
+    public let roots: [UInt32]
+
+    private let index: NodeIndex
+    private let offsets: [Int]
+    private let targets: [UInt32]
+
+    public var nodeCount: Int { bases.count }
+    public var referenceCount: Int { targets.count }
+
+    /// Bytes of the memory scanned by a single load.
+    static let windowSize: UInt = 1 << 20
+    /// Bytes of active chunks scanned by a single task of a worker.
+    static let taskSize: UInt = 8 << 20
+
+    /// Scans the active chunks and the roots of the process.
+    /// - Parameters:
+    ///   - session: Session of the process. The map has to be loaded.
+    ///   - chunks: Chunks found by the analysis, see `GlibcMallocAnalyzer.chunks`.
+    ///   - workerCount: Number of workers scanning the memory concurrently.
+    /// - Throws: `MemoryGraph.Error`. Memory that fails to load is skipped with a warning.
+    public init(session: ProcessWideSession, chunks: ChunkTable, workerCount: Int = 1) throws {
+        guard let map = session.map else {
+            throw Error.mapNotLoaded
+        }
+
+        var chunks = chunks
+        chunks.sort()
+
+        var bases: [UInt] = []
+        var sizes: [UInt] = []
+        var tasks: [ScanTask] = []
+        var taskStart = 0
+        var taskFirstNode = 0
+        var taskBytes: UInt = 0
+        for index in chunks.indices where Self.isNode(chunks.states[index]) {
+            if taskBytes >= Self.taskSize {
+                tasks.append(ScanTask(chunks: taskStart..<index, firstNode: taskFirstNode))
+                taskStart = index
+                taskFirstNode = bases.count
+                taskBytes = 0
+            }
+            bases.append(chunks.bases[index])
+            sizes.append(chunks.sizes[index])
+            taskBytes += chunks.sizes[index]
+        }
+        tasks.append(ScanTask(chunks: taskStart..<chunks.count, firstNode: taskFirstNode))
+
+        guard bases.count <= UInt32.max else {
+            throw Error.tooManyNodes(bases.count)
+        }
+
+        // Adjacent chunks form the heaps, mmapped chunks are areas of their own
+        var areas: [MemoryRange] = []
+        for chunk in chunks.indices {
+            let range = chunks.bases[chunk]..<(chunks.bases[chunk] + chunks.sizes[chunk])
+            if let last = areas.last, last.upperBound >= range.lowerBound {
+                areas[areas.count - 1] = last.lowerBound..<max(last.upperBound, range.upperBound)
+            } else {
+                areas.append(range)
+            }
+        }
+
+        let index = NodeIndex(bases: bases, sizes: sizes, areas: areas)
+        let scanned = try session.perform(tasks, workerCount: workerCount) { task, taskSession in
+            Self.scan(task, of: chunks, index: index, memory: taskSession.memory)
+        }
+
+        var offsets = [Int]()
+        offsets.reserveCapacity(bases.count + 1)
+        offsets.append(0)
+        var targets = [UInt32]()
+        targets.reserveCapacity(scanned.reduce(0) { $0 + $1.targets.count })
+        for result in scanned {
+            for count in result.counts {
+                offsets.append(offsets[offsets.count - 1] + Int(count))
+            }
+            targets.append(contentsOf: result.targets)
+        }
+
+        let threadPointers = [session.fsBase] + session.threads.map(\.fsBase)
+        let rootRegions = Self.rootRegions(in: map, threadPointers: threadPointers).filter {
+            // Scanning mapping containing chunks would make the chunks reachable
+            chunks.indices(overlapping: $0).isEmpty
+        }
+        let rootWindows = rootRegions.flatMap { region in
+            stride(from: region.lowerBound, to: region.upperBound, by: Int(Self.windowSize)).map {
+                $0..<min($0 + Self.windowSize, region.upperBound)
+            }
+        }
+        let rootReferences = try session.perform(rootWindows, workerCount: workerCount) { window, taskSession in
+            var references: [UInt32] = []
+            Self.withBytes(of: window, from: taskSession.memory) { bytes in
+                index.scan(bytes) { references.append(UInt32($0)) }
+            }
+            return references
+        }
+
+        self.index = index
+        self.offsets = offsets
+        self.targets = targets
+        self.rootRegions = rootRegions
+        self.roots = Array(Set(rootReferences.joined())).sorted()
+    }
+
+    /// Index of the node containing the address.
+    public func node(containing address: UInt) -> Int? {
+        index.node(containing: address)
+    }
+
+    /// Range of the chunk represented by the node.
+    public func range(of node: Int) -> MemoryRange {
+        bases[node]..<(bases[node] + sizes[node])
+    }
+
+    /// Nodes referenced by the node in increasing order.
+    public func references(from node: Int) -> ArraySlice<UInt32> {
+        targets[offsets[node]..<offsets[node + 1]]
+    }
+
+    /// Nodes reachable from the roots.
+    public func reachableFromRoots() -> NodeSet {
+        reachable(from: roots, avoiding: nil)
+    }
+
+    /// Nodes, that are not reachable from the roots (leaked chunks), in increasing order.
+    public func unreachableNodes() -> [Int] {
+        let reachable = reachableFromRoots()
+        return (0..<nodeCount).filter { !reachable.contains($0) }
+    }
+
+    /// Number of bytes, that would be freed together with the node: the size of the node and of all
+    /// nodes reachable from it, that are not reachable from the roots without passing through the node.
+    /// The query traverses the graph twice.
+    public func retainedSize(of node: Int) -> UInt {
+        let retained = reachable(from: [UInt32(node)], avoiding: nil)
+        let kept = reachable(from: roots, avoiding: node)
+        var size: UInt = 0
+        for candidate in 0..<nodeCount where retained.contains(candidate) && !kept.contains(candidate) {
+            size += sizes[candidate]
+        }
+        return size
+    }
+
+    /// Depth-first traversal from the nodes, that never enters the avoided node.
+    private func reachable(from start: [UInt32], avoiding avoided: Int?) -> NodeSet {
+        var visited = NodeSet(capacity: nodeCount)
+        var stack: [UInt32] = []
+        for node in start where Int(node) != avoided && visited.insert(Int(node)) {
+            stack.append(node)
+        }
+
+        while let node = stack.popLast() {
+            for target in references(from: Int(node)) where Int(target) != avoided && visited.insert(Int(target)) {
+                stack.append(target)
+            }
+        }
+        return visited
+    }
+}
+
+// MARK: - Scan
+
+extension MemoryGraph {
+    /// Chunks scanned by a single worker task.
+    struct ScanTask {
+        /// Indices of the chunks in the sorted table.
+        let chunks: Range<Int>
+        /// Node of the first active chunk of the task.
+        let firstNode: Int
+    }
+
+    /// Sorted base addresses of the nodes used to resolve the scanned words.
+    struct NodeIndex {
+        let bases: [UInt]
+        let sizes: [UInt]
+        /// Sorted areas of the heaps covering all nodes, words outside of them do not point into any node.
+        let areas: [MemoryRange]
+
+        /// Words are compared with the bounds of each area, more areas are merged over the smallest gaps.
+        static let maxAreaCount = 8
+
+        /// - Parameters:
+        ///   - areas: Sorted disjoint ranges covering all nodes, like the heaps of the chunks.
+        init(bases: [UInt], sizes: [UInt], areas: [MemoryRange]) {
+            self.bases = bases
+            self.sizes = sizes
+            self.areas = Self.merge(areas.filter { !$0.isEmpty }, count: Self.maxAreaCount)
+        }
+
+        /// Merges the sorted areas into the count of areas, the largest gaps between them are kept.
+        static func merge(_ areas: [MemoryRange], count: Int) -> [MemoryRange] {
+            guard areas.count > count else {
+                return areas
+            }
+
+            func gap(before area: Int) -> UInt {
+                areas[area].lowerBound - areas[area - 1].upperBound
+            }
+            let kept = Set((1..<areas.count).sorted { gap(before: $0) > gap(before: $1) }.prefix(count - 1))
+            var merged = [areas[0]]
+            for area in 1..<areas.count {
+                if kept.contains(area) {
+                    merged.append(areas[area])
+                } else {
+                    merged[merged.count - 1] = merged[merged.count - 1].lowerBound..<areas[area].upperBound
+                }
+            }
+            return merged
+        }
+
+        func node(containing address: UInt) -> Int? {
+            // First node with base address greater than the address
+            var low = 0
+            var high = bases.count
+            while low < high {
+                let middle = (low + high) / 2
+                if bases[middle] <= address {
+                    low = middle + 1
+                } else {
+                    high = middle
+                }
+            }
+
+            guard low > 0, address - bases[low - 1] < sizes[low - 1] else {
+                return nil
+            }
+            return low - 1
+        }
+
+        /// Resolves every aligned word of the bytes. Eight words are compared with the bounds of the
+        /// areas at once, only the words within an area are searched for.
+        func scan(_ bytes: UnsafeRawBufferPointer, _ found: (Int) -> Void) {
+            guard !areas.isEmpty else {
+                return
+            }
+
+            let wordCount = bytes.count / MemoryLayout<UInt64>.size
+            let bounds = areas.map {
+                (lower: SIMD8<UInt64>(repeating: UInt64($0.lowerBound)), upper: SIMD8<UInt64>(repeating: UInt64($0.upperBound)))
+            }
+            var word = 0
+            while word + 8 <= wordCount {
+                let words = bytes.loadUnaligned(fromByteOffset: word * MemoryLayout<UInt64>.size, as: SIMD8<UInt64>.self)
+                var candidates = SIMDMask<SIMD8<Int64>>(repeating: false)
+                for area in bounds {
+                    candidates .|= (words .>= area.lower) .& (words .< area.upper)
+                }
+                if any(candidates) {
+                    for lane in 0..<8 where candidates[lane] {
+                        if let node = node(containing: UInt(words[lane])) {
+                            found(node)
+                        }
+                    }
+                }
+                word += 8
+            }
+
+            while word < wordCount {
+                let value = UInt(bytes.loadUnaligned(fromByteOffset: word * MemoryLayout<UInt64>.size, as: UInt64.self))
+                if areas.contains(where: { $0.contains(value) }), let node = node(containing: value) {
+                    found(node)
+                }
+                word += 1
+            }
+        }
+    }
+
+    static func isNode(_ state: UInt8) -> Bool {
+        state == GlibcMallocChunkState.heapActive.rawValue || state == GlibcMallocChunkState.mmapped.rawValue
+    }
+
+    /// Content of the active chunk. The header is skipped, the content of an active heap chunk
+    /// continues over the `prev_size` field of the following chunk.
+    static func content(of index: Int, in chunks: ChunkTable) -> MemoryRange {
+        let base = chunks.bases[index]
+        let end = base + chunks.sizes[index]
+        let headerSize = UInt(2 * MemoryLayout<UInt>.size)
+        guard chunks.sizes[index] >= headerSize else {
+            return end..<end
+        }
+
+        if
+            chunks.states[index] == GlibcMallocChunkState.heapActive.rawValue,
+            index + 1 < chunks.count,
+            chunks.bases[index + 1] == end
+        {
+            return (base + headerSize)..<(end + UInt(MemoryLayout<UInt>.size))
+        }
+        return (base + headerSize)..<end
+    }
+
+    /// Scans the active chunks of the task. Adjacent chunks are read together in windows, contents
+    /// larger than a window are read in pieces of the window size.
+    /// - Returns: Number of references of each node of the task and the references.
+    static func scan(_ task: ScanTask, of chunks: ChunkTable, index: NodeIndex, memory: MemoryReader) -> (counts: [UInt32], targets: [UInt32]) {
+        var counts: [UInt32] = []
+        var targets: [UInt32] = []
+        var node = task.firstNode
+        var first = task.chunks.lowerBound
+
+        while first < task.chunks.upperBound {
+            guard isNode(chunks.states[first]) else {
+                first += 1
+                continue
+            }
+
+            let firstContent = content(of: first, in: chunks)
+            if firstContent.upperBound - chunks.bases[first] > windowSize {
+                // The pieces start at multiples of the window size from the aligned content, so the
+                // words stay aligned. Pieces, that fail to load, are skipped.
+                let start = targets.count
+                for offset in stride(from: 0, to: UInt(firstContent.count), by: Int(windowSize)) {
+                    let piece = (firstContent.lowerBound + offset)..<min(firstContent.lowerBound + offset + windowSize, firstContent.upperBound)
+                    withBytes(of: piece, from: memory) { bytes in
+                        index.scan(bytes) { target in
+                            if target != node {
+                                targets.append(UInt32(target))
+                            }
+                        }
+                    }
+                }
+                counts.append(removeDuplicates(in: &targets, from: start))
+                node += 1
+                first += 1
+                continue
+            }
+
+            // Extend the window over the adjacent chunks, whose contents fit into it
+            var windowEnd = firstContent.upperBound
+            var next = first + 1
+            while
+                next < task.chunks.upperBound,
+                chunks.bases[next] == chunks.bases[next - 1] + chunks.sizes[next - 1]
+            {
+                if isNode(chunks.states[next]) {
+                    let end = content(of: next, in: chunks).upperBound
+                    guard end - chunks.bases[first] <= windowSize else {
+                        break
+                    }
+                    windowEnd = end
+                }
+                next += 1
+            }
+
+            let window = chunks.bases[first]..<windowEnd
+            let nodes = (first..<next).filter { isNode(chunks.states[$0]) }
+            let scanned = withBytes(of: window, from: memory) { bytes in
+                for chunk in nodes {
+                    let start = targets.count
+                    let content = content(of: chunk, in: chunks)
+                    let offset = Int(content.lowerBound - window.lowerBound)
+                    index.scan(UnsafeRawBufferPointer(rebasing: bytes[offset..<(offset + content.count)])) { target in
+                        if target != node {
+                            targets.append(UInt32(target))
+                        }
+                    }
+                    counts.append(removeDuplicates(in: &targets, from: start))
+                    node += 1
+                }
+            }
+
+            if !scanned {
+                counts.append(contentsOf: repeatElement(0, count: nodes.count))
+                node += nodes.count
+            }
+            first = next
+        }
+
+        return (counts, targets)
+    }
+
+    /// Sorts the references of a node appended from the start and keeps each reference only once.
+    /// - Returns: Number of the references of the node.
+    static func removeDuplicates(in targets: inout [UInt32], from start: Int) -> UInt32 {
+        targets[start...].sort()
+        var unique = start
+        for position in start..<targets.count where unique == start || targets[unique - 1] != targets[position] {
+            targets[unique] = targets[position]
+            unique += 1
+        }
+        targets.removeSubrange(unique...)
+        return UInt32(targets.count - start)
+    }
+
+    /// Provides bytes of the window to the body, warns if the memory is not available.
+    /// - Returns: False, if the window could not be read.
+    @discardableResult
+    static func withBytes(of window: MemoryRange, from memory: MemoryReader, _ body: (UnsafeRawBufferPointer) -> Void) -> Bool {
+        do {
+            try memory.withUnsafeBytes(of: window, body)
+            return true
+        } catch let readError {
+            error("Warning: Failed to scan " + String(format: "%016lx", window.lowerBound) + "-" + String(format: "%016lx", window.upperBound) + ": \(readError)")
+            return false
+        }
+    }
+
+    /// Mappings scanned as roots: writable mappings of the files, anonymous mappings following them
+    /// (`.bss`), the main stack and the mappings containing the thread pointers.
+    static func rootRegions(in map: [MapRegion], threadPointers: [UInt]) -> [MemoryRange] {
+        map.indices.filter { index in
+            let region = map[index]
+            let flags = region.properties.flags
+            guard flags.contains(.read), flags.contains(.write) else {
+                return false
+            }
+
+            switch region.properties.pathname {
+            case .file, .pseudopath(.stack):
+                return true
+            case .pseudopath(.mmapped):
+                if threadPointers.contains(where: { region.range.contains($0) }) {
+                    return true
+                }
+                guard index > 0, case .file = map[index - 1].properties.pathname else {
+                    return false
+                }
+                return map[index - 1].range.upperBound == region.range.lowerBound
+            case .pseudopath(.heap), .pseudopath(.vdso), .pseudopath(.vsyscall), .pseudopath(.vvar):
+                return false
+            }
+        }
+        .map { map[$0].range }
+    }
+}
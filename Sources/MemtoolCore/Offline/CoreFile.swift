@@ -0,0 +1,401 @@
+import Foundation
+import Cutils
+import Glibc
+
+/// CoreFile provides the memory of a crashed process stored in an ELF64 core file, so the heap
+/// can be analyzed by `OfflineSession(core:)` when there is no live process.
+///
+/// The file is mapped into memory when it is opened and only the program headers and notes are
+/// parsed. The map is built from `PT_LOAD` segments, named by the `NT_FILE` note, and threads
+/// with their registers are taken from the `NT_PRSTATUS` notes. Memory pages are read
+/// by the kernel on the first access, so cores of any size open instantly. Loads copy only the
+/// requested bytes, `withUnsafeBytes(of:_:)` provides the mapped bytes directly.
+public final class CoreFile: MemoryReader {
+    public enum Error: Swift.Error {
+        case couldNotOpen(errno: Int32)
+        case couldNotMap(errno: Int32)
+        case notElf64
+        case notCore
+        case malformedProgramHeaders
+        case malformedNotes
+        case missingThreads
+    }
+
+    /// Path of the file.
+    public let path: String
+    /// The PID of the process, that dumped the core.
+    public let pid: Int32
+    /// Map of the process built from `PT_LOAD` segments.
+    public let map: [MapRegion]
+    /// Threads of the process, the main thread is first.
+    public let threads: [ProcessImage.Thread]
+
+    private let base: UnsafeRawPointer
+    private let size: Int
+    /// Ranges with content in the file sorted by their base address and offsets of their bytes.
+    private let segments: [(range: MemoryRange, fileOffset: Int)]
+
+    /// `NT_FILE` note contains ranges of mapped files, `0x46494c45` is "FILE".
+    private static let fileNoteType: UInt32 = 0x4649_4c45
+    /// Offset of `pr_pid` in `struct elf_prstatus` of x86_64.
+    private static let prstatusPidOffset = 32
+    /// Offset of `pr_reg` (`elf_gregset_t`) in `struct elf_prstatus` of x86_64.
+    private static let prstatusRegistersOffset = 112
+    /// Offset of `pr_pid` in `struct elf_prpsinfo` of x86_64.
+    private static let prpsinfoPidOffset = 24
+
+    /// Maps the core file into memory and parses its program headers and notes.
+    /// - Parameter path: Path to the ELF64 core file.
+    public init(path: String) throws {
+        let fd = open(path, O_RDONLY | O_CLOEXEC)
+        guard fd >= 0 else {
+            throw Error.couldNotOpen(errno: errno)
+        }
+        defer { close(fd) }
+
+        var status = stat()
+        guard fstat(fd, &status) == 0 else {
+            throw Error.couldNotOpen(errno: errno)
+        }
+
+        let size = Int(status.st_size)
+        guard size >= MemoryLayout<Elf64_Ehdr>.size else {
+            throw Error.notElf64
+        }
+
+        guard let mapped = mmap(nil, size, PROT_READ, MAP_PRIVATE, fd, 0), mapped != UnsafeMutableRawPointer(bitPattern: -1) else {
+            throw Error.couldNotMap(errno: errno)
+        }
+        let base = UnsafeRawPointer(mapped)
+
+        do {
+            let content = try CoreFile.parse(UnsafeRawBufferPointer(start: base, count: size))
+            self.pid = content.pid
+            self.map = content.map
+            self.threads = content.threads
+            self.segments = content.segments
+        } catch {
+            munmap(mapped, size)
+            throw error
+        }
+
+        self.path = path
+        self.base = base
+        self.size = size
+    }
+
+    deinit {
+        munmap(UnsafeMutableRawPointer(mutating: base), size)
+    }
+
+    /// Provides the mapped bytes of the range without copying them.
+    /// - Parameters:
+    ///   - segment: Range of the memory of the process.
+    ///   - body: Closure receiving the bytes, which must not escape it.
+    /// - Throws: `RemoteMemoryError` if the range is not stored in the core as a whole.
+    public func withUnsafeBytes<R>(of segment: MemoryRange, _ body: (UnsafeRawBufferPointer) throws -> R) throws -> R {
+        guard let stored = self.segment(containing: segment) else {
+            throw RemoteMemoryError.readFailed(base: segment.lowerBound, errno: EFAULT)
+        }
+
+        let offset = stored.fileOffset + Int(segment.lowerBound - stored.range.lowerBound)
+        return try body(UnsafeRawBufferPointer(start: base + offset, count: segment.count))
+    }
+
+    /// Stored range containing the range, nil if the range is not stored as a whole.
+    private func segment(containing range: MemoryRange) -> (range: MemoryRange, fileOffset: Int)? {
+        // First segment with base address greater than the base of the range
+        var low = 0
+        var high = segments.count
+        while low < high {
+            let middle = (low + high) / 2
+            if segments[middle].range.lowerBound <= range.lowerBound {
+                low = middle + 1
+            } else {
+                high = middle
+            }
+        }
+
+        guard low > 0, segments[low - 1].range.upperBound >= range.upperBound else {
+            return nil
+        }
+        return segments[low - 1]
+    }
+
+    public func load(_ segment: MemoryRange) throws -> RawRemoteMemory {
+        try withUnsafeBytes(of: segment) { bytes in
+            RawRemoteMemory(segment: segment, buffer: ContiguousArray(bytes))
+        }
+    }
+
+    public func load<T>(of type: T.Type, base: UInt) throws -> BoundRemoteMemory<T> {
+        let range = base..<(base + UInt(MemoryLayout<T>.size))
+        return try withUnsafeBytes(of: range) { bytes in
+            withUnsafeTemporaryAllocation(byteCount: MemoryLayout<T>.size, alignment: MemoryLayout<T>.alignment) { ptr in
+                ptr.copyMemory(from: bytes)
+                return BoundRemoteMemory(segment: range, buffer: ptr.load(as: T.self))
+            }
+        }
+    }
+
+    /// The file is mapped as a whole, nothing is loaded.
+    @discardableResult
+    public func prefetch(_ range: MemoryRange) -> UInt {
+        0
+    }
+
+    /// The file does not change, nothing is invalidated.
+    public func invalidate() {}
+
+    /// The file is immutable, so it is shared by all workers.
+    public func makeWorkerReader() -> MemoryReader {
+        self
+    }
+}
+
+extension CoreFile {
+    struct Content {
+        var pid: Int32
+        var map: [MapRegion]
+        var threads: [ProcessImage.Thread]
+        var segments: [(range: MemoryRange, fileOffset: Int)]
+    }
+
+    /// Range of a file mapped in the process from the `NT_FILE` note.
+    struct MappedFile {
+        var range: MemoryRange
+        var offset: UInt
+        var path: String
+    }
+
+    static func parse(_ file: UnsafeRawBufferPointer) throws -> Content {
+        let header = file.loadUnaligned(as: Elf64_Ehdr.self)
+        guard
+            header.e_ident.0 == 0x7f,
+            header.e_ident.1 == UInt8(ascii: "E"),
+            header.e_ident.2 == UInt8(ascii: "L"),
+            header.e_ident.3 == UInt8(ascii: "F"),
+            header.e_ident.4 == UInt8(ELFCLASS64)
+        else {
+            throw Error.notElf64
+        }
+        guard header.e_type == UInt16(ET_CORE) else {
+            throw Error.notCore
+        }
+
+        let count = Int(header.e_phnum)
+        let entrySize = Int(header.e_phentsize)
+        guard
+            let offset = Int(exactly: header.e_phoff),
+            entrySize >= MemoryLayout<Elf64_Phdr>.size,
+            offset <= file.count,
+            count * entrySize <= file.count - offset
+        else {
+            throw Error.malformedProgramHeaders
+        }
+
+        let programHeaders = (0..<count).map { index in
+            file.loadUnaligned(fromByteOffset: offset + index * entrySize, as: Elf64_Phdr.self)
+        }
+
+        var processId: Int32?
+        var threads: [ProcessImage.Thread] = []
+        var files: [MappedFile] = []
+        for programHeader in programHeaders where programHeader.p_type == UInt32(PT_NOTE) {
+            guard
+                let notesOffset = Int(exactly: programHeader.p_offset),
+                let notesSize = Int(exactly: programHeader.p_filesz),
+                notesOffset <= file.count,
+                notesSize <= file.count - notesOffset
+            else {
+                throw Error.malformedProgramHeaders
+            }
+
+            try forEachNote(in: UnsafeRawBufferPointer(rebasing: file[notesOffset..<(notesOffset + notesSize)])) { type, descriptor in
+                switch type {
+                case UInt32(NT_PRSTATUS):
+                    // `pr_reg` has the layout of `user_regs_struct`
+                    guard descriptor.count >= prstatusRegistersOffset + MemoryLayout<user_regs_struct>.size else {
+                        error("Warning: Core note NT_PRSTATUS is too short")
+                        return
+                    }
+                    threads.append(ProcessImage.Thread(
+                        tid: descriptor.loadUnaligned(fromByteOffset: prstatusPidOffset, as: Int32.self),
+                        registers: descriptor.loadUnaligned(fromByteOffset: prstatusRegistersOffset, as: user_regs_struct.self)
+                    ))
+                case UInt32(NT_PRPSINFO):
+                    if descriptor.count >= prpsinfoPidOffset + MemoryLayout<Int32>.size {
+                        processId = descriptor.loadUnaligned(fromByteOffset: prpsinfoPidOffset, as: Int32.self)
+                    }
+                case fileNoteType:
+                    files = try parseFiles(descriptor)
+                default:
+                    break
+                }
+            }
+        }
+
+        guard let firstThread = threads.first else {
+            throw Error.missingThreads
+        }
+        let pid = processId ?? firstThread.tid
+        // The thread, that received the signal, is stored first, the analysis expects the main thread
+        if let main = threads.firstIndex(where: { $0.tid == pid }) {
+            threads.insert(threads.remove(at: main), at: 0)
+        }
+
+        files.sort { $0.range.lowerBound < $1.range.lowerBound }
+        var map: [MapRegion] = []
+        var segments: [(range: MemoryRange, fileOffset: Int)] = []
+        for programHeader in programHeaders where programHeader.p_type == UInt32(PT_LOAD) {
+            let end = UInt(programHeader.p_vaddr).addingReportingOverflow(UInt(programHeader.p_memsz))
+            guard !end.overflow else {
+                throw Error.malformedProgramHeaders
+            }
+            let range = UInt(programHeader.p_vaddr)..<end.partialValue
+
+            var flags: MapFlags = [.protected]
+            if programHeader.p_flags & UInt32(PF_R) != 0 { flags.insert(.read) }
+            if programHeader.p_flags & UInt32(PF_W) != 0 { flags.insert(.write) }
+            if programHeader.p_flags & UInt32(PF_X) != 0 { flags.insert(.execute) }
+
+            let mappedFile = files.last { $0.range.lowerBound <= range.lowerBound && range.lowerBound < $0.range.upperBound }
+            let mappedOffset = mappedFile.map { $0.offset.addingReportingOverflow(range.lowerBound - $0.range.lowerBound) }
+            guard mappedOffset?.overflow != true else {
+                throw Error.malformedNotes
+            }
+            map.append(MapRegion(
+                range: range,
+                properties: MapInfo(
+                    flags: flags,
+                    offset: mappedOffset?.partialValue ?? 0,
+                    device: (major: 0, minor: 0),
+                    inode: 0,
+                    pathname: mappedFile.map { .file($0.path) } ?? .pseudopath(.mmapped)
+                )
+            ))
+
+            // Segments not dumped by the kernel (like the code of mapped files) have no content
+            let stored = min(UInt(programHeader.p_filesz), UInt(programHeader.p_memsz))
+            guard
+                stored > 0,
+                let fileOffset = Int(exactly: programHeader.p_offset),
+                fileOffset <= file.count,
+                stored <= UInt(file.count - fileOffset)
+            else {
+                continue
+            }
+            segments.append((range.lowerBound..<(range.lowerBound + stored), fileOffset))
+        }
+
+        map.sort { $0.range.lowerBound < $1.range.lowerBound }
+        nameAnonymousMappings(in: &map, mainStackPointer: threads[0].registers.map { UInt($0.rsp) })
+
+        return Content(
+            pid: pid,
+            map: map,
+            threads: threads,
+            segments: segments.sorted { $0.range.lowerBound < $1.range.lowerBound }
+        )
+    }
+
+    /// The core does not store the names of the anonymous mappings. The mapping containing the stack
+    /// pointer of the main thread is named `[stack]`. The `[heap]` of the program break is the first
+    /// anonymous writable mapping between the executable (the lowest mapped file) and the next
+    /// file, that does not adjoin the executable and its `.bss`. Without ASLR, the heap adjoins the
+    /// `.bss` and stays unnamed.
+    static func nameAnonymousMappings(in map: inout [MapRegion], mainStackPointer: UInt?) {
+        if let stackPointer = mainStackPointer, let stack = map.firstIndex(where: { $0.range.contains(stackPointer) }) {
+            if map[stack].properties.pathname == .pseudopath(.mmapped) {
+                map[stack].properties.pathname = .pseudopath(.stack)
+            }
+        }
+
+        guard
+            let executable = map.first(where: { $0.properties.pathname != .pseudopath(.mmapped) && $0.properties.pathname != .pseudopath(.stack) })?.properties.pathname,
+            let last = map.lastIndex(where: { $0.properties.pathname == executable })
+        else {
+            return
+        }
+
+        var end = map[last].range.upperBound
+        for index in (last + 1)..<map.count {
+            guard map[index].properties.pathname == .pseudopath(.mmapped) else {
+                // Mappings of the libraries follow the heap
+                return
+            }
+            if map[index].range.lowerBound == end {
+                // `.bss` of the executable
+                end = map[index].range.upperBound
+            } else if map[index].properties.flags.contains(.write) {
+                map[index].properties.pathname = .pseudopath(.heap)
+                return
+            }
+        }
+    }
+
+    /// Calls the closure with the type and the descriptor of every note of the `CORE` owner.
+    static func forEachNote(in notes: UnsafeRawBufferPointer, _ body: (UInt32, UnsafeRawBufferPointer) throws -> Void) rethrows {
+        var offset = 0
+        let headerSize = MemoryLayout<Elf64_Nhdr>.size
+        while offset + headerSize <= notes.count {
+            let note = notes.loadUnaligned(fromByteOffset: offset, as: Elf64_Nhdr.self)
+            let nameSize = (Int(note.n_namesz) + 3) & ~3
+            let descriptorSize = (Int(note.n_descsz) + 3) & ~3
+            let descriptorOffset = offset + headerSize + nameSize
+
+            guard descriptorOffset + Int(note.n_descsz) <= notes.count else {
+                error("Warning: Core notes are truncated")
+                return
+            }
+
+            let name = notes[(offset + headerSize)..<(offset + headerSize + Int(note.n_namesz))]
+            if name.prefix { $0 != 0 }.elementsEqual("CORE".utf8) {
+                try body(note.n_type, UnsafeRawBufferPointer(rebasing: notes[descriptorOffset..<(descriptorOffset + Int(note.n_descsz))]))
+            }
+            offset = descriptorOffset + descriptorSize
+        }
+    }
+
+    /// Parses the `NT_FILE` note: count and page size followed by `count` triples of start, end
+    /// and offset in pages, followed by `count` zero terminated paths.
+    /// - Throws: `Error.malformedNotes` if the triples do not fit into the note or an offset overflows.
+    static func parseFiles(_ descriptor: UnsafeRawBufferPointer) throws -> [MappedFile] {
+        let word = MemoryLayout<UInt>.size
+        guard descriptor.count >= 2 * word else {
+            throw Error.malformedNotes
+        }
+
+        let tableSize = descriptor.loadUnaligned(as: UInt.self).multipliedReportingOverflow(by: UInt(3 * word))
+        guard !tableSize.overflow, tableSize.partialValue <= UInt(descriptor.count - 2 * word) else {
+            throw Error.malformedNotes
+        }
+        let count = Int(tableSize.partialValue) / (3 * word)
+        let pageSize = descriptor.loadUnaligned(fromByteOffset: word, as: UInt.self)
+        var pathOffset = 2 * word + Int(tableSize.partialValue)
+
+        var files: [MappedFile] = []
+        files.reserveCapacity(count)
+        for index in 0..<count {
+            let entry = 2 * word + index * 3 * word
+            let start = descriptor.loadUnaligned(fromByteOffset: entry, as: UInt.self)
+            let end = descriptor.loadUnaligned(fromByteOffset: entry + word, as: UInt.self)
+            let pageOffset = descriptor.loadUnaligned(fromByteOffset: entry + 2 * word, as: UInt.self)
+
+            let tail = descriptor[pathOffset...]
+            let terminator = tail.firstIndex(of: 0) ?? tail.endIndex
+            let path = String(decoding: tail[..<terminator], as: UTF8.self)
+            pathOffset = min(terminator + 1, descriptor.count)
+
+            guard start <= end else {
+                continue
+            }
+            let offset = pageOffset.multipliedReportingOverflow(by: pageSize)
+            guard !offset.overflow else {
+                throw Error.malformedNotes
+            }
+            files.append(MappedFile(range: start..<end, offset: offset.partialValue, path: path))
+        }
+        return files
+    }
+}
@@ -0,0 +1,544 @@
+import Foundation
+import Cutils
+import Glibc
+
+/// HeapSnapshotFile is a copy of the process stored in a file, so the heap captured on one machine
+/// can be analyzed on another one. The file contains the map, the registers of every thread, the
+/// symbols needed by the Glibc malloc analysis, the memory copied by `ProcessImage` and optionally
+/// the analyzed `ChunkTable`.
+///
+/// The file starts with a header followed by page-aligned copies of the memory. The rest of the
+/// data (fixed-size records, columns of the chunk table and a string table) follows the copies at
+/// `metadataOffset`. All values are stored in the native byte order.
+///
+/// The file is mapped into memory when it is opened. Only the metadata is decoded, the copies of
+/// the memory are read by the kernel on the first access, so opening a large snapshot is instant.
+/// Loads copy only the requested bytes, `withUnsafeBytes(of:_:)` provides the mapped bytes directly.
+public final class HeapSnapshotFile: MemoryReader {
+    public enum Error: Swift.Error {
+        case malformedFile
+        case unsupportedVersion
+        case writeFailed(errno: Int32)
+    }
+
+    private struct Header {
+        var magic: UInt32
+        var version: UInt32
+        var pid: Int32
+        var flags: UInt32
+        var regionCount: UInt64
+        var threadCount: UInt64
+        var symbolCount: UInt64
+        var segmentCount: UInt64
+        var ownerCount: UInt64
+        var chunkCount: UInt64
+        var stringsSize: UInt64
+        var metadataOffset: UInt64
+    }
+
+    private struct RegionRecord {
+        var start: UInt64
+        var end: UInt64
+        var offset: UInt64
+        var inode: UInt64
+        var major: UInt32
+        var minor: UInt32
+        var flags: UInt32
+        var pathOffset: UInt32
+        var pathLength: UInt32
+        var padding: UInt32
+    }
+
+    private struct ThreadRecord {
+        var tid: Int32
+        var flags: UInt32
+        var fsBase: UInt64
+        var registers: user_regs_struct
+    }
+
+    private struct SymbolRecord {
+        var location: UInt64
+        var size: UInt64
+        /// ASCII characters of `SymbolFlags.rawValue`
+        var flags: UInt64
+        var nameOffset: UInt32
+        var nameLength: UInt32
+        var sectionOffset: UInt32
+        var sectionLength: UInt32
+        var fileOffset: UInt32
+        var fileLength: UInt32
+    }
+
+    private struct SegmentRecord {
+        var start: UInt64
+        var end: UInt64
+        var fileOffset: UInt64
+    }
+
+    private struct OwnerRecord {
+        var threadHeapBase: UInt64
+        var tcacheThread: Int32
+        var flags: UInt32
+    }
+
+    private static let magic: UInt32 = 0x5348_544d // "MTHS"
+    private static let version: UInt32 = 3
+    private static let hasChunksFlag: UInt32 = 0b1
+
+    private static let hasThreadHeapFlag: UInt32 = 0b1
+    private static let hasTCacheFlag: UInt32 = 0b10
+    private static let freedArenaFlag: UInt32 = 0b100
+
+    private static let hasRegistersFlag: UInt32 = 0b1
+
+    /// Size of the pieces, in which the memory is copied into the file.
+    private static let writeWindow: UInt = 1 << 20
+
+    /// Names of the symbols stored in the file in addition to the `GLIBC_` version symbols.
+    public static let storedSymbolNames: Set<String> = Set([
+        GlibcAssurances.KnownSymbols.mainArena,
+        .tCache,
+        .threadArena,
+        .errno,
+        .rDebug,
+    ].map(\.name))
+
+    /// The PID of the captured process.
+    public let pid: Int32
+    /// Map of the process at the time of the capture.
+    public let map: [MapRegion]
+    /// Threads of the process, the main thread is first.
+    public let threads: [ProcessImage.Thread]
+    /// Symbols of the executable files stored in the file.
+    public let unloadedSymbols: [String: [UnloadedSymbolInfo]]
+    /// Whether the file contains the analyzed chunks.
+    public let hasChunks: Bool
+
+    private let data: Data
+    private let header: Header
+    /// Copied ranges sorted by their base address and offsets of their bytes in `data`.
+    private let segments: [(range: MemoryRange, fileOffset: Int)]
+    private let ownersOffset: Int
+    private let ownerCount: Int
+    private let chunksOffset: Int
+    private let chunkCount: Int
+
+    /// Opens the file and decodes its metadata.
+    /// - Parameter url: Location of the file.
+    public init(contentsOf url: URL) throws {
+        let data = try Data(contentsOf: url, options: .alwaysMapped)
+        self.data = data
+
+        let header: Header = try data.withUnsafeBytes { (raw: UnsafeRawBufferPointer) in
+            guard raw.count >= MemoryLayout<Header>.size else {
+                throw Error.malformedFile
+            }
+            return raw.loadUnaligned(as: Header.self)
+        }
+        guard header.magic == HeapSnapshotFile.magic else {
+            throw Error.malformedFile
+        }
+        guard header.version == HeapSnapshotFile.version else {
+            throw Error.unsupportedVersion
+        }
+        self.header = header
+        self.pid = header.pid
+        self.hasChunks = header.flags & HeapSnapshotFile.hasChunksFlag != 0
+
+        // Sections follow each other up to the end of the file, so each of them lies within the file
+        guard
+            let regionsOffset = Int(exactly: header.metadataOffset), regionsOffset >= MemoryLayout<Header>.size,
+            let regionCount = Int(exactly: header.regionCount),
+            let threadCount = Int(exactly: header.threadCount),
+            let symbolCount = Int(exactly: header.symbolCount),
+            let segmentCount = Int(exactly: header.segmentCount),
+            let ownerCount = Int(exactly: header.ownerCount),
+            let chunkCount = Int(exactly: header.chunkCount),
+            let threadsOffset = HeapSnapshotFile.offset(after: regionsOffset, count: regionCount, stride: MemoryLayout<RegionRecord>.stride),
+            let symbolsOffset = HeapSnapshotFile.offset(after: threadsOffset, count: threadCount, stride: MemoryLayout<ThreadRecord>.stride),
+            let segmentsOffset = HeapSnapshotFile.offset(after: symbolsOffset, count: symbolCount, stride: MemoryLayout<SymbolRecord>.stride),
+            let ownersOffset = HeapSnapshotFile.offset(after: segmentsOffset, count: segmentCount, stride: MemoryLayout<SegmentRecord>.stride),
+            let chunksOffset = HeapSnapshotFile.offset(after: ownersOffset, count: ownerCount, stride: MemoryLayout<OwnerRecord>.stride),
+            let columnsSize = HeapSnapshotFile.chunkColumnsSize(count: chunkCount),
+            let stringsOffset = HeapSnapshotFile.offset(after: chunksOffset, count: 1, stride: columnsSize),
+            let stringsSize = Int(exactly: header.stringsSize),
+            HeapSnapshotFile.offset(after: stringsOffset, count: 1, stride: stringsSize) == data.count
+        else {
+            throw Error.malformedFile
+        }
+        self.ownersOffset = ownersOffset
+        self.ownerCount = ownerCount
+        self.chunksOffset = chunksOffset
+        self.chunkCount = chunkCount
+
+        typealias Decoded = (map: [MapRegion], threads: [ProcessImage.Thread], unloadedSymbols: [String: [UnloadedSymbolInfo]], segments: [(range: MemoryRange, fileOffset: Int)])
+        let decoded = try data.withUnsafeBytes { (raw: UnsafeRawBufferPointer) -> Decoded in
+            let strings = UnsafeRawBufferPointer(rebasing: raw[stringsOffset...])
+            func string(offset: UInt32, length: UInt32) throws -> String {
+                guard Int(offset) + Int(length) <= strings.count else {
+                    throw Error.malformedFile
+                }
+                return String(decoding: strings[Int(offset)..<(Int(offset) + Int(length))], as: UTF8.self)
+            }
+
+            var map: [MapRegion] = []
+            map.reserveCapacity(regionCount)
+            for index in 0..<regionCount {
+                let record = raw.loadUnaligned(fromByteOffset: regionsOffset + index * MemoryLayout<RegionRecord>.stride, as: RegionRecord.self)
+                guard record.start <= record.end else {
+                    throw Error.malformedFile
+                }
+                map.append(MapRegion(
+                    range: UInt(record.start)..<UInt(record.end),
+                    properties: MapInfo(
+                        flags: MapFlags(rawValue: UInt(record.flags)),
+                        offset: UInt(record.offset),
+                        device: (major: UInt(record.major), minor: UInt(record.minor)),
+                        inode: UInt(record.inode),
+                        pathname: MapPath(rawValue: try string(offset: record.pathOffset, length: record.pathLength))
+                    )
+                ))
+            }
+
+            var threads: [ProcessImage.Thread] = []
+            for index in 0..<threadCount {
+                let record = raw.loadUnaligned(fromByteOffset: threadsOffset + index * MemoryLayout<ThreadRecord>.stride, as: ThreadRecord.self)
+                let hasRegisters = record.flags & HeapSnapshotFile.hasRegistersFlag != 0
+                threads.append(ProcessImage.Thread(tid: record.tid, fsBase: UInt(record.fsBase), registers: hasRegisters ? record.registers : nil))
+            }
+
+            var unloadedSymbols: [String: [UnloadedSymbolInfo]] = [:]
+            for index in 0..<symbolCount {
+                let record = raw.loadUnaligned(fromByteOffset: symbolsOffset + index * MemoryLayout<SymbolRecord>.stride, as: SymbolRecord.self)
+                let file = try string(offset: record.fileOffset, length: record.fileLength)
+                unloadedSymbols[file, default: []].append(UnloadedSymbolInfo(
+                    file: file,
+                    location: UInt(record.location),
+                    flags: SymbolFlags(packed: record.flags),
+                    segment: SymbolSection(rawValue: try string(offset: record.sectionOffset, length: record.sectionLength)),
+                    size: UInt(record.size),
+                    name: try string(offset: record.nameOffset, length: record.nameLength)
+                ))
+            }
+
+            var segments: [(range: MemoryRange, fileOffset: Int)] = []
+            for index in 0..<segmentCount {
+                let record = raw.loadUnaligned(fromByteOffset: segmentsOffset + index * MemoryLayout<SegmentRecord>.stride, as: SegmentRecord.self)
+                // Copies of the memory lie between the header and the metadata
+                let end = record.fileOffset.addingReportingOverflow(record.end &- record.start)
+                guard
+                    record.start <= record.end, record.fileOffset >= UInt64(MemoryLayout<Header>.size),
+                    !end.overflow, end.partialValue <= header.metadataOffset
+                else {
+                    throw Error.malformedFile
+                }
+                segments.append((UInt(record.start)..<UInt(record.end), Int(record.fileOffset)))
+            }
+
+            return (map, threads, unloadedSymbols, segments.sorted { $0.range.lowerBound < $1.range.lowerBound })
+        }
+        self.map = decoded.map
+        self.threads = decoded.threads
+        self.unloadedSymbols = decoded.unloadedSymbols
+        self.segments = decoded.segments
+    }
+
+    /// Chunks stored in the file, nil if the file does not contain them. The table is decoded
+    /// on every access.
+    public func chunks() throws -> ChunkTable? {
+        guard hasChunks else {
+            return nil
+        }
+
+        let count = chunkCount
+        return try data.withUnsafeBytes { (raw: UnsafeRawBufferPointer) -> ChunkTable in
+            var owners: [ChunkTable.Owner] = []
+            for index in 0..<ownerCount {
+                let record = raw.loadUnaligned(fromByteOffset: ownersOffset + index * MemoryLayout<OwnerRecord>.stride, as: OwnerRecord.self)
+                owners.append(ChunkTable.Owner(
+                    threadHeapBase: record.flags & HeapSnapshotFile.hasThreadHeapFlag != 0 ? UInt(record.threadHeapBase) : nil,
+                    tcacheThread: record.flags & HeapSnapshotFile.hasTCacheFlag != 0 ? record.tcacheThread : nil,
+                    freedArena: record.flags & HeapSnapshotFile.freedArenaFlag != 0
+                ))
+            }
+
+            let basesOffset = chunksOffset
+            let sizesOffset = basesOffset + count * MemoryLayout<UInt64>.size
+            let ownerIdsOffset = sizesOffset + count * MemoryLayout<UInt64>.size
+            let statesOffset = ownerIdsOffset + count * MemoryLayout<UInt32>.size
+
+            func column<T: FixedWidthInteger, R>(_ type: T.Type, at offset: Int, _ transform: (T) -> R) -> [R] {
+                (0..<count).map { transform(raw.loadUnaligned(fromByteOffset: offset + $0 * MemoryLayout<T>.size, as: T.self)) }
+            }
+
+            guard let table = ChunkTable(
+                bases: column(UInt64.self, at: basesOffset) { UInt($0) },
+                sizes: column(UInt64.self, at: sizesOffset) { UInt($0) },
+                states: column(UInt8.self, at: statesOffset) { $0 },
+                ownerIds: column(UInt32.self, at: ownerIdsOffset) { $0 },
+                owners: owners
+            ) else {
+                throw Error.malformedFile
+            }
+            return table
+        }
+    }
+
+    /// Bytes of the columns used by a single chunk: base, size, owner id and state.
+    private static let chunkRowSize = 2 * MemoryLayout<UInt64>.size + MemoryLayout<UInt32>.size + MemoryLayout<UInt8>.size
+
+    /// Size of the columns of the table padded to 8 bytes, nil if it overflows.
+    private static func chunkColumnsSize(count: Int) -> Int? {
+        offset(after: 7, count: count, stride: chunkRowSize).map { $0 & ~7 }
+    }
+
+    /// Offset following `count` records of the `stride` at the offset, nil if it overflows.
+    private static func offset(after offset: Int, count: Int, stride: Int) -> Int? {
+        let size = count.multipliedReportingOverflow(by: stride)
+        guard !size.overflow, size.partialValue >= 0 else {
+            return nil
+        }
+        let end = offset.addingReportingOverflow(size.partialValue)
+        return end.overflow ? nil : end.partialValue
+    }
+
+    /// Provides the mapped bytes of the range without copying them.
+    /// - Parameters:
+    ///   - segment: Range of the memory of the process.
+    ///   - body: Closure receiving the bytes, which must not escape it.
+    /// - Throws: `RemoteMemoryError` if the range was not captured as a whole.
+    public func withUnsafeBytes<R>(of segment: MemoryRange, _ body: (UnsafeRawBufferPointer) throws -> R) throws -> R {
+        guard let copied = self.segment(containing: segment) else {
+            throw RemoteMemoryError.readFailed(base: segment.lowerBound, errno: EFAULT)
+        }
+
+        let offset = copied.fileOffset + Int(segment.lowerBound - copied.range.lowerBound)
+        return try data.withUnsafeBytes { (raw: UnsafeRawBufferPointer) in
+            try body(UnsafeRawBufferPointer(rebasing: raw[offset..<(offset + segment.count)]))
+        }
+    }
+
+    /// Stored range containing the range, nil if the range is not stored as a whole.
+    private func segment(containing range: MemoryRange) -> (range: MemoryRange, fileOffset: Int)? {
+        // First segment with base address greater than the base of the range
+        var low = 0
+        var high = segments.count
+        while low < high {
+            let middle = (low + high) / 2
+            if segments[middle].range.lowerBound <= range.lowerBound {
+                low = middle + 1
+            } else {
+                high = middle
+            }
+        }
+
+        guard low > 0, segments[low - 1].range.upperBound >= range.upperBound else {
+            return nil
+        }
+        return segments[low - 1]
+    }
+
+    public func load(_ segment: MemoryRange) throws -> RawRemoteMemory {
+        try withUnsafeBytes(of: segment) { bytes in
+            RawRemoteMemory(segment: segment, buffer: ContiguousArray(bytes))
+        }
+    }
+
+    public func load<T>(of type: T.Type, base: UInt) throws -> BoundRemoteMemory<T> {
+        let range = base..<(base + UInt(MemoryLayout<T>.size))
+        return try withUnsafeBytes(of: range) { bytes in
+            withUnsafeTemporaryAllocation(byteCount: MemoryLayout<T>.size, alignment: MemoryLayout<T>.alignment) { ptr in
+                ptr.copyMemory(from: bytes)
+                return BoundRemoteMemory(segment: range, buffer: ptr.load(as: T.self))
+            }
+        }
+    }
+
+    /// The file is mapped as a whole, nothing is loaded.
+    @discardableResult
+    public func prefetch(_ range: MemoryRange) -> UInt {
+        0
+    }
+
+    /// The file does not change, nothing is invalidated.
+    public func invalidate() {}
+
+    /// The file is immutable, so it is shared by all workers.
+    public func makeWorkerReader() -> MemoryReader {
+        self
+    }
+}
+
+extension HeapSnapshotFile {
+    /// Stores the session into a file. The memory, that `ProcessImage.capture(pid:)` copies, is read
+    /// through the `memory` of the session, ranges that could not be read are skipped. Symbols
+    /// named in `storedSymbolNames` and the `GLIBC_` version symbols are stored. The file is
+    /// replaced atomically.
+    /// - Parameters:
+    ///   - session: Session of the process, usually an `OfflineSession` of a `ProcessImage`.
+    ///   - chunks: Analyzed chunks stored with the memory.
+    ///   - url: Location of the file.
+    public static func write(session: ProcessWideSession, chunks: ChunkTable? = nil, to url: URL) throws {
+        let temporaryPath = url.path + ".tmp"
+        let fd = open(temporaryPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0o644)
+        guard fd >= 0 else {
+            throw Error.writeFailed(errno: errno)
+        }
+        var isClosed = false
+        defer {
+            if !isClosed {
+                close(fd)
+                unlink(temporaryPath)
+            }
+        }
+
+        let pageSize = Int(RemoteMemoryCache.pageSize)
+        let map = session.map ?? []
+        // Registers are known only for copies of the process
+        let capturedThreads = (session as? OfflineSession)?.capturedThreads
+            ?? ([session as Session] + session.threads).map { ProcessImage.Thread(tid: $0.ptraceId, fsBase: $0.fsBase) }
+
+        // Memory starts at the first page after the header
+        var segments: [SegmentRecord] = []
+        var position = pageSize
+        for range in ProcessImage.capturedRanges(in: map, threadPointers: capturedThreads.map(\.fsBase), memory: session.memory) {
+            do {
+                var written: UInt = 0
+                while written < UInt(range.count) {
+                    let base = range.lowerBound + written
+                    let piece = try session.memory.load(base..<min(base + writeWindow, range.upperBound))
+                    try piece.buffer.withUnsafeBytes { try write(fd, $0, at: position + Int(written)) }
+                    written += UInt(piece.buffer.count)
+                }
+            } catch let loadError as RemoteMemoryError {
+                error("Warning: Failed to store " + String(format: "%016lx", range.lowerBound) + ": \(loadError)")
+                continue
+            }
+
+            segments.append(SegmentRecord(start: UInt64(range.lowerBound), end: UInt64(range.upperBound), fileOffset: UInt64(position)))
+            position += (range.count + pageSize - 1) & ~(pageSize - 1)
+        }
+
+        var strings: [UInt8] = []
+        var stringOffsets: [String: UInt32] = [:]
+        func store(_ string: String) -> (offset: UInt32, length: UInt32) {
+            let offset = stringOffsets[string] ?? {
+                let offset = UInt32(strings.count)
+                strings.append(contentsOf: string.utf8)
+                stringOffsets[string] = offset
+                return offset
+            }()
+            return (offset, UInt32(string.utf8.count))
+        }
+
+        let regions = map.map { region -> RegionRecord in
+            let path = store(region.properties.pathname.rawValue)
+            return RegionRecord(
+                start: UInt64(region.range.lowerBound),
+                end: UInt64(region.range.upperBound),
+                offset: UInt64(region.properties.offset),
+                inode: UInt64(region.properties.inode),
+                major: UInt32(truncatingIfNeeded: region.properties.device.major),
+                minor: UInt32(truncatingIfNeeded: region.properties.device.minor),
+                flags: UInt32(truncatingIfNeeded: region.properties.flags.rawValue),
+                pathOffset: path.offset,
+                pathLength: path.length,
+                padding: 0
+            )
+        }
+
+        let threads = capturedThreads.map { thread in
+            ThreadRecord(
+                tid: thread.tid,
+                flags: thread.registers != nil ? hasRegistersFlag : 0,
+                fsBase: UInt64(thread.fsBase),
+                registers: thread.registers ?? user_regs_struct()
+            )
+        }
+
+        let storedSymbols = (session.unloadedSymbols ?? [:]).values.joined().filter {
+            storedSymbolNames.contains($0.name) || ($0.segment == .known(.abs) && $0.name.hasPrefix("GLIBC_"))
+        }
+        let symbols = storedSymbols.map { symbol -> SymbolRecord in
+            let name = store(symbol.name)
+            let section = store(symbol.segment.rawValue)
+            let file = store(symbol.file)
+            return SymbolRecord(
+                location: UInt64(symbol.location),
+                size: UInt64(symbol.size),
+                flags: symbol.flags.packed,
+                nameOffset: name.offset,
+                nameLength: name.length,
+                sectionOffset: section.offset,
+                sectionLength: section.length,
+                fileOffset: file.offset,
+                fileLength: file.length
+            )
+        }
+
+        let owners = (chunks?.owners ?? []).map { owner in
+            OwnerRecord(
+                threadHeapBase: UInt64(owner.threadHeapBase ?? 0),
+                tcacheThread: owner.tcacheThread ?? 0,
+                flags: (owner.threadHeapBase != nil ? hasThreadHeapFlag : 0)
+                    | (owner.tcacheThread != nil ? hasTCacheFlag : 0)
+                    | (owner.freedArena ? freedArenaFlag : 0)
+            )
+        }
+
+        var metadata: [UInt8] = []
+        regions.withUnsafeBytes { metadata.append(contentsOf: $0) }
+        threads.withUnsafeBytes { metadata.append(contentsOf: $0) }
+        symbols.withUnsafeBytes { metadata.append(contentsOf: $0) }
+        segments.withUnsafeBytes { metadata.append(contentsOf: $0) }
+        owners.withUnsafeBytes { metadata.append(contentsOf: $0) }
+        if let chunks = chunks {
+            chunks.bases.map(UInt64.init).withUnsafeBytes { metadata.append(contentsOf: $0) }
+            chunks.sizes.map(UInt64.init).withUnsafeBytes { metadata.append(contentsOf: $0) }
+            chunks.ownerIds.withUnsafeBytes { metadata.append(contentsOf: $0) }
+            chunks.states.withUnsafeBytes { metadata.append(contentsOf: $0) }
+            metadata.append(contentsOf: repeatElement(0, count: chunkColumnsSize(count: chunks.count)! - chunks.count * chunkRowSize))
+        }
+        metadata.append(contentsOf: strings)
+        try metadata.withUnsafeBytes { try write(fd, $0, at: position) }
+
+        var header = Header(
+            magic: magic,
+            version: version,
+            pid: session.pid,
+            flags: chunks != nil ? hasChunksFlag : 0,
+            regionCount: UInt64(regions.count),
+            threadCount: UInt64(threads.count),
+            symbolCount: UInt64(symbols.count),
+            segmentCount: UInt64(segments.count),
+            ownerCount: UInt64(owners.count),
+            chunkCount: UInt64(chunks?.count ?? 0),
+            stringsSize: UInt64(strings.count),
+            metadataOffset: UInt64(position)
+        )
+        // The instance method of the class would shadow the function of the standard library
+        try Swift.withUnsafeBytes(of: &header) { try write(fd, $0, at: 0) }
+
+        isClosed = true
+        guard close(fd) == 0, rename(temporaryPath, url.path) == 0 else {
+            let failure = errno
+            unlink(temporaryPath)
+            throw Error.writeFailed(errno: failure)
+        }
+    }
+
+    /// Writes the whole buffer at the offset of the file.
+    private static func write(_ fd: Int32, _ buffer: UnsafeRawBufferPointer, at offset: Int) throws {
+        var total = 0
+        while total < buffer.count {
+            let result = pwrite(fd, buffer.baseAddress! + total, buffer.count - total, off_t(offset + total))
+            if result < 0, errno == EINTR {
+                continue
+            }
+            guard result > 0 else {
+                throw Error.writeFailed(errno: errno)
+            }
+            total += result
+        }
+    }
+}
@@ -0,0 +1,148 @@
+/// OfflineSession analyzes a copy of the process instead of the attached process. The loads are
+/// served by the copy, so the process keeps running during the whole analysis and the
+/// session never issues `ptrace` requests.
+///
+/// ```swift
+/// let image = ProcessImage.capture(pid: pid)
+/// let session = OfflineSession(image: image)
+/// session.loadSymbols()
+/// let analyzer = try GlibcMallocAnalyzer(session: session)
+/// try analyzer.analyze()
+/// ```
+///
+/// The copy is either a `ProcessImage` in memory, a `HeapSnapshotFile` or a `CoreFile`.
+public final class OfflineSession: ProcessWideSession {
+    public let pid: Int32
+    /// The process is not attached, the PID identifies the main thread.
+    public var ptraceId: Int32 { pid }
+
+    public var map: [MapRegion]? {
+        didSet {
+            mapIndex = map.flatMap(MapIndex.init(regions:))
+        }
+    }
+    public private(set) var mapIndex: MapIndex?
+    public var executableFileBasePoints: [String: UInt]?
+    public var unloadedSymbols: [String: [UnloadedSymbolInfo]]? {
+        didSet {
+            symbolIndexStorage = nil
+        }
+    }
+    public var symbols: [SymbolRegion]? {
+        didSet {
+            symbolIndexStorage = nil
+        }
+    }
+    public var symbolIndex: SymbolIndex? {
+        if symbolIndexStorage == nil, let symbols = symbols {
+            symbolIndexStorage = SymbolIndex(symbols: symbols, unloadedSymbols: unloadedSymbols ?? [:])
+        }
+        return symbolIndexStorage
+    }
+    private var symbolIndexStorage: SymbolIndex?
+    public let tags = TagStore()
+
+    public let memory: MemoryReader
+    public let fsBase: UInt
+    /// Threads of the copy with their registers, the main thread is first.
+    public let capturedThreads: [ProcessImage.Thread]
+    public private(set) var threadSessions: [OfflineThreadSession] = []
+    public var threads: [Session] { threadSessions }
+
+    /// Creates the session of the image. The map and the threads are taken from the image,
+    /// symbols have to be loaded by `loadSymbols()`.
+    public convenience init(image: ProcessImage) {
+        self.init(pid: image.pid, map: image.map, threads: image.threads, memory: image)
+    }
+
+    /// Creates the session of the snapshot file. Symbols stored in the file are resolved, so the
+    /// session is ready for the analysis without the executable files of the process.
+    public convenience init(snapshot: HeapSnapshotFile) {
+        self.init(pid: snapshot.pid, map: snapshot.map, threads: snapshot.threads, memory: snapshot)
+        resolveSymbols(snapshot.unloadedSymbols)
+    }
+
+    /// Creates the session of the core file. Symbols have to be loaded by `loadSymbols()` from
+    /// the same executable files, that were mapped by the crashed process.
+    public convenience init(core: CoreFile) {
+        self.init(pid: core.pid, map: core.map, threads: core.threads, memory: core)
+    }
+
+    /// Creates the session of a copy of the process.
+    /// - Parameters:
+    ///   - pid: The PID of the copied process.
+    ///   - map: Map of the process.
+    ///   - threads: Threads of the process, the main thread is first.
+    ///   - memory: Copy of the memory of the process.
+    public init(pid: Int32, map: [MapRegion], threads: [ProcessImage.Thread], memory: MemoryReader) {
+        self.pid = pid
+        self.map = map
+        self.mapIndex = MapIndex(regions: map)
+        self.executableFileBasePoints = Map.executableFileBasePoints(in: map)
+        self.memory = memory
+        self.fsBase = threads.first { $0.tid == pid }?.fsBase ?? 0
+        self.capturedThreads = threads
+        self.threadSessions = threads
+            .filter { $0.tid != pid }
+            .map { OfflineThreadSession(tid: $0.tid, fsBase: $0.fsBase, owner: self) }
+    }
+}
+
+/// Thread of the copied process. All data except for the `FS_BASE` register are shared with the owner.
+public final class OfflineThreadSession: Session {
+    public var pid: Int32 { owner.pid }
+    public var ptraceId: Int32 { tid }
+    public let tid: Int32
+    public let fsBase: UInt
+    public unowned let owner: OfflineSession
+
+    public var map: [MapRegion]? {
+        get {
+            owner.map
+        }
+        set {
+            owner.map = newValue
+        }
+    }
+
+    public var mapIndex: MapIndex? { owner.mapIndex }
+
+    public var symbolIndex: SymbolIndex? { owner.symbolIndex }
+
+    public var executableFileBasePoints: [String : UInt]? {
+        get {
+            owner.executableFileBasePoints
+        }
+        set {
+            owner.executableFileBasePoints = newValue
+        }
+    }
+
+    public var unloadedSymbols: [String : [UnloadedSymbolInfo]]? {
+        get {
+            owner.unloadedSymbols
+        }
+        set {
+            owner.unloadedSymbols = newValue
+        }
+    }
+
+    public var symbols: [SymbolRegion]? {
+        get {
+            owner.symbols
+        }
+        set {
+            owner.symbols = newValue
+        }
+    }
+
+    public var tags: TagStore { owner.tags }
+
+    public var memory: MemoryReader { owner.memory }
+
+    public init(tid: Int32, fsBase: UInt, owner: OfflineSession) {
+        self.tid = tid
+        self.fsBase = fsBase
+        self.owner = owner
+    }
+}
@@ -0,0 +1,315 @@
+import Foundation
+import Cutils
+import Glibc
+
+/// ProcessImage is a copy of the parts of the process memory needed by the Glibc malloc analysis,
+/// together with the map and the registers of every thread. The image is captured while all
+/// threads are stopped and the threads are detached right after the copy, so the analysis of the
+/// image does not stop the process.
+///
+/// The image serves loads of `OfflineSession`. Loads of the memory, that was not copied, fail.
+public final class ProcessImage: MemoryReader {
+    /// Thread of the process at the time of the capture.
+    public struct Thread {
+        public let tid: Int32
+        /// Value of the `FS_BASE` register, which points to the `tcbhead_t` of the thread.
+        public let fsBase: UInt
+        /// General purpose registers of the thread, nil if only the `FS_BASE` is known.
+        public let registers: user_regs_struct?
+
+        public init(tid: Int32, fsBase: UInt, registers: user_regs_struct? = nil) {
+            self.tid = tid
+            self.fsBase = fsBase
+            self.registers = registers
+        }
+
+        public init(tid: Int32, registers: user_regs_struct) {
+            self.init(tid: tid, fsBase: UInt(registers.fs_base), registers: registers)
+        }
+    }
+
+    /// The PID of the captured process.
+    public let pid: Int32
+    /// Map of the process at the time of the capture.
+    public let map: [MapRegion]
+    /// Threads of the process, the main thread is first.
+    public let threads: [Thread]
+    /// Time, for which the process was stopped by the capture.
+    public let pauseDuration: Duration
+
+    /// Copied ranges sorted by their base address.
+    private let segments: [(range: MemoryRange, bytes: ContiguousArray<UInt8>)]
+
+    /// Number of bytes copied from the process.
+    public var byteCount: Int { segments.reduce(0) { $0 + $1.bytes.count } }
+
+    public init(pid: Int32, map: [MapRegion], threads: [Thread], segments: [(range: MemoryRange, bytes: ContiguousArray<UInt8>)], pauseDuration: Duration) {
+        self.pid = pid
+        self.map = map
+        self.threads = threads
+        self.segments = segments.sorted { $0.range.lowerBound < $1.range.lowerBound }
+        self.pauseDuration = pauseDuration
+    }
+
+    /// Stops all threads of the process, reads their registers, copies the memory needed by the
+    /// analysis (see `capturedRanges(in:threadPointers:memory:)`) and detaches the threads. Symbols are
+    /// not needed during the pause, load them afterwards (see `OfflineSession.loadSymbols()`).
+    ///
+    /// All `ptrace` requests are issued by the calling thread, the process must not be attached.
+    /// - Parameter pid: The PID of the process.
+    public static func capture(pid: Int32) -> ProcessImage {
+        let clock = ContinuousClock()
+        let start = clock.now
+
+        // Threads started while the others are being stopped are found by the next pass
+        var attached: [(tid: Int32, signal: Int32)] = []
+        var listed: Set<Int32> = []
+        while true {
+            let tids = ([pid] + ThreadLoader(pid: pid).threads).filter { !listed.contains($0) }
+            guard !tids.isEmpty else {
+                break
+            }
+            for tid in tids {
+                listed.insert(tid)
+                var signal: Int32 = 0
+                guard swift_inspect_bridge__ptrace_attach_and_wait(tid, &signal) == 0 else {
+                    error("Warning: Failed to stop thread \(tid), errno \(errno)")
+                    continue
+                }
+                attached.append((tid, signal))
+            }
+        }
+
+        var threads: [Thread] = []
+        for (tid, _) in attached {
+            var registers = user_regs_struct()
+            guard swift_inspect_bridge__ptrace_getregs(tid, &registers) == 0 else {
+                error("Warning: Failed to read registers of thread \(tid), errno \(errno)")
+                continue
+            }
+            threads.append(Thread(tid: tid, registers: registers))
+        }
+
+        let map = Map.getMap(for: pid)
+        var segments: [(range: MemoryRange, bytes: ContiguousArray<UInt8>)] = []
+        let memory = RemoteMemoryCache(pid: pid, readAheadPages: 1)
+        for range in capturedRanges(in: map, threadPointers: threads.map(\.fsBase), memory: memory) {
+            var bytes = ContiguousArray<UInt8>(repeating: 0, count: range.count)
+            do {
+                try bytes.withUnsafeMutableBytes { buffer in
+                    try readRemoteMemory(pid: pid, baseAddress: range.lowerBound, into: buffer)
+                }
+            } catch let readError {
+                error("Warning: Failed to copy " + String(format: "%016lx", range.lowerBound) + ": \(readError)")
+                continue
+            }
+            segments.append((range, bytes))
+        }
+
+        for (tid, signal) in attached {
+            swift_inspect_bridge__ptrace_detach(tid, signal)
+        }
+        let pauseDuration = clock.now - start
+
+        return ProcessImage(pid: pid, map: map, threads: threads, segments: segments, pauseDuration: pauseDuration)
+    }
+
+    /// Heaps of thread arenas start at an address aligned to `HEAP_MAX_SIZE` (64 MiB on 64-bit
+    /// platforms, larger with huge pages).
+    static let heapAlignment: UInt = 64 << 20
+    /// Bytes copied below the thread pointer, the static TLS blocks of the modules.
+    static let staticTLSSize: UInt = 64 << 10
+    /// Bytes copied from the thread pointer, the `struct pthread` starting with the `tcbhead_t`.
+    static let threadControlBlockSize: UInt = 8 << 10
+    /// Arenas followed in the ring of `malloc_state.next` before the ring is considered corrupted.
+    static let maxArenaCount = 4096
+
+    /// Ranges of the memory copied by `capture(pid:)`, sorted by their address:
+    /// - the `[heap]` of the main arena,
+    /// - non-executable mappings of the `glibc` and `ld` files (`main_arena`, `mp_`, `_r_debug` and
+    ///   the GOT) and the anonymous mappings following them (the link maps and the TLS of the
+    ///   main thread allocated by `ld`),
+    /// - the used part (`heap_info.size`) of the heaps of the thread arenas, see `threadHeaps(in:glibcData:memory:)`,
+    /// - the pages around each thread pointer (the TCB and the static TLS) instead of the whole
+    ///   stacks of the threads.
+    ///
+    /// Other mappings, including the roots of `MemoryGraph`, are not copied.
+    /// - Parameters:
+    ///   - map: Map of the process.
+    ///   - threadPointers: `FS_BASE` registers of the threads.
+    ///   - memory: Memory of the process, only the `heap_info` and `malloc_state` of the candidate
+    ///     heaps are read.
+    static func capturedRanges(in map: [MapRegion], threadPointers: [UInt], memory: MemoryReader) -> [MemoryRange] {
+        var ranges: [MemoryRange] = []
+        var glibcData: [MemoryRange] = []
+        var candidates: [MapRegion] = []
+        for index in map.indices {
+            let region = map[index]
+            let flags = region.properties.flags
+            guard flags.contains(.read), flags.contains(.protected) else {
+                continue
+            }
+
+            switch region.properties.pathname {
+            case .pseudopath(.heap):
+                ranges.append(region.range)
+            case let .file(file):
+                if !flags.contains(.execute), GlibcAssurances.isGlibcFileName(file) {
+                    ranges.append(region.range)
+                    glibcData.append(region.range)
+                }
+            case .pseudopath(.mmapped):
+                guard flags.contains(.write) else {
+                    continue
+                }
+                if index > 0, case let .file(file) = map[index - 1].properties.pathname, GlibcAssurances.isGlibcFileName(file), map[index - 1].range.upperBound == region.range.lowerBound {
+                    ranges.append(region.range)
+                    continue
+                }
+                if !threadPointers.contains(where: region.range.contains) {
+                    candidates.append(region)
+                }
+            case .pseudopath(.stack), .pseudopath(.vdso), .pseudopath(.vsyscall), .pseudopath(.vvar):
+                continue
+            }
+        }
+        ranges += threadHeaps(in: candidates, glibcData: glibcData, memory: memory)
+
+        let mapIndex = MapIndex(regions: map)
+        for pointer in threadPointers {
+            guard let region = mapIndex.region(containing: pointer) else {
+                continue
+            }
+            let page = pointer & ~(RemoteMemoryCache.pageSize - 1)
+            let lowerBound = page - min(staticTLSSize, page - region.range.lowerBound)
+            ranges.append(lowerBound..<min(page + threadControlBlockSize, region.range.upperBound))
+        }
+
+        // Thread pointers may lie in the copied mappings
+        ranges.sort { $0.lowerBound < $1.lowerBound }
+        var merged: [MemoryRange] = []
+        for range in ranges {
+            if let last = merged.last, last.upperBound >= range.lowerBound {
+                merged[merged.count - 1] = last.lowerBound..<max(last.upperBound, range.upperBound)
+            } else {
+                merged.append(range)
+            }
+        }
+        return merged
+    }
+
+    /// Used parts of the heaps of the thread arenas found in the mappings. A heap is copied only if
+    /// its `heap_info` is consistent with the mapping and its `ar_ptr` is a located arena: the
+    /// `malloc_state` following the `heap_info` of the first heap of an arena, whose ring of
+    /// `next` pointers returns to it through other located arenas and `main_arena` in the data of
+    /// `glibc`. Other anonymous mappings (buffers, JIT code, mmapped chunks) are not copied.
+    static func threadHeaps(in candidates: [MapRegion], glibcData: [MemoryRange], memory: MemoryReader) -> [MemoryRange] {
+        let headerSize = UInt(MemoryLayout<heap_info>.size)
+        var heaps: [(range: MemoryRange, info: heap_info)] = []
+        for region in candidates {
+            var base = (region.range.lowerBound + heapAlignment - 1) & ~(heapAlignment - 1)
+            while base < region.range.upperBound {
+                if let info = try? memory.load(of: heap_info.self, base: base).buffer {
+                    let size = UInt(bitPattern: info.size)
+                    if size >= headerSize, size <= heapAlignment, size <= UInt(bitPattern: info.mprotect_size), size <= region.range.upperBound - base {
+                        heaps.append((base..<(base + size), info))
+                    }
+                }
+                base += heapAlignment
+            }
+        }
+
+        // The arena of a new heap is stored right after its `heap_info`
+        let arenaCandidates = Set(heaps.compactMap { heap -> UInt? in
+            heap.info.prev == nil && UInt(bitPattern: heap.info.ar_ptr) == heap.range.lowerBound + headerSize ? UInt(bitPattern: heap.info.ar_ptr) : nil
+        })
+        let arenas = arenaCandidates.filter { start in
+            var current = start
+            for _ in 0..<maxArenaCount {
+                guard let next = try? UInt(bitPattern: memory.load(of: malloc_state.self, base: current).buffer.next) else {
+                    return false
+                }
+                if next == start {
+                    return true
+                }
+                guard arenaCandidates.contains(next) || glibcData.contains(where: { $0.contains(next) }) else {
+                    return false
+                }
+                current = next
+            }
+            return false
+        }
+
+        return heaps.filter { arenas.contains(UInt(bitPattern: $0.info.ar_ptr)) }.map(\.range)
+    }
+
+    /// Copied bytes containing the range, nil if the range is not copied as a whole.
+    private func segment(containing range: MemoryRange) -> (range: MemoryRange, bytes: ContiguousArray<UInt8>)? {
+        // First segment with base address greater than the base of the range
+        var low = 0
+        var high = segments.count
+        while low < high {
+            let middle = (low + high) / 2
+            if segments[middle].range.lowerBound <= range.lowerBound {
+                low = middle + 1
+            } else {
+                high = middle
+            }
+        }
+
+        guard low > 0, segments[low - 1].range.upperBound >= range.upperBound else {
+            return nil
+        }
+        return segments[low - 1]
+    }
+
+    public func load(_ segment: MemoryRange) throws -> RawRemoteMemory {
+        guard let copied = self.segment(containing: segment) else {
+            throw RemoteMemoryError.readFailed(base: segment.lowerBound, errno: EFAULT)
+        }
+
+        let offset = Int(segment.lowerBound - copied.range.lowerBound)
+        return RawRemoteMemory(segment: segment, buffer: ContiguousArray(copied.bytes[offset..<(offset + segment.count)]))
+    }
+
+    /// Provides the copied bytes directly.
+    public func withUnsafeBytes<R>(of segment: MemoryRange, _ body: (UnsafeRawBufferPointer) throws -> R) throws -> R {
+        guard let copied = self.segment(containing: segment) else {
+            throw RemoteMemoryError.readFailed(base: segment.lowerBound, errno: EFAULT)
+        }
+
+        let offset = Int(segment.lowerBound - copied.range.lowerBound)
+        return try copied.bytes.withUnsafeBytes { source in
+            try body(UnsafeRawBufferPointer(rebasing: source[offset..<(offset + segment.count)]))
+        }
+    }
+
+    public func load<T>(of type: T.Type, base: UInt) throws -> BoundRemoteMemory<T> {
+        let range = base..<(base + UInt(MemoryLayout<T>.size))
+        guard let copied = segment(containing: range) else {
+            throw RemoteMemoryError.readFailed(base: base, errno: EFAULT)
+        }
+
+        let offset = Int(base - copied.range.lowerBound)
+        return withUnsafeTemporaryAllocation(byteCount: MemoryLayout<T>.size, alignment: MemoryLayout<T>.alignment) { ptr in
+            copied.bytes.withUnsafeBytes { source in
+                ptr.copyMemory(from: UnsafeRawBufferPointer(rebasing: source[offset..<(offset + ptr.count)]))
+            }
+            return BoundRemoteMemory(segment: range, buffer: ptr.load(as: T.self))
+        }
+    }
+
+    /// The whole image is in the memory, nothing is loaded.
+    @discardableResult
+    public func prefetch(_ range: MemoryRange) -> UInt {
+        0
+    }
+
+    /// The image does not change, nothing is invalidated.
+    public func invalidate() {}
+
+    /// The image is immutable, so it is shared by all workers.
+    public func makeWorkerReader() -> MemoryReader {
+        self
+    }
+}
@@ -0,0 +1,413 @@
+import Foundation
+
+/// AddressResolver attributes addresses (for example data addresses sampled by a profiler) to the
+/// mapping, the symbol and the chunk containing them.
+///
+/// The mappings, the symbols and the chunks are merged into a single sorted sequence of disjoint
+/// intervals, each storing the index of its mapping, symbol and chunk. A lookup is a single binary
+/// search over the bounds of the intervals. Where symbols overlap, the interval refers to the
+/// innermost one (the symbol starting last).
+///
+/// ```swift
+/// let resolver = AddressResolver(session: session, chunks: analyzer.chunks)
+/// resolver.resolve(reading: .standardInput, writingTo: .standardOutput, workerCount: 8)
+/// ```
+public final class AddressResolver {
+    public struct Resolution {
+        public let address: UInt
+        public let region: MapRegion?
+        public let symbol: SymbolRegion?
+        public let chunk: ChunkTable.Entry?
+    }
+
+    /// Result of a streamed resolution.
+    public struct Summary {
+        /// Number of resolved addresses.
+        public var resolved = 0
+        /// Number of non-empty lines, that are not a hexadecimal address.
+        public var invalid = 0
+    }
+
+    public let regions: [MapRegion]
+    public let symbols: [SymbolRegion]
+    public let chunks: ChunkTable
+
+    /// Lower bounds of the intervals in ascending order. Each interval ends at the following bound,
+    /// the last one does not belong to anything.
+    private let bounds: ContiguousArray<UInt>
+    /// Index into `regions` for each interval, -1 if no mapping contains it.
+    private let regionIds: ContiguousArray<Int32>
+    /// Index into `symbols` for each interval, -1 if no symbol contains it.
+    private let symbolIds: ContiguousArray<Int32>
+    /// Index into `chunks` for each interval, -1 if no chunk contains it.
+    private let chunkIds: ContiguousArray<Int32>
+
+    /// Names printed by the streamed resolution.
+    private let regionNames: [[UInt8]]
+    private let symbolNames: [[UInt8]]
+
+    /// Number of intervals of the index.
+    public var intervalCount: Int { bounds.count }
+
+    /// Indexes the map and the symbols of the session and the chunks.
+    /// - Parameters:
+    ///   - session: Session with the map and optionally the symbols loaded.
+    ///   - chunks: Chunks found by the analysis.
+    public convenience init(session: Session, chunks: ChunkTable? = nil) {
+        self.init(regions: session.map ?? [], symbols: session.symbols ?? [], chunks: chunks ?? ChunkTable())
+    }
+
+    public init(regions: [MapRegion], symbols: [SymbolRegion], chunks: ChunkTable) {
+        var chunks = chunks
+        chunks.sort()
+        self.regions = regions
+        self.symbols = symbols
+        self.chunks = chunks
+
+        let regionLayer = Self.flatten(regions.indices.map { (regions[$0].range, Int32($0)) })
+        let symbolLayer = Self.flatten(symbols.indices.map { (symbols[$0].range, Int32($0)) })
+        let chunkLayer = Self.flatten(chunks.indices.map { (chunks.bases[$0]..<(chunks.bases[$0] + chunks.sizes[$0]), Int32($0)) })
+
+        let bounds = Self.merge(Self.merge(Self.bounds(of: regionLayer), Self.bounds(of: symbolLayer)), Self.bounds(of: chunkLayer))
+        self.bounds = bounds
+        self.regionIds = Self.ids(of: regionLayer, at: bounds)
+        self.symbolIds = Self.ids(of: symbolLayer, at: bounds)
+        self.chunkIds = Self.ids(of: chunkLayer, at: bounds)
+
+        self.regionNames = regions.map { region in
+            let name = region.properties.pathname.rawValue
+            return Array((name.isEmpty ? "[anon]" : name).utf8)
+        }
+        self.symbolNames = symbols.map { Array($0.properties.name.utf8) }
+    }
+
+    /// Resolves a single address.
+    public func resolve(_ address: UInt) -> Resolution {
+        resolution(of: address, interval: interval(containing: address))
+    }
+
+    /// Resolves the addresses, the workers resolve consecutive parts of the array concurrently.
+    /// - Returns: Resolutions in the order of the addresses.
+    public func resolve(_ addresses: [UInt], workerCount: Int = 1) -> [Resolution] {
+        let intervals = intervals(of: addresses, workerCount: workerCount)
+        return zip(addresses, intervals).map { resolution(of: $0, interval: Int($1)) }
+    }
+
+    /// Reads hexadecimal addresses (one per line, optionally prefixed by `0x`) until the end of the
+    /// input and writes one line per address:
+    ///
+    /// ```
+    /// <address>\t<mapping>+<offset>\t<symbol>+<offset>\t<chunk base>+<offset>:<chunk state>
+    /// ```
+    ///
+    /// Fields of missing entities are `-`. The input is processed in batches, each batch is resolved
+    /// and formatted concurrently by the workers and written before the next one is read.
+    /// - Parameters:
+    ///   - batchSize: Number of bytes of the input read at once.
+    /// - Returns: Counts of resolved addresses and invalid lines.
+    @discardableResult
+    public func resolve(reading input: FileHandle, writingTo output: FileHandle, workerCount: Int = 1, batchSize: Int = 16 << 20) -> Summary {
+        var summary = Summary()
+        var pending: [UInt8] = []
+
+        while true {
+            let data = input.readData(ofLength: batchSize)
+            let isEnd = data.isEmpty
+            pending.append(contentsOf: data)
+
+            // Only complete lines are parsed, except at the end of the input
+            let lineEnd = isEnd ? pending.count : (pending.lastIndex(of: UInt8(ascii: "\n")).map { $0 + 1 } ?? 0)
+            let addresses = Self.parseAddresses(pending[0..<lineEnd], invalid: &summary.invalid)
+            pending.removeSubrange(0..<lineEnd)
+
+            if !addresses.isEmpty {
+                output.write(format(addresses, workerCount: workerCount))
+                summary.resolved += addresses.count
+            }
+            if isEnd {
+                return summary
+            }
+        }
+    }
+
+    /// Index of the interval containing the address, -1 if it precedes all intervals.
+    @inline(__always)
+    func interval(containing address: UInt) -> Int {
+        bounds.withUnsafeBufferPointer { bounds in
+            guard let first = bounds.first, first <= address else {
+                return -1
+            }
+            // Branch-free search of the last bound lower or equal to the address
+            var base = 0
+            var count = bounds.count
+            while count > 1 {
+                let half = count / 2
+                base = bounds[base + half] <= address ? base + half : base
+                count -= half
+            }
+            return base
+        }
+    }
+
+    private func intervals(of addresses: [UInt], workerCount: Int) -> [Int32] {
+        var intervals = [Int32](repeating: -1, count: addresses.count)
+        let partCount = max(1, min(workerCount, addresses.count / 4096))
+        let partSize = (addresses.count + partCount - 1) / partCount
+        intervals.withUnsafeMutableBufferPointer { intervals in
+            let intervals = intervals
+            DispatchQueue.concurrentPerform(iterations: partCount) { part in
+                for index in (part * partSize)..<min((part + 1) * partSize, addresses.count) {
+                    intervals[index] = Int32(interval(containing: addresses[index]))
+                }
+            }
+        }
+        return intervals
+    }
+
+    private func resolution(of address: UInt, interval: Int) -> Resolution {
+        guard interval >= 0 else {
+            return Resolution(address: address, region: nil, symbol: nil, chunk: nil)
+        }
+        let region = regionIds[interval]
+        let symbol = symbolIds[interval]
+        let chunk = chunkIds[interval]
+        return Resolution(
+            address: address,
+            region: region >= 0 ? regions[Int(region)] : nil,
+            symbol: symbol >= 0 ? symbols[Int(symbol)] : nil,
+            chunk: chunk >= 0 ? chunks[Int(chunk)] : nil
+        )
+    }
+
+    /// Resolves and formats the addresses, the workers format consecutive parts concurrently.
+    private func format(_ addresses: [UInt], workerCount: Int) -> Data {
+        let partCount = max(1, min(workerCount, addresses.count / 4096))
+        let partSize = (addresses.count + partCount - 1) / partCount
+        var parts = [[UInt8]](repeating: [], count: partCount)
+
+        parts.withUnsafeMutableBufferPointer { parts in
+            let parts = parts
+            DispatchQueue.concurrentPerform(iterations: partCount) { part in
+                var line: [UInt8] = []
+                line.reserveCapacity(partSize * 64)
+                for address in addresses[(part * partSize)..<min((part + 1) * partSize, addresses.count)] {
+                    appendRecord(of: address, to: &line)
+                }
+                parts[part] = line
+            }
+        }
+
+        var data = Data(capacity: parts.map(\.count).reduce(0, +))
+        parts.forEach { data.append(contentsOf: $0) }
+        return data
+    }
+
+    private func appendRecord(of address: UInt, to line: inout [UInt8]) {
+        let interval = interval(containing: address)
+        let tab = UInt8(ascii: "\t")
+        let plus = UInt8(ascii: "+")
+        let missing = UInt8(ascii: "-")
+
+        Self.appendHex(address, to: &line)
+
+        line.append(tab)
+        if interval >= 0, case let region = Int(regionIds[interval]), region >= 0 {
+            line.append(contentsOf: regionNames[region])
+            line.append(plus)
+            Self.appendHex(address - regions[region].range.lowerBound, to: &line)
+        } else {
+            line.append(missing)
+        }
+
+        line.append(tab)
+        if interval >= 0, case let symbol = Int(symbolIds[interval]), symbol >= 0 {
+            line.append(contentsOf: symbolNames[symbol])
+            line.append(plus)
+            Self.appendHex(address - symbols[symbol].range.lowerBound, to: &line)
+        } else {
+            line.append(missing)
+        }
+
+        line.append(tab)
+        if interval >= 0, case let chunk = Int(chunkIds[interval]), chunk >= 0 {
+            let base = chunks.bases[chunk]
+            Self.appendHex(base, to: &line)
+            line.append(plus)
+            Self.appendHex(address - base, to: &line)
+            line.append(UInt8(ascii: ":"))
+            line.append(contentsOf: Self.stateNames[Int(chunks.states[chunk])])
+        } else {
+            line.append(missing)
+        }
+
+        line.append(UInt8(ascii: "\n"))
+    }
+
+    private static let stateNames: [[UInt8]] = (0...UInt8.max).map { raw in
+        Array((GlibcMallocChunkState(rawValue: raw).map { String(describing: $0) } ?? "unknown").utf8)
+    }
+
+    private static func appendHex(_ value: UInt, to line: inout [UInt8]) {
+        let digits: StaticString = "0123456789abcdef"
+        line.append(UInt8(ascii: "0"))
+        line.append(UInt8(ascii: "x"))
+        var shift = max(0, (UInt.bitWidth - value.leadingZeroBitCount + 3) / 4 - 1) * 4
+        while shift >= 0 {
+            line.append(digits.utf8Start[Int((value >> UInt(shift)) & 0xf)])
+            shift -= 4
+        }
+    }
+
+    /// Parses lines of hexadecimal addresses, empty lines are skipped.
+    static func parseAddresses(_ bytes: ArraySlice<UInt8>, invalid: inout Int) -> [UInt] {
+        var addresses: [UInt] = []
+        addresses.reserveCapacity(bytes.count / 13)
+
+        var value: UInt = 0
+        var digits = 0
+        var isValid = true
+        var isEmpty = true
+
+        func finishLine() {
+            if !isEmpty {
+                if isValid, digits > 0, digits <= 16 {
+                    addresses.append(value)
+                } else {
+                    invalid += 1
+                }
+            }
+            value = 0
+            digits = 0
+            isValid = true
+            isEmpty = true
+        }
+
+        for byte in bytes {
+            switch byte {
+            case UInt8(ascii: "\n"):
+                finishLine()
+            case UInt8(ascii: " "), UInt8(ascii: "\t"), UInt8(ascii: "\r"):
+                continue
+            case UInt8(ascii: "x") where digits == 1 && value == 0:
+                // `0x` prefix
+                isEmpty = false
+                digits = 0
+            default:
+                isEmpty = false
+                let nibble: UInt8
+                switch byte {
+                case UInt8(ascii: "0")...UInt8(ascii: "9"):
+                    nibble = byte - UInt8(ascii: "0")
+                case UInt8(ascii: "a")...UInt8(ascii: "f"):
+                    nibble = byte - UInt8(ascii: "a") + 10
+                case UInt8(ascii: "A")...UInt8(ascii: "F"):
+                    nibble = byte - UInt8(ascii: "A") + 10
+                default:
+                    isValid = false
+                    continue
+                }
+                value = value << 4 | UInt(nibble)
+                digits += 1
+            }
+        }
+        finishLine()
+
+        return addresses
+    }
+
+    /// Makes the ranges disjoint. Where ranges overlap, the one starting last is used.
+    static func flatten(_ ranges: [(range: MemoryRange, id: Int32)]) -> [(range: MemoryRange, id: Int32)] {
+        // Enclosing ranges precede the ranges they contain
+        let sorted = ranges
+            .filter { !$0.range.isEmpty }
+            .sorted { ($0.range.lowerBound, UInt.max - $0.range.upperBound) < ($1.range.lowerBound, UInt.max - $1.range.upperBound) }
+        var flat: [(range: MemoryRange, id: Int32)] = []
+        flat.reserveCapacity(sorted.count)
+
+        var open: [(upperBound: UInt, id: Int32)] = []
+        var position: UInt = 0
+        var next = 0
+
+        while next < sorted.count || !open.isEmpty {
+            while let top = open.last, top.upperBound <= position {
+                open.removeLast()
+            }
+
+            let nextLowerBound = next < sorted.count ? sorted[next].range.lowerBound : UInt.max
+            guard let top = open.last else {
+                guard next < sorted.count else {
+                    break
+                }
+                position = nextLowerBound
+                open.append((sorted[next].range.upperBound, sorted[next].id))
+                next += 1
+                continue
+            }
+            if nextLowerBound <= position {
+                open.append((sorted[next].range.upperBound, sorted[next].id))
+                next += 1
+                continue
+            }
+
+            let end = min(top.upperBound, nextLowerBound)
+            if let last = flat.last, last.id == top.id, last.range.upperBound == position {
+                flat[flat.count - 1].range = last.range.lowerBound..<end
+            } else {
+                flat.append((position..<end, top.id))
+            }
+            position = end
+        }
+
+        return flat
+    }
+
+    /// Bounds of the disjoint ranges in ascending order without duplicates.
+    private static func bounds(of layer: [(range: MemoryRange, id: Int32)]) -> ContiguousArray<UInt> {
+        var bounds = ContiguousArray<UInt>()
+        bounds.reserveCapacity(2 * layer.count)
+        for (range, _) in layer {
+            if bounds.last != range.lowerBound {
+                bounds.append(range.lowerBound)
+            }
+            bounds.append(range.upperBound)
+        }
+        return bounds
+    }
+
+    /// Merges two ascending sequences without duplicates.
+    private static func merge(_ lhs: ContiguousArray<UInt>, _ rhs: ContiguousArray<UInt>) -> ContiguousArray<UInt> {
+        var merged = ContiguousArray<UInt>()
+        merged.reserveCapacity(lhs.count + rhs.count)
+        var left = 0
+        var right = 0
+        while left < lhs.count || right < rhs.count {
+            let value: UInt
+            if right == rhs.count || (left < lhs.count && lhs[left] <= rhs[right]) {
+                value = lhs[left]
+                left += 1
+            } else {
+                value = rhs[right]
+                right += 1
+            }
+            if merged.last != value {
+                merged.append(value)
+            }
+        }
+        return merged
+    }
+
+    /// Index of the range of the layer containing each interval starting at the bounds.
+    private static func ids(of layer: [(range: MemoryRange, id: Int32)], at bounds: ContiguousArray<UInt>) -> ContiguousArray<Int32> {
+        var ids = ContiguousArray<Int32>(repeating: -1, count: bounds.count)
+        var current = 0
+        for (index, bound) in bounds.enumerated() {
+            while current < layer.count, layer[current].range.upperBound <= bound {
+                current += 1
+            }
+            if current < layer.count, layer[current].range.lowerBound <= bound {
+                ids[index] = layer[current].id
+            }
+        }
+        return ids
+    }
+}
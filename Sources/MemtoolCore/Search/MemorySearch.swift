@@ -0,0 +1,297 @@
+import Foundation
+
+/// MemorySearch locates a byte pattern, a 64-bit value or a range of values in the memory of the
+/// process. The memory is read in large windows, which are split between the workers, and each
+/// window is compared by SIMD kernels. Matches are annotated by the mapping, the symbol and the
+/// chunk containing them.
+///
+/// ```swift
+/// let matches = try MemorySearch.find(.value(0xdeadbeef), session: session, chunks: analyzer.chunks)
+/// ```
+public enum MemorySearch {
+    public enum Error: Swift.Error {
+        case emptyPattern
+        /// The session has no map, call `loadMap()` first.
+        case mapNotLoaded
+        /// Searching chunks requires the chunks found by the analysis.
+        case chunksNotAvailable
+    }
+
+    /// The searched content.
+    public enum Pattern {
+        /// Sequence of bytes at any address.
+        case bytes([UInt8])
+        /// The 64-bit value stored in an aligned word.
+        case value(UInt64)
+        /// Any value of the range stored in an aligned word.
+        case values(ClosedRange<UInt64>)
+    }
+
+    /// The searched memory.
+    public enum Scope {
+        /// All readable mappings of the process.
+        case mappings
+        /// Content of the active chunks.
+        case chunks
+    }
+
+    public struct Match {
+        /// Address of the first byte of the match.
+        public let address: UInt
+        /// The matching word, nil for byte patterns.
+        public let value: UInt64?
+        public let region: MapRegion?
+        public let symbol: SymbolRegion?
+        public let chunk: ChunkTable.Entry?
+    }
+
+    /// Part of the memory, that is searched within a window. Byte patterns are searched also in the
+    /// first bytes of the following part, matches are reported only in the owned range.
+    struct Piece {
+        let searched: MemoryRange
+        let owned: MemoryRange
+    }
+
+    /// Window read by a single request and the parts of the window, that are searched.
+    struct Window {
+        var range: MemoryRange
+        var pieces: [Piece]
+    }
+
+    /// Bytes of the memory read by a single request.
+    static let windowSize: UInt = 1 << 20
+
+    /// Searches the memory of the process.
+    /// - Parameters:
+    ///   - pattern: The searched content.
+    ///   - scope: The searched memory.
+    ///   - session: Session of the process. The map has to be loaded.
+    ///   - chunks: Chunks found by the analysis, used to annotate the matches. Required by `.chunks` scope.
+    ///   - limit: Maximal number of reported matches, the matches with the lowest addresses are reported.
+    ///   - workerCount: Number of workers searching the windows concurrently.
+    /// - Returns: The matches in the order of addresses.
+    /// - Throws: `MemorySearch.Error`. Memory that fails to load is skipped with a warning.
+    public static func find(
+        _ pattern: Pattern,
+        in scope: Scope = .mappings,
+        session: ProcessWideSession,
+        chunks: ChunkTable? = nil,
+        limit: Int = .max,
+        workerCount: Int = 1
+    ) throws -> [Match] {
+        switch pattern {
+        case let .bytes(bytes) where bytes.isEmpty:
+            throw Error.emptyPattern
+        default:
+            break
+        }
+        guard let map = session.map else {
+            throw Error.mapNotLoaded
+        }
+
+        var chunks = chunks
+        chunks?.sort()
+
+        let windows: [Window]
+        switch scope {
+        case .mappings:
+            let readable = map
+                .filter { region in
+                    guard region.properties.flags.contains(.read) else {
+                        return false
+                    }
+                    switch region.properties.pathname {
+                    case .pseudopath(.vvar), .pseudopath(.vsyscall):
+                        return false
+                    default:
+                        return true
+                    }
+                }
+                .map(\.range)
+            windows = Self.windows(searching: readable, overlap: pattern.overlap, mergingGap: nil)
+        case .chunks:
+            guard let chunks = chunks else {
+                throw Error.chunksNotAvailable
+            }
+            let contents = chunks.indices
+                .filter { MemoryGraph.isNode(chunks.states[$0]) }
+                .map { MemoryGraph.content(of: $0, in: chunks) }
+                .filter { !$0.isEmpty }
+            // Adjacent chunks are separated by their headers
+            windows = Self.windows(searching: contents, overlap: pattern.overlap, mergingGap: UInt(2 * MemoryLayout<UInt>.size))
+        }
+
+        let found = try session.perform(windows, workerCount: workerCount) { window, taskSession in
+            var matches: [(address: UInt, value: UInt64?)] = []
+            MemoryGraph.withBytes(of: window.range, from: taskSession.memory) { bytes in
+                for piece in window.pieces where matches.count < limit {
+                    let offset = Int(piece.searched.lowerBound - window.range.lowerBound)
+                    let pieceBytes = UnsafeRawBufferPointer(rebasing: bytes[offset..<(offset + piece.searched.count)])
+                    pattern.search(pieceBytes) { position, value in
+                        let address = piece.searched.lowerBound + UInt(position)
+                        guard piece.owned.contains(address) else {
+                            return true
+                        }
+                        matches.append((address, value))
+                        return matches.count < limit
+                    }
+                }
+            }
+            return matches
+        }
+
+        return found
+            .joined()
+            .sorted { $0.address < $1.address }
+            .prefix(limit)
+            .map { match in
+                Match(
+                    address: match.address,
+                    value: match.value,
+                    region: session.mapIndex?.region(containing: match.address),
+                    symbol: session.symbolIndex?.symbols(containing: match.address).first,
+                    chunk: chunks.flatMap { chunks in chunks.index(containing: match.address).map { chunks[$0] } }
+                )
+            }
+    }
+
+    /// Splits the ranges into pieces of `windowSize` bytes and groups them into windows.
+    /// - Parameters:
+    ///   - ranges: Searched ranges in increasing order.
+    ///   - overlap: Number of bytes of the following piece searched with each piece.
+    ///   - mergingGap: Ranges separated by at most this number of bytes are read together, nil to
+    ///   read each range separately.
+    static func windows(searching ranges: [MemoryRange], overlap: UInt, mergingGap: UInt?) -> [Window] {
+        var windows: [Window] = []
+        var current: Window?
+
+        for range in ranges {
+            var pieceBase = range.lowerBound
+            while pieceBase < range.upperBound {
+                let owned = pieceBase..<min(pieceBase + windowSize, range.upperBound)
+                let piece = Piece(searched: owned.lowerBound..<min(owned.upperBound + overlap, range.upperBound), owned: owned)
+                pieceBase = owned.upperBound
+
+                if
+                    var window = current,
+                    let mergingGap = mergingGap,
+                    piece.searched.lowerBound >= window.range.upperBound,
+                    piece.searched.lowerBound - window.range.upperBound <= mergingGap,
+                    piece.searched.upperBound - window.range.lowerBound <= windowSize
+                {
+                    window.range = window.range.lowerBound..<piece.searched.upperBound
+                    window.pieces.append(piece)
+                    current = window
+                } else {
+                    if let window = current {
+                        windows.append(window)
+                    }
+                    current = Window(range: piece.searched, pieces: [piece])
+                }
+            }
+        }
+        if let window = current {
+            windows.append(window)
+        }
+
+        return windows
+    }
+}
+
+extension MemorySearch.Pattern {
+    /// Number of bytes of the following piece, that may contain the end of a match.
+    var overlap: UInt {
+        switch self {
+        case let .bytes(bytes):
+            return UInt(bytes.count - 1)
+        case .value, .values:
+            // Words are aligned, they never cross pieces
+            return 0
+        }
+    }
+
+    /// Calls the closure with the offset and the matching word (nil for byte patterns) of each match
+    /// in increasing order. Return false from the closure to stop the search.
+    func search(_ bytes: UnsafeRawBufferPointer, _ found: (Int, UInt64?) -> Bool) {
+        switch self {
+        case let .bytes(pattern):
+            Self.search(pattern, in: bytes, found)
+        case let .value(value):
+            Self.searchWords(in: bytes, lanes: { $0 .== SIMD8(repeating: value) }, matches: { $0 == value }, found)
+        case let .values(range):
+            let lower = SIMD8<UInt64>(repeating: range.lowerBound)
+            let upper = SIMD8<UInt64>(repeating: range.upperBound)
+            Self.searchWords(in: bytes, lanes: { ($0 .>= lower) .& ($0 .<= upper) }, matches: { range.contains($0) }, found)
+        }
+    }
+
+    /// Compares eight aligned words at once, the remaining words one by one.
+    private static func searchWords(
+        in bytes: UnsafeRawBufferPointer,
+        lanes: (SIMD8<UInt64>) -> SIMDMask<SIMD8<Int64>>,
+        matches: (UInt64) -> Bool,
+        _ found: (Int, UInt64?) -> Bool
+    ) {
+        let wordSize = MemoryLayout<UInt64>.size
+        let wordCount = bytes.count / wordSize
+        var word = 0
+        while word + 8 <= wordCount {
+            let words = bytes.loadUnaligned(fromByteOffset: word * wordSize, as: SIMD8<UInt64>.self)
+            let candidates = lanes(words)
+            if any(candidates) {
+                for lane in 0..<8 where candidates[lane] {
+                    guard found((word + lane) * wordSize, words[lane]) else {
+                        return
+                    }
+                }
+            }
+            word += 8
+        }
+
+        while word < wordCount {
+            let value = bytes.loadUnaligned(fromByteOffset: word * wordSize, as: UInt64.self)
+            if matches(value) {
+                guard found(word * wordSize, value) else {
+                    return
+                }
+            }
+            word += 1
+        }
+    }
+
+    /// Compares the first byte of the pattern with 32 bytes at once, candidates are compared
+    /// with the whole pattern.
+    private static func search(_ pattern: [UInt8], in bytes: UnsafeRawBufferPointer, _ found: (Int, UInt64?) -> Bool) {
+        guard bytes.count >= pattern.count, let base = bytes.baseAddress else {
+            return
+        }
+
+        let lastPosition = bytes.count - pattern.count
+        let first = SIMD32<UInt8>(repeating: pattern[0])
+        let matches = { (position: Int) -> Bool in
+            pattern.withUnsafeBytes { memcmp(base + position, $0.baseAddress!, pattern.count) == 0 }
+        }
+
+        var position = 0
+        while position + 32 <= lastPosition + 1 {
+            let candidates = bytes.loadUnaligned(fromByteOffset: position, as: SIMD32<UInt8>.self) .== first
+            if any(candidates) {
+                for lane in 0..<32 where candidates[lane] && matches(position + lane) {
+                    guard found(position + lane, nil) else {
+                        return
+                    }
+                }
+            }
+            position += 32
+        }
+
+        while position <= lastPosition {
+            if bytes[position] == pattern[0], matches(position) {
+                guard found(position, nil) else {
+                    return
+                }
+            }
+            position += 1
+        }
+    }
+}
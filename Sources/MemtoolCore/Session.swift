@@ -8,7 +8,7 @@ import Glibc
 public struct MemoryTag {
     /// Type, that has been previously bound to the remote memory in the 
     /// tracing process.
-    var type: Any.Type
+    public var type: Any.Type
 }
 
 /// Session is a reference-counted object, that manages (in a RAII way) the attachment
@@ -24,6 +24,9 @@ public protocol Session: AnyObject {
     /// the LAP of the remote process, and metadata associated with those adresses.
     var map: [MapRegion]? { get set }
 
+    /// Index of the `map` used for lookups of addresses. It is updated whenever the `map` is set.
+    var mapIndex: MapIndex? { get }
+
     /// Dictionary, that contains base address of the LAP of the remote process, to 
     /// which an executable file was loaded.
     var executableFileBasePoints: [String: UInt]? { get set }
@@ -34,9 +37,26 @@ public protocol Session: AnyObject {
     /// Symbols, that represent a region in the traced process memory.
     var symbols: [SymbolRegion]? { set get }
 
-    /// Dictionary, that stores additional information for a given address of the 
-    /// remote process memory. These records are created during analysis.
-    var tag: [UInt: MemoryTag] { get set }
+    /// Index of `symbols` and `unloadedSymbols` used for queries. It is rebuilt after any of them changes.
+    var symbolIndex: SymbolIndex? { get }
+
+    /// Types bound to the addresses of the remote process memory by the checked loads. Shared by
+    /// the sessions of the threads of the process.
+    var tags: TagStore { get }
+
+    /// Memory of the process used by the checked loads. Copies of the memory of a live process
+    /// have to be invalidated whenever the process is resumed.
+    var memory: MemoryReader { get }
+
+    /// Value of the `FS_BASE` register of the thread, which points to its `tcbhead_t`.
+    var fsBase: UInt { get }
+}
+
+/// Session of the whole process, that provides sessions of its threads. Implemented by attached
+/// processes as well as by sessions analyzing a copy of the process.
+public protocol ProcessWideSession: Session {
+    /// Sessions of the threads of the process except the main thread.
+    var threads: [Session] { get }
 }
 
 public enum SessionError: Error {
@@ -46,6 +66,11 @@ public enum SessionError: Error {
 }
 
 public extension Session {
+    /// Reads the register of the attached thread using `ptrace`.
+    var fsBase: UInt {
+        UInt(bitPattern: swift_inspect_bridge__ptrace_peekuser(ptraceId, FS_BASE))
+    }
+
     /// Use this method to load a BoundRemoteMemory in a safer manner. Data stored in the 
     /// `Session` object are consulted in order to determine, whether the load might be safe.
     /// - Parameters:
@@ -55,20 +80,61 @@ public extension Session {
     func checkedLoad<T>(of type: T.Type, base: UInt, skipMismatchTypeCheck: Bool = false) throws -> BoundRemoteMemory<T> {
         let range = base..<(base + UInt(MemoryLayout<T>.size))
 
-        guard map?.contains(where: { $0.range.contains(range) }) == true else {
+        guard mapIndex?.contains(range) == true else {
             throw SessionError.loadOutsideOfKnownMemory
         }
 
-        if !skipMismatchTypeCheck {
-            let existingTag = tag[base].flatMap({ $0.type == type })
-            guard existingTag == nil || existingTag == true else {
-                error("Error: Checked load of type \(type) at " + String(format: "%016lx", base) + " failed. Previously loaded a mismatching type \(tag[base]!.type).")
-                throw SessionError.loadingPreviouslyLoadedTypeMismatch
+        if !skipMismatchTypeCheck, let existing = tags.record(type, at: base) {
+            error("Error: Checked load of type \(type) at " + String(format: "%016lx", base) + " failed. Previously loaded a mismatching type \(existing).")
+            throw SessionError.loadingPreviouslyLoadedTypeMismatch
+        }
+
+        return try memory.load(of: T.self, base: base)
+    }
+
+    /// Use this method to load raw bytes in a safer manner. Data stored in the `Session` object
+    /// are consulted in order to determine, whether the load might be safe.
+    /// - Parameter segment: Range of the remote memory.
+    func checkedLoad(segment: MemoryRange) throws -> RawRemoteMemory {
+        guard mapIndex?.contains(segment) == true else {
+            throw SessionError.loadOutsideOfKnownMemory
+        }
+
+        return try memory.load(segment)
+    }
+
+    /// Loads zero terminated string from the remote process. The load ends at the terminator,
+    /// after `maxLength` bytes or at the end of the readable memory.
+    /// - Parameters:
+    ///   - base: Base address of the string.
+    ///   - maxLength: Maximal number of bytes loaded.
+    func checkedLoadCString(base: UInt, maxLength: UInt = 4096) throws -> String {
+        guard mapIndex?.contains(base) == true else {
+            throw SessionError.loadOutsideOfKnownMemory
+        }
+
+        var bytes: [UInt8] = []
+        var current = base
+        while current < base + maxLength {
+            // Load at most until the end of the page, so the load never crosses into unreadable page
+            let pageEnd = (current & ~(RemoteMemoryCache.pageSize - 1)) + RemoteMemoryCache.pageSize
+            let segment = current..<min(pageEnd, base + maxLength)
+            let piece: RawRemoteMemory
+            do {
+                piece = try memory.load(segment)
+            } catch where current != base {
+                break
+            }
+
+            if let terminator = piece.buffer.firstIndex(of: 0) {
+                bytes.append(contentsOf: piece.buffer[..<terminator])
+                break
             }
-            tag[base] = MemoryTag(type: type)
+            bytes.append(contentsOf: piece.buffer)
+            current = segment.upperBound
         }
 
-        return BoundRemoteMemory(pid: pid, load: base)
+        return String(decoding: bytes, as: UTF8.self)
     }
 
     /// Use this method to load a Chunk in a safer manner. Data stored in the `Session` object 
@@ -84,97 +150,147 @@ public extension Session {
 
         let chunkContent = (baseAddress + Chunk.chunkContentOffset)..<endAddress.partialValue
 
-        guard map?.contains(where: { $0.range.contains(chunkContent) }) == true else {
+        guard mapIndex?.contains(chunkContent) == true else {
             throw SessionError.loadOutsideOfKnownMemory
         }
 
-        return Chunk(header: header, content: RawRemoteMemory(pid: pid, load: chunkContent)
-        )
+        return Chunk(header: header, content: try memory.load(chunkContent))
     }
 }
 
-public final class ProcessSession: Session {
+public extension Session {
+    /// Loads symbols for executable files and computes their location in the LAP of the 
+    /// remote process. Fills `unloadedSymbols` and `symbols`.
+    /// - Parameter store: Symbols of files already decoded for other sessions, the files are
+    ///   decoded by this session without it.
+    func loadSymbols(store: SharedSymbolStore? = nil) {
+        guard let maps = executableFileBasePoints else { return }
+        let files = Array(maps.keys)
+
+        Metrics.measure("loadSymbols") {
+            var unloadedSymbols: [String: [UnloadedSymbolInfo]] = [:]
+            for file in files {
+                // Symbols are free of duplicities
+                unloadedSymbols[file] = store?.symbols(for: file) ?? Symbolication.loadSymbols(for: file)
+            }
+
+            resolveSymbols(unloadedSymbols)
+        }
+    }
+
+    /// Computes the location of the symbols of executable files in the LAP of the remote
+    /// process. Fills `unloadedSymbols` and `symbols`.
+    /// - Parameter unloadedSymbols: Symbols of the executable files.
+    func resolveSymbols(_ unloadedSymbols: [String: [UnloadedSymbolInfo]]) {
+        let maps = executableFileBasePoints ?? [:]
+
+        var symbols: [SymbolRegion] = []
+        symbols.reserveCapacity(unloadedSymbols.values.map(\.count).reduce(0, +))
+        for (_, unloaded) in unloadedSymbols {
+            for symbol in unloaded {
+                guard 
+                    case let .known(known) = symbol.segment, 
+                    ProcessSession.sectionsToResolve.contains(known) 
+                else {
+                    continue
+                }
+                SymbolRegion(unloadedSymbol: symbol, executableFileBasePoints: maps).flatMap { symbols.append($0) }
+            }
+        }
+
+        self.unloadedSymbols = unloadedSymbols
+        self.symbols = symbols
+        // Build the index once, so queries do not pay for it
+        _ = symbolIndex
+    }
+}
+
+public final class ProcessSession: ProcessWideSession {
     public var ptraceId: Int32 { pid }
 
     public let pid: Int32
 
-    public var map: [MapRegion]?
+    public var map: [MapRegion]? {
+        didSet {
+            mapIndex = map.flatMap(MapIndex.init(regions:))
+        }
+    }
+    public private(set) var mapIndex: MapIndex?
     public var executableFileBasePoints: [String: UInt]?
-    public var unloadedSymbols: [String: [UnloadedSymbolInfo]]?
-    public var symbols: [SymbolRegion]?
+    public var unloadedSymbols: [String: [UnloadedSymbolInfo]]? {
+        didSet {
+            symbolIndexStorage = nil
+        }
+    }
+    public var symbols: [SymbolRegion]? {
+        didSet {
+            symbolIndexStorage = nil
+        }
+    }
+    public var symbolIndex: SymbolIndex? {
+        if symbolIndexStorage == nil, let symbols = symbols {
+            symbolIndexStorage = SymbolIndex(symbols: symbols, unloadedSymbols: unloadedSymbols ?? [:])
+        }
+        return symbolIndexStorage
+    }
+    private var symbolIndexStorage: SymbolIndex?
     public var threadSessions: [ThreadSession] = []
-    public var tag: [UInt: MemoryTag] = [:]
-
+    public var threads: [Session] { threadSessions }
+    public let tags = TagStore()
+    /// Copies of the memory of the process, invalidated when threads are reloaded.
+    public let cache: RemoteMemoryCache
+    public var memory: MemoryReader { cache }
+
+    /// Whether the main thread is attached and stopped, see `detach()`.
+    public private(set) var isAttached = false
+    /// Signal, that the main thread was stopped in the delivery of, delivered by the detach.
+    private var pendingSignal: Int32 = 0
+
+    /// Attaches the main thread and waits until it stops. Threads are attached by `loadThreads()`.
     public init(pid: Int32) {
-        swift_inspect_bridge__ptrace_attach(pid)
         self.pid = pid
+        self.cache = RemoteMemoryCache(pid: pid)
+        isAttached = swift_inspect_bridge__ptrace_attach_and_wait(pid, &pendingSignal) == 0
+        if !isAttached {
+            error("Warning: Failed to attach \(pid), errno \(errno)")
+        }
     }
 
     deinit {
-        swift_inspect_bridge__ptrace_syscall(pid)
+        detach()
     }
 
-    /// Loads map of LAP of the remote process. Fills `map` and `executableFileBasePoints`.
-    public func loadMap() {
-        map = Map.getMap(for: pid)
-        executableFileBasePoints = [:]
-        for map in map ?? [] {
-            guard case let .file(filename) = map.properties.pathname else {
-                continue
-            }
-
-            let current = executableFileBasePoints?[filename]
-            executableFileBasePoints?[filename] = current.flatMap { min($0, map.range.lowerBound) } ?? map.range.lowerBound
+    /// Detaches the threads and the main thread, so the process continues without stopping
+    /// again. Loads of the memory still work, but the process changes under them. Has to be
+    /// called by the thread, that created the session, like all other `ptrace` requests.
+    public func detach() {
+        threadSessions.forEach { $0.detach() }
+        if isAttached {
+            swift_inspect_bridge__ptrace_detach(pid, pendingSignal)
+            isAttached = false
         }
+        cache.invalidate()
+    }
 
-        // Remove files that do not have executable page in memory
-        executableFileBasePoints = executableFileBasePoints?.filter { key, _ -> Bool in
-            for map in map ?? [] {
-                if case let .file(filename) = map.properties.pathname, filename == key, map.properties.flags.contains(.execute) {
-                    return true
-                }
-            }
-            return false
+    /// Loads map of LAP of the remote process. Fills `map` and `executableFileBasePoints`.
+    public func loadMap() {
+        Metrics.measure("loadMap") {
+            map = Map.getMap(for: pid)
+            executableFileBasePoints = map.map(Map.executableFileBasePoints(in:))
         }
     }
 
     /// Symbol types, that are resolved against the base address of their file and their location.
     public static let sectionsToResolve: Set<KnownSymbolSection> = [.bss, .data, .data1, .rodata, .rodata1, .text, .dataRelRo]
 
-    /// Loads symbols for executable files and computes their location in the LAP of the 
-    /// remote process. Fills `unloadedSymbols` and `symbols`.
-    public func loadSymbols() {
-        guard let maps = executableFileBasePoints else { return }
-        let files = Array(maps.keys)
-
-        unloadedSymbols = [:]
-        for file in files {
-            let symbols = Symbolication.loadSymbols(for: file)
-            // Remove duplicities
-            let hashedSymbols = Array(Set(symbols))
-            unloadedSymbols?[file] = hashedSymbols
-        }
-
-        symbols = []
-        symbols?.reserveCapacity( unloadedSymbols?.values.map(\.count).reduce(0, +) ?? 0)
-        for (_, unloaded) in unloadedSymbols ?? [:] {
-            for symbol in unloaded {
-                guard 
-                    case let .known(known) = symbol.segment, 
-                    ProcessSession.sectionsToResolve.contains(known) 
-                else {
-                    continue
-                }
-                SymbolRegion(unloadedSymbol: symbol, executableFileBasePoints: maps).flatMap { symbols?.append($0) }
-            }
-        }
-    }
-
     /// Loads the TIDs of threads associated with this process and creates ThreadSession
     /// instances.
     public func loadThreads() {
-        let threads = ThreadLoader(pid: pid)
+        let threads = Metrics.measure("loadThreads") { ThreadLoader(pid: pid) }
+        // Threads are detached before they are attached again by the new sessions
+        threadSessions.forEach { $0.detach() }
         threadSessions = threads.threads.map { ThreadSession(tid: $0, owner: self) }
+        cache.invalidate()
     }
 }
 
@@ -193,6 +309,10 @@ public final class ThreadSession: Session {
         }
     }
 
+    public var mapIndex: MapIndex? { owner.mapIndex }
+
+    public var symbolIndex: SymbolIndex? { owner.symbolIndex }
+
     public var executableFileBasePoints: [String : UInt]? {
         get {
             owner.executableFileBasePoints
@@ -220,22 +340,129 @@ public final class ThreadSession: Session {
         }
     }
 
-    public var tag: [UInt: MemoryTag] {
-        get {
-            owner.tag
-        }
-        set {
-            owner.tag = newValue
-        }
-    }
+    public var tags: TagStore { owner.tags }
+
+    public var cache: RemoteMemoryCache { owner.cache }
+
+    public var memory: MemoryReader { owner.memory }
 
+    /// Whether the thread is attached and stopped, see `detach()`.
+    public private(set) var isAttached = false
+    /// Signal, that the thread was stopped in the delivery of, delivered by the detach.
+    private var pendingSignal: Int32 = 0
+
+    /// Attaches the thread and waits until it stops.
     public init(tid: Int32, owner: ProcessSession) {
-        swift_inspect_bridge__ptrace_attach(tid)
         self.owner = owner
         self.tid = tid
+        isAttached = swift_inspect_bridge__ptrace_attach_and_wait(tid, &pendingSignal) == 0
+        if !isAttached {
+            error("Warning: Failed to attach thread \(tid), errno \(errno)")
+        }
     }
 
     deinit {
-        swift_inspect_bridge__ptrace_syscall(tid)
+        detach()
+    }
+
+    /// Detaches the thread, so it continues without stopping again.
+    public func detach() {
+        guard isAttached else {
+            return
+        }
+        swift_inspect_bridge__ptrace_detach(tid, pendingSignal)
+        isAttached = false
+    }
+}
+
+/// WorkerSession reads the memory of the process on behalf of its owner on a background thread.
+/// It never issues `ptrace` requests (loads use `process_vm_readv` or `/proc/[pid]/mem`), it
+/// copies the map and symbols of the owner and keeps its own reader and tags. Create it on the
+/// thread that uses the owner; merging of the tags back to the owner is up to the caller.
+public final class WorkerSession: Session {
+    public let pid: Int32
+    /// Worker does not perform `ptrace` requests, the PID is reported for completeness.
+    public var ptraceId: Int32 { pid }
+
+    public var map: [MapRegion]? {
+        didSet {
+            mapIndex = map.flatMap(MapIndex.init(regions:))
+        }
+    }
+    public private(set) var mapIndex: MapIndex?
+    public var executableFileBasePoints: [String: UInt]?
+    public var unloadedSymbols: [String: [UnloadedSymbolInfo]]? {
+        didSet {
+            symbolIndex = symbols.map { SymbolIndex(symbols: $0, unloadedSymbols: unloadedSymbols ?? [:]) }
+        }
+    }
+    public var symbols: [SymbolRegion]? {
+        didSet {
+            symbolIndex = symbols.map { SymbolIndex(symbols: $0, unloadedSymbols: unloadedSymbols ?? [:]) }
+        }
+    }
+    public private(set) var symbolIndex: SymbolIndex?
+    /// Tags of the worker, that use the policy of the owner.
+    public let tags: TagStore
+    public let memory: MemoryReader
+    public let fsBase: UInt
+
+    public init(owner: Session) {
+        self.pid = owner.pid
+        self.map = owner.map
+        self.mapIndex = owner.mapIndex
+        self.executableFileBasePoints = owner.executableFileBasePoints
+        self.unloadedSymbols = owner.unloadedSymbols
+        self.symbols = owner.symbols
+        self.symbolIndex = owner.symbolIndex
+        self.tags = TagStore(policy: owner.tags.policy)
+        self.memory = owner.memory.makeWorkerReader()
+        self.fsBase = owner.fsBase
+    }
+}
+
+extension Session {
+    /// Performs the tasks and returns their results in the order of the tasks. With a single worker
+    /// the tasks are performed in order using this session. Otherwise each worker reads the
+    /// memory through its own `WorkerSession` and the tags collected by the workers are merged into
+    /// this session afterwards.
+    /// - Throws: The error of the first failed task in the order of the tasks.
+    func perform<Task, Output>(_ tasks: [Task], workerCount: Int, _ body: (Task, Session) throws -> Output) throws -> [Output] {
+        let workerCount = min(workerCount, tasks.count)
+        guard workerCount > 1 else {
+            return try tasks.map { try body($0, self) }
+        }
+
+        // Workers copy the map and symbols of the process, they have to be created by this thread
+        let workers = (0..<workerCount).map { _ in WorkerSession(owner: self) }
+        var results = [Result<Output, Swift.Error>?](repeating: nil, count: tasks.count)
+        let lock = NSLock()
+        var nextTask = 0
+
+        results.withUnsafeMutableBufferPointer { storage in
+            // Each task writes only its own element
+            let results = storage
+            DispatchQueue.concurrentPerform(iterations: workerCount) { worker in
+                while true {
+                    lock.lock()
+                    let task = nextTask
+                    nextTask += 1
+                    lock.unlock()
+
+                    guard task < tasks.count else {
+                        return
+                    }
+                    results[task] = Result { try body(tasks[task], workers[worker]) }
+                }
+            }
+        }
+
+        let outputs = try results.map { try $0!.get() }
+
+        for worker in workers {
+            try tags.merge(worker.tags)
+        }
+
+        return outputs
     }
 }
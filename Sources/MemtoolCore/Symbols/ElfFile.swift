@@ -0,0 +1,334 @@
+import Foundation
+import Cutils
+import Glibc
+
+/// ElfFile provides read-only access to an ELF64 file mapped into the memory of the tracing process.
+/// Only the section headers are parsed when the file is opened, symbol tables are decoded
+/// on demand directly from the mapped memory.
+public final class ElfFile {
+    public enum Error: Swift.Error {
+        case couldNotOpen(errno: Int32)
+        case couldNotMap(errno: Int32)
+        case notElf64
+        case malformedSectionHeaders
+    }
+
+    /// Section of the ELF file with resolved name.
+    public struct Section {
+        public let index: Int
+        public let name: String
+        public let header: Elf64_Shdr
+    }
+
+    /// Path of the file.
+    public let path: String
+    /// All sections of the file in the order of the section header table.
+    public let sections: [Section]
+
+    private let base: UnsafeRawPointer
+    private let size: Int
+
+    /// Maps the file into memory and parses the section headers.
+    /// - Parameter path: Path to the ELF64 file.
+    public init(path: String) throws {
+        let fd = open(path, O_RDONLY | O_CLOEXEC)
+        guard fd >= 0 else {
+            throw Error.couldNotOpen(errno: errno)
+        }
+        defer { close(fd) }
+
+        var status = stat()
+        guard fstat(fd, &status) == 0 else {
+            throw Error.couldNotOpen(errno: errno)
+        }
+
+        let size = Int(status.st_size)
+        guard size >= MemoryLayout<Elf64_Ehdr>.size else {
+            throw Error.notElf64
+        }
+
+        guard let mapped = mmap(nil, size, PROT_READ, MAP_PRIVATE, fd, 0), mapped != UnsafeMutableRawPointer(bitPattern: -1) else {
+            throw Error.couldNotMap(errno: errno)
+        }
+        let base = UnsafeRawPointer(mapped)
+
+        do {
+            self.sections = try ElfFile.parseSections(base: base, size: size)
+        } catch {
+            munmap(mapped, size)
+            throw error
+        }
+
+        self.path = path
+        self.base = base
+        self.size = size
+    }
+
+    deinit {
+        munmap(UnsafeMutableRawPointer(mutating: base), size)
+    }
+
+    /// Returns the first section with given name.
+    public func section(named name: String) -> Section? {
+        sections.first { $0.name == name }
+    }
+
+    /// Content of the section in the mapped file. Sections without content in the file (like `.bss`)
+    /// or sections exceeding the file yield nil.
+    public func content(of section: Section) -> UnsafeRawBufferPointer? {
+        let offset = Int(section.header.sh_offset)
+        let count = Int(section.header.sh_size)
+        guard
+            section.header.sh_type != UInt32(SHT_NOBITS),
+            offset <= size,
+            count <= size - offset
+        else {
+            return nil
+        }
+        return UnsafeRawBufferPointer(start: base + offset, count: count)
+    }
+
+    /// The content of the GNU build-id note, if present.
+    public private(set) lazy var buildId: [UInt8]? = {
+        for section in self.sections where section.header.sh_type == UInt32(SHT_NOTE) {
+            guard let content = self.content(of: section) else {
+                continue
+            }
+
+            var offset = 0
+            let headerSize = MemoryLayout<Elf64_Nhdr>.size
+            while offset + headerSize <= content.count {
+                let note = content.loadUnaligned(fromByteOffset: offset, as: Elf64_Nhdr.self)
+                let nameSize = (Int(note.n_namesz) + 3) & ~3
+                let descriptorSize = (Int(note.n_descsz) + 3) & ~3
+                let descriptorOffset = offset + headerSize + nameSize
+
+                guard descriptorOffset + Int(note.n_descsz) <= content.count else {
+                    break
+                }
+
+                if note.n_type == UInt32(NT_GNU_BUILD_ID), note.n_namesz == 4 {
+                    return Array(content[descriptorOffset..<(descriptorOffset + Int(note.n_descsz))])
+                }
+                offset = descriptorOffset + descriptorSize
+            }
+        }
+        return nil
+    }()
+
+    /// File name stored in the `.gnu_debuglink` section, if present.
+    public private(set) lazy var debugLink: String? = {
+        guard
+            let linkSection = self.section(named: ".gnu_debuglink"),
+            let content = self.content(of: linkSection),
+            let terminator = content.firstIndex(of: 0),
+            terminator > 0
+        else {
+            return nil
+        }
+        return String(decoding: content[0..<terminator], as: UTF8.self)
+    }()
+
+    /// Name of the section as printed by `objdump`, including the special section indices.
+    public func sectionName(for index: UInt16) -> String {
+        switch Int32(index) {
+        case SHN_UNDEF:
+            return "*UND*"
+        case SHN_ABS:
+            return "*ABS*"
+        case SHN_COMMON:
+            return "*COM*"
+        default:
+            return Int(index) < sections.count ? sections[Int(index)].name : "*UND*"
+        }
+    }
+
+    /// Decodes all symbols of the `.symtab` section.
+    /// - Parameter file: File reported in the symbols (the debug file reports symbols of the original file).
+    public func staticSymbols(reportedAs file: String? = nil) -> [UnloadedSymbolInfo] {
+        guard let table = sections.first(where: { $0.header.sh_type == UInt32(SHT_SYMTAB) }) else {
+            return []
+        }
+        return symbols(in: table, dynamic: false, reportedAs: file ?? path)
+    }
+
+    /// Decodes all symbols of the `.dynsym` section.
+    /// - Parameter file: File reported in the symbols.
+    public func dynamicSymbols(reportedAs file: String? = nil) -> [UnloadedSymbolInfo] {
+        guard let table = sections.first(where: { $0.header.sh_type == UInt32(SHT_DYNSYM) }) else {
+            return []
+        }
+        return symbols(in: table, dynamic: true, reportedAs: file ?? path)
+    }
+
+    /// Looks up a symbol in the `.symtab` and `.dynsym` sections. Only the matching entry is decoded.
+    /// - Parameters:
+    ///   - name: Exact name of the symbol.
+    ///   - file: File reported in the symbol.
+    public func symbol(named name: String, reportedAs file: String? = nil) -> UnloadedSymbolInfo? {
+        let requested = Array(name.utf8)
+        for type in [UInt32(SHT_SYMTAB), UInt32(SHT_DYNSYM)] {
+            guard let table = sections.first(where: { $0.header.sh_type == type }) else {
+                continue
+            }
+
+            var result: UnloadedSymbolInfo?
+            forEachSymbol(in: table) { symbol, symbolName in
+                guard symbolName.elementsEqual(requested) else {
+                    return true
+                }
+                result = makeSymbol(symbol, name: symbolName, dynamic: type == UInt32(SHT_DYNSYM), file: file ?? path)
+                return false
+            }
+
+            if result != nil {
+                return result
+            }
+        }
+        return nil
+    }
+
+    private func symbols(in table: Section, dynamic: Bool, reportedAs file: String) -> [UnloadedSymbolInfo] {
+        var result: [UnloadedSymbolInfo] = []
+        result.reserveCapacity(Int(table.header.sh_size) / MemoryLayout<Elf64_Sym>.size)
+        forEachSymbol(in: table) { symbol, name in
+            result.append(makeSymbol(symbol, name: name, dynamic: dynamic, file: file))
+            return true
+        }
+        return result
+    }
+
+    /// Iterates the entries of the symbol table without copying. The null entry is skipped.
+    /// - Parameter body: Receives the symbol and bytes of its name, returns false to stop the iteration.
+    private func forEachSymbol(in table: Section, _ body: (Elf64_Sym, UnsafeRawBufferPointer) -> Bool) {
+        guard
+            let entries = content(of: table),
+            Int(table.header.sh_link) < sections.count,
+            let strings = content(of: sections[Int(table.header.sh_link)])
+        else {
+            return
+        }
+
+        let entrySize = MemoryLayout<Elf64_Sym>.size
+        for index in 1..<max(entries.count / entrySize, 1) {
+            let symbol = entries.loadUnaligned(fromByteOffset: index * entrySize, as: Elf64_Sym.self)
+            let nameStart = Int(symbol.st_name)
+            var name = UnsafeRawBufferPointer(start: nil, count: 0)
+            if nameStart < strings.count {
+                let tail = UnsafeRawBufferPointer(rebasing: strings[nameStart...])
+                name = UnsafeRawBufferPointer(rebasing: tail[..<(tail.firstIndex(of: 0) ?? tail.endIndex)])
+            }
+
+            guard body(symbol, name) else {
+                return
+            }
+        }
+    }
+
+    private func makeSymbol(_ symbol: Elf64_Sym, name: UnsafeRawBufferPointer, dynamic: Bool, file: String) -> UnloadedSymbolInfo {
+        let segment = sectionName(for: symbol.st_shndx)
+        let isSectionSymbol = Int32(symbol.st_info & 0xf) == STT_SECTION
+        return UnloadedSymbolInfo(
+            file: file,
+            location: UInt(symbol.st_value),
+            flags: SymbolFlags(elfInfo: symbol.st_info, dynamic: dynamic),
+            segment: SymbolSection(rawValue: segment),
+            size: UInt(symbol.st_size),
+            // Section symbols are printed with the name of their section
+            name: name.isEmpty && isSectionSymbol ? segment : String(decoding: name, as: UTF8.self)
+        )
+    }
+
+    private static func parseSections(base: UnsafeRawPointer, size: Int) throws -> [Section] {
+        let header = base.loadUnaligned(as: Elf64_Ehdr.self)
+        guard
+            header.e_ident.0 == 0x7f,
+            header.e_ident.1 == UInt8(ascii: "E"),
+            header.e_ident.2 == UInt8(ascii: "L"),
+            header.e_ident.3 == UInt8(ascii: "F"),
+            header.e_ident.4 == UInt8(ELFCLASS64)
+        else {
+            throw Error.notElf64
+        }
+
+        let count = Int(header.e_shnum)
+        let offset = Int(header.e_shoff)
+        let entrySize = Int(header.e_shentsize)
+        guard count > 0 else {
+            return []
+        }
+        guard
+            entrySize >= MemoryLayout<Elf64_Shdr>.size,
+            offset <= size,
+            count * entrySize <= size - offset,
+            Int(header.e_shstrndx) < count
+        else {
+            throw Error.malformedSectionHeaders
+        }
+
+        let headers = (0..<count).map { index in
+            base.loadUnaligned(fromByteOffset: offset + index * entrySize, as: Elf64_Shdr.self)
+        }
+
+        let names = headers[Int(header.e_shstrndx)]
+        let namesOffset = Int(names.sh_offset)
+        let namesCount = Int(names.sh_size)
+        guard namesOffset <= size, namesCount <= size - namesOffset else {
+            throw Error.malformedSectionHeaders
+        }
+        let nameTable = UnsafeRawBufferPointer(start: base + namesOffset, count: namesCount)
+
+        return headers.enumerated().map { index, sectionHeader in
+            var name = ""
+            let nameStart = Int(sectionHeader.sh_name)
+            if nameStart < nameTable.count {
+                let tail = nameTable[nameStart...]
+                name = String(decoding: tail[..<(tail.firstIndex(of: 0) ?? tail.endIndex)], as: UTF8.self)
+            }
+            return Section(index: index, name: name, header: sectionHeader)
+        }
+    }
+}
+
+extension SymbolFlags {
+    /// Creates the flags the same way `objdump` does for ELF symbols.
+    /// - Parameters:
+    ///   - elfInfo: The `st_info` field of the symbol
+    ///   - dynamic: The symbol is from the dynamic symbol table
+    init(elfInfo: UInt8, dynamic: Bool) {
+        let binding = Int32(elfInfo >> 4)
+        let type = Int32(elfInfo & 0xf)
+
+        switch binding {
+        case STB_LOCAL:
+            self.scopeFlag = .local
+        case STB_GLOBAL:
+            self.scopeFlag = .global
+        case STB_GNU_UNIQUE:
+            self.scopeFlag = .uniqueGlobal
+        default:
+            self.scopeFlag = .neither
+        }
+        self.weakFlag = binding == STB_WEAK ? .weak : .strong
+        self.constructorFlag = .ordianry
+        self.warningFlag = .normal
+        self.referenceFlag = type == STT_GNU_IFUNC ? .functionEvalOnRec : .normal
+
+        if type == STT_SECTION || type == STT_FILE {
+            self.debuggingFlag = .debugging
+        } else {
+            self.debuggingFlag = dynamic ? .dynamic : .normal
+        }
+
+        switch type {
+        case STT_FUNC, STT_GNU_IFUNC:
+            self.typeFlag = .function
+        case STT_FILE:
+            self.typeFlag = .file
+        case STT_OBJECT, STT_COMMON:
+            self.typeFlag = .object
+        default:
+            self.typeFlag = .normal
+        }
+    }
+}
@@ -0,0 +1,79 @@
+import Foundation
+import Glibc
+
+/// SharedSymbolStore keeps decoded symbols of ELF files in memory, so sessions of many processes
+/// mapping the same files (for example workers of a prefork server) decode each file only once.
+///
+/// Files are identified by their device, inode, size and modification time, so processes, that
+/// map the same file under different paths, share the entry as well. Stored symbols are never
+/// modified and the store is thread-safe: sessions on different threads may load symbols
+/// concurrently, a file requested by several of them at once is decoded by the first one while
+/// the others wait for the result.
+///
+/// ```swift
+/// let store = SharedSymbolStore()
+/// for session in sessions {
+///     session.loadSymbols(store: store)
+/// }
+/// ```
+public final class SharedSymbolStore {
+    /// Symbols of a single file, decoded by the first request.
+    private final class Entry {
+        let lock = NSLock()
+        var symbols: [UnloadedSymbolInfo]?
+    }
+
+    private let lock = NSLock()
+    private var entries: [String: Entry] = [:]
+
+    public init() {}
+
+    /// Number of files, whose symbols were requested.
+    public var fileCount: Int {
+        lock.lock()
+        defer { lock.unlock() }
+        return entries.count
+    }
+
+    /// Symbols of the file as reported by `Symbolication.loadSymbols(for:)`, decoded on the first request.
+    /// - Parameter file: Path to the ELF file.
+    public func symbols(for file: String) -> [UnloadedSymbolInfo] {
+        let key = Self.key(for: file)
+
+        lock.lock()
+        let entry = entries[key] ?? Entry()
+        entries[key] = entry
+        lock.unlock()
+
+        entry.lock.lock()
+        defer { entry.lock.unlock() }
+        if let symbols = entry.symbols {
+            return Self.symbols(symbols, reportedAs: file)
+        }
+
+        let symbols = Symbolication.loadSymbols(for: file)
+        entry.symbols = symbols
+        return symbols
+    }
+
+    /// Key of the file, its path if the file can not be examined.
+    static func key(for file: String) -> String {
+        var status = stat()
+        guard stat(file, &status) == 0 else {
+            return "p-" + file
+        }
+        return "f-\(status.st_dev)-\(status.st_ino)-\(status.st_size)-\(status.st_mtim.tv_sec).\(status.st_mtim.tv_nsec)"
+    }
+
+    /// Symbols stored for another path of the same file refer to the requested path.
+    private static func symbols(_ symbols: [UnloadedSymbolInfo], reportedAs file: String) -> [UnloadedSymbolInfo] {
+        guard let first = symbols.first, first.file != file else {
+            return symbols
+        }
+        return symbols.map { symbol in
+            var symbol = symbol
+            symbol.file = file
+            return symbol
+        }
+    }
+}
@@ -0,0 +1,305 @@
+import Foundation
+import Glibc
+
+/// SymbolCache persists decoded symbols of ELF files in a directory, so the next attach to a
+/// process, that maps the same files, does not need to decode their symbol tables again.
+///
+/// Entries are keyed by the GNU build-id of the file. Files without build-id are keyed by
+/// their device, inode, size and modification time. Each entry is a single file containing
+/// a header, fixed-size records and a string table in the native byte order. The entry is
+/// mapped into memory when it is read and the names of the symbols are decoded from the
+/// mapped string table only when they are requested.
+///
+/// Once an entry is stored, a link named by the device, inode, size and modification time of
+/// the file points to it, so a warm load costs a `stat` of the file and a `mmap` of the entry.
+/// The file is not opened and its debug file is not searched again. Symbols stored without
+/// a debug file are therefore kept even if the debug file is installed later, remove the
+/// directory to pick it up.
+public final class SymbolCache {
+    public enum Error: Swift.Error {
+        case couldNotOpen(errno: Int32)
+        case couldNotMap(errno: Int32)
+        case malformedEntry
+        case unsupportedVersion
+    }
+
+    /// Decoded content of a cache entry.
+    public struct Entry {
+        /// Symbols reported for the requested file, their names refer to the mapped entry.
+        public var symbols: [UnloadedSymbolInfo]
+        /// Symbols of the separate debug file are included.
+        public var hasDebugFile: Bool
+    }
+
+    /// Entry file mapped into the memory of the tracing process. It is unmapped when the last
+    /// symbol name referring to it is released.
+    final class MappedEntry {
+        let bytes: UnsafeRawBufferPointer
+
+        init(path: String) throws {
+            let fd = open(path, O_RDONLY | O_CLOEXEC)
+            guard fd >= 0 else {
+                throw Error.couldNotOpen(errno: errno)
+            }
+            defer { close(fd) }
+
+            var status = stat()
+            guard fstat(fd, &status) == 0 else {
+                throw Error.couldNotOpen(errno: errno)
+            }
+
+            let size = Int(status.st_size)
+            guard size >= MemoryLayout<Header>.size else {
+                throw Error.malformedEntry
+            }
+
+            guard let mapped = mmap(nil, size, PROT_READ, MAP_PRIVATE, fd, 0), mapped != UnsafeMutableRawPointer(bitPattern: -1) else {
+                throw Error.couldNotMap(errno: errno)
+            }
+            self.bytes = UnsafeRawBufferPointer(start: mapped, count: size)
+        }
+
+        deinit {
+            munmap(UnsafeMutableRawPointer(mutating: bytes.baseAddress), bytes.count)
+        }
+    }
+
+    private struct Header {
+        var magic: UInt32
+        var version: UInt32
+        var count: UInt32
+        var flags: UInt32
+        var stringsSize: UInt64
+    }
+
+    private struct Record {
+        var location: UInt64
+        var size: UInt64
+        /// ASCII characters of `SymbolFlags.rawValue`
+        var flags: UInt64
+        var nameOffset: UInt32
+        var nameLength: UInt32
+        var sectionOffset: UInt32
+        var sectionLength: UInt32
+    }
+
+    private static let magic: UInt32 = 0x4353_544d // "MTSC"
+    private static let version: UInt32 = 1
+    private static let hasDebugFileFlag: UInt32 = 0b1
+
+    /// Directory containing the entries.
+    public let directory: URL
+
+    public init(directory: URL) {
+        self.directory = directory
+    }
+
+    /// Cache located in `$XDG_CACHE_HOME/memtool/symbols` or `~/.cache/memtool/symbols`.
+    /// Returns nil if the environment variable `MEMTOOL_SYMBOL_CACHE` is set to `0`.
+    public static func userCache() -> SymbolCache? {
+        let environment = ProcessInfo.processInfo.environment
+        guard environment["MEMTOOL_SYMBOL_CACHE"] != "0" else {
+            return nil
+        }
+
+        let base: URL
+        if let cacheHome = environment["XDG_CACHE_HOME"], !cacheHome.isEmpty {
+            base = URL(fileURLWithPath: cacheHome)
+        } else {
+            base = FileManager.default.homeDirectoryForCurrentUser.appendingPathComponent(".cache")
+        }
+        return SymbolCache(directory: base.appendingPathComponent("memtool/symbols"))
+    }
+
+    /// Returns symbols of the file from the cache. If the entry is missing or it was created
+    /// without debug file, which is available now, the symbols are decoded and stored.
+    /// - Parameter file: Path to the ELF file.
+    public func symbols(for file: String) -> [UnloadedSymbolInfo] {
+        let fileKey = SymbolCache.fileKey(for: file)
+        if let fileKey, let entry = try? read(key: fileKey, reportedAs: file) {
+            return entry.symbols
+        }
+
+        let elf: ElfFile
+        do {
+            elf = try ElfFile(path: file)
+        } catch let openError {
+            MemtoolCore.error("Error: Symbols for file \(file) failed to load: \(openError)")
+            return []
+        }
+
+        let key = SymbolCache.key(for: elf)
+        let entry = key.flatMap { try? read(key: $0, reportedAs: file) }
+        let debugFile = entry?.hasDebugFile == true ? nil : Symbolication.debugFile(for: elf)
+
+        if let key, let entry, entry.hasDebugFile || debugFile == nil {
+            link(fileKey, to: key)
+            return entry.symbols
+        }
+
+        let symbols = Symbolication.loadSymbols(from: elf, debugFile: debugFile)
+        if let key {
+            do {
+                try write(symbols, hasDebugFile: debugFile != nil, key: key)
+                link(fileKey, to: key)
+            } catch let writeError {
+                MemtoolCore.error("Warning: Failed to store symbols of \(file) in cache: \(writeError)")
+            }
+        }
+        return symbols
+    }
+
+    /// Key of the entry for the file.
+    public static func key(for elf: ElfFile) -> String? {
+        if let buildId = elf.buildId, !buildId.isEmpty {
+            return "b-" + buildId.map { String(format: "%02x", $0) }.joined()
+        }
+        return fileKey(for: elf.path)
+    }
+
+    /// Key identifying the file by its device, inode, size and modification time.
+    public static func fileKey(for file: String) -> String? {
+        var status = stat()
+        guard stat(file, &status) == 0 else {
+            return nil
+        }
+        return "f-\(status.st_dev)-\(status.st_ino)-\(status.st_size)-\(status.st_mtim.tv_sec).\(status.st_mtim.tv_nsec)"
+    }
+
+    /// Points the key of the file to the entry keyed by build-id. Failures are ignored, the
+    /// file is then opened by the next load again.
+    private func link(_ fileKey: String?, to key: String) {
+        guard let fileKey, fileKey != key else {
+            return
+        }
+        _ = symlink(key, directory.appendingPathComponent(fileKey).path)
+    }
+
+    /// Reads the entry. Names of the symbols are not decoded.
+    /// - Parameters:
+    ///   - key: Key of the entry.
+    ///   - file: File reported in the symbols.
+    public func read(key: String, reportedAs file: String) throws -> Entry {
+        let mapped = try MappedEntry(path: directory.appendingPathComponent(key).path)
+        let raw = mapped.bytes
+
+        let headerSize = MemoryLayout<Header>.size
+        let recordSize = MemoryLayout<Record>.size
+        let header = raw.loadUnaligned(as: Header.self)
+        guard header.magic == SymbolCache.magic else {
+            throw Error.malformedEntry
+        }
+        guard header.version == SymbolCache.version else {
+            throw Error.unsupportedVersion
+        }
+
+        let stringsBase = headerSize + Int(header.count) * recordSize
+        guard stringsBase + Int(header.stringsSize) == raw.count else {
+            throw Error.malformedEntry
+        }
+        let strings = UnsafeRawBufferPointer(rebasing: raw[stringsBase...])
+
+        // Flags and sections repeat, decode each of them once
+        var flags: [UInt64: SymbolFlags] = [:]
+        var sections: [UInt32: SymbolSection] = [:]
+        var symbols: [UnloadedSymbolInfo] = []
+        symbols.reserveCapacity(Int(header.count))
+
+        for index in 0..<Int(header.count) {
+            let record = raw.loadUnaligned(fromByteOffset: headerSize + index * recordSize, as: Record.self)
+            let nameEnd = Int(record.nameOffset) + Int(record.nameLength)
+            let sectionEnd = Int(record.sectionOffset) + Int(record.sectionLength)
+            guard nameEnd <= strings.count, sectionEnd <= strings.count else {
+                throw Error.malformedEntry
+            }
+
+            let section = sections[record.sectionOffset] ?? {
+                let section = SymbolSection(rawValue: String(decoding: strings[Int(record.sectionOffset)..<sectionEnd], as: UTF8.self))
+                sections[record.sectionOffset] = section
+                return section
+            }()
+
+            let symbolFlags = flags[record.flags] ?? {
+                let symbolFlags = SymbolFlags(packed: record.flags)
+                flags[record.flags] = symbolFlags
+                return symbolFlags
+            }()
+
+            symbols.append(UnloadedSymbolInfo(
+                file: file,
+                location: UInt(record.location),
+                flags: symbolFlags,
+                segment: section,
+                size: UInt(record.size),
+                symbolName: SymbolName(bytes: UnsafeRawBufferPointer(rebasing: strings[Int(record.nameOffset)..<nameEnd]), in: mapped)
+            ))
+        }
+
+        return Entry(symbols: symbols, hasDebugFile: header.flags & SymbolCache.hasDebugFileFlag != 0)
+    }
+
+    /// Stores the entry. The entry is replaced atomically.
+    /// - Parameters:
+    ///   - symbols: Symbols of the file.
+    ///   - hasDebugFile: Symbols of the separate debug file are included.
+    ///   - key: Key of the entry.
+    public func write(_ symbols: [UnloadedSymbolInfo], hasDebugFile: Bool, key: String) throws {
+        var strings: [UInt8] = []
+        var sectionOffsets: [String: UInt32] = [:]
+        var records: [Record] = []
+        records.reserveCapacity(symbols.count)
+
+        for symbol in symbols {
+            let section = symbol.segment.rawValue
+            let sectionOffset = sectionOffsets[section] ?? {
+                let offset = UInt32(strings.count)
+                strings.append(contentsOf: section.utf8)
+                sectionOffsets[section] = offset
+                return offset
+            }()
+
+            let nameOffset = UInt32(strings.count)
+            symbol.symbolName.withUTF8 { strings.append(contentsOf: $0) }
+
+            records.append(Record(
+                location: UInt64(symbol.location),
+                size: UInt64(symbol.size),
+                flags: symbol.flags.packed,
+                nameOffset: nameOffset,
+                nameLength: UInt32(strings.count) - nameOffset,
+                sectionOffset: sectionOffset,
+                sectionLength: UInt32(section.utf8.count)
+            ))
+        }
+
+        var header = Header(
+            magic: SymbolCache.magic,
+            version: SymbolCache.version,
+            count: UInt32(records.count),
+            flags: hasDebugFile ? SymbolCache.hasDebugFileFlag : 0,
+            stringsSize: UInt64(strings.count)
+        )
+
+        var data = Data(capacity: MemoryLayout<Header>.size + records.count * MemoryLayout<Record>.size + strings.count)
+        withUnsafeBytes(of: &header) { data.append(contentsOf: $0) }
+        records.withUnsafeBytes { data.append(contentsOf: $0) }
+        data.append(contentsOf: strings)
+
+        try FileManager.default.createDirectory(at: directory, withIntermediateDirectories: true)
+        try data.write(to: directory.appendingPathComponent(key), options: .atomic)
+    }
+}
+
+extension SymbolFlags {
+    /// ASCII characters of the `rawValue` packed into single integer.
+    var packed: UInt64 {
+        rawValue.utf8.prefix(8).enumerated().reduce(0) { result, item in
+            result | UInt64(item.element) << (8 * UInt64(item.offset))
+        }
+    }
+
+    init(packed: UInt64) {
+        let bytes = (0..<8).map { UInt8(truncatingIfNeeded: packed >> (8 * UInt64($0))) }.filter { $0 != 0 }
+        self.init(rawValue: String(decoding: bytes, as: UTF8.self))
+    }
+}
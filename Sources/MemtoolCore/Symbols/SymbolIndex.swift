@@ -0,0 +1,192 @@
+import Foundation
+
+/// SymbolIndex answers queries over symbols of the session without scanning all of them.
+///
+/// Loaded symbols are sorted by their base address. Since symbols may overlap, the sorted array
+/// is searched as an implicit balanced interval tree: the middle of each range of positions is
+/// the root of its subtree and the index keeps the maximal end address of each subtree, so
+/// subtrees ending before an address are skipped. Both loaded and unloaded symbols are indexed
+/// by name and sorted names allow prefix queries. Names are indexed and sorted by their bytes,
+/// so names kept in the `SymbolCache` are decoded only when they are returned.
+public struct SymbolIndex {
+    /// Symbols located in the remote process in the original order.
+    public let symbols: [SymbolRegion]
+
+    /// Indices into `symbols` sorted by the base address of the symbol.
+    private let order: [Int]
+    /// Base addresses sorted in ascending order.
+    private let lowerBounds: [UInt]
+    /// The maximal end address of the symbols in the subtree rooted at each position.
+    private let subtreeUpperBounds: [UInt]
+
+    private let loadedByName: [SymbolName: [Int]]
+    private let unloadedByName: [SymbolName: [UnloadedSymbolInfo]]
+    /// Unique names of both loaded and unloaded symbols in ascending order.
+    private var sortedNames: [SymbolName] { sortedNamesStorage.names }
+    private let sortedNamesStorage: SortedNames
+
+    /// Builds the index.
+    /// - Parameters:
+    ///   - symbols: Symbols located in the remote process.
+    ///   - unloadedSymbols: Symbols of the executable files.
+    public init(symbols: [SymbolRegion], unloadedSymbols: [String: [UnloadedSymbolInfo]]) {
+        self.symbols = symbols
+
+        let order = symbols.indices.sorted { symbols[$0].range.lowerBound < symbols[$1].range.lowerBound }
+        self.order = order
+        self.lowerBounds = order.map { symbols[$0].range.lowerBound }
+
+        var subtreeUpperBounds = order.map { symbols[$0].range.upperBound }
+        Self.buildSubtrees(&subtreeUpperBounds, in: 0..<subtreeUpperBounds.count)
+        self.subtreeUpperBounds = subtreeUpperBounds
+
+        var loadedByName: [SymbolName: [Int]] = [:]
+        for (index, symbol) in symbols.enumerated() {
+            loadedByName[symbol.properties.symbolName, default: []].append(index)
+        }
+        self.loadedByName = loadedByName
+
+        var unloadedByName: [SymbolName: [UnloadedSymbolInfo]] = [:]
+        for symbol in unloadedSymbols.values.joined() {
+            unloadedByName[symbol.symbolName, default: []].append(symbol)
+        }
+        self.unloadedByName = unloadedByName
+
+        self.sortedNamesStorage = SortedNames(Array(Set(loadedByName.keys).union(unloadedByName.keys)))
+    }
+
+    /// Loaded symbols, that contain the address, ordered by their base address.
+    public func symbols(containing address: UInt) -> [SymbolRegion] {
+        var result: [SymbolRegion] = []
+        collect(containing: address, in: 0..<lowerBounds.count, into: &result)
+        return result
+    }
+
+    /// Loaded symbols with exactly matching name.
+    public func symbols(named name: String) -> [SymbolRegion] {
+        symbols(named: SymbolName(name))
+    }
+
+    /// Unloaded symbols with exactly matching name.
+    public func unloadedSymbols(named name: String) -> [UnloadedSymbolInfo] {
+        unloadedSymbols(named: SymbolName(name))
+    }
+
+    /// Names of all symbols starting with the prefix.
+    public func names(withPrefix prefix: String) -> ArraySlice<String> {
+        ArraySlice(sortedNames(withPrefix: prefix).map(\.string))
+    }
+
+    /// Names of all symbols containing the text. Each unique name is tested once.
+    public func names(containing text: String) -> [String] {
+        sortedNames.compactMap { name in
+            let string = name.string
+            return string.contains(text) ? string : nil
+        }
+    }
+
+    /// Loaded symbols with names starting with the prefix.
+    public func symbols(withPrefix prefix: String) -> [SymbolRegion] {
+        sortedNames(withPrefix: prefix).flatMap { symbols(named: $0) }
+    }
+
+    /// Unloaded symbols with names starting with the prefix.
+    public func unloadedSymbols(withPrefix prefix: String) -> [UnloadedSymbolInfo] {
+        sortedNames(withPrefix: prefix).flatMap { unloadedSymbols(named: $0) }
+    }
+
+    /// Locates loaded symbols with the name of the known symbol.
+    public func locate(knownSymbol: GlibcAssurances.KnownSymbols) -> [SymbolRegion] {
+        symbols(named: knownSymbol.name)
+    }
+
+    private func symbols(named name: SymbolName) -> [SymbolRegion] {
+        loadedByName[name]?.map { symbols[$0] } ?? []
+    }
+
+    private func unloadedSymbols(named name: SymbolName) -> [UnloadedSymbolInfo] {
+        unloadedByName[name] ?? []
+    }
+
+    /// Unique names starting with the prefix in ascending order.
+    private func sortedNames(withPrefix prefix: String) -> ArraySlice<SymbolName> {
+        let names = self.sortedNames
+        let prefix = SymbolName(prefix)
+
+        var low = 0
+        var high = names.count
+        while low < high {
+            let middle = (low + high) / 2
+            if names[middle] < prefix {
+                low = middle + 1
+            } else {
+                high = middle
+            }
+        }
+
+        var end = low
+        while end < names.count, names[end].hasPrefix(prefix) {
+            end += 1
+        }
+        return names[low..<end]
+    }
+
+    /// Appends symbols of the subtree containing the address in the order of their base address.
+    private func collect(containing address: UInt, in positions: Range<Int>, into result: inout [SymbolRegion]) {
+        guard !positions.isEmpty else {
+            return
+        }
+        let middle = (positions.lowerBound + positions.upperBound) / 2
+        guard subtreeUpperBounds[middle] > address else {
+            return
+        }
+
+        collect(containing: address, in: positions.lowerBound..<middle, into: &result)
+        // The symbol and the right subtree start after the address
+        guard lowerBounds[middle] <= address else {
+            return
+        }
+        let symbol = symbols[order[middle]]
+        if symbol.range.contains(address) {
+            result.append(symbol)
+        }
+        collect(containing: address, in: (middle + 1)..<positions.upperBound, into: &result)
+    }
+
+    /// Replaces the end address of each position by the maximal end address of its subtree.
+    @discardableResult
+    private static func buildSubtrees(_ upperBounds: inout [UInt], in positions: Range<Int>) -> UInt {
+        guard !positions.isEmpty else {
+            return 0
+        }
+        let middle = (positions.lowerBound + positions.upperBound) / 2
+        let left = buildSubtrees(&upperBounds, in: positions.lowerBound..<middle)
+        let right = buildSubtrees(&upperBounds, in: (middle + 1)..<positions.upperBound)
+        upperBounds[middle] = max(upperBounds[middle], left, right)
+        return upperBounds[middle]
+    }
+}
+
+/// Names sorted by the first request. Copies of the index share it and the index may be queried
+/// from several threads.
+private final class SortedNames {
+    private let lock = NSLock()
+    private var unique: [SymbolName]
+    private var sorted: [SymbolName]?
+
+    init(_ unique: [SymbolName]) {
+        self.unique = unique
+    }
+
+    var names: [SymbolName] {
+        lock.lock()
+        defer { lock.unlock() }
+        if let sorted {
+            return sorted
+        }
+        let names = unique.sorted()
+        sorted = names
+        unique = []
+        return names
+    }
+}
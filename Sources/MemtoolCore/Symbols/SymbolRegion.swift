@@ -1,3 +1,5 @@
+import Glibc
+
 public enum SymbolScopeFlag: String {
     case local = "l"
     case global = "g"
@@ -118,19 +120,127 @@ public struct SymbolFlags: Hashable {
     }
 }
 
+/// Name of a symbol. Names of symbols read from the `SymbolCache` stay in the mapped cache entry
+/// and are decoded only when `string` is requested. Names are compared and hashed by their
+/// UTF-8 bytes, which does not decode them. The bytes also order the names, which is the order
+/// of their Unicode scalars.
+public struct SymbolName: Hashable, Comparable, CustomStringConvertible {
+    private enum Storage {
+        case decoded(String)
+        /// Bytes of the name inside the memory of the entry, the entry is kept mapped by the name.
+        case mapped(SymbolCache.MappedEntry, bytes: UnsafeRawBufferPointer)
+    }
+
+    private let storage: Storage
+
+    public init(_ string: String) {
+        self.storage = .decoded(string)
+    }
+
+    init(bytes: UnsafeRawBufferPointer, in entry: SymbolCache.MappedEntry) {
+        self.storage = .mapped(entry, bytes: bytes)
+    }
+
+    /// The decoded name.
+    public var string: String {
+        switch storage {
+        case let .decoded(string):
+            return string
+        case let .mapped(entry, bytes):
+            return withExtendedLifetime(entry) { String(decoding: bytes, as: UTF8.self) }
+        }
+    }
+
+    public var description: String { string }
+
+    /// Calls the body with the UTF-8 bytes of the name.
+    public func withUTF8<Result>(_ body: (UnsafeRawBufferPointer) throws -> Result) rethrows -> Result {
+        switch storage {
+        case var .decoded(string):
+            return try string.withUTF8 { try body(UnsafeRawBufferPointer($0)) }
+        case let .mapped(entry, bytes):
+            return try withExtendedLifetime(entry) { try body(bytes) }
+        }
+    }
+
+    public static func == (lhs: SymbolName, rhs: SymbolName) -> Bool {
+        lhs.withUTF8 { left in
+            rhs.withUTF8 { right in
+                left.count == right.count && (left.isEmpty || memcmp(left.baseAddress!, right.baseAddress!, left.count) == 0)
+            }
+        }
+    }
+
+    public static func < (lhs: SymbolName, rhs: SymbolName) -> Bool {
+        lhs.withUTF8 { left in
+            rhs.withUTF8 { right in
+                let common = min(left.count, right.count)
+                let order = common == 0 ? 0 : memcmp(left.baseAddress!, right.baseAddress!, common)
+                return order != 0 ? order < 0 : left.count < right.count
+            }
+        }
+    }
+
+    public func hash(into hasher: inout Hasher) {
+        withUTF8 { hasher.combine(bytes: $0) }
+    }
+
+    /// The name starts with the bytes of the prefix.
+    public func hasPrefix(_ prefix: SymbolName) -> Bool {
+        withUTF8 { name in
+            prefix.withUTF8 { prefix in
+                name.count >= prefix.count && (prefix.isEmpty || memcmp(name.baseAddress!, prefix.baseAddress!, prefix.count) == 0)
+            }
+        }
+    }
+}
+
 public struct UnloadedSymbolInfo: Hashable {
     public var file: String
     public var location: UInt
     public var flags: SymbolFlags
     public var segment: SymbolSection
     public var size: UInt
-    public var name: String
+    /// Name of the symbol, decoded on every access if it is kept in a cache entry.
+    public var name: String {
+        get { symbolName.string }
+        set { symbolName = SymbolName(newValue) }
+    }
+    public var symbolName: SymbolName
+
+    public init(file: String, location: UInt, flags: SymbolFlags, segment: SymbolSection, size: UInt, name: String) {
+        self.init(file: file, location: location, flags: flags, segment: segment, size: size, symbolName: SymbolName(name))
+    }
+
+    public init(file: String, location: UInt, flags: SymbolFlags, segment: SymbolSection, size: UInt, symbolName: SymbolName) {
+        self.file = file
+        self.location = location
+        self.flags = flags
+        self.segment = segment
+        self.size = size
+        self.symbolName = symbolName
+    }
 }
 
 public struct LoadedSymbolInfo {
     public var flags: SymbolFlags
     public var segment: SymbolSection
-    public var name: String
+    /// Name of the symbol, decoded on every access if it is kept in a cache entry.
+    public var name: String {
+        get { symbolName.string }
+        set { symbolName = SymbolName(newValue) }
+    }
+    public var symbolName: SymbolName
+
+    public init(flags: SymbolFlags, segment: SymbolSection, name: String) {
+        self.init(flags: flags, segment: segment, symbolName: SymbolName(name))
+    }
+
+    public init(flags: SymbolFlags, segment: SymbolSection, symbolName: SymbolName) {
+        self.flags = flags
+        self.segment = segment
+        self.symbolName = symbolName
+    }
 }
 
 /**
@@ -425,16 +535,10 @@ public extension SymbolRegion {
         self.properties = LoadedSymbolInfo(
             flags: unloadedSymbol.flags, 
             segment: unloadedSymbol.segment,
-            name: unloadedSymbol.name
+            symbolName: unloadedSymbol.symbolName
         )
     }
 }
 
-public extension [SymbolRegion] {
-    func locate(knownSymbol: GlibcAssurances.KnownSymbols) -> [SymbolRegion] {
-        filter { $0.properties.name == knownSymbol.name }
-    }
-}
-
 // Workaround: Declaration in file with _StringProcessing was ignored.
 public enum Symbolication { }
@@ -1,158 +1,96 @@
 import Foundation
-import RegexBuilder
-import _StringProcessing
 
 extension Symbolication {
 
-    private static let firstLine = "SYMBOL TABLE:"
-
-    private static let locationRef = Reference(Substring.self)
-    private static let flagsRef = Reference(Substring.self)
-    private static let segmentRef = Reference(Substring.self)
-    private static let sizeRef = Reference(Substring.self)
-    private static let nameRef = Reference(Substring.self)
-    private static let regex: Regex = {
-        let hexadec = Regex {
-            Optionally {
-                "0x"
-            }
-            OneOrMore(.hexDigit)
-        }
-        
-        return Regex {
-            Capture(as: locationRef) {
-                hexadec
-            }
-            One(.horizontalWhitespace)
-            Capture(as: flagsRef) {
-                ChoiceOf {
-                    " "
-                    "l"
-                    "g"
-                    "u"
-                    "!"
-                }
-                ChoiceOf {
-                    " "
-                    "w"
-                }
-                ChoiceOf {
-                    " "
-                    "C"
-                }
-                ChoiceOf {
-                    " "
-                    "W"
-                }
-                ChoiceOf {
-                    " "
-                    "i"
-                    "I"
-                }
-                ChoiceOf {
-                    " "
-                    "d"
-                    "D"
-                }
-                ChoiceOf {
-                    " "
-                    "f"
-                    "F"
-                    "O"
-                }
-            }
-            OneOrMore(.horizontalWhitespace)
-            Capture(as: segmentRef) {
-                OneOrMore(.whitespace.inverted)
-            }
-            One(.horizontalWhitespace)
-            Capture(as: sizeRef) {
-                hexadec
-            }
-            One(.horizontalWhitespace)
-            Capture(as: nameRef) {
-                OneOrMore(.anyNonNewline)
-            }
-        }
-    }()
+    /// Directory searched for separate debug files.
+    public static var debugDirectory = "/usr/lib/debug"
 
-    private static func getElfDescription(file: String, filter: String? = nil) -> String {
-        let process = Process()
-        let aStdout = Pipe()
-        let aStderr = Pipe()
+    /// Persistent cache of decoded symbols. Set to nil in order to always decode the symbols.
+    public static var cache: SymbolCache? = SymbolCache.userCache()
 
-        var buffer = Data()
+    /// Loads all symbols of the `.symtab` of the file and of its separate debug file (equivalent
+    /// of `objdump -tL`). If neither of those contains `.symtab`, symbols of `.dynsym` are used.
+    /// The symbols are served from the `cache` if possible. Duplicate records are removed.
+    /// - Parameter file: Path to the ELF file.
+    public static func loadSymbols(for file: String) -> [UnloadedSymbolInfo] {
+        if let cache = cache {
+            return cache.symbols(for: file)
+        }
 
-        process.executableURL = URL(fileURLWithPath: "/bin/env")
-        process.standardOutput = aStdout
-        //process.standardError = aStderr
-        // `objdump -tL [file]`
-        // objdump  : program for dumping object file information
-        // -t       : dump symbol table
-        // -L       : follow links (for example when binary is stripped) 1313
-        process.arguments = ["bash", "-c", "objdump -tL \(file) " + (filter.flatMap { " | grep \($0)" } ?? "") ]
+        let elf: ElfFile
+        do {
+            elf = try ElfFile(path: file)
+        } catch {
+            MemtoolCore.error("Error: Symbols for file \(file) failed to load: \(error)")
+            return []
+        }
 
-        try! process.run()
+        return loadSymbols(from: elf, debugFile: debugFile(for: elf))
+    }
 
-        while process.isRunning {
-            buffer.append(aStdout.fileHandleForReading.availableData)
+    /// Decodes symbols of the file and its debug file. Duplicate records are removed.
+    /// - Parameters:
+    ///   - elf: The ELF file.
+    ///   - debugFile: Separate debug file of the ELF file.
+    public static func loadSymbols(from elf: ElfFile, debugFile: ElfFile?) -> [UnloadedSymbolInfo] {
+        var symbols = elf.staticSymbols()
+        if let debugFile = debugFile {
+            symbols.append(contentsOf: debugFile.staticSymbols(reportedAs: elf.path))
         }
 
-        guard process.terminationStatus == 0 else {
-            error("Error: Map failed to load. Path: \(process.executableURL?.path ?? ""), arguments: \(process.arguments ?? []), termination status: \(process.terminationStatus), stderr: \(String(data: aStderr.fileHandleForReading.readDataToEndOfFile(), encoding: .utf8) ?? "")") 
-            return ""
+        if symbols.isEmpty {
+            symbols = elf.dynamicSymbols()
         }
-        let result = String(data: buffer, encoding: .utf8)
 
-        return result!
+        var unique = Set<UnloadedSymbolInfo>()
+        unique.reserveCapacity(symbols.count)
+        return symbols.filter { unique.insert($0).inserted }
     }
 
-    public static func loadSymbols(for file: String) -> [UnloadedSymbolInfo] {
-        // This is just a workaround, so the program does not output Warnings where parsing is expected to fail
-        var iteratingSymbolTable = false
-        return getElfDescription(file: file).components(separatedBy: "\n").compactMap { line -> UnloadedSymbolInfo? in
-            if line.hasPrefix(firstLine) {
-                iteratingSymbolTable = true
-                return nil
-            }
-            guard !line.isEmpty else {
-                iteratingSymbolTable = false
-                return nil
-            }
-            guard iteratingSymbolTable else {
-                return nil
-            }
-            guard let result = try? regex.firstMatch(in: line) else {
-                error("Warning: Symbol for file \(file) failed to match regex: \(line)")
-                return nil
-            }
-            return UnloadedSymbolInfo(
-                file: file,
-                location: UInt(String(result[locationRef]), radix: 16)!,
-                flags: SymbolFlags(rawValue: String(result[flagsRef])),
-                segment: SymbolSection(rawValue: String(result[segmentRef])),
-                size: UInt(String(result[sizeRef]), radix: 16)!,
-                name: String(result[nameRef]).trimmingCharacters(in: .whitespacesAndNewlines)
-            )
+    /// Looks up a single symbol in the file or in its separate debug file without decoding other symbols.
+    /// - Parameters:
+    ///   - symbolName: Exact name of the symbol.
+    ///   - file: Path to the ELF file.
+    public static func loadSymbol(named symbolName: String, for file: String) -> UnloadedSymbolInfo? {
+        guard let elf = try? ElfFile(path: file) else {
+            return nil
+        }
+
+        if let debugFile = debugFile(for: elf), let symbol = debugFile.symbol(named: symbolName, reportedAs: file) {
+            return symbol
         }
+        return elf.symbol(named: symbolName)
     }
 
-    public static func loadSymbol(named symbolName: String, for file: String) -> UnloadedSymbolInfo? {
-        let entry = getElfDescription(file: file, filter: symbolName)
-        guard !entry.isEmpty else {
-            return nil
+    /// Locates the separate debug file using the build-id and the `.gnu_debuglink` section. Searched
+    /// locations are the same as in GDB.
+    /// - Parameter elf: The file with stripped debug information.
+    public static func debugFile(for elf: ElfFile) -> ElfFile? {
+        var candidates: [String] = []
+
+        if let buildId = elf.buildId, buildId.count > 1 {
+            let hex = buildId.map { String(format: "%02x", $0) }
+            candidates.append(debugDirectory + "/.build-id/" + hex[0] + "/" + hex[1...].joined() + ".debug")
         }
-        guard let result = try? regex.firstMatch(in: entry) else {
-            error("Warning: Symbol failed to match regex: \(entry)")
-            return nil
+
+        if let debugLink = elf.debugLink {
+            let directory = (elf.path as NSString).deletingLastPathComponent
+            candidates.append(directory + "/" + debugLink)
+            candidates.append(directory + "/.debug/" + debugLink)
+            candidates.append(debugDirectory + directory + "/" + debugLink)
         }
-        return UnloadedSymbolInfo(
-            file: file,
-            location: UInt(String(result[locationRef]), radix: 16)!,
-            flags: SymbolFlags(rawValue: String(result[flagsRef])),
-            segment: SymbolSection(rawValue: String(result[segmentRef])),
-            size: UInt(String(result[sizeRef]), radix: 16)!,
-            name: String(result[nameRef]).trimmingCharacters(in: .whitespacesAndNewlines)
-        )
+
+        for candidate in candidates where candidate != elf.path && FileManager.default.fileExists(atPath: candidate) {
+            guard let debugFile = try? ElfFile(path: candidate) else {
+                continue
+            }
+            // Build-id of the debug file has to match, if present
+            if let buildId = elf.buildId, let debugBuildId = debugFile.buildId, buildId != debugBuildId {
+                continue
+            }
+            return debugFile
+        }
+
+        return nil
     }
 }
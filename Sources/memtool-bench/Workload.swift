@@ -0,0 +1,222 @@
+import Foundation
+
+/// Parameters of a synthetic program, whose heap is analyzed by the benchmark.
+struct Workload: Codable {
+    enum SizeDistribution: Codable {
+        /// Every chunk requests the same size.
+        case fixed(Int)
+        /// Sizes are uniformly distributed in the range.
+        case uniform(min: Int, max: Int)
+        /// Powers of two are uniformly distributed in the range, sizes are uniform between them.
+        case logUniform(min: Int, max: Int)
+    }
+
+    var name: String
+    /// Number of chunks allocated by all threads together.
+    var chunkCount: Int
+    var sizes: SizeDistribution
+    /// Number of threads allocating the chunks, each thread except the main one gets its own arena
+    /// until glibc runs out of arenas.
+    var threadCount: Int
+    /// Every `freeStep`-th chunk of each thread is freed, populating the tcaches, fastbins and bins.
+    /// Zero frees nothing.
+    var freeStep: Int
+    /// Number of additional small anonymous mappings.
+    var mappingCount: Int
+    /// Number of shared libraries loaded by the program, each with a TLS variable.
+    var libraryCount: Int
+
+    static let presets: [Workload] = [
+        Workload(name: "baseline", chunkCount: 100_000, sizes: .uniform(min: 16, max: 512), threadCount: 1, freeStep: 0, mappingCount: 0, libraryCount: 0),
+        Workload(name: "large", chunkCount: 4_000_000, sizes: .logUniform(min: 16, max: 4096), threadCount: 1, freeStep: 0, mappingCount: 0, libraryCount: 0),
+        Workload(name: "threads", chunkCount: 2_000_000, sizes: .uniform(min: 16, max: 1024), threadCount: 64, freeStep: 0, mappingCount: 0, libraryCount: 0),
+        Workload(name: "freed", chunkCount: 2_000_000, sizes: .logUniform(min: 16, max: 2048), threadCount: 8, freeStep: 3, mappingCount: 0, libraryCount: 0),
+        Workload(name: "mappings", chunkCount: 100_000, sizes: .fixed(64), threadCount: 4, freeStep: 0, mappingCount: 20_000, libraryCount: 64),
+    ]
+
+    /// C source of the program. The program prints ";" once all threads finished allocating and
+    /// then waits until it is killed.
+    func source(libraries: [String]) -> String {
+        let (sizeMin, sizeMax, sizeLog): (Int, Int, Int)
+        switch sizes {
+        case let .fixed(size):
+            (sizeMin, sizeMax, sizeLog) = (size, size, 0)
+        case let .uniform(min, max):
+            (sizeMin, sizeMax, sizeLog) = (min, max, 0)
+        case let .logUniform(min, max):
+            (sizeMin, sizeMax, sizeLog) = (min, max, 1)
+        }
+
+        return """
+        #include <dlfcn.h>
+        #include <pthread.h>
+        #include <stdio.h>
+        #include <stdlib.h>
+        #include <string.h>
+        #include <sys/mman.h>
+        #include <unistd.h>
+
+        #define CHUNKS \(chunkCount)L
+        #define THREADS \(max(threadCount, 1))
+        #define FREE_STEP \(freeStep)L
+        #define MAPPINGS \(mappingCount)
+        #define SIZE_MIN \(sizeMin)UL
+        #define SIZE_MAX \(sizeMax)UL
+        #define SIZE_LOG \(sizeLog)
+
+        static const char * libraries[] = { \((libraries.map { "\"\($0)\"" } + ["NULL"]).joined(separator: ", ")) };
+        static pthread_barrier_t ready;
+
+        static unsigned long next_random(unsigned long * state) {
+            *state = *state * 6364136223846793005UL + 1442695040888963407UL;
+            return *state >> 33;
+        }
+
+        static unsigned long next_size(unsigned long * state) {
+            unsigned long min = SIZE_MIN, max = SIZE_MAX;
+            if (SIZE_LOG) {
+                int low = 63 - __builtin_clzl(SIZE_MIN), high = 63 - __builtin_clzl(SIZE_MAX);
+                int exponent = low + next_random(state) % (high - low + 1);
+                min = 1UL << exponent;
+                max = (exponent == high) ? SIZE_MAX : (min << 1) - 1;
+                if (min < SIZE_MIN) {
+                    min = SIZE_MIN;
+                }
+            }
+            return min + next_random(state) % (max - min + 1);
+        }
+
+        static void allocate(long thread) {
+            long count = CHUNKS / THREADS;
+            void ** ptrs = malloc(count * sizeof(void *));
+            unsigned long state = thread + 1;
+            for (long i = 0; i < count; i++) {
+                ptrs[i] = malloc(next_size(&state));
+                memset(ptrs[i], 0xab, 8);
+            }
+            if (FREE_STEP > 0) {
+                for (long i = 0; i < count; i += FREE_STEP) {
+                    free(ptrs[i]);
+                }
+            }
+            pthread_barrier_wait(&ready);
+        }
+
+        static void * work(void * thread) {
+            allocate((long)thread);
+            while (1) {
+                pause();
+            }
+            return NULL;
+        }
+
+        int main(void) {
+            for (int i = 0; i < MAPPINGS; i++) {
+                // Alternating protections keep the kernel from merging the mappings
+                int protection = (i % 2) ? PROT_READ : PROT_READ | PROT_WRITE;
+                mmap(NULL, 4096, protection, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            }
+            for (int i = 0; libraries[i] != NULL; i++) {
+                if (dlopen(libraries[i], RTLD_NOW) == NULL) {
+                    fprintf(stderr, "%s\\n", dlerror());
+                    return 1;
+                }
+            }
+
+            pthread_barrier_init(&ready, NULL, THREADS);
+            for (long thread = 1; thread < THREADS; thread++) {
+                pthread_t handle;
+                pthread_create(&handle, NULL, work, (void *)thread);
+            }
+            allocate(0);
+
+            printf(";");
+            fflush(stdout);
+            while (1) {
+                pause();
+            }
+            return 0;
+        }
+        """
+    }
+
+    /// C source of the `index`-th shared library.
+    static func librarySource(index: Int) -> String {
+        """
+        __thread long memtool_bench_tls_\(index);
+
+        long memtool_bench_library_\(index)(void) {
+            return ++memtool_bench_tls_\(index);
+        }
+        """
+    }
+}
+
+/// Compiled and running workload.
+final class WorkloadProgram {
+    enum Error: Swift.Error {
+        case compilationFailed(command: String)
+        case programEnded
+    }
+
+    let process: Process
+    private let directory: URL
+    private let output: Pipe
+
+    var pid: Int32 { process.processIdentifier }
+
+    /// Compiles the workload and its libraries with `clang` and waits until the program allocated all chunks.
+    init(workload: Workload) throws {
+        directory = FileManager.default.temporaryDirectory.appendingPathComponent("memtool-bench-\(getpid())-\(workload.name)")
+        try FileManager.default.createDirectory(at: directory, withIntermediateDirectories: true)
+
+        var libraries: [String] = []
+        for index in 0..<workload.libraryCount {
+            let source = directory.appendingPathComponent("library\(index).c")
+            let library = directory.appendingPathComponent("libmemtoolbench\(index).so")
+            try Workload.librarySource(index: index).write(to: source, atomically: false, encoding: .utf8)
+            try Self.run("clang -O1 -shared -fPIC \(source.path) -o \(library.path)")
+            libraries.append(library.path)
+        }
+
+        let source = directory.appendingPathComponent("workload.c")
+        let executable = directory.appendingPathComponent("workload")
+        try workload.source(libraries: libraries).write(to: source, atomically: false, encoding: .utf8)
+        try Self.run("clang -O1 \(source.path) -o \(executable.path) -lpthread -ldl")
+
+        process = Process()
+        output = Pipe()
+        process.executableURL = executable
+        process.standardOutput = output
+        process.standardInput = Pipe()
+        try process.run()
+
+        // The program prints ";" once all chunks are allocated
+        while true {
+            let data = output.fileHandleForReading.availableData
+            guard !data.isEmpty else {
+                throw Error.programEnded
+            }
+            if data.contains(UInt8(ascii: ";")) {
+                break
+            }
+        }
+    }
+
+    private static func run(_ command: String) throws {
+        let process = Process()
+        process.executableURL = URL(fileURLWithPath: "/usr/bin/env")
+        process.arguments = ["bash", "-c", command]
+        try process.run()
+        process.waitUntilExit()
+        guard process.terminationStatus == 0 else {
+            throw Error.compilationFailed(command: command)
+        }
+    }
+
+    deinit {
+        process.terminate()
+        process.waitUntilExit()
+        try? FileManager.default.removeItem(at: directory)
+    }
+}
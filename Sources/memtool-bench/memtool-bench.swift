@@ -0,0 +1,200 @@
+import Foundation
+import MemtoolCore
+
+/// Measured run of a single workload, encoded as one JSON line.
+struct BenchmarkResult: Codable {
+    var label: String?
+    var workload: Workload
+    var run: Int
+    var workerCount: Int
+    /// Wall time of each phase in seconds, analyzer steps are prefixed by `analyze.` and the TLS
+    /// heuristics by `tls.`.
+    var phases: [String: Double] = [:]
+    var chunkCount = 0
+    var threadCount = 0
+    /// Whether the remote counters were collected, see `Metrics.isEnabled`.
+    var metricsEnabled = Metrics.isEnabled
+    var remoteReads: UInt64 = 0
+    var remoteBytes: UInt64 = 0
+    var remoteSyscalls: UInt64 = 0
+    var cacheHits: UInt64 = 0
+    var cacheMisses: UInt64 = 0
+    /// `syscr` of `/proc/self/io` during the run, read syscalls on files (maps, symbols).
+    var readSyscalls = 0
+    /// `rchar` of `/proc/self/io` during the run, bytes read from files.
+    var readBytes = 0
+    /// Peak resident set size of the benchmark process so far in bytes.
+    var peakRSS = 0
+}
+
+/// Runs the synthetic workloads and prints the measurements as JSON lines.
+///
+/// ```
+/// memtool-bench [workload ...] [--chunks N] [--threads N] [--workers N] [--repeat N] [--label text] [--output path]
+/// ```
+@main
+enum MemtoolBench {
+    static let usage = "Usage: memtool-bench [workload ...] [--chunks N] [--threads N] [--workers N] [--repeat N] [--label text] [--output path]"
+
+    static func main() {
+        do {
+            try run()
+        } catch is ExitCode {
+            exit(EXIT_FAILURE)
+        } catch let runError {
+            error("Error: \(runError)")
+            exit(EXIT_FAILURE)
+        }
+    }
+
+    static func run() throws {
+        var names: [String] = []
+        var chunkCount: Int?
+        var threadCount: Int?
+        var workerCount = 1
+        var repeatCount = 1
+        var label: String?
+        var outputPath: String?
+
+        var arguments = CommandLine.arguments.dropFirst()
+        func number(for option: String, minimum: Int) throws -> Int {
+            guard let value = arguments.popFirst().flatMap({ Int($0) }), value >= minimum else {
+                error("Error: \(option) expects a number of at least \(minimum).\n\(usage)")
+                throw ExitCode()
+            }
+            return value
+        }
+
+        while let argument = arguments.popFirst() {
+            switch argument {
+            case "--chunks":
+                chunkCount = try number(for: argument, minimum: 0)
+            case "--threads":
+                threadCount = try number(for: argument, minimum: 0)
+            case "--workers":
+                workerCount = try number(for: argument, minimum: 1)
+            case "--repeat":
+                repeatCount = try number(for: argument, minimum: 1)
+            case "--label":
+                label = arguments.popFirst()
+            case "--output":
+                outputPath = arguments.popFirst()
+            default:
+                names.append(argument)
+            }
+        }
+
+        var workloads = names.isEmpty ? Workload.presets : try names.map { name in
+            guard let workload = Workload.presets.first(where: { $0.name == name }) else {
+                error("Error: Unknown workload \(name), available: \(Workload.presets.map(\.name).joined(separator: ", ")).")
+                throw ExitCode()
+            }
+            return workload
+        }
+        for index in workloads.indices {
+            workloads[index].chunkCount = chunkCount ?? workloads[index].chunkCount
+            workloads[index].threadCount = threadCount ?? workloads[index].threadCount
+        }
+
+        var output = FileHandle.standardOutput
+        if let outputPath = outputPath {
+            FileManager.default.createFile(atPath: outputPath, contents: nil)
+            guard let handle = FileHandle(forWritingAtPath: outputPath) else {
+                error("Error: Could not open \(outputPath).")
+                throw ExitCode()
+            }
+            output = handle
+        }
+
+        let encoder = JSONEncoder()
+        encoder.outputFormatting = .sortedKeys
+        for workload in workloads {
+            let program = try WorkloadProgram(workload: workload)
+            for run in 0..<repeatCount {
+                let result = try measure(program, workload: workload, run: run, workerCount: workerCount, label: label)
+                output.write(try encoder.encode(result) + Data("\n".utf8))
+            }
+        }
+    }
+
+    /// Attaches to the running workload and measures the phases of the analysis.
+    static func measure(_ program: WorkloadProgram, workload: Workload, run: Int, workerCount: Int, label: String?) throws -> BenchmarkResult {
+        var result = BenchmarkResult(label: label, workload: workload, run: run, workerCount: workerCount)
+        let clock = ContinuousClock()
+        func phase<T>(_ name: String, _ body: () throws -> T) rethrows -> T {
+            let start = clock.now
+            defer { result.phases[name] = (clock.now - start).seconds }
+            return try body()
+        }
+
+        Metrics.reset()
+        let ioStart = IOCounters.current()
+        do {
+            let session = phase("attach") { ProcessSession(pid: program.pid) }
+            phase("loadMap") { session.loadMap() }
+            phase("loadSymbols") { session.loadSymbols() }
+            phase("loadThreads") { session.loadThreads() }
+            let analyzer = try phase("analyzerInit") { try GlibcMallocAnalyzer(session: session, workerCount: workerCount) }
+            try phase("analyze") { try analyzer.analyze() }
+
+            let metrics = Metrics.current
+            for (name, duration) in metrics.phases where result.phases[name] == nil {
+                result.phases[name] = duration.seconds
+            }
+            result.remoteReads = metrics.remoteReads
+            result.remoteBytes = metrics.remoteBytes
+            result.remoteSyscalls = metrics.syscalls
+            result.cacheHits = metrics.cacheHits
+            result.cacheMisses = metrics.cacheMisses
+            result.chunkCount = analyzer.chunks.count
+            result.threadCount = session.threadSessions.count
+            session.detach()
+        }
+        let ioEnd = IOCounters.current()
+
+        result.readSyscalls = ioEnd.readSyscalls - ioStart.readSyscalls
+        result.readBytes = ioEnd.readBytes - ioStart.readBytes
+        var usage = rusage()
+        getrusage(RUSAGE_SELF, &usage)
+        result.peakRSS = usage.ru_maxrss * 1024
+        return result
+    }
+}
+
+/// Read counters of the benchmark process from `/proc/self/io`.
+struct IOCounters {
+    var readSyscalls = 0
+    var readBytes = 0
+
+    static func current() -> IOCounters {
+        var counters = IOCounters()
+        guard let content = try? String(contentsOfFile: "/proc/self/io") else {
+            return counters
+        }
+        for line in content.split(separator: "\n") {
+            let fields = line.split(separator: ":").map { $0.trimmingCharacters(in: .whitespaces) }
+            guard fields.count == 2, let value = Int(fields[1]) else {
+                continue
+            }
+            switch fields[0] {
+            case "syscr":
+                counters.readSyscalls = value
+            case "rchar":
+                counters.readBytes = value
+            default:
+                break
+            }
+        }
+        return counters
+    }
+}
+
+/// Terminates the benchmark after the error was reported.
+struct ExitCode: Error {}
+
+extension Duration {
+    var seconds: Double {
+        let (seconds, attoseconds) = components
+        return Double(seconds) + Double(attoseconds) * 1e-18
+    }
+}
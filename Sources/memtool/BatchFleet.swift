@@ -0,0 +1,175 @@
+import Foundation
+import MemtoolCore
+
+/// Non-interactive analysis of many processes, for example workers of a prefork server:
+///
+/// ```
+/// memtool fleet [-j workers] [-f text|json|binary] PID...
+/// ```
+///
+/// The processes are analyzed concurrently by `FleetAnalysis`, sharing the symbols of their
+/// files. For each process, its totals, usage by size class and by arena are written, followed
+/// by the same records of the whole fleet (without `pid`).
+enum BatchFleet {
+    static let usage = "Usage: memtool fleet [-j workers] [-f text|json|binary] PID..."
+
+    /// - Returns: Exit code of the process.
+    static func run(_ arguments: [String]) -> Int32 {
+        var pids: [Int32] = []
+        var workerCount = 1
+        var format = RecordWriter.Format.text
+
+        var remaining = arguments[...]
+        while let argument = remaining.popFirst() {
+            switch argument {
+            case "-j":
+                guard let count = remaining.popFirst().flatMap({ Int($0) }), count > 0 else {
+                    MemtoolCore.error(usage)
+                    return 1
+                }
+                workerCount = count
+            case "-f":
+                switch remaining.popFirst() {
+                case "text":
+                    format = .text
+                case "json":
+                    format = .jsonLines
+                case "binary":
+                    format = .binary
+                default:
+                    MemtoolCore.error(usage)
+                    return 1
+                }
+            default:
+                guard let pid = Int32(argument) else {
+                    MemtoolCore.error(usage)
+                    return 1
+                }
+                pids.append(pid)
+            }
+        }
+
+        guard !pids.isEmpty else {
+            MemtoolCore.error(usage)
+            return 1
+        }
+
+        let report = FleetAnalysis().analyze(pids: pids, workerCount: workerCount)
+
+        let writer = RecordWriter(format: format)
+        for process in report.processes {
+            if let error = process.error {
+                MemtoolCore.error("Warning: Analysis of \(process.pid) failed: \(error).")
+            }
+            writer.write(FleetTotalRecord(pid: process.pid, processCount: 1, failedCount: process.error == nil ? 0 : 1, usage: process.usage))
+            write(sizeClasses: process.sizeClasses, arenas: process.arenas, bases: process.arenaBases, pid: process.pid, to: writer)
+        }
+
+        let aggregate = report.aggregate
+        writer.write(FleetTotalRecord(pid: nil, processCount: aggregate.processCount, failedCount: aggregate.failedCount, usage: aggregate.usage))
+        write(sizeClasses: aggregate.sizeClasses, arenas: aggregate.arenas, bases: [:], pid: nil, to: writer)
+        writer.flush()
+
+        return aggregate.failedCount < aggregate.processCount ? 0 : 1
+    }
+
+    private static func write(sizeClasses: [UInt: FleetAnalysis.Usage], arenas: [FleetAnalysis.Arena: FleetAnalysis.Usage], bases: [FleetAnalysis.Arena: UInt], pid: Int32?, to writer: RecordWriter) {
+        for (sizeClass, usage) in sizeClasses.sorted(by: { $0.key < $1.key }) {
+            writer.write(FleetSizeClassRecord(pid: pid, sizeClass: sizeClass, usage: usage))
+        }
+        for (arena, usage) in arenas.sorted(by: { $0.key < $1.key }) {
+            writer.write(FleetArenaRecord(pid: pid, arena: arena, base: bases[arena], usage: usage))
+        }
+    }
+}
+
+/// Totals of a process, or of the fleet without `pid`.
+struct FleetTotalRecord: StreamRecord {
+    static var recordType: String { "fleetTotal" }
+    static var recordTag: UInt8 { 6 }
+
+    let pid: Int32?
+    let processCount: Int
+    let failedCount: Int
+    let usage: FleetAnalysis.Usage
+
+    var cliPrint: String {
+        let owner = pid.map { "[\($0)]" } ?? "[fleet: \(processCount) processes, \(failedCount) failed]"
+        return "\(owner) total \(usage.cliPrint)"
+    }
+
+    func encode(to encoder: inout RecordEncoder) {
+        encoder.field("pid", pid)
+        encoder.field("processCount", UInt(processCount))
+        encoder.field("failedCount", UInt(failedCount))
+        usage.encode(to: &encoder)
+    }
+}
+
+struct FleetSizeClassRecord: StreamRecord {
+    static var recordType: String { "fleetSizeClass" }
+    static var recordTag: UInt8 { 7 }
+
+    let pid: Int32?
+    let sizeClass: UInt
+    let usage: FleetAnalysis.Usage
+
+    var cliPrint: String {
+        "\(pid.map { "[\($0)]" } ?? "[fleet]") size <= \(sizeClass) \(usage.cliPrint)"
+    }
+
+    func encode(to encoder: inout RecordEncoder) {
+        encoder.field("pid", pid)
+        encoder.field("sizeClass", sizeClass)
+        usage.encode(to: &encoder)
+    }
+}
+
+struct FleetArenaRecord: StreamRecord {
+    static var recordType: String { "fleetArena" }
+    static var recordTag: UInt8 { 8 }
+
+    let pid: Int32?
+    let arena: FleetAnalysis.Arena
+    /// Base of the heap of a thread arena of a single process.
+    let base: UInt?
+    let usage: FleetAnalysis.Usage
+
+    var arenaName: String {
+        switch arena {
+        case .main:
+            return "main"
+        case let .thread(index):
+            return "thread.\(index)"
+        case .threads:
+            return "threads"
+        case .mmapped:
+            return "mmapped"
+        }
+    }
+
+    var cliPrint: String {
+        let base = base.map { " (\($0.cliPrint))" } ?? ""
+        return "\(pid.map { "[\($0)]" } ?? "[fleet]") arena \(arenaName)\(base) \(usage.cliPrint)"
+    }
+
+    func encode(to encoder: inout RecordEncoder) {
+        encoder.field("pid", pid)
+        encoder.field("arena", arenaName)
+        encoder.field("base", base)
+        usage.encode(to: &encoder)
+    }
+}
+
+extension FleetAnalysis.Usage: CLIPrint {
+    var cliPrint: String {
+        "active: \(activeChunks) chunks, \(activeBytes) bytes; free: \(freeChunks) chunks, \(freeBytes) bytes"
+    }
+
+    func encode(to encoder: inout RecordEncoder) {
+        encoder.field("activeChunks", UInt(activeChunks))
+        encoder.field("activeBytes", activeBytes)
+        encoder.field("freeChunks", UInt(freeChunks))
+        encoder.field("freeBytes", freeBytes)
+    }
+}
@@ -0,0 +1,90 @@
+import Foundation
+import MemtoolCore
+
+/// Non-interactive resolution of addresses, for example samples of `perf mem`:
+///
+/// ```
+/// memtool resolve (-p PID|-c core path|-s snapshot path) [-j workers] [-n] [input path] > resolved.tsv
+/// ```
+///
+/// The session is prepared by the same operations as in the interactive mode (`attach`, `map`,
+/// `symbol` and `analyze`; use -n to skip the analysis), addresses are read from the input path
+/// or stdin and the records are written to stdout.
+enum BatchResolve {
+    static let usage = "Usage: memtool resolve (-p PID|-c core path|-s snapshot path) [-j workers] [-n] [input path]"
+
+    /// - Returns: Exit code of the process.
+    static func run(_ arguments: [String]) -> Int32 {
+        var commands: [String] = []
+        var workerCount = 1
+        var analyze = true
+        var inputPath: String?
+
+        var remaining = arguments[...]
+        while let argument = remaining.popFirst() {
+            switch argument {
+            case "-p":
+                guard let pid = remaining.popFirst().flatMap({ Int32($0) }) else {
+                    MemtoolCore.error(usage)
+                    return 1
+                }
+                commands += ["attach \(pid)", "map", "symbol"]
+            case "-c", "-s":
+                guard let path = remaining.popFirst() else {
+                    MemtoolCore.error(usage)
+                    return 1
+                }
+                commands.append((argument == "-c" ? "core" : "open") + " \"\(path)\"")
+                if argument == "-c" {
+                    commands.append("symbol")
+                }
+            case "-j":
+                guard let count = remaining.popFirst().flatMap({ Int($0) }), count > 0 else {
+                    MemtoolCore.error(usage)
+                    return 1
+                }
+                workerCount = count
+            case "-n":
+                analyze = false
+            default:
+                guard inputPath == nil else {
+                    MemtoolCore.error(usage)
+                    return 1
+                }
+                inputPath = argument
+            }
+        }
+
+        guard !commands.isEmpty else {
+            MemtoolCore.error(usage)
+            return 1
+        }
+        if analyze {
+            commands.append("analyze -j \(workerCount)")
+        }
+
+        var context = Context(operations: operations, session: nil, shouldStop: false)
+        guard context.run(commands), let session = context.session else {
+            return 1
+        }
+
+        let input: FileHandle
+        if let inputPath = inputPath {
+            guard let handle = FileHandle(forReadingAtPath: inputPath) else {
+                MemtoolCore.error("Error: Could not open \(inputPath).")
+                return 1
+            }
+            input = handle
+        } else {
+            input = .standardInput
+        }
+
+        // Chunks stored in the snapshot are used until the analysis is performed
+        let resolver = AddressResolver(session: session, chunks: context.glibcMallocExplorer?.chunks ?? context.snapshotChunks)
+        let summary = resolver.resolve(reading: input, writingTo: .standardOutput, workerCount: workerCount)
+        if summary.invalid > 0 {
+            MemtoolCore.error("Warning: Skipped \(summary.invalid) lines without a hexa address.")
+        }
+        return 0
+    }
+}
@@ -4,19 +4,56 @@ import MemtoolCore
 struct Context {
     let operations: [Operation]
     var subprocess: Process?
-    var session: ProcessSession?
+    var session: ProcessWideSession?
     var glibcMallocExplorer: GlibcMallocAnalyzer?
+    /// Chunks stored in the opened snapshot file, used until the analysis is performed.
+    var snapshotChunks: ChunkTable?
     var shouldStop: Bool
+    /// The last command was not recognized or its operation failed, see `fail(_:)`.
+    var failed = false
 
-    mutating func resolve(input: String) {
+    /// Performs the first operation accepting the input.
+    /// - Returns: false if no operation accepted the input or the operation failed.
+    @discardableResult
+    mutating func resolve(input: String) -> Bool {
+        failed = false
         if operations.first(where: { $0.resolve(input, &self) }) == nil {
-            print("Error: Unrecognized input \(input)")
+            fail("Error: Unrecognized input \(input)")
         }
+        return !failed
+    }
+
+    /// Prints the error of an operation, that accepted the input but could not perform it.
+    /// `run` does not perform the following commands.
+    mutating func fail(_ message: String) {
+        MemtoolCore.error(message)
+        failed = true
+    }
+
+    /// Performs the commands in order without interaction. Empty lines and lines starting with `#`
+    /// are skipped.
+    /// - Returns: false if a command was not recognized or failed, the following commands are not performed.
+    mutating func run<Commands: Sequence>(_ commands: Commands) -> Bool where Commands.Element == String {
+        for command in commands {
+            let command = command.trimmingCharacters(in: .whitespacesAndNewlines)
+            guard !command.isEmpty, !command.hasPrefix("#") else {
+                continue
+            }
+            guard resolve(input: command) else {
+                return false
+            }
+            if shouldStop {
+                break
+            }
+        }
+        return true
     }
 }
 
 struct Operation {
     let keyword: String
     let help: String
+    /// Performs the input, if it is a command of the operation.
+    /// Returns false if it is not, failures of accepted commands are reported by `Context.fail(_:)`.
     let resolve: (String, inout Context) -> Bool
 }
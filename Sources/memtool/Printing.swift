@@ -27,6 +27,12 @@ extension MemoryRegion: CLIPrint {
     }
 }
 
+extension ChunkTable.Entry: CLIPrint {
+    var cliPrint: String {
+        region.cliPrint
+    }
+}
+
 extension MapInfo: CLIPrint {
     var cliPrint: String {
         "MapInfo(flags: \(flags.stringValue), offset: \(offset.cliPrint), device major: \(device.major), device minor: \(device.minor), inode: \(inode), pathname: \(pathname.rawValue))".removingMemtoolMentions()
@@ -45,23 +51,29 @@ extension LoadedSymbolInfo: CLIPrint {
     }
 }
 
-extension ProcessSession: CLIPrint {
+extension Metrics: CLIPrint {
     var cliPrint: String {
-"""
-=== Session [\(pid)]
-Map:
-\(map?.map(\.cliPrint).joined(separator: "\n") ?? "[not loaded]")
-
-Unloaded Symbols:
-\(unloadedSymbols?.flatMap({ $1 }).map(\.cliPrint).joined(separator: "\n") ?? "[not loaded]")
-
-Symbols:
-\(symbols?.map(\.cliPrint).joined(separator: "\n") ?? "[not loaded]")
+        guard Metrics.isEnabled else {
+            return "[metrics disabled, build without MEMTOOL_DISABLE_METRICS]"
+        }
 
-Threads:
-\(threadSessions.map(\.tid).map(String.init(_:)).joined(separator: " "))
-=== 
-""".removingMemtoolMentions()
+        let phaseLines = phases
+            .sorted { $0.key < $1.key }
+            .map { name, duration in
+                let (seconds, attoseconds) = duration.components
+                return "  \(name): " + String(format: "%.3f ms", Double(seconds) * 1e3 + Double(attoseconds) * 1e-15)
+            }
+        let lookups = cacheHits + cacheMisses
+        let hitRate = lookups > 0 ? Double(cacheHits) / Double(lookups) * 100 : 0
+        return """
+=== Metrics
+Remote reads: \(remoteReads) (\(remoteBytes) bytes, \(failedReads) incomplete)
+Syscalls: \(syscalls) (process_vm_readv: \(processVmReadvSyscalls), /proc/[pid]/mem: \(procMemSyscalls), PTRACE_PEEKDATA: \(peekdataSyscalls))
+Cache: \(cacheHits) hits, \(cacheMisses) misses (\(String(format: "%.1f", hitRate)) %)
+Phases:
+\(phaseLines.isEmpty ? "  [none]" : phaseLines.joined(separator: "\n"))
+===
+"""
     }
 }
 
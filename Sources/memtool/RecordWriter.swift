@@ -0,0 +1,292 @@
+import Foundation
+import MemtoolCore
+
+/// Record of the output, that can be written as text, a JSON line or a binary record.
+protocol StreamRecord: CLIPrint {
+    /// Value of the `"type"` field of the JSON line.
+    static var recordType: String { get }
+    /// First byte of the binary record.
+    static var recordTag: UInt8 { get }
+    /// Encodes the fields in a fixed order.
+    func encode(to encoder: inout RecordEncoder)
+}
+
+/// RecordWriter streams records to a C stream through its own buffer, so the output is written in
+/// large blocks while the memory stays constant regardless of the number of records. It writes
+/// through the same `FILE` as `print`, so the order of the output is kept.
+///
+/// Formats:
+/// - text: `cliPrint` of the record on a line.
+/// - JSON lines: an object per line, `"type"` followed by the fields of the record.
+/// - binary: the tag byte, length of the payload as a little-endian `UInt32` and the payload.
+/// Integers of the payload are little-endian `UInt64`/`Int32`, doubles their IEEE 754 bit pattern
+/// as `UInt64`, booleans a byte, strings are prefixed by their length as `UInt32` and optionals by
+/// a byte (0 for nil).
+final class RecordWriter {
+    enum Format {
+        case text
+        case jsonLines
+        case binary
+    }
+
+    let format: Format
+    private let file: UnsafeMutablePointer<FILE>
+    private let bufferSize: Int
+    private var buffer: [UInt8] = []
+
+    init(format: Format, file: UnsafeMutablePointer<FILE> = stdout, bufferSize: Int = 1 << 16) {
+        self.format = format
+        self.file = file
+        self.bufferSize = bufferSize
+        buffer.reserveCapacity(bufferSize)
+    }
+
+    deinit {
+        flush()
+    }
+
+    func write<Record: StreamRecord>(_ record: Record) {
+        switch format {
+        case .text:
+            buffer.append(contentsOf: record.cliPrint.utf8)
+            buffer.append(UInt8(ascii: "\n"))
+        case .jsonLines:
+            var encoder = RecordEncoder(format: .jsonLines)
+            encoder.field("type", Record.recordType)
+            record.encode(to: &encoder)
+            buffer.append(contentsOf: encoder.bytes)
+            buffer.append(contentsOf: "}\n".utf8)
+        case .binary:
+            var encoder = RecordEncoder(format: .binary)
+            record.encode(to: &encoder)
+            buffer.append(Record.recordTag)
+            withUnsafeBytes(of: UInt32(encoder.bytes.count).littleEndian) { buffer.append(contentsOf: $0) }
+            buffer.append(contentsOf: encoder.bytes)
+        }
+
+        if buffer.count >= bufferSize {
+            flush()
+        }
+    }
+
+    /// Writes a line of text regardless of the format, used for headers of the text output.
+    func writeLine(_ line: String) {
+        buffer.append(contentsOf: line.utf8)
+        buffer.append(UInt8(ascii: "\n"))
+        if buffer.count >= bufferSize {
+            flush()
+        }
+    }
+
+    func flush() {
+        guard !buffer.isEmpty else {
+            return
+        }
+        buffer.withUnsafeBytes { bytes in
+            _ = fwrite(bytes.baseAddress, 1, bytes.count, file)
+        }
+        fflush(file)
+        buffer.removeAll(keepingCapacity: true)
+    }
+}
+
+/// Encodes the fields of a single record.
+struct RecordEncoder {
+    let format: RecordWriter.Format
+    private(set) var bytes: [UInt8] = []
+
+    init(format: RecordWriter.Format) {
+        self.format = format
+        if format == .jsonLines {
+            bytes.append(UInt8(ascii: "{"))
+        }
+    }
+
+    mutating func field(_ name: String, _ value: UInt) {
+        switch format {
+        case .jsonLines:
+            key(name)
+            bytes.append(contentsOf: String(value).utf8)
+        default:
+            withUnsafeBytes(of: UInt64(value).littleEndian) { bytes.append(contentsOf: $0) }
+        }
+    }
+
+    mutating func field(_ name: String, _ value: Int32) {
+        switch format {
+        case .jsonLines:
+            key(name)
+            bytes.append(contentsOf: String(value).utf8)
+        default:
+            withUnsafeBytes(of: value.littleEndian) { bytes.append(contentsOf: $0) }
+        }
+    }
+
+    mutating func field(_ name: String, _ value: Double) {
+        switch format {
+        case .jsonLines:
+            key(name)
+            bytes.append(contentsOf: (value.isFinite ? String(value) : "null").utf8)
+        default:
+            withUnsafeBytes(of: value.bitPattern.littleEndian) { bytes.append(contentsOf: $0) }
+        }
+    }
+
+    mutating func field(_ name: String, _ value: Bool) {
+        switch format {
+        case .jsonLines:
+            key(name)
+            bytes.append(contentsOf: (value ? "true" : "false").utf8)
+        default:
+            bytes.append(value ? 1 : 0)
+        }
+    }
+
+    mutating func field(_ name: String, _ value: String) {
+        switch format {
+        case .jsonLines:
+            key(name)
+            appendJSONString(value)
+        default:
+            withUnsafeBytes(of: UInt32(value.utf8.count).littleEndian) { bytes.append(contentsOf: $0) }
+            bytes.append(contentsOf: value.utf8)
+        }
+    }
+
+    mutating func field(_ name: String, _ value: UInt?) {
+        optional(name, value) { $0.field(name, $1) }
+    }
+
+    mutating func field(_ name: String, _ value: Int32?) {
+        optional(name, value) { $0.field(name, $1) }
+    }
+
+    mutating func field(_ name: String, _ value: String?) {
+        optional(name, value) { $0.field(name, $1) }
+    }
+
+    private mutating func optional<T>(_ name: String, _ value: T?, _ encode: (inout RecordEncoder, T) -> Void) {
+        switch (format, value) {
+        case let (.jsonLines, .some(value)):
+            encode(&self, value)
+        case (.jsonLines, .none):
+            key(name)
+            bytes.append(contentsOf: "null".utf8)
+        case let (_, .some(value)):
+            bytes.append(1)
+            encode(&self, value)
+        case (_, .none):
+            bytes.append(0)
+        }
+    }
+
+    private mutating func key(_ name: String) {
+        if bytes.count > 1 {
+            bytes.append(UInt8(ascii: ","))
+        }
+        appendJSONString(name)
+        bytes.append(UInt8(ascii: ":"))
+    }
+
+    private mutating func appendJSONString(_ string: String) {
+        let hex: [UInt8] = Array("0123456789abcdef".utf8)
+        bytes.append(UInt8(ascii: "\""))
+        for byte in string.utf8 {
+            switch byte {
+            case UInt8(ascii: "\""), UInt8(ascii: "\\"):
+                bytes.append(UInt8(ascii: "\\"))
+                bytes.append(byte)
+            case 0..<0x20:
+                bytes.append(contentsOf: "\\u00".utf8)
+                bytes.append(hex[Int(byte >> 4)])
+                bytes.append(hex[Int(byte & 0xf)])
+            default:
+                bytes.append(byte)
+            }
+        }
+        bytes.append(UInt8(ascii: "\""))
+    }
+}
+
+/// Properties of a region written as a `StreamRecord`.
+protocol StreamRegionProperties {
+    static var recordType: String { get }
+    static var recordTag: UInt8 { get }
+    func encode(to encoder: inout RecordEncoder)
+}
+
+extension MemoryRegion: StreamRecord where T: StreamRegionProperties {
+    static var recordType: String { T.recordType }
+    static var recordTag: UInt8 { T.recordTag }
+
+    func encode(to encoder: inout RecordEncoder) {
+        encoder.field("start", range.lowerBound)
+        encoder.field("end", range.upperBound)
+        properties.encode(to: &encoder)
+    }
+}
+
+extension MapInfo: StreamRegionProperties {
+    static var recordType: String { "map" }
+    static var recordTag: UInt8 { 1 }
+
+    func encode(to encoder: inout RecordEncoder) {
+        encoder.field("flags", flags.stringValue)
+        encoder.field("offset", offset)
+        encoder.field("inode", inode)
+        encoder.field("path", pathname.rawValue)
+    }
+}
+
+extension LoadedSymbolInfo: StreamRegionProperties {
+    static var recordType: String { "symbol" }
+    static var recordTag: UInt8 { 2 }
+
+    func encode(to encoder: inout RecordEncoder) {
+        encoder.field("name", name)
+        encoder.field("segment", segment.rawValue)
+    }
+}
+
+extension UnloadedSymbolInfo: StreamRecord {
+    static var recordType: String { "unloadedSymbol" }
+    static var recordTag: UInt8 { 3 }
+
+    func encode(to encoder: inout RecordEncoder) {
+        encoder.field("file", file)
+        encoder.field("location", location)
+        encoder.field("size", size)
+        encoder.field("name", name)
+        encoder.field("segment", segment.rawValue)
+    }
+}
+
+extension ChunkTable.Entry: StreamRecord {
+    static var recordType: String { "chunk" }
+    static var recordTag: UInt8 { 4 }
+
+    func encode(to encoder: inout RecordEncoder) {
+        encoder.field("base", base)
+        encoder.field("size", size)
+        encoder.field("state", String(describing: state))
+        encoder.field("threadHeapBase", owner.threadHeapBase)
+        encoder.field("tcacheThread", owner.tcacheThread)
+        encoder.field("freedArena", owner.freedArena)
+    }
+}
+
+extension GlibcMallocInfo: StreamRegionProperties {
+    static var recordType: String { "structure" }
+    static var recordTag: UInt8 { 5 }
+
+    func encode(to encoder: inout RecordEncoder) {
+        switch rebound {
+        case .mallocState:
+            encoder.field("rebound", "mallocState")
+        case let .mallocChunk(state):
+            encoder.field("rebound", "mallocChunk." + String(describing: state))
+        case .heapInfo:
+            encoder.field("rebound", "heapInfo")
+        }
+    }
+}
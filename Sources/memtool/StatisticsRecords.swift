@@ -0,0 +1,136 @@
+import Foundation
+import MemtoolCore
+
+/// Records of `stats`, streamed in the order: arenas, their size classes and list occupancy,
+/// then threads and their tcache occupancy.
+enum StatisticsRecords {
+    static func write(_ statistics: GlibcMallocStatistics, to writer: RecordWriter) {
+        for arena in statistics.arenas {
+            let name = arenaName(arena.threadHeapBase)
+            writer.write(ArenaStatisticsRecord(name: name, arena: arena))
+
+            for (sizeClass, counters) in arena.powerOfTwoClasses.sorted(by: { $0.key < $1.key }) {
+                writer.write(SizeClassStatisticsRecord(arena: name, kind: "pow2", sizeClass: sizeClass, counters: counters))
+            }
+            for (index, counters) in arena.binClasses.sorted(by: { $0.key < $1.key }) {
+                writer.write(SizeClassStatisticsRecord(arena: name, kind: "bin", sizeClass: UInt(index), counters: counters))
+            }
+            for (index, count) in arena.fastbinOccupancy.sorted(by: { $0.key < $1.key }) {
+                writer.write(OccupancyStatisticsRecord(owner: name, list: "fastbin", index: index, count: count))
+            }
+            for (index, count) in arena.binOccupancy.sorted(by: { $0.key < $1.key }) {
+                writer.write(OccupancyStatisticsRecord(owner: name, list: "bin", index: index, count: count))
+            }
+        }
+
+        for thread in statistics.threads {
+            writer.write(ThreadStatisticsRecord(thread: thread, arena: arenaName(thread.threadHeapBase)))
+            for (index, count) in thread.tcacheOccupancy.sorted(by: { $0.key < $1.key }) {
+                writer.write(OccupancyStatisticsRecord(owner: String(thread.ptraceId), list: "tcache", index: index, count: count))
+            }
+        }
+    }
+
+    static func arenaName(_ threadHeapBase: UInt?) -> String {
+        threadHeapBase.map { String(format: "0x%016lx", $0) } ?? "main"
+    }
+}
+
+struct ArenaStatisticsRecord: StreamRecord {
+    static var recordType: String { "arenaStats" }
+    static var recordTag: UInt8 { 9 }
+
+    let name: String
+    let arena: GlibcMallocStatistics.Arena
+
+    var cliPrint: String {
+        "[\(name)\(arena.freedArena ? ", freed" : "")] active: \(arena.active.cliPrint); free: \(arena.free.cliPrint); top: \(arena.topChunkSize) bytes; "
+            + "largest free extent: \(arena.largestFreeExtent) bytes; fragmentation: " + String(format: "%.3f", arena.fragmentation)
+    }
+
+    func encode(to encoder: inout RecordEncoder) {
+        encoder.field("arena", name)
+        encoder.field("freedArena", arena.freedArena)
+        encoder.field("activeChunks", UInt(arena.active.count))
+        encoder.field("activeBytes", arena.active.bytes)
+        encoder.field("freeChunks", UInt(arena.free.count))
+        encoder.field("freeBytes", arena.free.bytes)
+        encoder.field("topChunk", arena.topChunkBase)
+        encoder.field("topChunkSize", arena.topChunkSize)
+        encoder.field("largestFreeExtent", arena.largestFreeExtent)
+        encoder.field("fragmentation", arena.fragmentation)
+    }
+}
+
+struct SizeClassStatisticsRecord: StreamRecord {
+    static var recordType: String { "sizeClassStats" }
+    static var recordTag: UInt8 { 10 }
+
+    let arena: String
+    /// `pow2` for power of two classes keyed by the size, `bin` for glibc bins keyed by the bin index.
+    let kind: String
+    let sizeClass: UInt
+    let counters: GlibcMallocStatistics.SizeClass
+
+    var cliPrint: String {
+        let label = kind == "bin" ? "bin \(sizeClass)" : "size <= \(sizeClass)"
+        return "[\(arena)] \(label) active: \(counters.active.cliPrint); free: \(counters.free.cliPrint)"
+    }
+
+    func encode(to encoder: inout RecordEncoder) {
+        encoder.field("arena", arena)
+        encoder.field("kind", kind)
+        encoder.field("sizeClass", sizeClass)
+        encoder.field("activeChunks", UInt(counters.active.count))
+        encoder.field("activeBytes", counters.active.bytes)
+        encoder.field("freeChunks", UInt(counters.free.count))
+        encoder.field("freeBytes", counters.free.bytes)
+    }
+}
+
+struct OccupancyStatisticsRecord: StreamRecord {
+    static var recordType: String { "occupancyStats" }
+    static var recordTag: UInt8 { 11 }
+
+    /// Name of the arena for fastbins and bins, PID/TID of the thread for tcache bins.
+    let owner: String
+    let list: String
+    let index: Int
+    let count: Int
+
+    var cliPrint: String {
+        "[\(owner)] \(list) \(index): \(count) chunks"
+    }
+
+    func encode(to encoder: inout RecordEncoder) {
+        encoder.field("owner", owner)
+        encoder.field("list", list)
+        encoder.field("index", UInt(index))
+        encoder.field("count", UInt(count))
+    }
+}
+
+struct ThreadStatisticsRecord: StreamRecord {
+    static var recordType: String { "threadStats" }
+    static var recordTag: UInt8 { 12 }
+
+    let thread: GlibcMallocStatistics.Thread
+    let arena: String
+
+    var cliPrint: String {
+        "[\(thread.ptraceId)] arena: \(arena); tcache: \(thread.tcache.cliPrint)"
+    }
+
+    func encode(to encoder: inout RecordEncoder) {
+        encoder.field("thread", thread.ptraceId)
+        encoder.field("arena", arena)
+        encoder.field("tcacheChunks", UInt(thread.tcache.count))
+        encoder.field("tcacheBytes", thread.tcache.bytes)
+    }
+}
+
+extension GlibcMallocStatistics.Counter: CLIPrint {
+    var cliPrint: String {
+        "\(count) chunks, \(bytes) bytes"
+    }
+}
@@ -7,6 +7,39 @@ enum memtool {
     static func main() throws {
         var context = Context(operations: operations, session: nil, shouldStop: false)
 
+        // Non-interactive modes:
+        //   memtool resolve ...                    resolves sampled addresses, see `BatchResolve`
+        //   memtool fleet ...                      analyzes many processes at once, see `BatchFleet`
+        //   memtool script [path]                  performs commands of the file or stdin
+        //   memtool exec "command" "command" ...   performs the arguments as commands
+        let arguments = Array(CommandLine.arguments.dropFirst())
+        switch arguments.first {
+        case "resolve":
+            exit(BatchResolve.run(Array(arguments.dropFirst())))
+        case "fleet":
+            exit(BatchFleet.run(Array(arguments.dropFirst())))
+        case "script":
+            guard arguments.count <= 2 else {
+                MemtoolCore.error("Usage: memtool script [path]")
+                exit(1)
+            }
+            let succeeded: Bool
+            if arguments.count == 2 {
+                guard let script = try? String(contentsOfFile: arguments[1]) else {
+                    MemtoolCore.error("Error: Could not read \(arguments[1]).")
+                    exit(1)
+                }
+                succeeded = context.run(script.components(separatedBy: "\n"))
+            } else {
+                succeeded = context.run(AnyIterator { readLine() })
+            }
+            exit(succeeded ? 0 : 1)
+        case "exec":
+            exit(context.run(arguments.dropFirst()) ? 0 : 1)
+        default:
+            break
+        }
+
         while context.shouldStop == false {
             print("?", terminator: " ")
             while true {
@@ -24,7 +57,13 @@ let operations: [Operation] = [
     attachOperation,
     runOperation,
     detachOperation,
+    snapshotOperation,
+    saveOperation,
+    exportOperation,
+    openOperation,
+    coreOperation,
     statusOperation,
+    dumpOperation,
     threadOperation,
     mapOperation,
     symbolOperation,
@@ -33,7 +72,11 @@ let operations: [Operation] = [
     lookupOperation,
     peekOperation,
     addressOperation,
+    resolveOperation,
+    findOperation,
     analyzeOperation,
+    statsOperation,
+    graphOperation,
     chunkOperation,
     tcbOperation,
     wordOperation,
@@ -77,12 +120,17 @@ let attachOperation = Operation(keyword: "attach", help: "[PID] attempts to atta
     }
 
     if ctx.session != nil {
-        MemtoolCore.error("Error: Already attached to a process.")
+        ctx.fail("Error: Already attached to a process.")
         return true
     }
 
-    ctx.session = ProcessSession(pid: pid)
-    ctx.session!.loadThreads()
+    let session = ProcessSession(pid: pid)
+    guard session.isAttached else {
+        ctx.fail("Error: Could not attach to \(pid).")
+        return true
+    }
+    session.loadThreads()
+    ctx.session = session
 
     return true
 }
@@ -103,7 +151,7 @@ let runOperation = Operation(keyword: "run", help: "\"[path to executable]\" run
     let path = components[0].trimmingCharacters(in: CharacterSet(charactersIn: "\""))
 
     if ctx.session != nil {
-        MemtoolCore.error("Error: Already attached to a process.")
+        ctx.fail("Error: Already attached to a process.")
         return true
     }
 
@@ -113,14 +161,20 @@ let runOperation = Operation(keyword: "run", help: "\"[path to executable]\" run
     do {
         try process.run()
     } catch {
-        MemtoolCore.error("Error: Failed to run process, \(error)")
+        ctx.fail("Error: Failed to run process, \(error)")
         return true
     }
 
     sleep(5)
 
-    ctx.session = MemtoolCore.ProcessSession(pid: process.processIdentifier)
-    ctx.session!.loadThreads()
+    let session = MemtoolCore.ProcessSession(pid: process.processIdentifier)
+    guard session.isAttached else {
+        process.terminate()
+        ctx.fail("Error: Could not attach to \(process.processIdentifier).")
+        return true
+    }
+    session.loadThreads()
+    ctx.session = session
     ctx.subprocess = process
 
     return true
@@ -131,19 +185,167 @@ let detachOperation = Operation(keyword: "detach", help: "Detached from attached
         return false
     }
 
+    // The analyzer keeps the session, so releasing it would not detach the process
+    (ctx.session as? ProcessSession)?.detach()
     ctx.session = nil
+    ctx.glibcMallocExplorer = nil
+    ctx.snapshotChunks = nil
     ctx.subprocess?.terminate()
     ctx.subprocess = nil
 
     return true
 }
 
-let statusOperation = Operation(keyword: "status", help: "[-m|-u|-l|-a] Prints current session to stdout. Use -m for map, -u for unloaded symbols and -l for loaded symbols, -a for glibc malloc analysis result.") { input, ctx -> Bool in
+let snapshotOperation = Operation(keyword: "snapshot", help: "[PID] stops the process only to copy its heap, then analyzes the copy offline.") { input, ctx -> Bool in
+    guard input.hasPrefix("snapshot"), let pid = Int32(input.trimmingPrefix("snapshot").trimmingCharacters(in: .whitespacesAndNewlines)) else {
+        return false
+    }
+
+    if ctx.session != nil {
+        ctx.fail("Error: Already attached to a process.")
+        return true
+    }
+
+    let image = ProcessImage.capture(pid: pid)
+    guard image.threads.contains(where: { $0.tid == pid }) else {
+        ctx.fail("Error: Could not stop process \(pid).")
+        return true
+    }
+    print("Process \(pid) paused for \(image.pauseDuration), copied \(image.byteCount) bytes")
+
+    let session = OfflineSession(image: image)
+    session.loadSymbols()
+    ctx.session = session
+
+    return true
+}
+
+let saveOperation = Operation(keyword: "save", help: "\"[path]\" stores the heap of the session and the analyzed chunks in a snapshot file.") { input, ctx -> Bool in
+    guard input.hasPrefix("save") else {
+        return false
+    }
+    let payload = input.trimmingPrefix("save").trimmingCharacters(in: .whitespaces)
+    guard payload.count > 2, payload.hasPrefix("\""), payload.hasSuffix("\"") else {
+        return false
+    }
+    let path = payload.trimmingCharacters(in: CharacterSet(charactersIn: "\""))
+
+    guard let session = ctx.session else {
+        ctx.fail("Error: Not attached to a session!")
+        return true
+    }
+
+    do {
+        try HeapSnapshotFile.write(session: session, chunks: ctx.glibcMallocExplorer?.chunks ?? ctx.snapshotChunks, to: URL(fileURLWithPath: path))
+    } catch {
+        ctx.fail("Error: Failed to store snapshot: \(error)")
+    }
+
+    return true
+}
+
+let exportOperation = Operation(keyword: "export", help: "[-f] \"[path]\" writes the header and content of each active chunk into a file. Use -f to include freed chunks.") { input, ctx -> Bool in
+    guard input.hasPrefix("export") else {
+        return false
+    }
+    var payload = input.trimmingPrefix("export").trimmingCharacters(in: .whitespaces)
+    var options = ChunkExport.Options()
+    if payload.hasPrefix("-f") {
+        options.includeFree = true
+        payload = payload.dropFirst(2).trimmingCharacters(in: .whitespaces)
+    }
+    guard payload.count > 2, payload.hasPrefix("\""), payload.hasSuffix("\"") else {
+        return false
+    }
+    let path = payload.trimmingCharacters(in: CharacterSet(charactersIn: "\""))
+
+    guard let session = ctx.session else {
+        ctx.fail("Error: Not attached to a session!")
+        return true
+    }
+
+    // Chunks stored in the snapshot are used until the analysis is performed
+    guard let chunks = ctx.glibcMallocExplorer?.chunks ?? ctx.snapshotChunks, !chunks.isEmpty else {
+        ctx.fail("Error: No chunks to export, run `analyze` first.")
+        return true
+    }
+
+    FileManager.default.createFile(atPath: path, contents: nil)
+    guard let handle = FileHandle(forWritingAtPath: path) else {
+        ctx.fail("Error: Could not open \(path).")
+        return true
+    }
+    defer { try? handle.close() }
+
+    do {
+        let summary = try ChunkExport.write(chunks: chunks, from: session, options: options, to: handle)
+        print("Exported \(summary.chunks) chunks (\(summary.bytesRead) bytes) in \(summary.batches) reads.")
+        if summary.bytesMissing > 0 {
+            MemtoolCore.error("Warning: \(summary.bytesMissing) bytes could not be read and were zeroed.")
+        }
+    } catch {
+        ctx.fail("Error: Failed to export chunks: \(error)")
+    }
+
+    return true
+}
+
+let openOperation = Operation(keyword: "open", help: "\"[path]\" opens a snapshot file as an offline session.") { input, ctx -> Bool in
+    guard input.hasPrefix("open") else {
+        return false
+    }
+    let payload = input.trimmingPrefix("open").trimmingCharacters(in: .whitespaces)
+    guard payload.count > 2, payload.hasPrefix("\""), payload.hasSuffix("\"") else {
+        return false
+    }
+    let path = payload.trimmingCharacters(in: CharacterSet(charactersIn: "\""))
+
+    if ctx.session != nil {
+        ctx.fail("Error: Already attached to a process.")
+        return true
+    }
+
+    do {
+        let snapshot = try HeapSnapshotFile(contentsOf: URL(fileURLWithPath: path))
+        ctx.snapshotChunks = try snapshot.chunks()
+        ctx.session = OfflineSession(snapshot: snapshot)
+    } catch {
+        ctx.fail("Error: Failed to open snapshot: \(error)")
+    }
+
+    return true
+}
+
+let coreOperation = Operation(keyword: "core", help: "\"[path]\" opens an ELF core file as an offline session.") { input, ctx -> Bool in
+    guard input.hasPrefix("core") else {
+        return false
+    }
+    let payload = input.trimmingPrefix("core").trimmingCharacters(in: .whitespaces)
+    guard payload.count > 2, payload.hasPrefix("\""), payload.hasSuffix("\"") else {
+        return false
+    }
+    let path = payload.trimmingCharacters(in: CharacterSet(charactersIn: "\""))
+
+    if ctx.session != nil {
+        ctx.fail("Error: Already attached to a process.")
+        return true
+    }
+
+    do {
+        ctx.session = OfflineSession(core: try CoreFile(path: path))
+    } catch {
+        ctx.fail("Error: Failed to open core file: \(error)")
+    }
+
+    return true
+}
+
+let statusOperation = Operation(keyword: "status", help: "[-m|-u|-l|-a|-p] Prints current session to stdout. Use -m for map, -u for unloaded symbols and -l for loaded symbols, -a for glibc malloc analysis result, -p for performance counters.") { input, ctx -> Bool in
     guard input.hasPrefix("status") else {
         return false
     }
     let suffix = input.trimmingPrefix("status").trimmingCharacters(in: .whitespaces)
-    guard suffix.isEmpty || suffix == "-m" || suffix == "-u" || suffix == "-l" || suffix == "-a" else {
+    guard suffix.isEmpty || suffix == "-m" || suffix == "-u" || suffix == "-l" || suffix == "-a" || suffix == "-p" else {
         return false
     }
 
@@ -152,17 +354,30 @@ let statusOperation = Operation(keyword: "status", help: "[-m|-u|-l|-a] Prints c
         return true
     }
 
+    // Records are streamed, the output is never built as a whole
+    let writer = RecordWriter(format: .text)
     switch suffix {
     case "":
-        print(session.cliPrint)
+        writer.writeLine("=== \(session is OfflineSession ? "Offline session" : "Session") [\(session.pid)]")
+        writer.writeLine("Map:")
+        dump(.map, of: session, ctx: ctx, to: writer)
+        writer.writeLine("\nUnloaded Symbols:")
+        dump(.unloaded, of: session, ctx: ctx, to: writer)
+        writer.writeLine("\nSymbols:")
+        dump(.symbols, of: session, ctx: ctx, to: writer)
+        writer.writeLine("\nThreads:")
+        writer.writeLine(session.threads.map(\.ptraceId).map(String.init(_:)).joined(separator: " "))
+        writer.writeLine("=== ")
     case "-m":
-        print(session.map?.map(\.cliPrint).joined(separator: "\n") ?? "[not loaded]")
+        dump(.map, of: session, ctx: ctx, to: writer)
     case "-u":
-        print(session.unloadedSymbols?.flatMap({ $1 }).map(\.cliPrint).joined(separator: "\n") ?? "[not loaded]")
+        dump(.unloaded, of: session, ctx: ctx, to: writer)
     case "-l":
-        print(session.symbols?.map(\.cliPrint).joined(separator: "\n") ?? "[not loaded]")
+        dump(.symbols, of: session, ctx: ctx, to: writer)
     case "-a":
-        print(ctx.glibcMallocExplorer?.exploredHeap.map(\.cliPrint).joined(separator: "\n") ?? "[not loaded]")
+        dump(.heap, of: session, ctx: ctx, to: writer)
+    case "-p":
+        print(Metrics.current.cliPrint)
     default:
         return false
     }
@@ -171,6 +386,80 @@ let statusOperation = Operation(keyword: "status", help: "[-m|-u|-l|-a] Prints c
     return true
 }
 
+/// Content written by `dump` and `status`.
+enum DumpContent: String, CaseIterable {
+    case map
+    case symbols
+    case unloaded
+    /// Structures and chunks found by the analysis.
+    case heap
+    case chunks
+}
+
+/// Streams the records of the content, `[not loaded]` is written to the text output only.
+func dump(_ content: DumpContent, of session: ProcessWideSession, ctx: Context, to writer: RecordWriter) {
+    func notLoaded() {
+        if writer.format == .text {
+            writer.writeLine("[not loaded]")
+        }
+    }
+
+    switch content {
+    case .map:
+        guard let map = session.map else {
+            return notLoaded()
+        }
+        map.forEach(writer.write)
+    case .symbols:
+        guard let symbols = session.symbols else {
+            return notLoaded()
+        }
+        symbols.forEach(writer.write)
+    case .unloaded:
+        guard let unloadedSymbols = session.unloadedSymbols else {
+            return notLoaded()
+        }
+        for symbols in unloadedSymbols.values {
+            symbols.forEach(writer.write)
+        }
+    case .heap, .chunks:
+        // Chunks stored in the snapshot are used until the analysis is performed
+        guard let chunks = ctx.glibcMallocExplorer?.chunks ?? ctx.snapshotChunks else {
+            return notLoaded()
+        }
+        if content == .heap {
+            ctx.glibcMallocExplorer?.structures.forEach(writer.write)
+        }
+        chunks.forEach(writer.write)
+    }
+}
+
+let dumpOperation = Operation(keyword: "dump", help: "[-j|-b] [map|symbols|unloaded|heap|chunks] Streams records of the session to stdout. Use -j for JSON lines, -b for binary records.") { input, ctx -> Bool in
+    guard input.hasPrefix("dump") else {
+        return false
+    }
+    var payload = input.trimmingPrefix("dump").trimmingCharacters(in: .whitespaces)
+    var format = RecordWriter.Format.text
+    if payload.hasPrefix("-j") || payload.hasPrefix("-b") {
+        format = payload.hasPrefix("-j") ? .jsonLines : .binary
+        payload = payload.dropFirst(2).trimmingCharacters(in: .whitespaces)
+    }
+    guard let content = DumpContent(rawValue: payload) else {
+        return false
+    }
+
+    guard let session = ctx.session else {
+        ctx.fail("Error: Not attached to a session!")
+        return true
+    }
+
+    let writer = RecordWriter(format: format)
+    dump(content, of: session, ctx: ctx, to: writer)
+    writer.flush()
+
+    return true
+}
+
 let threadOperation = Operation(keyword: "thread", help: "[decimal TID/PID] Prints analysis status for TID/PID.") { input, ctx -> Bool in
     guard input.hasPrefix("thread") else {
         return false
@@ -181,31 +470,33 @@ let threadOperation = Operation(keyword: "thread", help: "[decimal TID/PID] Prin
     }
 
     guard let session = ctx.session else {
-        MemtoolCore.error("Error: Not attached to a session!")
+        ctx.fail("Error: Not attached to a session!")
         return true
     }
 
     guard let explorer = ctx.glibcMallocExplorer else {
-        MemtoolCore.error("Error: Analysis not performed")
+        ctx.fail("Error: Analysis not performed")
         return true
     }
 
     let target: Session
     if session.ptraceId == tid {
         target = session
-    } else if let thread = session.threadSessions.first(where: { $0.ptraceId == tid }) {
+    } else if let thread = session.threads.first(where: { $0.ptraceId == tid }) {
         target = thread
     } else {
-        MemtoolCore.error("Error: No session for PID/TID \(tid)")
+        ctx.fail("Error: No session for PID/TID \(tid)")
         return true
     }
 
     do {
         let view = try explorer.view(for: target)
-        print("View for PID/TID [\(tid)]:")
-        print(view.map(\.cliPrint).joined(separator: "\n"))
+        let writer = RecordWriter(format: .text)
+        writer.writeLine("View for PID/TID [\(tid)]:")
+        view.structures.forEach(writer.write)
+        view.chunks.forEach(writer.write)
     } catch {
-        MemtoolCore.error("Error: \(error)")
+        ctx.fail("Error: \(error)")
     }
 
     return true
@@ -217,11 +508,16 @@ let mapOperation = Operation(keyword: "map", help: "Parse /proc/pid/maps file.")
     }
 
     guard let session = ctx.session else {
-        MemtoolCore.error("Error: Not attached to a session!")
+        ctx.fail("Error: Not attached to a session!")
         return true
     }
 
-    session.loadMap()
+    guard let processSession = session as? ProcessSession else {
+        ctx.fail("Error: Map of an offline session can not be reloaded!")
+        return true
+    }
+
+    processSession.loadMap()
 
     return true
 }
@@ -232,29 +528,31 @@ let symbolOperation = Operation(keyword: "symbol", help: "Requires maps. Loads a
     }
 
     guard let session = ctx.session else {
-        MemtoolCore.error("Error: Not attached to a session!")
+        ctx.fail("Error: Not attached to a session!")
         return true
     }
 
     guard session.executableFileBasePoints != nil else {
-        MemtoolCore.error("Error: Need to load map first!")
+        ctx.fail("Error: Need to load map first!")
         return true
     }
 
     session.loadSymbols()
-    if !GlibcAssurances.isValidatedGlibcVersion(unloadedSymbols: session.unloadedSymbols!) {
+    if !GlibcAssurances.isValidatedGlibcVersion(symbolIndex: session.symbolIndex!) {
         MemtoolCore.error("Warning: MemtoolCore is not validated for Glibc version used by this program!")
     }
 
     return true
 }
 
-let lookupOperation = Operation(keyword: "lookup", help: "[-e] \"[text]\" searches symbols matching text. Use -e if you want only exact matches.") { input, ctx -> Bool in
+let lookupOperation = Operation(keyword: "lookup", help: "[-e|-p] \"[text]\" searches symbols matching text. Use -e if you want only exact matches, -p for matches by prefix.") { input, ctx -> Bool in
     guard input.hasPrefix("lookup") else {
         return false
     }
-    let exact = input.trimmingPrefix("lookup").trimmingCharacters(in: .whitespaces).hasPrefix("-e")
-    let text = input.trimmingPrefix("lookup").trimmingCharacters(in: .whitespaces).trimmingPrefix("-e").trimmingCharacters(in: .whitespaces)
+    let payload = input.trimmingPrefix("lookup").trimmingCharacters(in: .whitespaces)
+    let exact = payload.hasPrefix("-e")
+    let prefix = payload.hasPrefix("-p")
+    let text = (exact || prefix ? payload.dropFirst(2) : payload[...]).trimmingCharacters(in: .whitespaces)
     guard text.hasPrefix("\""), text.hasSuffix("\"") else {
         return false
     }
@@ -264,36 +562,38 @@ let lookupOperation = Operation(keyword: "lookup", help: "[-e] \"[text]\" search
     }
 
     guard let session = ctx.session else {
-        MemtoolCore.error("Error: Not attached to a session!")
+        ctx.fail("Error: Not attached to a session!")
         return true
     }
 
-    let unloadedPredicate: (UnloadedSymbolInfo) -> Bool = {
-        exact == true
-            ? $0.name == textToSearch
-            : $0.name.contains(textToSearch) 
+    let names: [String]? = session.symbolIndex.flatMap { index in
+        if exact {
+            return [textToSearch]
+        } else if prefix {
+            return Array(index.names(withPrefix: textToSearch))
+        } else {
+            return index.names(containing: textToSearch)
+        }
     }
 
-    let loadedPredicate: (SymbolRegion) -> Bool = {
-        exact == true
-            ? $0.properties.name == textToSearch
-            : $0.properties.name.contains(textToSearch)
+    let writer = RecordWriter(format: .text)
+    writer.writeLine("Unloaded symbols: ")
+    if let names = names, let index = session.symbolIndex {
+        for name in names {
+            index.unloadedSymbols(named: name).forEach(writer.write)
+        }
+    } else {
+        writer.writeLine("[not loaded]")
     }
 
-    print("Unloaded symbols: ")
-    let unloaded: String? = session.unloadedSymbols?
-        .flatMap({ $1 })
-        .filter(unloadedPredicate)
-        .map(\.cliPrint)
-        .joined(separator: "\n")
-    print(unloaded ?? "[not loaded]")
-
-    print("Loaded symbols: ")
-    let loaded: String? = session.symbols?
-        .filter(loadedPredicate)
-        .map(\.cliPrint)
-        .joined(separator: "\n")
-    print(loaded ?? "[not loaded]")
+    writer.writeLine("Loaded symbols: ")
+    if let names = names, let index = session.symbolIndex {
+        for name in names {
+            index.symbols(named: name).forEach(writer.write)
+        }
+    } else {
+        writer.writeLine("[not loaded]")
+    }
 
     return true
 }
@@ -311,34 +611,34 @@ let peekOperation = Operation(keyword: "peek", help: "[typename] [hexa pointer]
     }
 
     guard let session = ctx.session else {
-        MemtoolCore.error("Error: Not attached to a session!")
+        ctx.fail("Error: Not attached to a session!")
         return true
     }
 
     switch components[0] {
     case String(describing: malloc_state.self):
-        print(BoundRemoteMemory<malloc_state>(pid: session.pid, load: base))
+        peek(malloc_state.self, base: base, in: session, ctx: &ctx)
     
     case String(describing: malloc_chunk.self):
-        print(BoundRemoteMemory<malloc_chunk>(pid: session.pid, load: base))
+        peek(malloc_chunk.self, base: base, in: session, ctx: &ctx)
     
     case String(describing: heap_info.self):
-        print(BoundRemoteMemory<heap_info>(pid: session.pid, load: base))
+        peek(heap_info.self, base: base, in: session, ctx: &ctx)
 
     case String(describing: tcbhead_t.self):
-        print(BoundRemoteMemory<tcbhead_t>(pid: session.pid, load: base))
+        peek(tcbhead_t.self, base: base, in: session, ctx: &ctx)
 
     case String(describing: dtv_pointer.self):
-        print(BoundRemoteMemory<dtv_pointer>(pid: session.pid, load: base))
+        peek(dtv_pointer.self, base: base, in: session, ctx: &ctx)
 
     case String(describing: link_map.self):
-        print(BoundRemoteMemory<link_map>(pid: session.pid, load: base))
+        peek(link_map.self, base: base, in: session, ctx: &ctx)
 
     case String(describing: r_debug.self):
-        print(BoundRemoteMemory<r_debug>(pid: session.pid, load: base))
+        peek(r_debug.self, base: base, in: session, ctx: &ctx)
     
     case String(describing: link_map_private.self):
-        print(BoundRemoteMemory<link_map_private>(pid: session.pid, load: base))
+        peek(link_map_private.self, base: base, in: session, ctx: &ctx)
         
     default:
         return false
@@ -347,6 +647,15 @@ let peekOperation = Operation(keyword: "peek", help: "[typename] [hexa pointer]
     return true
 }
 
+/// Prints the memory bound to the type, the memory is read from the live process or its copy.
+func peek<T>(_ type: T.Type, base: UInt, in session: Session, ctx: inout Context) {
+    do {
+        print(try session.memory.load(of: type, base: base))
+    } catch {
+        ctx.fail("Error: Failed to load \(type) at \(base.cliPrint): \(error)")
+    }
+}
+
 let addressOperation = Operation(keyword: "addr", help: "[hexa pointer] Prints all entities that contain given address with offsets.") { input, ctx -> Bool in
     guard input.hasPrefix("addr") else {
         return false
@@ -358,7 +667,7 @@ let addressOperation = Operation(keyword: "addr", help: "[hexa pointer] Prints a
     }
 
     guard let session = ctx.session else {
-        MemtoolCore.error("Error: Not attached to a session!")
+        ctx.fail("Error: Not attached to a session!")
         return true
     }
 
@@ -377,10 +686,8 @@ let addressOperation = Operation(keyword: "addr", help: "[hexa pointer] Prints a
     print(map ?? "[not loaded]")
 
     print("Loaded symbols: ")
-    let loaded: String? = session.symbols?
-        .filter {
-            $0.range.contains(base)
-        }
+    let loaded: String? = session.symbolIndex?
+        .symbols(containing: base)
         .map {
             let offset = base - $0.range.lowerBound
             return $0.range.lowerBound.cliPrint + " + " + offset.cliPrint + " \t" + $0.cliPrint
@@ -389,36 +696,286 @@ let addressOperation = Operation(keyword: "addr", help: "[hexa pointer] Prints a
     print(loaded ?? "[not loaded]")
 
     print("Glibc malloc analysis: ")
-    let analyzed = ctx.glibcMallocExplorer?.exploredHeap
-        .filter {
-            $0.range.contains(base)
+    // Chunks stored in the snapshot are used until the analysis is performed
+    let chunks = ctx.glibcMallocExplorer?.chunks ?? ctx.snapshotChunks
+    let analyzed: String? = chunks.map { chunks in
+        let structures = (ctx.glibcMallocExplorer?.structures ?? [])
+            .filter {
+                $0.range.contains(base)
+            }
+            .map {
+                let offset = base - $0.range.lowerBound
+                return $0.range.lowerBound.cliPrint + " + " + offset.cliPrint + " \t" + $0.cliPrint
+            }
+        let chunk = chunks.index(containing: base)
+            .map { chunks[$0] }
+            .map {
+                let offset = base - $0.base
+                return $0.base.cliPrint + " + " + offset.cliPrint + " \t" + $0.cliPrint
+            }
+        return (structures + (chunk.map { [$0] } ?? [])).joined(separator: "\n")
+    }
+    print(analyzed ?? "[not loaded]")
+
+
+    return true
+}
+
+/// Number of matches printed by the `find` operation.
+let findLimit = 1000
+
+let resolveOperation = Operation(keyword: "resolve", help: "\"[input path]\" [\"output path\"] Resolves hexa addresses, one per line, to mappings, symbols and chunks. Prints to stdout without the output path.") { input, ctx -> Bool in
+    guard input.hasPrefix("resolve") else {
+        return false
+    }
+    let payload = input.trimmingPrefix("resolve").trimmingCharacters(in: .whitespaces)
+    let paths = payload.components(separatedBy: "\"").map { $0.trimmingCharacters(in: .whitespaces) }.filter { !$0.isEmpty }
+    guard payload.hasPrefix("\""), payload.hasSuffix("\""), paths.count == 1 || paths.count == 2 else {
+        return false
+    }
+
+    guard let session = ctx.session else {
+        ctx.fail("Error: Not attached to a session!")
+        return true
+    }
+
+    guard let inputHandle = FileHandle(forReadingAtPath: paths[0]) else {
+        ctx.fail("Error: Could not open \(paths[0]).")
+        return true
+    }
+    var outputHandle = FileHandle.standardOutput
+    if paths.count == 2 {
+        FileManager.default.createFile(atPath: paths[1], contents: nil)
+        guard let handle = FileHandle(forWritingAtPath: paths[1]) else {
+            ctx.fail("Error: Could not open \(paths[1]).")
+            return true
         }
-        .map {
-            let offset = base - $0.range.lowerBound
-            return $0.range.lowerBound.cliPrint + " + " + offset.cliPrint + " \t" + $0.cliPrint
+        outputHandle = handle
+    }
+
+    // Chunks stored in the snapshot are used until the analysis is performed
+    let resolver = AddressResolver(session: session, chunks: ctx.glibcMallocExplorer?.chunks ?? ctx.snapshotChunks)
+    let summary = resolver.resolve(reading: inputHandle, writingTo: outputHandle, workerCount: ctx.glibcMallocExplorer?.workerCount ?? 1)
+    if summary.invalid > 0 {
+        MemtoolCore.error("Warning: Skipped \(summary.invalid) lines without a hexa address.")
+    }
+
+    return true
+}
+
+let findOperation = Operation(keyword: "find", help: "[-c] [-v hexa value|-r hexa lower hexa upper|-s \"text\"|-x hexa bytes] Searches readable mappings for a value, range of values, text or bytes. Use -c to search only active chunks.") { input, ctx -> Bool in
+    guard input.hasPrefix("find") else {
+        return false
+    }
+    var payload = input.trimmingPrefix("find").trimmingCharacters(in: .whitespaces)
+    let scope: MemorySearch.Scope = payload.hasPrefix("-c") ? .chunks : .mappings
+    if scope == .chunks {
+        payload = payload.dropFirst(2).trimmingCharacters(in: .whitespaces)
+    }
+
+    let option = payload.prefix(2)
+    let arguments = payload.dropFirst(2).trimmingCharacters(in: .whitespaces)
+    let words = arguments.components(separatedBy: " ").filter { !$0.isEmpty }
+    func hexa(_ text: String) -> UInt64? {
+        UInt64(text.trimmingPrefix("0x"), radix: 16)
+    }
+
+    let pattern: MemorySearch.Pattern
+    switch option {
+    case "-v":
+        guard words.count == 1, let value = hexa(words[0]) else {
+            return false
         }
-        .joined(separator: "\n")
-    print(analyzed ?? "[not loaded]")
+        pattern = .value(value)
+    case "-r":
+        guard words.count == 2, let lower = hexa(words[0]), let upper = hexa(words[1]), lower <= upper else {
+            return false
+        }
+        pattern = .values(lower...upper)
+    case "-s":
+        guard arguments.count > 2, arguments.hasPrefix("\""), arguments.hasSuffix("\"") else {
+            return false
+        }
+        pattern = .bytes(Array(arguments.dropFirst().dropLast().utf8))
+    case "-x":
+        let digits = words.joined()
+        guard !digits.isEmpty, digits.count % 2 == 0 else {
+            return false
+        }
+        let bytes = stride(from: 0, to: digits.count, by: 2).compactMap { offset -> UInt8? in
+            let start = digits.index(digits.startIndex, offsetBy: offset)
+            return UInt8(digits[start..<digits.index(start, offsetBy: 2)], radix: 16)
+        }
+        guard bytes.count == digits.count / 2 else {
+            return false
+        }
+        pattern = .bytes(bytes)
+    default:
+        return false
+    }
 
+    guard let session = ctx.session else {
+        ctx.fail("Error: Not attached to a session!")
+        return true
+    }
+
+    // Chunks stored in the snapshot are used until the analysis is performed
+    let chunks = ctx.glibcMallocExplorer?.chunks ?? ctx.snapshotChunks
+    let matches: [MemorySearch.Match]
+    do {
+        matches = try MemorySearch.find(
+            pattern,
+            in: scope,
+            session: session,
+            chunks: chunks,
+            limit: findLimit + 1,
+            workerCount: ctx.glibcMallocExplorer?.workerCount ?? 1
+        )
+    } catch {
+        ctx.fail("Error: Search ended with error: \(error)")
+        return true
+    }
+
+    for match in matches.prefix(findLimit) {
+        var line = match.address.cliPrint
+        if let value = match.value {
+            line += " = " + UInt(value).cliPrint
+        }
+        if let region = match.region {
+            line += " \tmap: " + region.range.lowerBound.cliPrint + " + " + (match.address - region.range.lowerBound).cliPrint + " " + region.properties.pathname.rawValue
+        }
+        if let symbol = match.symbol {
+            line += " \tsymbol: " + symbol.properties.name + " + " + (match.address - symbol.range.lowerBound).cliPrint
+        }
+        if let chunk = match.chunk {
+            line += " \tchunk: " + chunk.base.cliPrint + " + " + (match.address - chunk.base).cliPrint + " \(chunk.state)"
+        }
+        print(line)
+    }
+    if matches.count > findLimit {
+        print("Only the first \(findLimit) matches are printed.")
+    }
 
     return true
 }
 
-let analyzeOperation = Operation(keyword: "analyze", help: "Attempts to enumerate heap chubnks") { input, ctx -> Bool in
-    guard input == "analyze" else {
+let analyzeOperation = Operation(keyword: "analyze", help: "[-j decimal count] Attempts to enumerate heap chubnks. Use -j to analyze arenas with multiple workers.") { input, ctx -> Bool in
+    guard input.hasPrefix("analyze") else {
         return false
     }
+    let payload = input.trimmingPrefix("analyze").trimmingCharacters(in: .whitespaces)
+    var workerCount = 1
+    if !payload.isEmpty {
+        guard 
+            payload.hasPrefix("-j"),
+            let count = Int(payload.dropFirst(2).trimmingCharacters(in: .whitespaces)),
+            count > 0
+        else {
+            return false
+        }
+        workerCount = count
+    }
     
     guard let session = ctx.session else {
-        MemtoolCore.error("Error: Not attached to a session!")
+        ctx.fail("Error: Not attached to a session!")
         return true
     }
 
     do {
-        ctx.glibcMallocExplorer = try GlibcMallocAnalyzer(session: session)
+        ctx.glibcMallocExplorer = try GlibcMallocAnalyzer(session: session, workerCount: workerCount)
         try ctx.glibcMallocExplorer?.analyze()
     } catch {
-        MemtoolCore.error("Error: Glibc exlorer ended with error: \(error)")
+        ctx.fail("Error: Glibc exlorer ended with error: \(error)")
+    }
+
+    return true
+}
+
+let statsOperation = Operation(keyword: "stats", help: "[-j|-b] Prints statistics of the glibc malloc heap by arena, size class and thread without storing the chunks. Use -j for JSON lines, -b for binary records.") { input, ctx -> Bool in
+    guard input.hasPrefix("stats") else {
+        return false
+    }
+    let payload = input.trimmingPrefix("stats").trimmingCharacters(in: .whitespaces)
+    let format: RecordWriter.Format
+    switch payload {
+    case "":
+        format = .text
+    case "-j":
+        format = .jsonLines
+    case "-b":
+        format = .binary
+    default:
+        return false
+    }
+
+    guard let session = ctx.session else {
+        ctx.fail("Error: Not attached to a session!")
+        return true
+    }
+
+    do {
+        // Counts the chunks of the last analysis, otherwise walks the heaps without storing them
+        let analyzer = try ctx.glibcMallocExplorer ?? GlibcMallocAnalyzer(session: session)
+        let statistics = try analyzer.statistics()
+        let writer = RecordWriter(format: format)
+        StatisticsRecords.write(statistics, to: writer)
+        writer.flush()
+    } catch {
+        ctx.fail("Error: Glibc exlorer ended with error: \(error)")
+    }
+
+    return true
+}
+
+let graphOperation = Operation(keyword: "graph", help: "[-l|-r hexa pointer] Scans active chunks for references. Use -l to list chunks unreachable from roots, -r for retained size of the chunk.") { input, ctx -> Bool in
+    guard input.hasPrefix("graph") else {
+        return false
+    }
+    let payload = input.trimmingPrefix("graph").trimmingCharacters(in: .whitespaces)
+
+    var retainedBase: UInt?
+    if payload.hasPrefix("-r") {
+        guard let base = UInt(payload.dropFirst(2).trimmingCharacters(in: .whitespaces).trimmingPrefix("0x"), radix: 16) else {
+            return false
+        }
+        retainedBase = base
+    } else if !payload.isEmpty && payload != "-l" {
+        return false
+    }
+
+    guard let session = ctx.session else {
+        ctx.fail("Error: Not attached to a session!")
+        return true
+    }
+
+    // Chunks stored in the snapshot are used until the analysis is performed
+    guard let chunks = ctx.glibcMallocExplorer?.chunks ?? ctx.snapshotChunks else {
+        ctx.fail("Error: Glibc malloc analysis not performed!")
+        return true
+    }
+
+    let graph: MemoryGraph
+    do {
+        graph = try MemoryGraph(session: session, chunks: chunks, workerCount: ctx.glibcMallocExplorer?.workerCount ?? 1)
+    } catch {
+        ctx.fail("Error: Memory graph ended with error: \(error)")
+        return true
+    }
+
+    if let base = retainedBase {
+        guard let node = graph.node(containing: base) else {
+            ctx.fail("Error: Address is not in any active chunk!")
+            return true
+        }
+        print(graph.range(of: node).lowerBound.cliPrint + " retains \(graph.retainedSize(of: node)) bytes")
+    } else if payload == "-l" {
+        for node in graph.unreachableNodes() {
+            let range = graph.range(of: node)
+            print(range.lowerBound.cliPrint + " size \(range.count)")
+        }
+    } else {
+        print("Nodes: \(graph.nodeCount), references: \(graph.referenceCount), root references: \(graph.roots.count), root mappings: \(graph.rootRegions.count)")
+        print("Unreachable: \(graph.unreachableNodes().count)")
     }
 
     return true
@@ -435,13 +992,17 @@ let chunkOperation = Operation(keyword: "chunk", help: "[hexa pointer] Attempts
     }
 
     guard let session = ctx.session else {
-        MemtoolCore.error("Error: Not attached to a session!")
+        ctx.fail("Error: Not attached to a session!")
         return true
     }
 
-    let chunk = Chunk(pid: session.pid, baseAddress: base)
-    print(chunk.cliPrint)
-    print("Content as ascii:\n" + chunk.content.asAsciiString)
+    do {
+        let chunk = try Chunk(memory: session.memory, baseAddress: base)
+        print(chunk.cliPrint)
+        print("Content as ascii:\n" + chunk.content.asAsciiString)
+    } catch {
+        ctx.fail("Error: Failed to load chunk at \(base.cliPrint): \(error)")
+    }
 
     return true
 }
@@ -452,28 +1013,26 @@ let tcbOperation = Operation(keyword: "tcb", help: "Locates and prints Thread Co
     }
 
     guard let session = ctx.session else {
-        MemtoolCore.error("Error: Not attached to a session!")
+        ctx.fail("Error: Not attached to a session!")
         return true
     }
 
     guard session.executableFileBasePoints != nil else {
-        MemtoolCore.error("Error: Need to load map first!")
+        ctx.fail("Error: Need to load map first!")
         return true
     }
 
     // The pointer to the TCB should be in the FS register at all times (but we need to use FS_BASE in order to read FS)
-    let fsBase = UInt(bitPattern: swift_inspect_bridge__ptrace_peekuser(session.pid, FS_BASE))
+    let fsBase = session.fsBase
 
     // Check, that we're not reading garbage and accessing the record wonn't cause crash
-    guard session.map?.contains(where: { $0.range.contains(fsBase) && $0.properties.flags.contains([.read, .write])}) == true else {
-        MemtoolCore.error("FS_BASE not in readable space")
+    guard session.mapIndex?.contains(fsBase, flags: [.read, .write]) == true else {
+        ctx.fail("Error: FS_BASE not in readable space")
         return true
     }
 
-    let head = BoundRemoteMemory<tcbhead_t>(pid: session.pid, load: fsBase)
-
     print("FS_BASE content: \(fsBase.cliPrint)")
-    print(head)
+    peek(tcbhead_t.self, base: fsBase, in: session, ctx: &ctx)
 
     return true
 }
@@ -497,35 +1056,41 @@ let wordOperation = Operation(keyword: "word", help: "[decimal count] [hex point
     let bitSize = UInt( ascii ? MemoryLayout<CChar>.size : MemoryLayout<UInt>.size)
 
     guard let session = ctx.session else {
-        MemtoolCore.error("Error: Not attached to a session!")
+        ctx.fail("Error: Not attached to a session!")
         return true
     }
 
-    guard let maps = session.map else {
-        MemtoolCore.error("Error: Need to load map first!")
+    guard let maps = session.mapIndex else {
+        ctx.fail("Error: Need to load map first!")
         return true
     }
 
     let range = base..<(base + count * bitSize)
 
-    guard let map = maps.first(where: { $0.range.lowerBound <= range.lowerBound && $0.range.upperBound >= range.upperBound }) else {
-        MemtoolCore.error("Error: Failed to map segment for this memory")
+    guard let map = maps.region(containing: range) else {
+        ctx.fail("Error: Failed to map segment for this memory")
         return true
     }
 
     let offset = base - map.range.lowerBound
     print(map.range.lowerBound.cliPrint + " + " + offset.cliPrint + " \t" + map.cliPrint)
     
+    let memory: RawRemoteMemory
+    do {
+        memory = try session.memory.load(range)
+    } catch {
+        ctx.fail("Error: Failed to load \(base.cliPrint): \(error)")
+        return true
+    }
+
     if ascii {
-        let memory = RawRemoteMemory(pid: session.pid, load: range)
         print(memory.asAsciiString)
     } else {
-        var memory = ContiguousArray<UInt>(repeating: 0, count: Int(count))
-        memory.withUnsafeMutableBufferPointer { ptr in
-            swift_inspect_bridge__ptrace_peekdata_initialize(session.pid, base, UnsafeMutableRawBufferPointer(ptr))
+        let words = memory.buffer.withUnsafeBytes { bytes in
+            (0..<Int(count)).map { bytes.loadUnaligned(fromByteOffset: $0 * MemoryLayout<UInt>.size, as: UInt.self) }
         }
 
-        print(memory.map(\.cliPrint).joined(separator: " "))
+        print(words.map(\.cliPrint).joined(separator: " "))
     }
 
     return true
@@ -549,7 +1114,7 @@ let tbssSymbolOperation = Operation(keyword: "tbss", help: "\"symbol name\" \"fi
     let file = components[1].trimmingCharacters(in: CharacterSet(charactersIn: "\""))
 
     guard let session = ctx.session else {
-        MemtoolCore.error("Error: Not attached to a session!")
+        ctx.fail("Error: Not attached to a session!")
         return true
     }
 
@@ -558,7 +1123,7 @@ let tbssSymbolOperation = Operation(keyword: "tbss", help: "\"symbol name\" \"fi
         print(result)
         print("Symbol base \(result.loadedSymbolBase.cliPrint)")
     } catch {
-        MemtoolCore.error("Error: Failed to locate tbss symbol: \(error)")
+        ctx.fail("Error: Failed to locate tbss symbol: \(error)")
     }
 
     return true
@@ -580,7 +1145,7 @@ let errnoGotOperation = Operation(keyword: "errnoGot", help: "\"glibc file name\
     let path = components[0].trimmingCharacters(in: CharacterSet(charactersIn: "\""))
 
     guard let session = ctx.session else {
-        MemtoolCore.error("Error: Not attached to a session!")
+        ctx.fail("Error: Not attached to a session!")
         return true
     }
 
@@ -589,7 +1154,7 @@ let errnoGotOperation = Operation(keyword: "errnoGot", help: "\"glibc file name\
         print(result)
         print("Errno base \(result.errnoLocation.cliPrint)")
     } catch {
-        MemtoolCore.error("Error: Failed to locate tbss symbol: \(error)")
+        ctx.fail("Error: Failed to locate tbss symbol: \(error)")
     }
 
     return true
@@ -606,11 +1171,17 @@ let revealOperation = Operation(keyword: "reveal", help: "[hexa pointer] Applies
     }
 
     guard let session = ctx.session else {
-        MemtoolCore.error("Error: Not attached to a session!")
+        ctx.fail("Error: Not attached to a session!")
         return true
     }
 
-    let content = BoundRemoteMemory<UnsafeRawPointer>(pid: session.pid, load: base)
+    let content: BoundRemoteMemory<UnsafeRawPointer>
+    do {
+        content = try session.memory.load(of: UnsafeRawPointer.self, base: base)
+    } catch {
+        ctx.fail("Error: Failed to load \(base.cliPrint): \(error)")
+        return true
+    }
     let pseudoPointer = UnsafeRawPointer(bitPattern: UInt(base))!
     let result = swift_inspect_bridge__macro_REVEAL_PTR(content.buffer, pseudoPointer)
 
@@ -0,0 +1,98 @@
+import XCTest
+@testable import MemtoolCore
+
+final class AddressResolverTests: XCTestCase {
+    private func region(_ range: MemoryRange, _ pathname: MapPath) -> MapRegion {
+        MapRegion(
+            range: range,
+            properties: MapInfo(flags: MapFlags(rawValue: "rw-p"), offset: 0, device: (0, 0), inode: 0, pathname: pathname)
+        )
+    }
+
+    private func symbol(_ name: String, _ range: MemoryRange) -> SymbolRegion {
+        SymbolRegion(
+            range: range,
+            properties: LoadedSymbolInfo(flags: SymbolFlags(rawValue: "g     O"), segment: .known(.data), name: name)
+        )
+    }
+
+    private func makeResolver() -> AddressResolver {
+        var chunks = ChunkTable()
+        chunks.append(base: 0x5020, size: 0x20, state: .heapBin, owner: ChunkTable.Owner(threadHeapBase: nil))
+        chunks.append(base: 0x5000, size: 0x20, state: .heapActive, owner: ChunkTable.Owner(threadHeapBase: nil))
+
+        return AddressResolver(
+            regions: [region(0x1000..<0x3000, .file("/lib/a.so")), region(0x5000..<0x6000, .pseudopath(.heap))],
+            symbols: [symbol("outer", 0x1000..<0x1100), symbol("inner", 0x1010..<0x1020), symbol("after", 0x1200..<0x1210)],
+            chunks: chunks
+        )
+    }
+
+    func testLookups() {
+        let resolver = makeResolver()
+
+        let inner = resolver.resolve(0x1018)
+        XCTAssertEqual(inner.region?.range, 0x1000..<0x3000)
+        XCTAssertEqual(inner.symbol?.properties.name, "inner")
+        XCTAssertNil(inner.chunk)
+
+        // The enclosing symbol continues after the inner one
+        XCTAssertEqual(resolver.resolve(0x1020).symbol?.properties.name, "outer")
+        XCTAssertNil(resolver.resolve(0x1150).symbol)
+        XCTAssertNotNil(resolver.resolve(0x1150).region)
+
+        XCTAssertEqual(resolver.resolve(0x5028).chunk?.base, 0x5020)
+        XCTAssertEqual(resolver.resolve(0x5008).chunk?.state, .heapActive)
+        XCTAssertNil(resolver.resolve(0x5040).chunk)
+
+        let outside = resolver.resolve([0x0fff, 0x4000, 0x6000], workerCount: 2)
+        XCTAssertTrue(outside.allSatisfy { $0.region == nil && $0.symbol == nil && $0.chunk == nil })
+    }
+
+    func testFlattenPrefersInnermostRange() {
+        let flat = AddressResolver.flatten([(0x10..<0x40, 0), (0x20..<0x30, 1), (0x30..<0x50, 2), (0x60..<0x60, 3)])
+
+        XCTAssertEqual(flat.map { $0.range }, [0x10..<0x20, 0x20..<0x30, 0x30..<0x50])
+        XCTAssertEqual(flat.map { $0.id }, [0, 1, 2])
+    }
+
+    func testParseAddresses() {
+        var invalid = 0
+        let input = "0x1018\n5028\n\n  0xFF \nnot an address\n0x\n12345678901234567"
+        let addresses = AddressResolver.parseAddresses(ArraySlice(input.utf8), invalid: &invalid)
+
+        XCTAssertEqual(addresses, [0x1018, 0x5028, 0xff])
+        XCTAssertEqual(invalid, 3)
+    }
+
+    func testStreamedRecords() throws {
+        let resolver = makeResolver()
+        let directory = FileManager.default.temporaryDirectory
+        let inputURL = directory.appendingPathComponent("\(Self.self)-\(getpid())-input")
+        let outputURL = directory.appendingPathComponent("\(Self.self)-\(getpid())-output")
+        defer {
+            try? FileManager.default.removeItem(at: inputURL)
+            try? FileManager.default.removeItem(at: outputURL)
+        }
+
+        try "0x1018\n0x5028\n0x4000".write(to: inputURL, atomically: true, encoding: .utf8)
+        FileManager.default.createFile(atPath: outputURL.path, contents: nil)
+        let input = try FileHandle(forReadingFrom: inputURL)
+        let output = try FileHandle(forWritingTo: outputURL)
+
+        let summary = resolver.resolve(reading: input, writingTo: output, batchSize: 4)
+        try output.close()
+
+        XCTAssertEqual(summary.resolved, 3)
+        XCTAssertEqual(summary.invalid, 0)
+        XCTAssertEqual(
+            try String(contentsOf: outputURL),
+            """
+            0x1018\t/lib/a.so+0x18\tinner+0x8\t-
+            0x5028\t[heap]+0x28\t-\t0x5020+0x8:heapBin
+            0x4000\t-\t-\t-
+
+            """
+        )
+    }
+}
@@ -1,4 +1,5 @@
 import Foundation
+@testable import MemtoolCore
 
 final class AdhocProgram {
     enum Erorr: Swift.Error {
@@ -82,4 +83,8 @@ final class AdhocProgram {
         runningProgram.terminate()
         try? FileManager.default.removeItem(at: programPath)
     }
-}
\ No newline at end of file
+}
+extension SymbolCache {
+    /// Cache of the tests in the temporary directory, tests must not store symbols in the cache of the user.
+    static let temporary = SymbolCache(directory: FileManager.default.temporaryDirectory.appendingPathComponent("memtool-tests-symbols"))
+}
@@ -10,6 +10,9 @@ int main(void) {
 """#
 
 final class AssurancesTests: XCTestCase {
+    override func setUp() {
+        Symbolication.cache = .temporary
+    }
 
     func testGlibcSymbols() throws {
         let program = try AdhocProgram(
@@ -27,11 +30,11 @@ final class AssurancesTests: XCTestCase {
         XCTAssertNotNil(session.unloadedSymbols)
         XCTAssertNotNil(session.symbols)
 
-        XCTAssertFalse(GlibcAssurances.glibcOccurances(of: .mainArena, in: session.unloadedSymbols!).isEmpty)
-        XCTAssertFalse(GlibcAssurances.glibcOccurances(of: .tCache, in: session.unloadedSymbols!).isEmpty)
-        XCTAssertFalse(GlibcAssurances.glibcOccurances(of: .threadArena, in: session.unloadedSymbols!).isEmpty)
-        XCTAssertFalse(GlibcAssurances.glibcOccurances(of: .rDebug, in: session.unloadedSymbols!).isEmpty)
-        XCTAssertFalse(GlibcAssurances.glibcOccurances(of: .errno, in: session.unloadedSymbols!).isEmpty)
+        XCTAssertFalse(GlibcAssurances.glibcOccurances(of: .mainArena, in: session.symbolIndex!).isEmpty)
+        XCTAssertFalse(GlibcAssurances.glibcOccurances(of: .tCache, in: session.symbolIndex!).isEmpty)
+        XCTAssertFalse(GlibcAssurances.glibcOccurances(of: .threadArena, in: session.symbolIndex!).isEmpty)
+        XCTAssertFalse(GlibcAssurances.glibcOccurances(of: .rDebug, in: session.symbolIndex!).isEmpty)
+        XCTAssertFalse(GlibcAssurances.glibcOccurances(of: .errno, in: session.symbolIndex!).isEmpty)
     }
 
     // Uncomment this test - the expected result is crash on `fatalError` in file `RemoteMemory.swift`
@@ -0,0 +1,84 @@
+import XCTest
+@testable import MemtoolCore
+
+final class ChunkTableTests: XCTestCase {
+    func testLookupsAndMerge() {
+        let main = ChunkTable.Owner(threadHeapBase: nil)
+        let thread = ChunkTable.Owner(threadHeapBase: 0x7000_0000)
+
+        var threadTable = ChunkTable()
+        threadTable.append(base: 0x7000_1000, size: 0x20, state: .heapActive, owner: thread)
+        threadTable.append(base: 0x7000_1020, size: 0x30, state: .heapTCache, owner: ChunkTable.Owner(threadHeapBase: 0x7000_0000, tcacheThread: 42))
+
+        var table = ChunkTable()
+        table.append(base: 0x1000, size: 0x20, state: .heapActive, owner: main)
+        table.append(base: 0x1020, size: 0x40, state: .heapFastBin, owner: main)
+        table.setState(.heapBin, at: 1)
+        XCTAssertTrue(table.isSorted)
+
+        // Appending a heap with lower addresses breaks the order
+        var merged = threadTable
+        merged.append(contentsOf: table)
+        XCTAssertFalse(merged.isSorted)
+        XCTAssertEqual(merged.index(containing: 0x1030), 3)
+        merged.sort()
+        XCTAssertTrue(merged.isSorted)
+
+        XCTAssertEqual(merged.map(\.base), [0x1000, 0x1020, 0x7000_1000, 0x7000_1020])
+        XCTAssertEqual(merged.map(\.state), [.heapActive, .heapBin, .heapActive, .heapTCache])
+        XCTAssertNil(merged.index(containing: 0x0fff))
+        XCTAssertEqual(merged.index(containing: 0x105f), 1)
+        XCTAssertNil(merged.index(containing: 0x1060))
+        XCTAssertEqual(merged.index(containing: 0x7000_1020), 3)
+        XCTAssertEqual(merged.indices(overlapping: 0x1010..<0x7000_1001), 0..<3)
+        XCTAssertEqual(merged.indices(overlapping: 0x2000..<0x3000), 2..<2)
+
+        // Owners are shared and expand to the origin of `GlibcMallocInfo`
+        XCTAssertTrue(merged[3].owner.contains(.tlsTCacge(pthreadId: 42)))
+        XCTAssertTrue(merged[3].owner.contains(.threadHeap(base: 0x7000_0000)))
+        XCTAssertFalse(merged[3].owner.contains(.mainHeap))
+        XCTAssertEqual(merged[3].region.properties.origin, [.threadHeap(base: 0x7000_0000), .tlsTCacge(pthreadId: 42)])
+        XCTAssertEqual(merged[0].region.properties.rebound, .mallocChunk(.heapActive))
+        XCTAssertEqual(merged.filter { $0.owner.contains(.mainHeap) }.count, 2)
+    }
+
+    func testDiff() {
+        let main = ChunkTable.Owner(threadHeapBase: nil)
+
+        var old = ChunkTable()
+        old.append(base: 0x1000, size: 0x20, state: .heapActive, owner: main)
+        old.append(base: 0x1020, size: 0x20, state: .heapActive, owner: main)
+        old.append(base: 0x1040, size: 0x40, state: .heapBin, owner: main)
+        old.append(base: 0x1080, size: 0x20, state: .heapActive, owner: main)
+
+        // 0x1020 freed, 0x1040 split and allocated, 0x1080 resized
+        var new = ChunkTable()
+        new.append(base: 0x1000, size: 0x20, state: .heapActive, owner: main)
+        new.append(base: 0x1020, size: 0x20, state: .heapTCache, owner: main)
+        new.append(base: 0x1040, size: 0x20, state: .heapActive, owner: main)
+        new.append(base: 0x1060, size: 0x20, state: .heapNoBinFree, owner: main)
+        new.append(base: 0x1080, size: 0x40, state: .heapActive, owner: main)
+        new.append(base: 0x10c0, size: 0x20, state: .heapActive, owner: main)
+
+        let diff = GlibcMallocDiff(from: old, to: new)
+        XCTAssertEqual(diff.allocated.map(\.base), [0x1040, 0x10c0])
+        XCTAssertEqual(diff.freed.map(\.base), [0x1020])
+        XCTAssertEqual(diff.resized.map(\.old.size), [0x20])
+        XCTAssertEqual(diff.resized.map(\.new.size), [0x40])
+
+        XCTAssertTrue(GlibcMallocDiff(from: new, to: new).isEmpty)
+        XCTAssertEqual(GlibcMallocDiff(from: new, to: ChunkTable()).freed.count, 4)
+    }
+
+    func testManyOwners() {
+        // Every thread with chunks in its tcache adds an owner
+        var table = ChunkTable()
+        for thread in 0..<70_000 {
+            table.append(base: 0x1000 + UInt(thread) * 0x20, size: 0x20, state: .heapTCache, owner: ChunkTable.Owner(threadHeapBase: nil, tcacheThread: Int32(thread)))
+        }
+
+        XCTAssertEqual(table.count, 70_000)
+        XCTAssertEqual(table[69_999].owner.tcacheThread, 69_999)
+        XCTAssertEqual(table.indices { $0.tcacheThread.map { $0 >= 69_998 } ?? false }, [69_998, 69_999])
+    }
+}
@@ -0,0 +1,257 @@
+import XCTest
+import Cutils
+import Glibc
+@testable import MemtoolCore
+
+/// Builds a minimal x86_64 core file: two threads, process info, mapped files and two `PT_LOAD`
+/// segments, where only the writable one has content.
+private struct CoreBuilder {
+    static let dataBase: UInt64 = 0x7f00_0000_1000
+    static let codeBase: UInt64 = 0x7f00_0000_0000
+    static let pageSize: UInt64 = 0x1000
+    static let library = "/usr/lib/x86_64-linux-gnu/libc.so.6"
+
+    var bytes: [UInt8] = []
+
+    mutating func append<T: FixedWidthInteger>(_ value: T) {
+        withUnsafeBytes(of: value.littleEndian) { bytes.append(contentsOf: $0) }
+    }
+
+    mutating func pad(to alignment: Int) {
+        bytes.append(contentsOf: repeatElement(0, count: (alignment - bytes.count % alignment) % alignment))
+    }
+
+    static func note(type: UInt32, descriptor: [UInt8]) -> [UInt8] {
+        var builder = CoreBuilder()
+        builder.append(UInt32(5))
+        builder.append(UInt32(descriptor.count))
+        builder.append(type)
+        builder.bytes.append(contentsOf: "CORE\0".utf8)
+        builder.pad(to: 4)
+        builder.bytes.append(contentsOf: descriptor)
+        builder.pad(to: 4)
+        return builder.bytes
+    }
+
+    static func prstatus(tid: Int32, fsBase: UInt64) -> [UInt8] {
+        var descriptor = [UInt8](repeating: 0, count: 336)
+        withUnsafeBytes(of: tid.littleEndian) { descriptor.replaceSubrange(32..<36, with: $0) }
+        let registerOffset = 112 + Int(FS_BASE) * 8
+        withUnsafeBytes(of: fsBase.littleEndian) { descriptor.replaceSubrange(registerOffset..<(registerOffset + 8), with: $0) }
+        return note(type: UInt32(NT_PRSTATUS), descriptor: descriptor)
+    }
+
+    static func prpsinfo(pid: Int32) -> [UInt8] {
+        var descriptor = [UInt8](repeating: 0, count: 136)
+        withUnsafeBytes(of: pid.littleEndian) { descriptor.replaceSubrange(24..<28, with: $0) }
+        return note(type: UInt32(NT_PRPSINFO), descriptor: descriptor)
+    }
+
+    static func files() -> [UInt8] {
+        var descriptor = CoreBuilder()
+        descriptor.append(UInt64(2))
+        descriptor.append(pageSize)
+        for (base, pageOffset) in [(codeBase, UInt64(0)), (dataBase, UInt64(2))] {
+            descriptor.append(base)
+            descriptor.append(base + pageSize)
+            descriptor.append(pageOffset)
+        }
+        descriptor.bytes.append(contentsOf: (library + "\0" + library + "\0").utf8)
+        return note(type: 0x4649_4c45, descriptor: descriptor.bytes)
+    }
+
+    static func core(pattern: UInt64) -> [UInt8] {
+        // The thread, that received the signal, is stored before the main thread
+        let notes = prstatus(tid: 101, fsBase: 0xbbbb) + prpsinfo(pid: 100) + prstatus(tid: 100, fsBase: 0xaaaa) + files()
+        let headersSize = 64 + 3 * 56
+        let notesOffset = UInt64(headersSize)
+        let dataOffset = (notesOffset + UInt64(notes.count) + pageSize - 1) & ~(pageSize - 1)
+
+        var builder = CoreBuilder()
+        builder.bytes.append(contentsOf: [0x7f, UInt8(ascii: "E"), UInt8(ascii: "L"), UInt8(ascii: "F"), 2, 1, 1])
+        builder.pad(to: 16)
+        builder.append(UInt16(ET_CORE))
+        builder.append(UInt16(62))
+        builder.append(UInt32(1))
+        builder.append(UInt64(0))
+        builder.append(UInt64(64))
+        builder.append(UInt64(0))
+        builder.append(UInt32(0))
+        builder.append(UInt16(64))
+        builder.append(UInt16(56))
+        builder.append(UInt16(3))
+        builder.append(UInt16(0))
+        builder.append(UInt16(0))
+        builder.append(UInt16(0))
+
+        let segments: [(type: Int32, flags: Int32, offset: UInt64, base: UInt64, fileSize: UInt64)] = [
+            (PT_NOTE, 0, notesOffset, 0, UInt64(notes.count)),
+            (PT_LOAD, PF_R | PF_X, dataOffset, codeBase, 0),
+            (PT_LOAD, PF_R | PF_W, dataOffset, dataBase, pageSize),
+        ]
+        for segment in segments {
+            builder.append(UInt32(segment.type))
+            builder.append(UInt32(segment.flags))
+            builder.append(segment.offset)
+            builder.append(segment.base)
+            builder.append(UInt64(0))
+            builder.append(segment.fileSize)
+            builder.append(segment.type == PT_NOTE ? segment.fileSize : pageSize)
+            builder.append(segment.type == PT_NOTE ? UInt64(0) : pageSize)
+        }
+
+        builder.bytes.append(contentsOf: notes)
+        builder.pad(to: Int(pageSize))
+        for _ in 0..<(pageSize / 8) {
+            builder.append(pattern)
+        }
+        return builder.bytes
+    }
+}
+
+final class CoreFileTests: XCTestCase {
+    override func setUp() {
+        Symbolication.cache = .temporary
+    }
+
+    func testMapThreadsAndLoads() throws {
+        let pattern: UInt64 = 0x0123_4567_89ab_cdef
+        let url = FileManager.default.temporaryDirectory.appendingPathComponent(String(describing: Self.self) + #function)
+        defer { try? FileManager.default.removeItem(at: url) }
+        try Data(CoreBuilder.core(pattern: pattern)).write(to: url)
+
+        let core = try CoreFile(path: url.path)
+        XCTAssertEqual(core.pid, 100)
+        XCTAssertEqual(core.threads.map(\.tid), [100, 101])
+        XCTAssertEqual(core.threads.map(\.fsBase), [0xaaaa, 0xbbbb])
+        XCTAssertEqual(core.threads.first?.registers?.fs_base, 0xaaaa)
+
+        XCTAssertEqual(core.map.map(\.range), [
+            UInt(CoreBuilder.codeBase)..<UInt(CoreBuilder.codeBase + CoreBuilder.pageSize),
+            UInt(CoreBuilder.dataBase)..<UInt(CoreBuilder.dataBase + CoreBuilder.pageSize),
+        ])
+        XCTAssertEqual(core.map[0].properties.pathname, .file(CoreBuilder.library))
+        XCTAssertTrue(core.map[0].properties.flags.contains(.execute))
+        XCTAssertEqual(core.map[1].properties.offset, UInt(2 * CoreBuilder.pageSize))
+        XCTAssertTrue(core.map[1].properties.flags.contains(.write))
+
+        let base = UInt(CoreBuilder.dataBase) + 0x10
+        XCTAssertEqual(try core.load(of: UInt64.self, base: base).buffer, pattern)
+        XCTAssertThrowsError(try core.load(of: UInt64.self, base: UInt(CoreBuilder.codeBase)))
+        XCTAssertThrowsError(try core.load(UInt(CoreBuilder.dataBase + CoreBuilder.pageSize - 4)..<UInt(CoreBuilder.dataBase + CoreBuilder.pageSize + 4)))
+
+        let session = OfflineSession(core: core)
+        XCTAssertEqual(session.fsBase, 0xaaaa)
+        XCTAssertEqual(session.threads.map(\.ptraceId), [101])
+        XCTAssertEqual(session.threads.map(\.fsBase), [0xbbbb])
+        XCTAssertEqual(session.executableFileBasePoints, [CoreBuilder.library: UInt(CoreBuilder.codeBase)])
+        XCTAssertEqual(try session.checkedLoad(of: UInt64.self, base: base).buffer, pattern)
+    }
+
+    func testAnalyzesCoreOfProgram() throws {
+        let directory = FileManager.default.temporaryDirectory.appendingPathComponent("\(Self.self)-\(getpid())-cores")
+        try? FileManager.default.removeItem(at: directory)
+        try FileManager.default.createDirectory(at: directory, withIntermediateDirectories: true)
+        defer { try? FileManager.default.removeItem(at: directory) }
+
+        let program = try AdhocProgram(
+            name: String(describing: Self.self) + #function,
+            code: """
+            #include <stdio.h>
+            #include <stdlib.h>
+            #include <unistd.h>
+            #include <sys/resource.h>
+
+            int main(void) {
+                struct rlimit limit = { RLIM_INFINITY, RLIM_INFINITY };
+                if (setrlimit(RLIMIT_CORE, &limit) != 0 || chdir("\(directory.path)") != 0) {
+                    printf(";");
+                    return 1;
+                }
+
+                void * active = malloc(0x40);
+                void * freed = malloc(0x100);
+                void * volatile last = malloc(0x40);
+                free(freed);
+                printf("%lx %lx ;", (unsigned long)active, (unsigned long)freed);
+                fflush(stdout);
+                abort();
+            }
+            """
+        )
+        let pointers = program.readStdout(until: ";").components(separatedBy: " ").dropLast().compactMap { UInt($0, radix: 16) }
+        program.runningProgram.waitUntilExit()
+        guard
+            pointers.count == 2,
+            let name = try FileManager.default.contentsOfDirectory(atPath: directory.path).first(where: { $0.hasPrefix("core") })
+        else {
+            throw XCTSkip("Core files are not written into the working directory, see kernel.core_pattern")
+        }
+
+        let core = try CoreFile(path: directory.appendingPathComponent(name).path)
+        XCTAssertEqual(core.pid, program.runningProgram.processIdentifier)
+        XCTAssertTrue(core.map.contains { $0.properties.pathname == .pseudopath(.stack) })
+        // Without ASLR the heap adjoins the `.bss` and is not named
+        if (try? String(contentsOfFile: "/proc/sys/kernel/randomize_va_space"))?.hasPrefix("2") == true {
+            let heap = core.map.first { $0.properties.pathname == .pseudopath(.heap) }
+            XCTAssertTrue(heap?.range.contains(pointers[0]) == true)
+        }
+
+        let session = OfflineSession(core: core)
+        session.loadSymbols()
+        let analyzer = try GlibcMallocAnalyzer(session: session)
+        try analyzer.analyze()
+
+        let chunks = analyzer.chunks
+        let active = try XCTUnwrap(chunks.index(containing: pointers[0]))
+        XCTAssertEqual(chunks[active].state, .heapActive)
+        let freed = try XCTUnwrap(chunks.index(containing: pointers[1]))
+        XCTAssertFalse(chunks[freed].state.isActive)
+    }
+
+    func testRejectsOverflowingSizes() throws {
+        func assertMalformedProgramHeaders(_ bytes: [UInt8], line: UInt = #line) {
+            XCTAssertThrowsError(try bytes.withUnsafeBytes { try CoreFile.parse($0) }, line: line) { error in
+                guard case CoreFile.Error.malformedProgramHeaders = error else {
+                    return XCTFail("Unexpected error \(error)", line: line)
+                }
+            }
+        }
+
+        // `p_memsz` of the writable segment, its end would overflow
+        var bytes = CoreBuilder.core(pattern: 0)
+        let memorySizeOffset = 64 + 2 * 56 + 40
+        bytes.replaceSubrange(memorySizeOffset..<(memorySizeOffset + 8), with: repeatElement(0xff, count: 8))
+        assertMalformedProgramHeaders(bytes)
+
+        // `e_phoff` beyond `Int.max`
+        bytes = CoreBuilder.core(pattern: 0)
+        bytes.replaceSubrange(32..<40, with: repeatElement(0xff, count: 8))
+        assertMalformedProgramHeaders(bytes)
+
+        // `NT_FILE` with a count, whose triples would overflow the size
+        var descriptor = CoreBuilder()
+        descriptor.append(UInt64.max / 8)
+        descriptor.append(CoreBuilder.pageSize)
+        XCTAssertThrowsError(try descriptor.bytes.withUnsafeBytes { try CoreFile.parseFiles($0) }) { error in
+            guard case CoreFile.Error.malformedNotes = error else {
+                return XCTFail("Unexpected error \(error)")
+            }
+        }
+    }
+
+    func testRejectsFilesOtherThanCore() throws {
+        let url = FileManager.default.temporaryDirectory.appendingPathComponent(String(describing: Self.self) + #function)
+        defer { try? FileManager.default.removeItem(at: url) }
+        var bytes = CoreBuilder.core(pattern: 0)
+        // ET_EXEC
+        bytes[16] = 2
+        try Data(bytes).write(to: url)
+
+        XCTAssertThrowsError(try CoreFile(path: url.path)) { error in
+            guard case CoreFile.Error.notCore = error else {
+                return XCTFail("Unexpected error \(error)")
+            }
+        }
+    }
+}
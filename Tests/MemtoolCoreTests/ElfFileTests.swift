@@ -0,0 +1,62 @@
+import XCTest
+@testable import MemtoolCore
+
+private let programWithSymbols =
+#"""
+#include <stdio.h>
+
+int initializedGlobal = 5;
+static int uninitializedLocal;
+__thread int threadLocal;
+
+int main(void) {
+    uninitializedLocal = threadLocal + initializedGlobal;
+    printf("%d ;", uninitializedLocal);
+    fflush( stdout );
+
+    while(1) {}
+    return 0;
+}
+"""#
+
+final class ElfFileTests: XCTestCase {
+    override func setUp() {
+        Symbolication.cache = .temporary
+    }
+
+    func testSymbolTable() throws {
+        let program = try AdhocProgram(
+            name: String(describing: Self.self) + #function,
+            code: programWithSymbols
+        )
+        _ = program.readStdout(until: ";")
+
+        let file = program.programPath.path
+        let elf = try ElfFile(path: file)
+        XCTAssertNotNil(elf.section(named: ".text"))
+
+        let symbols = Symbolication.loadSymbols(for: file)
+        XCTAssertTrue(symbols.allSatisfy { $0.file == file })
+
+        let global = try XCTUnwrap(symbols.first { $0.name == "initializedGlobal" })
+        XCTAssertEqual(global.segment, .known(.data))
+        XCTAssertEqual(global.size, 4)
+        XCTAssertEqual(global.flags.rawValue, "g     O")
+
+        let local = try XCTUnwrap(symbols.first { $0.name == "uninitializedLocal" })
+        XCTAssertEqual(local.segment, .known(.bss))
+        XCTAssertEqual(local.flags.scopeFlag, .local)
+
+        let tls = try XCTUnwrap(symbols.first { $0.name == "threadLocal" })
+        XCTAssertEqual(tls.segment, .known(.tbss))
+        XCTAssertEqual(tls.flags.typeFlag, .normal)
+
+        let main = try XCTUnwrap(symbols.first { $0.name == "main" })
+        XCTAssertEqual(main.segment, .known(.text))
+        XCTAssertEqual(main.flags.typeFlag, .function)
+
+        // Lookup of a single symbol decodes the same record
+        XCTAssertEqual(Symbolication.loadSymbol(named: "initializedGlobal", for: file), global)
+        XCTAssertNil(Symbolication.loadSymbol(named: "doesNotExist", for: file))
+    }
+}
@@ -0,0 +1,117 @@
+import XCTest
+@testable import MemtoolCore
+
+final class FleetAnalysisTests: XCTestCase {
+    override func setUp() {
+        Symbolication.cache = .temporary
+    }
+
+    func testSizeClasses() {
+        XCTAssertEqual(FleetAnalysis.sizeClass(of: 0), 32)
+        XCTAssertEqual(FleetAnalysis.sizeClass(of: 32), 32)
+        XCTAssertEqual(FleetAnalysis.sizeClass(of: 48), 64)
+        XCTAssertEqual(FleetAnalysis.sizeClass(of: 64), 64)
+        XCTAssertEqual(FleetAnalysis.sizeClass(of: 0x1010), 0x2000)
+    }
+
+    func testSummaryAndAggregate() {
+        var first = ChunkTable()
+        first.append(base: 0x1000, size: 0x20, state: .heapActive, owner: ChunkTable.Owner(threadHeapBase: nil))
+        first.append(base: 0x1020, size: 0x30, state: .heapTCache, owner: ChunkTable.Owner(threadHeapBase: nil, tcacheThread: 7))
+        first.append(base: 0x7000_0010, size: 0x40, state: .heapActive, owner: ChunkTable.Owner(threadHeapBase: 0x7000_0000))
+        first.append(base: 0x6000_0010, size: 0x50, state: .heapBin, owner: ChunkTable.Owner(threadHeapBase: 0x6000_0000))
+        first.append(base: 0x9000_0000, size: 0x2000, state: .mmapped, owner: ChunkTable.Owner(threadHeapBase: nil))
+
+        var second = ChunkTable()
+        second.append(base: 0x2000, size: 0x20, state: .heapActive, owner: ChunkTable.Owner(threadHeapBase: nil))
+        second.append(base: 0x8000_0010, size: 0x40, state: .heapActive, owner: ChunkTable.Owner(threadHeapBase: 0x8000_0000))
+
+        let process = FleetAnalysis.summarize(pid: 1, chunks: first)
+        XCTAssertEqual(process.usage.activeChunks, 3)
+        XCTAssertEqual(process.usage.activeBytes, 0x2060)
+        XCTAssertEqual(process.usage.freeBytes, 0x80)
+        XCTAssertEqual(process.sizeClasses[64]?.activeBytes, 0x40)
+        XCTAssertEqual(process.sizeClasses[64]?.freeBytes, 0x30)
+        // Thread arenas are numbered by the base of their heap
+        XCTAssertEqual(process.arenaBases[.thread(index: 0)], 0x6000_0000)
+        XCTAssertEqual(process.arenas[.thread(index: 1)]?.activeBytes, 0x40)
+        XCTAssertEqual(process.arenas[.main]?.freeChunks, 1)
+        XCTAssertEqual(process.arenas[.mmapped]?.activeBytes, 0x2000)
+
+        var failed = FleetAnalysis.ProcessResult(pid: 3)
+        failed.error = GlibcMallocAnalyzer.Error.mainArenaDebugSymbolNotFound
+
+        let aggregate = FleetAnalysis.aggregate([process, FleetAnalysis.summarize(pid: 2, chunks: second), failed])
+        XCTAssertEqual(aggregate.processCount, 3)
+        XCTAssertEqual(aggregate.failedCount, 1)
+        XCTAssertEqual(aggregate.usage.activeChunks, 5)
+        XCTAssertEqual(aggregate.sizeClasses[32]?.activeBytes, 0x40)
+        XCTAssertEqual(aggregate.arenas[.main]?.activeBytes, 0x40)
+        // Thread arenas of different processes are summed in a single bucket
+        XCTAssertNil(aggregate.arenas[.thread(index: 0)])
+        XCTAssertEqual(aggregate.arenas[.threads]?.activeBytes, 0x80)
+        XCTAssertEqual(aggregate.arenas[.threads]?.freeBytes, 0x50)
+    }
+
+    func testSharedSymbolStoreDecodesFileOnce() throws {
+        let program = try AdhocProgram(
+            name: String(describing: Self.self) + #function,
+            code: "int answer = 42; int main(void) { return answer; }"
+        )
+        let path = program.programPath.path
+        let link = FileManager.default.temporaryDirectory.appendingPathComponent("\(Self.self)-\(getpid())-link").path
+        try? FileManager.default.removeItem(atPath: link)
+        try FileManager.default.createSymbolicLink(atPath: link, withDestinationPath: path)
+        defer { try? FileManager.default.removeItem(atPath: link) }
+
+        let store = SharedSymbolStore()
+        var loaded = [[UnloadedSymbolInfo]](repeating: [], count: 8)
+        loaded.withUnsafeMutableBufferPointer { storage in
+            let loaded = storage
+            DispatchQueue.concurrentPerform(iterations: loaded.count) { index in
+                loaded[index] = store.symbols(for: path)
+            }
+        }
+
+        XCTAssertEqual(store.fileCount, 1)
+        XCTAssertTrue(loaded[0].contains { $0.name == "answer" })
+        XCTAssertTrue(loaded.allSatisfy { $0 == loaded[0] })
+
+        // Another path of the same file shares the entry
+        let linked = store.symbols(for: link)
+        XCTAssertEqual(store.fileCount, 1)
+        XCTAssertEqual(linked.count, loaded[0].count)
+        XCTAssertTrue(linked.allSatisfy { $0.file == link })
+    }
+
+    func testProcessesAreDetachedAfterAnalysis() throws {
+        let program = try AdhocProgram(
+            name: String(describing: Self.self) + #function,
+            code: #"""
+            #include <stdlib.h>
+            #include <stdio.h>
+
+            int main(void) {
+                void * volatile chunk = malloc(64);
+                printf(";");
+                fflush(stdout);
+                while(1) {}
+                return 0;
+            }
+            """#
+        )
+        _ = program.readStdout(until: ";")
+        let pid = program.runningProgram.processIdentifier
+
+        // No process has the PID above `pid_max`
+        let report = FleetAnalysis().analyze(pids: [pid, Int32.max], workerCount: 2)
+        XCTAssertNil(report.processes[0].error)
+        XCTAssertGreaterThan(report.processes[0].usage.activeChunks, 0)
+        guard case FleetAnalysis.Error.couldNotAttach? = report.processes[1].error else {
+            return XCTFail("Unexpected result \(String(describing: report.processes[1].error))")
+        }
+
+        let status = try String(contentsOfFile: "/proc/\(pid)/status")
+        XCTAssertTrue(status.contains("TracerPid:\t0\n"))
+    }
+}
@@ -0,0 +1,49 @@
+import XCTest
+@testable import MemtoolCore
+
+final class GlibcMallocStatisticsTests: XCTestCase {
+    func testSizeClasses() {
+        XCTAssertEqual(GlibcMallocStatistics.binIndex(of: 0x20), 2)
+        XCTAssertEqual(GlibcMallocStatistics.binIndex(of: 0x3f0), 63)
+        XCTAssertEqual(GlibcMallocStatistics.binIndex(of: 0x400), 64)
+        XCTAssertEqual(GlibcMallocStatistics.binIndex(of: 0xc00), 96)
+        XCTAssertEqual(GlibcMallocStatistics.binIndex(of: 0x10_0000), 126)
+
+        XCTAssertEqual(GlibcMallocStatistics.powerOfTwoClass(of: 0x20), 0x20)
+        XCTAssertEqual(GlibcMallocStatistics.powerOfTwoClass(of: 0x30), 0x40)
+    }
+
+    func testFreeExtentsAndTopChunk() {
+        let main = ChunkTable.Owner(threadHeapBase: nil)
+        let thread = ChunkTable.Owner(threadHeapBase: 0x7000_0000)
+        var statistics = GlibcMallocStatistics(topChunks: [0x1100])
+
+        statistics.add(ChunkTable.Entry(base: 0x1000, size: 0x20, state: .heapBin, owner: main))
+        statistics.add(ChunkTable.Entry(base: 0x1020, size: 0x20, state: .heapNoBinFree, owner: main))
+        statistics.add(ChunkTable.Entry(base: 0x1040, size: 0x40, state: .heapActive, owner: main))
+        statistics.add(ChunkTable.Entry(base: 0x1080, size: 0x30, state: .heapFastBin, owner: main))
+        statistics.add(ChunkTable.Entry(base: 0x1100, size: 0x1000, state: .heapActive, owner: main))
+
+        var walk = GlibcMallocStatistics(topChunks: [0x1100])
+        var tcacheOwner = thread
+        tcacheOwner.tcacheThread = 42
+        walk.add(ChunkTable.Entry(base: 0x7000_0100, size: 0x20, state: .heapTCache, owner: tcacheOwner))
+        walk.add(ChunkTable.Entry(base: 0x7000_0120, size: 0x20, state: .heapActive, owner: thread))
+        statistics.merge(walk)
+        statistics.sort()
+
+        XCTAssertEqual(statistics.arenas.map(\.threadHeapBase), [nil, 0x7000_0000])
+        let arena = statistics.arenas[0]
+        XCTAssertEqual(arena.active.count, 1)
+        XCTAssertEqual(arena.free.bytes, 0x70)
+        // Adjacent free chunks form a single extent, the top chunk is not counted
+        XCTAssertEqual(arena.largestFreeExtent, 0x40)
+        XCTAssertEqual(arena.fragmentation, 1 - 0x40 / 0x70, accuracy: 1e-9)
+        XCTAssertEqual(arena.binClasses[2]?.free.count, 2)
+        XCTAssertEqual(arena.powerOfTwoClasses[0x40]?.active.bytes, 0x40)
+
+        XCTAssertEqual(statistics.tcacheChunks[42]?.bytes, 0x20)
+        XCTAssertEqual(statistics.active.count, 2)
+        XCTAssertEqual(statistics.free.count, 4)
+    }
+}
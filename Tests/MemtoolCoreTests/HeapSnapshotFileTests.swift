@@ -0,0 +1,48 @@
+import XCTest
+@testable import MemtoolCore
+
+final class HeapSnapshotFileTests: XCTestCase {
+    /// Header of the current version with the counts of the sections, the metadata follows it.
+    private func header(counts: [UInt64], stringsSize: UInt64 = 0, metadataOffset: UInt64 = 80) -> [UInt8] {
+        var bytes: [UInt8] = []
+        for field in [UInt32(0x5348_544d), 3, 1, 0] {
+            withUnsafeBytes(of: field) { bytes.append(contentsOf: $0) }
+        }
+        for field in counts + [stringsSize, metadataOffset] {
+            withUnsafeBytes(of: field) { bytes.append(contentsOf: $0) }
+        }
+        return bytes
+    }
+
+    private func openFile(_ bytes: [UInt8], function: String = #function) throws -> HeapSnapshotFile {
+        let url = FileManager.default.temporaryDirectory.appendingPathComponent(String(describing: Self.self) + function)
+        defer { try? FileManager.default.removeItem(at: url) }
+        try Data(bytes).write(to: url)
+        return try HeapSnapshotFile(contentsOf: url)
+    }
+
+    func testMalformedFilesThrow() throws {
+        func assertMalformed(_ bytes: [UInt8], line: UInt = #line) {
+            XCTAssertThrowsError(try openFile(bytes), line: line) { thrown in
+                guard case HeapSnapshotFile.Error.malformedFile = thrown else {
+                    return XCTFail("Unexpected error \(thrown)", line: line)
+                }
+            }
+        }
+
+        let empty = header(counts: [0, 0, 0, 0, 0, 0])
+        XCTAssertEqual(try openFile(empty).map.count, 0)
+
+        // Truncated header
+        assertMalformed(Array(empty.prefix(20)))
+        // Counts, whose sections would overflow the offsets
+        assertMalformed(header(counts: [UInt64.max / 2, 0, 0, 0, 0, 0]))
+        assertMalformed(header(counts: [0, 0, 0, 0, 0, UInt64(Int.max / 8)]))
+        assertMalformed(header(counts: [0, 0, 0, 0, 0, 0], stringsSize: UInt64.max))
+        // Metadata inside the header or past the end of the file
+        assertMalformed(header(counts: [0, 0, 0, 0, 0, 0], metadataOffset: 8))
+        assertMalformed(header(counts: [0, 0, 0, 0, 0, 0], metadataOffset: UInt64.max))
+        // Sections longer than the file
+        assertMalformed(header(counts: [1, 0, 0, 0, 0, 0]))
+    }
+}
@@ -104,7 +104,46 @@ private let mallocManyFrees = commons +
 
 """# + freesMain
 
+/// Allocates page-sized chunks, then frees one of the last of them and allocates another chunk
+/// from the top, once a line is written to the input. The output is unbuffered and the top is
+/// padded, so the heap is neither written at its start nor grown by the change.
+private let mutatedHeap =
+#"""
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define COUNT 64
+#define FREED 60
+
+int main(void) {
+    setvbuf(stdout, NULL, _IONBF, 0);
+    mallopt(M_TOP_PAD, 1 << 20);
+
+    void * chunks[COUNT];
+    for (int i = 0; i < COUNT; i++) {
+        chunks[i] = malloc(0x1000);
+    }
+    printf("%lx %lx ;", (unsigned long)chunks[0], (unsigned long)chunks[FREED]);
+
+    char line;
+    read(0, &line, 1);
+    free(chunks[FREED]);
+    void * added = malloc(0x2000);
+    printf("%lx ;", (unsigned long)added);
+
+    while (1) {
+        sleep(1);
+    }
+}
+"""#
+
 final class MainHeapTests: XCTestCase {
+    override func setUp() {
+        Symbolication.cache = .temporary
+    }
+
     func testMallocNoFrees() throws {
         let program = try AdhocProgram(
             name: String(describing: Self.self) + #function, 
@@ -254,4 +293,178 @@ final class MainHeapTests: XCTestCase {
         XCTAssertEqual(analyzer.exploredHeap[9].properties.rebound, .mallocChunk(.heapBin))
         XCTAssertEqual(analyzer.exploredHeap[10].properties.rebound, .mallocChunk(.heapActive))
     }
+
+    func testEnumerateChunksStopsEarly() throws {
+        let program = try AdhocProgram(
+            name: String(describing: Self.self) + #function, 
+            code: mallocManySmallFrees
+        )
+
+        sleep(3)
+
+        let session = MemtoolCore.ProcessSession(pid: program.runningProgram.processIdentifier)
+        session.loadMap()
+        session.loadSymbols()
+
+        // Streaming before the analysis reads the heap without storing the chunks
+        let streaming = try GlibcMallocAnalyzer(session: session)
+        var streamed: [ChunkTable.Entry] = []
+        try streaming.enumerateChunks(states: [.heapTCache]) { chunk in
+            streamed.append(chunk)
+            return streamed.count < 3
+        }
+        XCTAssertEqual(streamed.count, 3)
+        XCTAssertTrue(streaming.chunks.isEmpty)
+
+        var otherArena = 0
+        try streaming.enumerateChunks(origin: .threadHeap(base: 0x1000)) { _ in
+            otherArena += 1
+            return true
+        }
+        XCTAssertEqual(otherArena, 0)
+
+        let analyzer = try GlibcMallocAnalyzer(session: session)
+        try analyzer.analyze()
+        XCTAssertEqual(streamed, Array(analyzer.chunks.filter { $0.state == .heapTCache }.prefix(3)))
+
+        // After the analysis, stored chunks are visited
+        var fastBins: [ChunkTable.Entry] = []
+        try analyzer.enumerateChunks(origin: .mainHeap, states: [.heapFastBin]) { chunk in
+            fastBins.append(chunk)
+            return true
+        }
+        XCTAssertEqual(fastBins.map(\.base), [analyzer.chunks[8].base, analyzer.chunks[9].base])
+    }
+
+    func testIncrementalAnalysisOfUnchangedHeap() throws {
+        let program = try AdhocProgram(
+            name: String(describing: Self.self) + #function, 
+            code: mallocManyFrees
+        )
+
+        sleep(3)
+
+        let session = MemtoolCore.ProcessSession(pid: program.runningProgram.processIdentifier)
+        session.loadMap()
+        session.loadSymbols()
+
+        let analyzer = try GlibcMallocAnalyzer(session: session)
+        try analyzer.analyze()
+
+        let snapshot: GlibcMallocSnapshot
+        do {
+            snapshot = try analyzer.snapshot()
+        } catch SoftDirty.Error.clearFailed, SoftDirty.Error.unsupported {
+            throw XCTSkip("Soft-dirty bits are not supported by the kernel")
+        }
+
+        // The process is stopped, nothing is written to the heap
+        let incremental = try GlibcMallocAnalyzer(session: session)
+        let diff = try incremental.analyze(since: snapshot)
+
+        XCTAssertTrue(diff.isEmpty)
+        XCTAssertEqual(Array(incremental.chunks), Array(analyzer.chunks))
+    }
+
+    func testIncrementalAnalysisOfMutatedHeap() throws {
+        let program = try AdhocProgram(
+            name: String(describing: Self.self) + #function,
+            code: mutatedHeap
+        )
+
+        let pointers = program.readStdout(until: ";").components(separatedBy: " ").dropLast().compactMap { UInt($0, radix: 16) }
+        XCTAssertEqual(pointers.count, 2)
+        let freed = pointers[1] - Chunk.chunkContentOffset
+
+        let pid = program.runningProgram.processIdentifier
+        let session = MemtoolCore.ProcessSession(pid: pid)
+        session.loadMap()
+        session.loadSymbols()
+
+        let analyzer = try GlibcMallocAnalyzer(session: session)
+        try analyzer.analyze()
+        XCTAssertEqual(analyzer.chunks.first { $0.base == freed }?.state, .heapActive)
+
+        let snapshot: GlibcMallocSnapshot
+        do {
+            snapshot = try analyzer.snapshot()
+        } catch SoftDirty.Error.clearFailed, SoftDirty.Error.unsupported {
+            throw XCTSkip("Soft-dirty bits are not supported by the kernel")
+        }
+
+        // The process changes the heap while it is detached
+        session.detach()
+        (program.runningProgram.standardInput as? Pipe)?.fileHandleForWriting.write(Data("\n".utf8))
+        let added = try XCTUnwrap(UInt(program.readStdout(until: ";").components(separatedBy: " ")[0], radix: 16)) - Chunk.chunkContentOffset
+
+        let mutated = MemtoolCore.ProcessSession(pid: pid)
+        mutated.loadMap()
+        mutated.loadSymbols()
+
+        let incremental = try GlibcMallocAnalyzer(session: mutated)
+        let diff = try incremental.analyze(since: snapshot)
+
+        XCTAssertEqual(diff.freed.map(\.base), [freed])
+        XCTAssertEqual(diff.allocated.map(\.base), [added])
+        XCTAssertTrue(diff.resized.isEmpty)
+
+        // Chunks ending before the first written page are reused, the rest is walked again
+        let heapArea = try XCTUnwrap(mutated.mapIndex?.region(containing: pointers[0])?.range)
+        let firstDirtyPage = try XCTUnwrap(SoftDirty.firstDirtyPage(pid: pid, in: heapArea))
+        XCTAssertLessThanOrEqual(firstDirtyPage, pointers[1])
+        let clean = incremental.chunks.filter { $0.range.upperBound + Chunk.chunkContentOffset <= firstDirtyPage }
+        XCTAssertGreaterThan(incremental.reusedChunkCount, 0)
+        XCTAssertEqual(incremental.reusedChunkCount, clean.count)
+        XCTAssertLessThan(incremental.reusedChunkCount, incremental.chunks.count)
+
+        // The result is the same as of a full analysis
+        let full = try GlibcMallocAnalyzer(session: mutated)
+        try full.analyze()
+        XCTAssertEqual(full.reusedChunkCount, 0)
+        XCTAssertEqual(Array(incremental.chunks), Array(full.chunks))
+    }
+
+    func testAnalyzerMetricsExcludeConcurrentReads() throws {
+        try XCTSkipUnless(Metrics.isEnabled, "Built without MEMTOOL_METRICS")
+
+        let program = try AdhocProgram(
+            name: String(describing: Self.self) + #function,
+            code: mallocManyFrees
+        )
+
+        sleep(3)
+
+        let pid = program.runningProgram.processIdentifier
+        let session = MemtoolCore.ProcessSession(pid: pid)
+        session.loadMap()
+        session.loadSymbols()
+        let heap = try XCTUnwrap(session.map?.first { $0.properties.pathname == .pseudopath(.heap) }?.range.lowerBound)
+
+        let analyzer = try GlibcMallocAnalyzer(session: session, workerCount: 4)
+        Metrics.reset()
+
+        // Another thread reads the same process during the analysis
+        var otherThread = Metrics()
+        let finished = DispatchSemaphore(value: 0)
+        let reader = Thread {
+            let before = Metrics.currentThread
+            let cache = RemoteMemoryCache(pid: pid, readAheadPages: 1)
+            for _ in 0..<100 {
+                cache.invalidate()
+                _ = try? cache.load(of: UInt64.self, base: heap)
+            }
+            otherThread = Metrics.currentThread - before
+            finished.signal()
+        }
+        reader.start()
+        try analyzer.analyze()
+        finished.wait()
+
+        let total = Metrics.current
+        XCTAssertEqual(otherThread.remoteReads, 100)
+        XCTAssertGreaterThan(analyzer.metrics.remoteReads, 0)
+        XCTAssertNotNil(analyzer.metrics.phases["analyze.traverseHeaps"])
+        XCTAssertEqual(analyzer.metrics.remoteReads + otherThread.remoteReads, total.remoteReads)
+        XCTAssertEqual(analyzer.metrics.remoteBytes + otherThread.remoteBytes, total.remoteBytes)
+    }
 }
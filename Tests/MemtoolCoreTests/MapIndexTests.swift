@@ -0,0 +1,37 @@
+import XCTest
+@testable import MemtoolCore
+
+final class MapIndexTests: XCTestCase {
+    private func region(_ range: MemoryRange, _ flags: String) -> MapRegion {
+        MapRegion(
+            range: range,
+            properties: MapInfo(flags: MapFlags(rawValue: flags), offset: 0, device: (0, 0), inode: 0, pathname: .pseudopath(.mmapped))
+        )
+    }
+
+    func testLookups() {
+        // Unsorted input with a gap between 0x3000 and 0x5000
+        let regions = [
+            region(0x5000..<0x6000, "r--p"),
+            region(0x1000..<0x2000, "r-xp"),
+            region(0x2000..<0x3000, "rw-p"),
+        ]
+        let index = MapIndex(regions: regions)
+
+        XCTAssertNil(index.index(containing: 0x0fff))
+        XCTAssertEqual(index.index(containing: 0x1000), 1)
+        XCTAssertEqual(index.index(containing: 0x2fff), 2)
+        XCTAssertNil(index.index(containing: 0x3000))
+        XCTAssertEqual(index.index(containing: 0x5800), 0)
+        XCTAssertNil(index.index(containing: 0x6000))
+
+        // Range has to be contained in a single region
+        XCTAssertTrue(index.contains(0x2100..<0x2200))
+        XCTAssertFalse(index.contains(0x1f00..<0x2100))
+        XCTAssertFalse(index.contains(0x2f00..<0x5100))
+
+        XCTAssertTrue(index.contains(0x2100, flags: [.read, .write]))
+        XCTAssertFalse(index.contains(0x1100, flags: [.read, .write]))
+        XCTAssertTrue(index.contains(0x5000..<0x5008, flags: .read))
+    }
+}
@@ -0,0 +1,175 @@
+import XCTest
+@testable import MemtoolCore
+
+private let referencesProgram =
+#"""
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+struct node {
+    struct node * next;
+    char data[24];
+};
+
+struct node * root;
+
+struct node * make(struct node * next) {
+    struct node * ptr = malloc(sizeof(struct node));
+    memset(ptr, 0, sizeof(struct node));
+    ptr->next = next;
+    return ptr;
+}
+
+void leak(void) {
+    struct node * d = make(NULL);
+    struct node * c = make(d);
+    printf("%lx %lx ", c, d);
+}
+
+void scrub(void) {
+    volatile char buffer[0x1000];
+    memset((char *)buffer, 0, sizeof(buffer));
+}
+
+int main(void) {
+    struct node * a = make(NULL);
+    struct node * b = make(a);
+    a->next = b;
+    root = a;
+    printf("%lx %lx ", a, b);
+    a = NULL;
+    b = NULL;
+
+    leak();
+    scrub();
+    printf(";");
+    fflush( stdout );
+
+    while(1) {}
+    return 0;
+}
+
+"""#
+
+/// Memory of an image, that records the ranges provided to the scans.
+private final class RecordingReader: MemoryReader {
+    let image: ProcessImage
+    private(set) var scanned: [MemoryRange] = []
+
+    init(image: ProcessImage) {
+        self.image = image
+    }
+
+    func load(_ segment: MemoryRange) throws -> RawRemoteMemory {
+        try image.load(segment)
+    }
+
+    func load<T>(of type: T.Type, base: UInt) throws -> BoundRemoteMemory<T> {
+        try image.load(of: type, base: base)
+    }
+
+    func prefetch(_ range: MemoryRange) -> UInt {
+        image.prefetch(range)
+    }
+
+    func invalidate() {}
+
+    func makeWorkerReader() -> MemoryReader {
+        self
+    }
+
+    func withUnsafeBytes<R>(of segment: MemoryRange, _ body: (UnsafeRawBufferPointer) throws -> R) throws -> R {
+        scanned.append(segment)
+        return try image.withUnsafeBytes(of: segment, body)
+    }
+}
+
+final class MemoryGraphTests: XCTestCase {
+    override func setUp() {
+        Symbolication.cache = .temporary
+    }
+
+    func testReachabilityAndRetainedSize() throws {
+        let program = try AdhocProgram(
+            name: String(describing: Self.self) + #function,
+            code: referencesProgram
+        )
+
+        let output = program.readStdout(until: ";")
+        let pointers = output.components(separatedBy: " ").dropLast().compactMap { UInt($0, radix: 16) }
+        XCTAssertEqual(pointers.count, 4)
+
+        let session = MemtoolCore.ProcessSession(pid: program.runningProgram.processIdentifier)
+        session.loadMap()
+        session.loadSymbols()
+
+        let analyzer = try GlibcMallocAnalyzer(session: session)
+        try analyzer.analyze()
+
+        let graph = try MemoryGraph(session: session, chunks: analyzer.chunks)
+        XCTAssertEqual(graph.nodeCount, analyzer.chunks.filter(\.state.isActive).count)
+
+        let nodes = pointers.compactMap(graph.node(containing:))
+        XCTAssertEqual(nodes.count, 4)
+        let (a, b, c, d) = (nodes[0], nodes[1], nodes[2], nodes[3])
+
+        XCTAssertEqual(Array(graph.references(from: a)), [UInt32(b)])
+        XCTAssertEqual(Array(graph.references(from: b)), [UInt32(a)])
+        XCTAssertEqual(Array(graph.references(from: c)), [UInt32(d)])
+        XCTAssertTrue(graph.roots.contains(UInt32(a)))
+
+        let reachable = graph.reachableFromRoots()
+        XCTAssertTrue(reachable.contains(a))
+        XCTAssertTrue(reachable.contains(b))
+
+        let leaked = graph.unreachableNodes()
+        XCTAssertTrue(leaked.contains(c))
+        XCTAssertTrue(leaked.contains(d))
+
+        XCTAssertEqual(graph.retainedSize(of: a), UInt(graph.range(of: a).count + graph.range(of: b).count))
+        XCTAssertEqual(graph.retainedSize(of: c), UInt(graph.range(of: c).count + graph.range(of: d).count))
+
+        let concurrent = try MemoryGraph(session: session, chunks: analyzer.chunks, workerCount: 4)
+        XCTAssertEqual(concurrent.referenceCount, graph.referenceCount)
+        XCTAssertEqual(concurrent.roots, graph.roots)
+    }
+
+    func testLargeChunksAreScannedInWindows() throws {
+        let windowSize = MemoryGraph.windowSize
+        let large: MemoryRange = 0x10_0000..<(0x10_0000 + 3 * windowSize + 0x100)
+        let small: MemoryRange = 0x1000_0000..<0x1000_0020
+
+        // References to the small chunk in the last piece, a word between the heaps is not a reference
+        var words = [UInt64](repeating: 0, count: large.count / 8)
+        words[words.count - 1] = UInt64(small.lowerBound + 0x10)
+        words[words.count - 2] = 0x800_0000
+        let image = ProcessImage(
+            pid: 1,
+            map: [],
+            threads: [],
+            segments: [
+                (large, ContiguousArray(words.withUnsafeBytes { Array($0) })),
+                (small, ContiguousArray(repeating: 0, count: small.count)),
+            ],
+            pauseDuration: .zero
+        )
+
+        var chunks = ChunkTable()
+        chunks.append(base: large.lowerBound, size: UInt(large.count), state: .mmapped, owner: .init(threadHeapBase: nil))
+        chunks.append(base: small.lowerBound, size: UInt(small.count), state: .heapActive, owner: .init(threadHeapBase: nil))
+        let index = MemoryGraph.NodeIndex(bases: [large.lowerBound, small.lowerBound], sizes: [UInt(large.count), UInt(small.count)], areas: [large, small])
+        XCTAssertEqual(index.areas, [large, small])
+
+        let reader = RecordingReader(image: image)
+        let result = MemoryGraph.scan(MemoryGraph.ScanTask(chunks: 0..<2, firstNode: 0), of: chunks, index: index, memory: reader)
+        XCTAssertEqual(result.counts, [1, 0])
+        XCTAssertEqual(result.targets, [1])
+        XCTAssertEqual(reader.scanned.count, 5)
+        XCTAssertTrue(reader.scanned.allSatisfy { $0.count <= windowSize && $0.lowerBound % 8 == 0 })
+
+        // The largest gaps separate the merged areas
+        let areas = [0x1000..<0x2000, 0x2100..<0x2200, 0x9000..<0xa000] as [MemoryRange]
+        XCTAssertEqual(MemoryGraph.NodeIndex.merge(areas, count: 2), [0x1000..<0x2200, 0x9000..<0xa000])
+    }
+}
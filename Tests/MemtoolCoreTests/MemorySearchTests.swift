@@ -0,0 +1,63 @@
+import XCTest
+@testable import MemtoolCore
+
+final class MemorySearchTests: XCTestCase {
+    private func matches(of pattern: MemorySearch.Pattern, in words: [UInt64]) -> [Int] {
+        var offsets: [Int] = []
+        words.withUnsafeBytes { bytes in
+            pattern.search(bytes) { offset, _ in
+                offsets.append(offset)
+                return true
+            }
+        }
+        return offsets
+    }
+
+    func testValueSearch() {
+        // Matches in the SIMD part and in the remaining words
+        var words = [UInt64](repeating: 0x1111, count: 21)
+        words[3] = 0xdead_beef
+        words[8] = 0xdead_beef
+        words[20] = 0xdead_beef
+
+        XCTAssertEqual(matches(of: .value(0xdead_beef), in: words), [24, 64, 160])
+        XCTAssertEqual(matches(of: .values(0xdead_0000...0xdead_ffff), in: words), [24, 64, 160])
+        XCTAssertEqual(matches(of: .values(0...0x1111), in: words).count, 18)
+        XCTAssertEqual(matches(of: .value(0x2222), in: words), [])
+    }
+
+    func testBytesSearch() {
+        var bytes = [UInt8](repeating: UInt8(ascii: "a"), count: 100)
+        for offset in [0, 31, 40, 97] {
+            bytes.replaceSubrange(offset..<(offset + 3), with: "abc".utf8)
+        }
+
+        var offsets: [Int] = []
+        bytes.withUnsafeBytes { buffer in
+            MemorySearch.Pattern.bytes(Array("abc".utf8)).search(buffer) { offset, value in
+                XCTAssertNil(value)
+                offsets.append(offset)
+                return offsets.count < 3
+            }
+        }
+        XCTAssertEqual(offsets, [0, 31, 40])
+    }
+
+    func testWindowsOverlapPieces() {
+        let size = MemorySearch.windowSize
+        let windows = MemorySearch.windows(searching: [0x1000..<(0x1000 + size + 0x10)], overlap: 3, mergingGap: nil)
+
+        XCTAssertEqual(windows.count, 2)
+        XCTAssertEqual(windows[0].pieces.map(\.owned), [0x1000..<(0x1000 + size)])
+        XCTAssertEqual(windows[0].range, 0x1000..<(0x1000 + size + 3))
+        XCTAssertEqual(windows[1].range, (0x1000 + size)..<(0x1000 + size + 0x10))
+    }
+
+    func testWindowsMergeAdjacentChunks() {
+        let contents: [MemoryRange] = [0x1010..<0x1028, 0x1030..<0x1040, 0x2000..<0x2010]
+        let windows = MemorySearch.windows(searching: contents, overlap: 0, mergingGap: 0x10)
+
+        XCTAssertEqual(windows.map(\.range), [0x1010..<0x1040, 0x2000..<0x2010])
+        XCTAssertEqual(windows[0].pieces.map(\.searched), [0x1010..<0x1028, 0x1030..<0x1040])
+    }
+}
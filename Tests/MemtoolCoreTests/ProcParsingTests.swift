@@ -0,0 +1,47 @@
+import XCTest
+@testable import MemtoolCore
+
+private let sampleMaps = """
+00400000-00452000 r-xp 00000000 08:02 173521      /usr/bin/dbus-daemon
+00e03000-00e24000 rw-p 00000000 00:00 0           [heap]
+35b1c00000-35b1dac000 r-xp 00000000 fd:01 135870  /usr/lib64/libc-2.15.so
+35b1dac000-35b1fac000 ---p 001ac000 fd:01 135870  /usr/lib64/libc-2.15.so
+35b1fb0000-35b1fb2000 rw-s 001b0000 fd:01 135870  /usr/lib64/libc-2.15.so
+7f2c6ff8c000-7f2c7078c000 rw-p 00000000 00:00 0 
+not a map line
+7fffb2d48000-7fffb2d49000 r-xp 00000000 00:00 0   [vdso]
+"""
+
+final class ProcParsingTests: XCTestCase {
+    func testMapParsing() {
+        let regions = Array(sampleMaps.utf8).withUnsafeBytes(Map.parse(maps:))
+
+        XCTAssertEqual(regions.count, 7)
+        XCTAssertEqual(regions[0].range, 0x00400000..<0x00452000)
+        XCTAssertEqual(regions[0].properties.flags, [.read, .execute, .protected])
+        XCTAssertEqual(regions[0].properties.pathname, .file("/usr/bin/dbus-daemon"))
+        XCTAssertEqual(regions[1].properties.pathname, .pseudopath(.heap))
+
+        XCTAssertEqual(regions[2].properties.device.major, 0xfd)
+        XCTAssertEqual(regions[2].properties.device.minor, 0x01)
+        XCTAssertEqual(regions[3].properties.offset, 0x001ac000)
+        XCTAssertEqual(regions[3].properties.flags, [.protected])
+        XCTAssertEqual(regions[4].properties.flags, [.read, .write])
+        XCTAssertEqual(regions[4].properties.inode, 135870)
+        XCTAssertEqual(regions[4].properties.pathname, regions[2].properties.pathname)
+
+        XCTAssertEqual(regions[5].properties.pathname, .pseudopath(.mmapped))
+        XCTAssertEqual(regions[6].properties.pathname, .pseudopath(.vdso))
+    }
+
+    func testOwnMapAndTasks() {
+        let pid = getpid()
+
+        let map = Map.getMap(for: pid)
+        XCTAssertTrue(map.contains { $0.properties.pathname == .pseudopath(.stack) })
+
+        let tasks = ProcFile.directoryEntries("/proc/\(pid)/task")
+        XCTAssertEqual(tasks?.contains(String(pid)), true)
+        XCTAssertEqual(ThreadLoader(pid: pid).threads.contains(pid), false)
+    }
+}
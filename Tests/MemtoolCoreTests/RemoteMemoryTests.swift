@@ -0,0 +1,177 @@
+import XCTest
+@testable import MemtoolCore
+
+private let pageFollowedByHole =
+#"""
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+int main(void) {
+    char * page = mmap(NULL, 0x2000, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    munmap(page + 0x1000, 0x1000);
+    memset(page, 'A', 0x1000);
+
+    printf("%lx ;", (unsigned long)page);
+    fflush( stdout );
+
+    while(1) {}
+    return 0;
+}
+"""#
+
+final class RemoteMemoryTests: XCTestCase {
+    func testBulkAndPartialRead() throws {
+        let program = try AdhocProgram(
+            name: String(describing: Self.self) + #function,
+            code: pageFollowedByHole
+        )
+
+        let output = program.readStdout(until: ";")
+
+        let pointers = output.components(separatedBy: " ").dropLast().compactMap { UInt($0, radix: 16)}
+        XCTAssertEqual(pointers.count, 1)
+        let page = pointers[0]
+
+        let session = MemtoolCore.ProcessSession(pid: program.runningProgram.processIdentifier)
+
+        let whole = try RawRemoteMemory(pid: session.pid, reading: page..<(page + 0x1000))
+        XCTAssertTrue(whole.buffer.allSatisfy { $0 == UInt8(ascii: "A") })
+
+        XCTAssertThrowsError(try RawRemoteMemory(pid: session.pid, reading: (page + 0xff0)..<(page + 0x1010))) { error in
+            guard case let RemoteMemoryError.partialRead(_, bytesRead) = error else {
+                return XCTFail("Unexpected error \(error)")
+            }
+            XCTAssertEqual(bytesRead, 0x10)
+        }
+
+        // Unchecked load keeps the unread bytes zeroed
+        let unchecked = RawRemoteMemory(pid: session.pid, load: (page + 0xff0)..<(page + 0x1010))
+        XCTAssertEqual(Array(unchecked.buffer[0..<0x10]), Array(repeating: UInt8(ascii: "A"), count: 0x10))
+        XCTAssertEqual(Array(unchecked.buffer[0x10..<0x20]), Array(repeating: 0, count: 0x10))
+    }
+
+    func testPageCache() throws {
+        let program = try AdhocProgram(
+            name: String(describing: Self.self) + #function,
+            code: pageFollowedByHole
+        )
+
+        let output = program.readStdout(until: ";")
+
+        let pointers = output.components(separatedBy: " ").dropLast().compactMap { UInt($0, radix: 16)}
+        XCTAssertEqual(pointers.count, 1)
+        let page = pointers[0]
+
+        let session = MemtoolCore.ProcessSession(pid: program.runningProgram.processIdentifier)
+        let cache = session.cache
+
+        // Only the readable page is stored
+        XCTAssertEqual(cache.prefetch(page..<(page + 0x2000)), 0x1000)
+        XCTAssertEqual(cache.pageCount, 0x1000 / Int(RemoteMemoryCache.pageSize))
+
+        let word = try cache.load(of: UInt64.self, base: page + 0x8)
+        XCTAssertEqual(word.buffer, 0x4141414141414141)
+
+        XCTAssertThrowsError(try cache.load((page + 0xff0)..<(page + 0x1010))) { error in
+            guard case let RemoteMemoryError.partialRead(_, bytesRead) = error else {
+                return XCTFail("Unexpected error \(error)")
+            }
+            XCTAssertEqual(bytesRead, 0x10)
+        }
+
+        cache.invalidate()
+        XCTAssertEqual(cache.pageCount, 0)
+
+        // Miss loads the page again
+        let bytes = try cache.load(page..<(page + 0x10))
+        XCTAssertEqual(Array(bytes.buffer), Array(repeating: UInt8(ascii: "A"), count: 0x10))
+        XCTAssertGreaterThan(cache.pageCount, 0)
+    }
+
+    func testMetricsCountReadsAndCacheHits() throws {
+        try XCTSkipUnless(Metrics.isEnabled, "Built without MEMTOOL_METRICS")
+
+        let program = try AdhocProgram(
+            name: String(describing: Self.self) + #function,
+            code: pageFollowedByHole
+        )
+
+        let output = program.readStdout(until: ";")
+
+        let pointers = output.components(separatedBy: " ").dropLast().compactMap { UInt($0, radix: 16)}
+        XCTAssertEqual(pointers.count, 1)
+        let page = pointers[0]
+
+        let session = MemtoolCore.ProcessSession(pid: program.runningProgram.processIdentifier)
+        session.cache.readAheadPages = 1
+        Metrics.reset()
+
+        _ = try session.cache.load(of: UInt64.self, base: page)
+        _ = try session.cache.load(of: UInt64.self, base: page + 0x8)
+        session.loadMap()
+
+        let metrics = Metrics.current
+        XCTAssertEqual(metrics.remoteReads, 1)
+        XCTAssertEqual(metrics.remoteBytes, UInt64(RemoteMemoryCache.pageSize))
+        XCTAssertGreaterThanOrEqual(metrics.syscalls, 1)
+        XCTAssertEqual(metrics.cacheMisses, 1)
+        XCTAssertEqual(metrics.cacheHits, 1)
+        XCTAssertNotNil(metrics.phases["loadMap"])
+    }
+
+    func testVectoredChunkExport() throws {
+        let program = try AdhocProgram(
+            name: String(describing: Self.self) + #function,
+            code: pageFollowedByHole
+        )
+
+        let output = program.readStdout(until: ";")
+        let page = try XCTUnwrap(output.components(separatedBy: " ").first.flatMap { UInt($0, radix: 16) })
+        let session = MemtoolCore.ProcessSession(pid: program.runningProgram.processIdentifier)
+
+        let owner = ChunkTable.Owner(threadHeapBase: nil)
+        var chunks = ChunkTable()
+        chunks.append(base: page + 0xff0, size: 0x20, state: .heapActive, owner: owner)
+        chunks.append(base: page, size: 0x20, state: .heapActive, owner: owner)
+        chunks.append(base: page + 0x20, size: 0x20, state: .heapBin, owner: owner)
+        chunks.append(base: page + 0x40, size: 0x40, state: .heapActive, owner: owner)
+
+        // Segments read partially are completed by the fallbacks, unread bytes are zeroed
+        let segments = [page..<(page + 0x10), (page + 0xff8)..<(page + 0x1008)]
+        let buffer = UnsafeMutableRawBufferPointer.allocate(byteCount: 0x20, alignment: 8)
+        defer { buffer.deallocate() }
+        XCTAssertEqual(session.memory.read(segments: segments, into: buffer), [0x10, 0x8])
+
+        // Free chunks are skipped by default
+        var active: [MemoryRange] = []
+        let defaults = try ChunkExport.export(chunks: chunks, from: session) { record in
+            active.append(record.range)
+        }
+        XCTAssertEqual(active.map(\.lowerBound), [page, page + 0x40, page + 0xff0])
+        XCTAssertEqual(defaults.chunks, 3)
+
+        // Adjacent chunks, including the free one, are read together in a single batch
+        var ranges: [MemoryRange] = []
+        let all = try ChunkExport.export(chunks: chunks, from: session, options: ChunkExport.Options(includeFree: true)) { record in
+            ranges.append(record.range)
+            XCTAssertTrue(record.bytes[..<record.bytesRead].allSatisfy { $0 == UInt8(ascii: "A") })
+            XCTAssertTrue(record.bytes[record.bytesRead...].allSatisfy { $0 == 0 })
+        }
+        XCTAssertEqual(ranges.map(\.lowerBound), [page, page + 0x20, page + 0x40, page + 0xff0])
+        XCTAssertEqual(all.batches, 1)
+        XCTAssertEqual(all.bytesRead, 0x90)
+        XCTAssertEqual(all.bytesMissing, 0x10)
+
+        // Budget splits the batches and large chunks into parts
+        var parts: [(offset: UInt, count: Int)] = []
+        let split = try ChunkExport.export(chunks: chunks, from: session, options: ChunkExport.Options(memoryBudget: 0x30)) { record in
+            parts.append((record.offset, record.range.count))
+        }
+        XCTAssertEqual(parts.map(\.offset), [0, 0, 0x30, 0])
+        XCTAssertEqual(parts.map(\.count), [0x20, 0x30, 0x10, 0x20])
+        XCTAssertEqual(split.chunks, 3)
+        XCTAssertEqual(split.records, 4)
+        XCTAssertEqual(split.batches, 3)
+    }
+}
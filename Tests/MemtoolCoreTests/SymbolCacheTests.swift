@@ -0,0 +1,55 @@
+import XCTest
+@testable import MemtoolCore
+
+final class SymbolCacheTests: XCTestCase {
+    func testRoundTrip() throws {
+        let directory = FileManager.default.temporaryDirectory.appendingPathComponent("memtool-symbol-cache-\(getpid())")
+        defer { try? FileManager.default.removeItem(at: directory) }
+
+        let program = try AdhocProgram(
+            name: String(describing: Self.self) + #function,
+            code: "int answer = 42; int main(void) { return answer; }"
+        )
+
+        let elf = try ElfFile(path: program.programPath.path)
+        let cache = SymbolCache(directory: directory)
+        let key = try XCTUnwrap(SymbolCache.key(for: elf))
+        let fileKey = try XCTUnwrap(SymbolCache.fileKey(for: elf.path))
+
+        // Cold load decodes and stores the entry
+        let decoded = cache.symbols(for: elf.path)
+        XCTAssertTrue(decoded.contains { $0.name == "answer" })
+        XCTAssertTrue(FileManager.default.fileExists(atPath: directory.appendingPathComponent(key).path))
+
+        // Entry is read for a different path of the same file
+        let entry = try cache.read(key: key, reportedAs: "/copy")
+        XCTAssertEqual(entry.symbols.count, decoded.count)
+        XCTAssertTrue(entry.symbols.allSatisfy { $0.file == "/copy" })
+        XCTAssertEqual(
+            Set(entry.symbols.map { UnloadedSymbolInfo(file: elf.path, location: $0.location, flags: $0.flags, segment: $0.segment, size: $0.size, name: $0.name) }),
+            Set(decoded)
+        )
+
+        // Warm load finds the entry by the identity of the file and returns the same symbols
+        XCTAssertNoThrow(try cache.read(key: fileKey, reportedAs: elf.path))
+        XCTAssertEqual(Set(cache.symbols(for: elf.path)), Set(decoded))
+    }
+
+    func testMappedNamesMatchDecodedNames() throws {
+        let directory = FileManager.default.temporaryDirectory.appendingPathComponent("memtool-symbol-names-\(getpid())")
+        defer { try? FileManager.default.removeItem(at: directory) }
+
+        let cache = SymbolCache(directory: directory)
+        let symbols = ["alpha", "", "beta"].enumerated().map { index, name in
+            UnloadedSymbolInfo(file: "/lib/a.so", location: UInt(index), flags: SymbolFlags(rawValue: "g     O"), segment: .known(.data), size: 8, name: name)
+        }
+        try cache.write(symbols, hasDebugFile: false, key: "test")
+
+        let entry = try cache.read(key: "test", reportedAs: "/lib/a.so")
+        XCTAssertFalse(entry.hasDebugFile)
+        XCTAssertEqual(entry.symbols, symbols)
+        XCTAssertEqual(Set(entry.symbols.map(\.symbolName)), Set(symbols.map(\.symbolName)))
+        XCTAssertEqual(entry.symbols.map(\.name), ["alpha", "", "beta"])
+        XCTAssertNotEqual(entry.symbols[0].symbolName, SymbolName("alph"))
+    }
+}
@@ -0,0 +1,52 @@
+import XCTest
+@testable import MemtoolCore
+
+final class SymbolIndexTests: XCTestCase {
+    private func symbol(_ name: String, _ range: MemoryRange) -> SymbolRegion {
+        SymbolRegion(
+            range: range,
+            properties: LoadedSymbolInfo(flags: SymbolFlags(rawValue: "g     O"), segment: .known(.data), name: name)
+        )
+    }
+
+    func testQueries() {
+        let index = SymbolIndex(
+            symbols: [
+                symbol("outer", 0x1000..<0x1100),
+                symbol("inner", 0x1010..<0x1020),
+                symbol("after", 0x1200..<0x1210),
+                symbol("empty", 0x1300..<0x1300),
+                symbol("inner", 0x2000..<0x2010),
+            ],
+            unloadedSymbols: [
+                "/lib/a.so": [UnloadedSymbolInfo(file: "/lib/a.so", location: 0x10, flags: SymbolFlags(rawValue: "l     O"), segment: .known(.tbss), size: 8, name: "tls_value")]
+            ]
+        )
+
+        // Overlapping symbols are found, symbol ending before the address is not
+        XCTAssertEqual(index.symbols(containing: 0x1018).map(\.properties.name), ["outer", "inner"])
+        XCTAssertEqual(index.symbols(containing: 0x1050).map(\.properties.name), ["outer"])
+        XCTAssertTrue(index.symbols(containing: 0x1150).isEmpty)
+        XCTAssertTrue(index.symbols(containing: 0x1300).isEmpty)
+        XCTAssertTrue(index.symbols(containing: 0x0fff).isEmpty)
+
+        XCTAssertEqual(index.symbols(named: "inner").map(\.range.lowerBound), [0x1010, 0x2000])
+        XCTAssertEqual(Array(index.names(withPrefix: "in")), ["inner"])
+        XCTAssertEqual(index.names(containing: "t"), ["after", "empty", "outer", "tls_value"])
+        XCTAssertEqual(index.unloadedSymbols(named: "tls_value").first?.file, "/lib/a.so")
+        XCTAssertTrue(index.unloadedSymbols(withPrefix: "tls").count == 1)
+    }
+
+    func testLargeSymbolPrecedingSmallOnes() {
+        // Every small symbol is inside the large one, addresses between them are only in the large one
+        let small = (0..<1000).map { symbol("small\($0)", UInt(0x10000 + $0 * 0x20)..<UInt(0x10000 + $0 * 0x20 + 0x10)) }
+        let index = SymbolIndex(symbols: [symbol("large", 0x10000..<0x20000)] + small, unloadedSymbols: [:])
+
+        XCTAssertEqual(index.symbols(containing: 0x10000).map(\.properties.name), ["large", "small0"])
+        XCTAssertEqual(index.symbols(containing: 0x10018).map(\.properties.name), ["large"])
+        XCTAssertEqual(index.symbols(containing: UInt(0x10000 + 999 * 0x20 + 0xf)).map(\.properties.name), ["large", "small999"])
+        XCTAssertEqual(index.symbols(containing: 0x1ffff).map(\.properties.name), ["large"])
+        XCTAssertTrue(index.symbols(containing: 0x20000).isEmpty)
+        XCTAssertEqual(index.symbols(withPrefix: "small99").count, 11)
+    }
+}
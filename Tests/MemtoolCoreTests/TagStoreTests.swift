@@ -0,0 +1,52 @@
+import XCTest
+@testable import MemtoolCore
+
+final class TagStoreTests: XCTestCase {
+    func testRecordsAndReportsMismatch() {
+        let store = TagStore()
+        XCTAssertNil(store.record(UInt64.self, at: 0x1000))
+        XCTAssertNil(store.record(UInt64.self, at: 0x1000))
+        XCTAssertNil(store.record(Int32.self, at: 0x1008))
+        XCTAssertTrue(store.record(Int32.self, at: 0x1000) == UInt64.self)
+        XCTAssertTrue(store[0x1000]?.type == UInt64.self)
+        XCTAssertNil(store[0x2000])
+        XCTAssertEqual(store.count, 2)
+    }
+
+    func testMergeTranslatesTypeIds() throws {
+        let store = TagStore()
+        store.record(Int32.self, at: 0x1000)
+
+        // The worker assigns different ids to the same types
+        let worker = TagStore()
+        worker.record(UInt64.self, at: 0x2000)
+        worker.record(Int32.self, at: 0x1000)
+        try store.merge(worker)
+        XCTAssertTrue(store[0x2000]?.type == UInt64.self)
+        XCTAssertEqual(store.count, 2)
+
+        let mismatching = TagStore()
+        mismatching.record(UInt8.self, at: 0x2000)
+        XCTAssertThrowsError(try store.merge(mismatching))
+    }
+
+    func testPolicies() {
+        let store = TagStore(policy: .off)
+        XCTAssertNil(store.record(UInt64.self, at: 0x1000))
+        XCTAssertNil(store.record(Int32.self, at: 0x1000))
+        XCTAssertEqual(store.count, 0)
+
+        store.policy = .sampled(rate: 4)
+        let addresses = Array(stride(from: UInt(0x10000), to: 0x20000, by: 16))
+        for address in addresses {
+            store.record(UInt64.self, at: address)
+        }
+        let tracked = addresses.filter(store.isTracked)
+        XCTAssertEqual(store.count, tracked.count)
+        XCTAssertGreaterThan(tracked.count, addresses.count / 8)
+        XCTAssertLessThan(tracked.count, addresses.count / 2)
+
+        store.policy = .full
+        XCTAssertEqual(store.count, 0)
+    }
+}
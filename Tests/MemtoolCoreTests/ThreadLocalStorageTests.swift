@@ -13,6 +13,10 @@ int main(void) {
 """#
 
 final class ThreadLocalStorageTests: XCTestCase {
+    override func setUp() {
+        Symbolication.cache = .temporary
+    }
+
     func testTbssLoaderOnErrno() throws {
         let program = try AdhocProgram(
             name: String(describing: Self.self) + #function, 
@@ -85,4 +89,27 @@ final class ThreadLocalStorageTests: XCTestCase {
 
         XCTAssertEqual(errnoDisassembly.errnoLocation, ldPrivate.loadedSymbolBase)
     }
+
+    func testResolverMatchesTbssHeuristic() throws {
+        let program = try AdhocProgram(
+            name: String(describing: Self.self) + #function, 
+            code: errnoSet
+        )
+
+        sleep(1)
+
+        let session = MemtoolCore.ProcessSession(pid: program.runningProgram.processIdentifier)
+        session.loadMap()
+        session.loadSymbols()
+
+        let libc = session.libcFile!
+
+        let resolver = TLSResolver(session: session)
+        let location = try resolver.locate(fileName: libc, symbolName: "errno", in: session)
+        let ldPrivate = try TbssSymbolGlibcLdHeuristic(session: session, fileName: libc, tbssSymbolName: "errno")
+
+        XCTAssertEqual(location.symbolBase, ldPrivate.loadedSymbolBase)
+        XCTAssertEqual(location.dtvBase, ldPrivate.dtvBase)
+        XCTAssertEqual(try resolver.module(fileName: libc, symbolName: "errno").moduleId, ldPrivate.privateLinkItem.buffer.l_tls_modid)
+    }
 }
@@ -1,4 +1,5 @@
 import XCTest
+import Cutils
 @testable import MemtoolCore
 
 private let commons = 
@@ -80,6 +81,10 @@ private let mallocManyFrees = commons +
 
 // TODO: Create tests for freed thread arenas
 final class ThreadedHeapsTests: XCTestCase {
+    override func setUp() {
+        Symbolication.cache = .temporary
+    }
+
     func testMallocFastbinFrees() throws {
         let program = try AdhocProgram(
             name: String(describing: Self.self) + #function, 
@@ -155,4 +160,143 @@ final class ThreadedHeapsTests: XCTestCase {
             XCTAssertEqual(view[12].properties.rebound, .mallocChunk(.heapActive))
         }
     }
+
+    func testParallelAnalysisMatchesSerial() throws {
+        let program = try AdhocProgram(
+            name: String(describing: Self.self) + #function, 
+            code: mallocManySmallFrees
+        )
+
+        sleep(3)
+
+        let session = MemtoolCore.ProcessSession(pid: program.runningProgram.processIdentifier)
+        session.loadMap()
+        session.loadSymbols()
+        session.loadThreads()
+
+        let serial = try GlibcMallocAnalyzer(session: session)
+        try serial.analyze()
+
+        let parallel = try GlibcMallocAnalyzer(session: session, workerCount: 4)
+        try parallel.analyze()
+
+        XCTAssertEqual(parallel.exploredHeap.map(\.range), serial.exploredHeap.map(\.range))
+        XCTAssertEqual(parallel.exploredHeap.map(\.properties), serial.exploredHeap.map(\.properties))
+        XCTAssertEqual(parallel.tcacheFreedChunks, serial.tcacheFreedChunks)
+        XCTAssertEqual(parallel.fastbinFreedChunks, serial.fastbinFreedChunks)
+        XCTAssertEqual(parallel.binFreedChunks, serial.binFreedChunks)
+    }
+
+    func testStatisticsWithoutStoredChunks() throws {
+        let program = try AdhocProgram(
+            name: String(describing: Self.self) + #function, 
+            code: mallocManySmallFrees
+        )
+
+        sleep(3)
+
+        let session = MemtoolCore.ProcessSession(pid: program.runningProgram.processIdentifier)
+        session.loadMap()
+        session.loadSymbols()
+        session.loadThreads()
+
+        let streamed = try GlibcMallocAnalyzer(session: session, workerCount: 2).statistics()
+
+        let analyzer = try GlibcMallocAnalyzer(session: session)
+        try analyzer.analyze()
+        let stored = try analyzer.statistics()
+
+        XCTAssertEqual(streamed.arenas.map(\.threadHeapBase), stored.arenas.map(\.threadHeapBase))
+        XCTAssertEqual(streamed.arenas.map(\.active), stored.arenas.map(\.active))
+        XCTAssertEqual(streamed.arenas.map(\.free), stored.arenas.map(\.free))
+        XCTAssertEqual(streamed.arenas.map(\.largestFreeExtent), stored.arenas.map(\.largestFreeExtent))
+
+        // Top chunks are not counted as chunks
+        let topSizes = stored.arenas.map(\.topChunkSize).reduce(0, +)
+        XCTAssertGreaterThan(topSizes, 0)
+        let tops = Set(stored.arenas.compactMap(\.topChunkBase))
+        XCTAssertEqual(stored.active.count + stored.free.count, analyzer.chunks.filter { !tops.contains($0.base) }.count)
+
+        for thread in session.threadSessions {
+            let statistics = try XCTUnwrap(streamed.threads.first { $0.ptraceId == thread.tid })
+            XCTAssertEqual(statistics.tcache.count, 7)
+            XCTAssertEqual(statistics.tcacheOccupancy.values.reduce(0, +), 7)
+
+            let arena = try XCTUnwrap(streamed.arenas.first { $0.threadHeapBase != nil && $0.threadHeapBase == statistics.threadHeapBase })
+            XCTAssertEqual(arena.fastbinOccupancy.values.reduce(0, +), 2)
+            XCTAssertEqual(arena.states[.heapFastBin]?.count, 2)
+        }
+    }
+
+    func testSnapshotAnalysisMatchesLive() throws {
+        let program = try AdhocProgram(
+            name: String(describing: Self.self) + #function, 
+            code: mallocManySmallFrees
+        )
+
+        sleep(3)
+
+        let image = ProcessImage.capture(pid: program.runningProgram.processIdentifier)
+        XCTAssertGreaterThan(image.byteCount, 0)
+        XCTAssertGreaterThan(image.pauseDuration, .zero)
+        XCTAssertTrue(image.threads.allSatisfy { $0.registers != nil })
+        // The threads are detached right after the copy
+        let status = try String(contentsOfFile: "/proc/\(program.runningProgram.processIdentifier)/status")
+        XCTAssertTrue(status.contains("TracerPid:\t0\n"))
+
+        let offline = OfflineSession(image: image)
+        offline.loadSymbols()
+        XCTAssertEqual(offline.threads.map(\.ptraceId), image.threads.dropFirst().map(\.tid))
+
+        let snapshot = try GlibcMallocAnalyzer(session: offline, workerCount: 4)
+        try snapshot.analyze()
+
+        let session = MemtoolCore.ProcessSession(pid: program.runningProgram.processIdentifier)
+        session.loadMap()
+        session.loadSymbols()
+        session.loadThreads()
+
+        let live = try GlibcMallocAnalyzer(session: session)
+        try live.analyze()
+
+        XCTAssertEqual(snapshot.structures.map(\.range), live.structures.map(\.range))
+        XCTAssertEqual(Array(snapshot.chunks), Array(live.chunks))
+        XCTAssertEqual(snapshot.tcacheFreedChunks, live.tcacheFreedChunks)
+    }
+
+    func testSnapshotFileRoundTrip() throws {
+        let program = try AdhocProgram(
+            name: String(describing: Self.self) + #function, 
+            code: mallocManySmallFrees
+        )
+
+        sleep(3)
+
+        let image = ProcessImage.capture(pid: program.runningProgram.processIdentifier)
+        let captured = OfflineSession(image: image)
+        captured.loadSymbols()
+        let analyzer = try GlibcMallocAnalyzer(session: captured)
+        try analyzer.analyze()
+
+        let url = FileManager.default.temporaryDirectory.appendingPathComponent(String(describing: Self.self) + #function)
+        defer { try? FileManager.default.removeItem(at: url) }
+        try HeapSnapshotFile.write(session: captured, chunks: analyzer.chunks, to: url)
+
+        let snapshot = try HeapSnapshotFile(contentsOf: url)
+        XCTAssertEqual(snapshot.pid, image.pid)
+        XCTAssertEqual(snapshot.map.map(\.range), image.map.map(\.range))
+        XCTAssertEqual(snapshot.threads.map(\.tid), image.threads.map(\.tid))
+        XCTAssertEqual(snapshot.threads.map { $0.registers?.rsp }, image.threads.map { $0.registers?.rsp })
+        XCTAssertEqual(Array(try XCTUnwrap(snapshot.chunks())), Array(analyzer.chunks))
+
+        let session = OfflineSession(snapshot: snapshot)
+        let reopened = try GlibcMallocAnalyzer(session: session)
+        try reopened.analyze()
+
+        XCTAssertEqual(reopened.structures.map(\.range), analyzer.structures.map(\.range))
+        XCTAssertEqual(Array(reopened.chunks), Array(analyzer.chunks))
+
+        let first = try XCTUnwrap(analyzer.chunks.first)
+        XCTAssertEqual(try session.memory.load(first.range).buffer, try captured.memory.load(first.range).buffer)
+    }
 }